@@ -5,6 +5,7 @@ import asyncio
 from datetime import datetime
 from .config import settings
 from .models import SensorData
+from .sensor_batch import decode_message
 
 class KafkaClient:
     def __init__(self):
@@ -23,7 +24,8 @@ class KafkaClient:
             settings.KAFKA_SENSOR_TOPIC,
             bootstrap_servers=settings.KAFKA_BOOTSTRAP_SERVERS,
             group_id=settings.KAFKA_CONSUMER_GROUP,
-            value_deserializer=lambda m: json.loads(m.decode('utf-8'))
+            # sensor-service может слать как JSON, так и бинарные пакеты WPSB
+            value_deserializer=decode_message
         )
         await self.consumer.start()
         self.running = True
@@ -65,6 +67,9 @@ class KafkaClient:
             async for message in self.consumer:
                 if not self.running:
                     break
-                await callback(message.value)
+                # Бинарный пакет раскрывается в отдельные записи
+                records = message.value if isinstance(message.value, list) else [message.value]
+                for record in records:
+                    await callback(record)
         except Exception as e:
             print(f"Error consuming messages: {e}") 
\ No newline at end of file
@@ -0,0 +1,129 @@
+"""Декодер бинарных пакетов измерений sensor-service (формат WPSB v1).
+
+Формат описан в sensor-service/include/SensorBatchCodec.hpp.
+"""
+import json
+import struct
+from typing import Any, Dict, List, Union
+
+MAGIC = b"WPSB"
+VERSION = 1
+
+
+class SensorBatchError(ValueError):
+    pass
+
+
+class _Reader:
+    def __init__(self, data: bytes, pos: int):
+        self.data = data
+        self.pos = pos
+        self.bit = 0
+
+    def byte(self) -> int:
+        self.align()
+        if self.pos >= len(self.data):
+            raise SensorBatchError("Sensor batch is truncated")
+        value = self.data[self.pos]
+        self.pos += 1
+        return value
+
+    def varint(self) -> int:
+        value = 0
+        for shift in range(0, 64, 7):
+            b = self.byte()
+            value |= (b & 0x7F) << shift
+            if not b & 0x80:
+                return value
+        raise SensorBatchError("Sensor batch contains a malformed varint")
+
+    def zigzag(self) -> int:
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+    def bits(self, count: int) -> int:
+        end_bit = self.bit + count
+        end_byte = self.pos + (end_bit + 7) // 8
+        if end_byte > len(self.data):
+            raise SensorBatchError("Sensor batch is truncated")
+        chunk = int.from_bytes(self.data[self.pos:end_byte], "big")
+        total_bits = (end_byte - self.pos) * 8
+        value = (chunk >> (total_bits - end_bit)) & ((1 << count) - 1)
+        self.pos += end_bit // 8
+        self.bit = end_bit % 8
+        return value
+
+    def align(self):
+        if self.bit:
+            self.bit = 0
+            self.pos += 1
+
+
+def _bits_to_float(bits: int) -> float:
+    return struct.unpack(">d", bits.to_bytes(8, "big"))[0]
+
+
+def is_sensor_batch(data: bytes) -> bool:
+    return len(data) > len(MAGIC) and data[:len(MAGIC)] == MAGIC
+
+
+def decode_batch(data: bytes) -> List[Dict[str, Any]]:
+    """Возвращает записи в той же форме, что и JSON-сообщения:
+    {"sensor_id": int, "timestamp": int (мс), "value": float}.
+    Записи сгруппированы по датчику, порядок внутри датчика сохранен."""
+    if not is_sensor_batch(data):
+        raise SensorBatchError("Not a sensor batch")
+
+    reader = _Reader(data, len(MAGIC))
+    version = reader.byte()
+    if version != VERSION:
+        raise SensorBatchError(f"Unsupported sensor batch version: {version}")
+    reader.byte()  # flags
+
+    record_count = reader.varint()
+    series_count = reader.varint()
+    base_timestamp = reader.zigzag()
+
+    records: List[Dict[str, Any]] = []
+    for _ in range(series_count):
+        sensor_id = reader.zigzag()
+        count = reader.varint()
+        if count == 0 or len(records) + count > record_count:
+            raise SensorBatchError("Sensor batch series is corrupted")
+
+        timestamps = []
+        timestamp = base_timestamp
+        for _ in range(count):
+            timestamp += reader.zigzag()
+            timestamps.append(timestamp)
+
+        prev = reader.bits(64)
+        values = [_bits_to_float(prev)]
+        leading = trailing = 0
+        for _ in range(count - 1):
+            if reader.bits(1):
+                if reader.bits(1):
+                    leading = reader.bits(5)
+                    meaningful = reader.bits(6) + 1
+                    trailing = 64 - leading - meaningful
+                    if trailing < 0:
+                        raise SensorBatchError("Sensor batch value stream is corrupted")
+                prev ^= reader.bits(64 - leading - trailing) << trailing
+            values.append(_bits_to_float(prev))
+        reader.align()
+
+        records.extend(
+            {"sensor_id": sensor_id, "timestamp": ts, "value": value}
+            for ts, value in zip(timestamps, values)
+        )
+
+    if len(records) != record_count:
+        raise SensorBatchError("Sensor batch record count mismatch")
+    return records
+
+
+def decode_message(data: bytes) -> Union[Dict[str, Any], List[Dict[str, Any]]]:
+    """Бинарный пакет -> список записей, иначе - обычное JSON-сообщение."""
+    if is_sensor_batch(data):
+        return decode_batch(data)
+    return json.loads(data.decode('utf-8'))
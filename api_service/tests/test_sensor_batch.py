@@ -0,0 +1,181 @@
+import json
+import math
+import struct
+
+import pytest
+
+from app.sensor_batch import (
+    MAGIC,
+    SensorBatchError,
+    decode_batch,
+    decode_message,
+    is_sensor_batch,
+)
+
+# Пакет из SensorBatchCodec::encode (sensor-service) для измерений:
+# (2, +0 мс, 21.5), (1, +100, 20.0), (2, +1000, 21.75), (1, +1100, 20.0),
+# (2, +2000, -3.25), (-7, +50, 0.1); base_timestamp = 1700000000000
+CPP_BATCH = bytes.fromhex(
+    "575053420100060380a0abfef9620d01643fb999999999999a0202c801d00f40"
+    "3400000000000000040300d00fd00f4035800000000000e207023007f8"
+)
+BASE_TS = 1700000000000
+
+
+def _varint(value):
+    out = bytearray()
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+    return bytes(out)
+
+
+def _zigzag(value):
+    return _varint((value << 1) ^ (value >> 63))
+
+
+def _float_bits(value):
+    return struct.unpack(">Q", struct.pack(">d", value))[0]
+
+
+class _BitWriter:
+    def __init__(self):
+        self.bits = []
+
+    def write(self, value, count):
+        self.bits.extend((value >> (count - 1 - i)) & 1 for i in range(count))
+
+    def to_bytes(self):
+        padded = self.bits + [0] * (-len(self.bits) % 8)
+        return bytes(
+            int("".join(map(str, padded[i:i + 8])), 2) for i in range(0, len(padded), 8)
+        )
+
+
+def encode(records):
+    """Повторяет SensorBatchCodec::encode: records - (sensor_id, timestamp, value)."""
+    base = records[0][1] if records else 0
+    series = {}
+    for sensor_id, ts, value in records:
+        series.setdefault(sensor_id, []).append((ts, value))
+
+    out = bytearray(MAGIC + bytes([1, 0]))
+    out += _varint(len(records)) + _varint(len(series)) + _zigzag(base)
+    for sensor_id in sorted(series):
+        points = series[sensor_id]
+        out += _zigzag(sensor_id) + _varint(len(points))
+        prev_ts = base
+        for ts, _ in points:
+            out += _zigzag(ts - prev_ts)
+            prev_ts = ts
+
+        writer = _BitWriter()
+        prev = _float_bits(points[0][1])
+        writer.write(prev, 64)
+        prev_leading, prev_trailing = -1, 0
+        for _, value in points[1:]:
+            current = _float_bits(value)
+            x, prev = current ^ prev, current
+            if x == 0:
+                writer.write(0, 1)
+                continue
+            writer.write(1, 1)
+            leading = min(64 - x.bit_length(), 31)
+            trailing = (x & -x).bit_length() - 1
+            if prev_leading >= 0 and leading >= prev_leading and trailing >= prev_trailing:
+                writer.write(0, 1)
+                writer.write(x >> prev_trailing, 64 - prev_leading - prev_trailing)
+            else:
+                meaningful = 64 - leading - trailing
+                writer.write(1, 1)
+                writer.write(leading, 5)
+                writer.write(meaningful - 1, 6)
+                writer.write(x >> trailing, meaningful)
+                prev_leading, prev_trailing = leading, trailing
+        out += writer.to_bytes()
+    return bytes(out)
+
+
+def test_decodes_packet_from_cpp_encoder():
+    assert decode_batch(CPP_BATCH) == [
+        {"sensor_id": -7, "timestamp": BASE_TS + 50, "value": 0.1},
+        {"sensor_id": 1, "timestamp": BASE_TS + 100, "value": 20.0},
+        {"sensor_id": 1, "timestamp": BASE_TS + 1100, "value": 20.0},
+        {"sensor_id": 2, "timestamp": BASE_TS, "value": 21.5},
+        {"sensor_id": 2, "timestamp": BASE_TS + 1000, "value": 21.75},
+        {"sensor_id": 2, "timestamp": BASE_TS + 2000, "value": -3.25},
+    ]
+
+
+def test_reference_encoder_matches_cpp_encoder():
+    records = [
+        (2, BASE_TS, 21.5), (1, BASE_TS + 100, 20.0), (2, BASE_TS + 1000, 21.75),
+        (1, BASE_TS + 1100, 20.0), (2, BASE_TS + 2000, -3.25), (-7, BASE_TS + 50, 0.1),
+    ]
+    assert encode(records) == CPP_BATCH
+
+
+@pytest.mark.parametrize("values", [
+    [1.0] * 10,
+    [float(i) for i in range(100)],
+    [20.0 + 0.01 * i for i in range(50)],
+    [0.0, -0.0, 1e-300, -1e300, float("inf"), float("-inf"), 42.0],
+    [math.pi * (-1) ** i * i for i in range(33)],
+])
+def test_round_trip_preserves_values_bit_exact(values):
+    records = [(5, BASE_TS + 10 * i, v) for i, v in enumerate(values)]
+    decoded = decode_batch(encode(records))
+    assert [r["timestamp"] for r in decoded] == [ts for _, ts, _ in records]
+    assert [_float_bits(r["value"]) for r in decoded] == [_float_bits(v) for v in values]
+
+
+def test_round_trip_nan():
+    decoded = decode_batch(encode([(1, BASE_TS, 1.0), (1, BASE_TS + 1, float("nan"))]))
+    assert math.isnan(decoded[1]["value"])
+
+
+def test_timestamps_may_go_backwards():
+    records = [(1, BASE_TS, 1.0), (1, BASE_TS - 5000, 2.0), (1, BASE_TS + 1, 3.0)]
+    assert [r["timestamp"] for r in decode_batch(encode(records))] == [
+        BASE_TS, BASE_TS - 5000, BASE_TS + 1,
+    ]
+
+
+def test_empty_batch():
+    assert decode_batch(encode([])) == []
+
+
+def test_is_sensor_batch():
+    assert is_sensor_batch(CPP_BATCH)
+    assert not is_sensor_batch(MAGIC)
+    assert not is_sensor_batch(b'{"sensor_id": 1}')
+
+
+def test_decode_message_falls_back_to_json():
+    message = {"sensor_id": 1, "timestamp": BASE_TS, "value": 23.5}
+    assert decode_message(json.dumps(message).encode("utf-8")) == message
+    assert len(decode_message(CPP_BATCH)) == 6
+
+
+def test_rejects_unknown_version():
+    with pytest.raises(SensorBatchError, match="version"):
+        decode_batch(MAGIC + bytes([2, 0]) + CPP_BATCH[6:])
+
+
+@pytest.mark.parametrize("cut", [5, 7, 12, 20, len(CPP_BATCH) - 1])
+def test_rejects_truncated_packet(cut):
+    with pytest.raises(SensorBatchError):
+        decode_batch(CPP_BATCH[:cut])
+
+
+def test_rejects_record_count_mismatch():
+    corrupted = bytearray(CPP_BATCH)
+    corrupted[6] = 7  # record_count
+    with pytest.raises(SensorBatchError):
+        decode_batch(bytes(corrupted))
+
+
+def test_rejects_non_batch():
+    with pytest.raises(SensorBatchError):
+        decode_batch(b"not a batch")
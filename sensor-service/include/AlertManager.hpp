@@ -3,8 +3,13 @@
 #include <string>
 #include <vector>
 #include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <curl/curl.h>
-#include <nlohmann/json.hpp>
 
 enum class AlertSeverity {
     INFO,
@@ -17,22 +22,112 @@ struct Alert {
     std::string description;
     AlertSeverity severity;
     std::chrono::system_clock::time_point timestamp;
+    int sensor_id = -1;  // -1 - алерт не относится к датчику
 };
 
+// Отправка алертов на вебхук. sendAlert() только ставит алерт в очередь;
+// отдельный поток собирает всплески в одну пачку
+//     {"alerts": [{"name", "text", "severity", "timestamp", "sensor_id"}, ...]}
+// и отправляет пачки через curl multi: несколько запросов одновременно,
+// каждый с таймаутом, так что медленный или лежащий вебхук задерживает
+// только сами алерты.
+//
+// Повторы подавляются по паре (имя алерта, sensor_id): алерт одного
+// датчика не глушит алерты других датчиков и другие алерты. Если алерт
+// так и не доставлен, cooldown по нему снимается и следующий такой же
+// алерт уходит сразу.
 class AlertManager {
 public:
+    struct Config {
+        // Сколько молчать после алерта с тем же именем и sensor_id
+        std::chrono::milliseconds cooldown{std::chrono::minutes(5)};
+        // Сколько копить пачку после первого алерта в очереди
+        std::chrono::milliseconds batch_window{500};
+        size_t max_batch = 50;
+        // Сверх этого новые алерты отбрасываются
+        size_t max_queued = 1000;
+        // Одновременных запросов к вебхуку
+        size_t max_in_flight = 2;
+        std::chrono::milliseconds connect_timeout{2000};
+        std::chrono::milliseconds request_timeout{5000};
+        // Попыток на пачку, включая первую, и пауза между ними
+        unsigned max_attempts = 3;
+        std::chrono::milliseconds retry_backoff{2000};
+    };
+
+    // Счетчики с запуска, в алертах
+    struct Stats {
+        uint64_t sent;
+        uint64_t failed;      // все попытки пачки не удались
+        uint64_t dropped;     // очередь переполнена
+        uint64_t suppressed;  // повтор в пределах cooldown
+        size_t queued;
+        size_t in_flight;     // в отправляемых и ждущих повтора пачках
+    };
+
     explicit AlertManager(const std::string& webhook_url);
+    // Бросает std::invalid_argument при неверной конфигурации и
+    // std::runtime_error, если не инициализируется curl
+    AlertManager(const std::string& webhook_url, Config config);
+    // Дожидается отправки очереди, но не дольше таймаута запроса на попытку
     ~AlertManager();
 
+    // Не блокирует на сети, звать можно из любых потоков
     void sendAlert(const Alert& alert);
-    void checkThresholds(double buffer_size, double kafka_lag, const std::vector<std::pair<int, double>>& sensor_values);
+
+    Stats getStats() const;
 
 private:
+    struct Pending {
+        Alert alert;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    // Одна пачка алертов - один POST
+    struct Request {
+        std::vector<Alert> alerts;
+        // Когда поставлен каждый алерт; это же время записано в last_sent_
+        std::vector<std::chrono::steady_clock::time_point> queued;
+        std::string body;
+        unsigned attempt{0};
+        std::chrono::steady_clock::time_point retry_at;
+        CURL* easy{nullptr};
+    };
+
     static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp);
-    void sendWebhook(const nlohmann::json& payload);
+    void dispatchLoop();
+    // Забирает из очереди готовые пачки; под mutex_
+    void takeBatches(std::chrono::steady_clock::time_point now, bool flush,
+                     std::vector<std::unique_ptr<Request>>& ready);
+    void startRequest(std::unique_ptr<Request> request);
+    // retry = false при остановке: неудачные пачки больше не повторяются
+    void completeRequests(std::chrono::steady_clock::time_point now, bool retry);
+    void finishRequest(std::unique_ptr<Request> request, bool delivered);
+    // Сколько можно ждать событий curl, не пропустив срок пачки или повтора
+    std::chrono::milliseconds pollTimeout(std::chrono::steady_clock::time_point now) const;
+    void pruneCooldowns(std::chrono::steady_clock::time_point now);
 
-    std::string webhook_url_;
-    CURL* curl_;
-    std::chrono::system_clock::time_point last_alert_time_;
-    static constexpr auto ALERT_COOLDOWN = std::chrono::minutes(5);
-}; 
\ No newline at end of file
+    static std::string buildPayload(const std::vector<Alert>& alerts);
+    static std::string cooldownKey(const Alert& alert);
+
+    const std::string webhook_url_;
+    const Config config_;
+    CURLM* multi_;
+    curl_slist* headers_{nullptr};
+
+    mutable std::mutex mutex_;
+    std::deque<Pending> queue_;
+    // Когда последний раз пропущен алерт с этим ключом. Ставится при
+    // постановке в очередь, чтобы не слать повтор, пока алерт в пути;
+    // снимается, если алерт не доставлен
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> last_sent_;
+    Stats stats_{};
+    bool stopping_{false};
+
+    // Дальше - только поток отправки
+    std::unordered_map<CURL*, std::unique_ptr<Request>> active_;
+    std::vector<std::unique_ptr<Request>> retries_;
+    std::chrono::steady_clock::time_point next_prune_{};
+
+    std::thread dispatcher_;
+};
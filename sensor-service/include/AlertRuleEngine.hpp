@@ -0,0 +1,131 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "AlertManager.hpp"
+#include "SensorManager.hpp"
+
+// Правила алертов из того же alert_rules.yml, что читает Prometheus,
+// но проверяемые прямо на потоке измерений: алерт срабатывает на первом
+// измерении, на котором условие держится дольше for:, без ожидания
+// scrape и цикла мониторинга.
+//
+// Поддерживаются выражения вида
+//     metric > 100
+//     metric{sensor_id="3"} == 0
+//     metric{sensor_id!="3"} <= -50
+// (операторы > >= < <= == !=). Правила с другими выражениями
+// пропускаются с предупреждением - их по-прежнему считает Prometheus.
+//
+// Состояние for: ведется отдельно для каждого sensor_id. Правила
+// проиндексированы по имени метрики, так что измерение стоит O(1) на
+// каждое подходящее правило. reload() пересобирает набор правил, но
+// сохраняет накопленное состояние правил, чье выражение и for: не
+// изменились.
+//
+// observe*() можно звать из любых потоков одновременно.
+class AlertRuleEngine {
+public:
+    // Вызывается под мьютексом правила - не должен блокироваться
+    using AlertCallback = std::function<void(const Alert& alert)>;
+
+    explicit AlertRuleEngine(AlertCallback callback);
+
+    // Бросает std::runtime_error (в том числе YAML::Exception), если файл
+    // не читается или не разбирается; путь все равно запоминается для
+    // reloadIfChanged()
+    void load(const std::string& path);
+    // Перечитывает файл, если он изменился с прошлой загрузки. Ошибка
+    // разбора оставляет прежние правила. true - правила обновлены
+    bool reloadIfChanged();
+    size_t ruleCount() const;
+
+    // Значение метрики без меток
+    void observe(std::string_view metric, double value,
+                 std::chrono::system_clock::time_point timestamp);
+    // Значение метрики одного датчика
+    void observeSensor(std::string_view metric, int sensor_id, double value,
+                       std::chrono::system_clock::time_point timestamp);
+    // Пакет измерений: value(sample) - значение метрики для измерения
+    template<typename ValueFn>
+    void observeSensors(std::string_view metric, const SensorData* data, size_t count, ValueFn value);
+
+private:
+    enum class Op { GT, GE, LT, LE, EQ, NE };
+
+    // Серия хранится, только пока условие нарушено
+    struct SeriesState {
+        std::chrono::system_clock::time_point active_since;
+        bool firing{false};
+    };
+
+    struct Rule {
+        std::string name;
+        std::string expr;
+        std::string metric;
+        std::optional<int> sensor_id;  // матчер метки sensor_id
+        bool sensor_id_negated{false};
+        Op op{Op::GT};
+        double threshold{0.0};
+        std::chrono::milliseconds for_duration{0};
+        AlertSeverity severity{AlertSeverity::WARNING};
+        std::string summary;
+        std::string description;
+
+        std::mutex mutex;
+        std::unordered_map<int, SeriesState> series;
+    };
+
+    struct RuleSet {
+        std::vector<std::shared_ptr<Rule>> rules;
+        // Метрик в правилах единицы: линейный поиск по string_view
+        // обходится без временной std::string на каждое измерение
+        std::vector<std::pair<std::string, std::vector<Rule*>>> by_metric;
+    };
+
+    const std::vector<Rule*>* rulesFor(const RuleSet& set, std::string_view metric) const;
+    void evaluate(Rule& rule, int sensor_id, double value,
+                  std::chrono::system_clock::time_point timestamp);
+    void fire(const Rule& rule, int sensor_id, double value,
+              std::chrono::system_clock::time_point timestamp);
+    std::shared_ptr<const RuleSet> currentRules() const;
+
+    static std::shared_ptr<Rule> compile(std::string name, std::string expr);
+    static std::chrono::milliseconds parseDuration(const std::string& text);
+    static std::string render(const std::string& text, int sensor_id, double value);
+
+    AlertCallback callback_;
+    std::shared_ptr<const RuleSet> rules_;  // через std::atomic_load/atomic_store
+
+    std::mutex load_mutex_;
+    std::string path_;
+    std::filesystem::file_time_type loaded_mtime_{};
+};
+
+template<typename ValueFn>
+void AlertRuleEngine::observeSensors(
+    std::string_view metric,
+    const SensorData* data,
+    size_t count,
+    ValueFn value
+) {
+    const auto set = currentRules();
+    const auto* rules = rulesFor(*set, metric);
+    if (rules == nullptr) {
+        return;
+    }
+    for (Rule* rule : *rules) {
+        std::lock_guard<std::mutex> lock(rule->mutex);
+        for (size_t i = 0; i < count; ++i) {
+            evaluate(*rule, data[i].sensor_id, value(data[i]), data[i].timestamp);
+        }
+    }
+}
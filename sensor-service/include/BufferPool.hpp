@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "DeliveryGroup.hpp"
+#include "RingBuffer.hpp"
+
+// Пул буферов под полезную нагрузку сообщений Kafka.
+// Память каждого класса размеров выделяется одним слэбом в конструкторе,
+// свободные буферы хранятся в MPMC-кольце: захват происходит в потоке
+// обработки, возврат - в колбэке отчета о доставке librdkafka.
+class BufferPool {
+public:
+    static constexpr size_t kMaxKeySize = 24;
+
+    struct Buffer {
+        char* data;
+        size_t capacity;
+        size_t size;
+        int size_class;     // -1 - буфер выделен в куче в обход пула
+        int attempts;       // неудачные попытки отправки, для повторов
+        char key[kMaxKeySize];  // ключ сообщения Kafka, хранится до повтора
+        size_t key_size;
+        uint32_t trace;     // трасса LatencyTracker, 0 - не в выборке
+        // Отпускается при возврате в пул, то есть по окончательному
+        // отчету о доставке; nullptr - не в группе
+        DeliveryGroup* group;
+    };
+
+    struct Config {
+        size_t small_buffers = 16384;   // по 256 байт
+        size_t medium_buffers = 1024;   // по 4 КБ
+        size_t large_buffers = 64;      // по 64 КБ
+    };
+
+    struct Stats {
+        size_t in_use;
+        size_t capacity;
+        uint64_t heap_fallbacks;
+    };
+
+    BufferPool();
+    explicit BufferPool(const Config& config);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Никогда не возвращает nullptr: если подходящий класс исчерпан,
+    // буфер выделяется в куче и учитывается в heap_fallbacks
+    Buffer* acquire(size_t size);
+    // Отпускает группу буфера, если она есть
+    void release(Buffer* buffer);
+    Stats getStats() const;
+
+private:
+    struct SizeClass {
+        size_t buffer_size;
+        std::unique_ptr<char[]> slab;
+        std::unique_ptr<Buffer[]> headers;
+        std::unique_ptr<MpmcRing<Buffer*>> free_list;
+    };
+
+    void addSizeClass(size_t buffer_size, size_t count);
+
+    std::vector<SizeClass> classes_;
+    size_t capacity_{0};
+    std::atomic<size_t> in_use_{0};
+    std::atomic<uint64_t> heap_fallbacks_{0};
+};
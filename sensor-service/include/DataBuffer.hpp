@@ -1,24 +1,53 @@
 #pragma once
 
-#include <deque>
-#include <mutex>
-#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "EventCount.hpp"
+#include "RingBuffer.hpp"
 #include "SensorManager.hpp"
 
+// Ограниченный буфер между опросом датчиков и обработкой.
+// Кольцо выделяется заранее (емкость округляется вверх до степени двойки),
+// push блокируется при переполнении, pop - при пустом буфере с таймаутом.
 class DataBuffer {
 public:
-    explicit DataBuffer(size_t max_size = 100000);
+    enum class Mode {
+        SPSC,   // один производитель, один потребитель
+        MPMC    // несколько потоков опроса и/или обработки
+    };
+
+    explicit DataBuffer(size_t max_size = 100000, Mode mode = Mode::MPMC);
 
     void push(const SensorData& data);
     bool pop(SensorData& data, std::chrono::milliseconds timeout);
+
+    // Кладет все count элементов, блокируясь при переполнении
+    void pushBatch(const SensorData* data, size_t count);
+    // Ждет первый элемент не дольше max_wait, затем без ожидания забирает
+    // все доступное, но не больше max_n. Возвращает число добавленных в out
+    size_t popBatch(
+        std::vector<SensorData>& out,
+        size_t max_n,
+        std::chrono::milliseconds max_wait
+    );
+
     size_t size() const;
+    size_t capacity() const;
     bool empty() const;
+    // В режиме SPSC вызывать только из потока-потребителя
     void clear();
 
 private:
-    std::deque<SensorData> buffer_;
-    const size_t max_size_;
-    mutable std::mutex mutex_;
-    std::condition_variable not_empty_;
-    std::condition_variable not_full_;
-}; 
\ No newline at end of file
+    bool tryPush(const SensorData& data);
+    bool tryPop(SensorData& data);
+    size_t tryPushBatch(const SensorData* data, size_t count);
+    size_t tryPopBatch(SensorData* out, size_t max_n);
+    bool waitNotEmpty(std::chrono::steady_clock::time_point deadline);
+
+    const Mode mode_;
+    std::unique_ptr<SpscRing<SensorData>> spsc_;
+    std::unique_ptr<MpmcRing<SensorData>> mpmc_;
+    EventCount not_empty_;
+    EventCount not_full_;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+// Сообщения Kafka, окончательный итог которых нужен вместе: например,
+// пакет из журнала переполнения, позицию чтения которого можно сдвинуть
+// только после ответа брокера. Создатель держит одну ссылку, каждый буфер
+// пула с group - еще по одной и отпускает ее, возвращаясь в пул. Когда
+// ссылок не осталось, вызывается done и группа удаляет себя. delivered
+// в done - брокер подтвердил все сообщения группы, ни одно не отброшено.
+class DeliveryGroup {
+public:
+    using Done = std::function<void(bool delivered)>;
+
+    static DeliveryGroup* create(Done done) { return new DeliveryGroup(std::move(done)); }
+
+    DeliveryGroup(const DeliveryGroup&) = delete;
+    DeliveryGroup& operator=(const DeliveryGroup&) = delete;
+
+    void retain() { refs_.fetch_add(1, std::memory_order_relaxed); }
+    // Сообщение группы окончательно не доставлено; зовется до его release
+    void fail() { failed_.store(true, std::memory_order_relaxed); }
+    // Можно звать из любого потока; done выполняется в том, что отпустил последним
+    void release() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            done_(!failed_.load(std::memory_order_relaxed));
+            delete this;
+        }
+    }
+
+private:
+    explicit DeliveryGroup(Done done) : done_(std::move(done)) {}
+
+    std::atomic<uint32_t> refs_{1};
+    std::atomic<bool> failed_{false};
+    Done done_;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Примитив ожидания на futex. Уведомляющая сторона делает системный вызов
+// только если кто-то действительно припаркован, поэтому на быстром пути
+// (очередь не пуста / не полна) стоимость - одна атомарная загрузка.
+//
+// Протокол ожидания:
+//     auto key = event.prepareWait();
+//     if (условие выполнено) { event.cancelWait(); ... }
+//     else event.wait(key, timeout);
+class EventCount {
+public:
+    uint32_t prepareWait();
+    void cancelWait();
+    // false - истек таймаут
+    bool wait(uint32_t key, std::chrono::nanoseconds timeout);
+
+    void notifyOne();
+    void notifyAll();
+
+private:
+    void notify(int count);
+
+    std::atomic<uint32_t> epoch_{0};
+    std::atomic<uint32_t> waiters_{0};
+};
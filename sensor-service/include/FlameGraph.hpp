@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Дерево стеков с весами, из которого пишутся collapsed stacks
+// ("a;b;c N", формат Brendan Gregg) и SVG-flamegraph - то же, что делают
+// pprof --collapsed и flamegraph.pl, но внутри процесса.
+class FlameGraph {
+public:
+    FlameGraph();
+
+    // Кадры от корня к листу
+    void add(const std::vector<std::string>& frames, uint64_t weight);
+    // Строки collapsed stacks; бросает std::runtime_error, если файл не читается
+    void readCollapsed(const std::string& path);
+
+    uint64_t totalWeight() const { return nodes_[0].weight; }
+
+    // Бросают std::runtime_error, если файл не записан
+    void writeCollapsed(const std::string& path) const;
+    // count_name - единица веса в подсказках ("samples", "bytes", "us")
+    void writeSvg(const std::string& path, const std::string& title,
+                  const std::string& count_name) const;
+
+private:
+    struct Node {
+        std::string name;
+        uint64_t weight{0};       // с детьми
+        uint64_t self_weight{0};
+        std::map<std::string, size_t> children;
+    };
+
+    size_t depth(size_t node) const;
+
+    std::vector<Node> nodes_;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Разбор файлов gperftools без pprof: бинарного CPU-профиля (слова
+// размера указателя: заголовок, записи "число, глубина, адреса", трейлер
+// и карта отображений текстом) и текстового heap-профиля.
+struct GperfProfile {
+    enum class Kind {
+        CPU,
+        HEAP
+    };
+
+    struct Sample {
+        // Адреса от листа к корню; все, кроме первого, - адреса возврата
+        std::vector<uint64_t> stack;
+        // CPU - число срабатываний таймера, heap - занятые байты
+        uint64_t weight;
+    };
+
+    Kind kind{Kind::CPU};
+    std::vector<Sample> samples;
+    // Карта отображений процесса в формате /proc/<pid>/maps
+    std::string mappings;
+    // Период CPU-профиля в мкс
+    uint64_t period_us{0};
+
+    // Бросает std::runtime_error, если файл не читается или не профиль gperftools
+    static GperfProfile read(const std::string& path);
+};
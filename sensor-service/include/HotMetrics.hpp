@@ -0,0 +1,124 @@
+#pragma once
+
+#include <prometheus/collectable.h>
+#include <prometheus/family.h>
+#include <prometheus/metric_family.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Счетчики и гистограммы для горячего пути. У каждого потока своя копия
+// ячеек, и запись - это обычные load/store без lock-префикса и без
+// общих строк кэша между потоками. Суммирование по потокам делает только
+// Collect(), то есть scrape Prometheus.
+//
+// Ячейки потока выделяются при первой записи и возвращаются в общую
+// сумму, когда поток завершается, так что значения не теряются.
+namespace hot_metrics {
+
+// Ячеек на поток: счетчики и корзины гистограмм, отдельно суммы гистограмм
+constexpr uint32_t kCountSlots = 1024;
+constexpr uint32_t kSumSlots = 64;
+
+struct alignas(64) ThreadSlots {
+    std::atomic<uint64_t> counts[kCountSlots];
+    std::atomic<double> sums[kSumSlots];
+};
+
+// Ячейки текущего потока; nullptr до первой записи
+inline thread_local ThreadSlots* current_slots = nullptr;
+ThreadSlots* registerThread();
+
+inline ThreadSlots& slots() {
+    ThreadSlots* slots = current_slots;
+    if (__builtin_expect(slots == nullptr, 0)) {
+        slots = registerThread();
+    }
+    return *slots;
+}
+
+// Пишет только поток-владелец, поэтому атомарный инкремент не нужен:
+// relaxed load/store лишь не дают Collect() увидеть разорванное значение
+inline void add(std::atomic<uint64_t>& slot, uint64_t value) {
+    slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+inline void add(std::atomic<double>& slot, double value) {
+    slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+}  // namespace hot_metrics
+
+class HotCounter {
+public:
+    void increment(uint64_t value = 1) {
+        hot_metrics::add(hot_metrics::slots().counts[slot_], value);
+    }
+    // Сумма по всем потокам
+    uint64_t value() const;
+
+private:
+    friend class HotMetrics;
+    explicit HotCounter(uint32_t slot) : slot_(slot) {}
+
+    const uint32_t slot_;
+};
+
+class HotHistogram {
+public:
+    void observe(double value) {
+        // Корзин немного, линейный проход дешевле двоичного поиска
+        uint32_t bucket = 0;
+        const uint32_t count = static_cast<uint32_t>(bounds_.size());
+        while (bucket < count && value > bounds_[bucket]) {
+            ++bucket;
+        }
+        auto& slots = hot_metrics::slots();
+        hot_metrics::add(slots.counts[first_slot_ + bucket], 1);
+        hot_metrics::add(slots.sums[sum_slot_], value);
+    }
+
+    // Некумулятивные счетчики корзин; последняя - +Inf
+    void snapshot(std::vector<uint64_t>& buckets, double& sum) const;
+    const std::vector<double>& bounds() const { return bounds_; }
+
+private:
+    friend class HotMetrics;
+    HotHistogram(std::vector<double> bounds, uint32_t first_slot, uint32_t sum_slot);
+
+    const std::vector<double> bounds_;
+    const uint32_t first_slot_;
+    const uint32_t sum_slot_;
+};
+
+// Регистрирует метрики и отдает их экспортеру Prometheus как Collectable.
+// Ячейки не переиспользуются, так что метрики регистрируются один раз при
+// старте; при нехватке ячеек бросается std::length_error
+class HotMetrics : public prometheus::Collectable {
+public:
+    HotCounter& counter(const std::string& name, const std::string& help,
+                        const prometheus::Labels& labels = {});
+    // bounds - верхние границы корзин по возрастанию, +Inf добавляется сама
+    HotHistogram& histogram(const std::string& name, const std::string& help,
+                            std::vector<double> bounds,
+                            const prometheus::Labels& labels = {});
+
+    std::vector<prometheus::MetricFamily> Collect() const override;
+
+private:
+    struct Family {
+        std::string name;
+        std::string help;
+        prometheus::MetricType type;
+        std::vector<std::pair<prometheus::Labels, std::unique_ptr<HotCounter>>> counters;
+        std::vector<std::pair<prometheus::Labels, std::unique_ptr<HotHistogram>>> histograms;
+    };
+
+    Family& family(const std::string& name, const std::string& help, prometheus::MetricType type);
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Family>> families_;
+};
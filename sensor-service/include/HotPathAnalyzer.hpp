@@ -1,52 +1,247 @@
 #pragma once
 
-#include <unordered_map>
-#include <string>
+#include <prometheus/collectable.h>
+#include <prometheus/metric_family.h>
+#include <atomic>
 #include <chrono>
-#include <mutex>
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Профилирование участков кода на горячем пути. Участок получает номер
+// один раз - при первом проходе через PROFILE_SCOPE (статическая
+// переменная в месте вызова), дальше замер - это два чтения TSC и запись
+// в ячейки текущего потока: без мьютекса, без строк и без поиска по имени.
+//
+// У каждого потока свои ячейки, пишет в них только он сам (как в
+// HotMetrics). Кроме числа вызовов и суммарного времени копится
+// лог-линейная гистограмма длительностей, из которой считаются p50/p99,
+// и точный максимум. Экспортер Prometheus собирает все это при scrape.
+//
+// Вложенные участки образуют дерево вызовов потока: узел - это путь от
+// корня, у него свое число вызовов и полное время, а собственное время -
+// полное минус полное время детей. Дерево читается без остановки потоков
+// и выгружается в формате collapsed stacks для flamegraph.pl.
+namespace hot_path {
+
+// Участков на процесс
+constexpr uint32_t kMaxScopes = 256;
+// Узлов в дереве вызовов потока; не поместившиеся участки в дерево не
+// попадают, но плоская статистика у них остается
+constexpr uint32_t kMaxNodes = 2048;
+constexpr uint32_t kNoNode = UINT32_MAX;
+// Лог-линейные корзины тактов: 8 точных, затем по 8 на каждую степень
+// двойки до 2^47 тактов. Погрешность квантиля - не больше 1/8 значения
+constexpr uint32_t kSubBuckets = 8;
+constexpr uint32_t kMaxMagnitude = 47;
+constexpr uint32_t kBuckets = (kMaxMagnitude - 1) * kSubBuckets;
+
+inline uint32_t bucketOf(uint64_t ticks) {
+    if (ticks < kSubBuckets) {
+        return static_cast<uint32_t>(ticks);
+    }
+    uint32_t magnitude = 63 - static_cast<uint32_t>(__builtin_clzll(ticks));
+    if (magnitude > kMaxMagnitude) {
+        return kBuckets - 1;
+    }
+    const uint32_t sub = static_cast<uint32_t>(ticks >> (magnitude - 3)) & (kSubBuckets - 1);
+    return (magnitude - 2) * kSubBuckets + sub;
+}
+
+// Нижняя граница корзины в тактах
+inline uint64_t bucketFloor(uint32_t bucket) {
+    if (bucket < kSubBuckets) {
+        return bucket;
+    }
+    const uint32_t magnitude = bucket / kSubBuckets + 2;
+    return (kSubBuckets + bucket % kSubBuckets) << (magnitude - 3);
+}
+
+inline uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+struct ScopeCell {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> ticks{0};
+    std::atomic<uint64_t> max_ticks{0};
+    std::atomic<uint64_t> buckets[kBuckets];
+
+    ScopeCell();
+};
+
+// Узел дерева вызовов. parent и scope не меняются после публикации
+// узла через node_count; first_child и next_sibling читает только владелец
+struct TreeNode {
+    uint32_t parent{kNoNode};
+    uint32_t scope{kNoNode};
+    uint32_t first_child{kNoNode};
+    uint32_t next_sibling{kNoNode};
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> ticks{0};
+};
+
+// Ячейки потока; ячейка участка выделяется при первом его замере в потоке
+struct ThreadCells {
+    std::atomic<ScopeCell*> scopes[kMaxScopes];
+    // Узел 0 - корень; current_node - узел открытого участка или kNoNode,
+    // если он не поместился в дерево
+    std::unique_ptr<TreeNode[]> nodes;
+    std::atomic<uint32_t> node_count{1};
+    uint32_t current_node{0};
+
+    ThreadCells();
+};
+
+inline thread_local ThreadCells* current_cells = nullptr;
+ThreadCells* registerThread();
+ScopeCell* createCell(ThreadCells& cells, uint32_t scope);
+// Новый ребенок узла; kNoNode, если дерево заполнено
+uint32_t addNode(ThreadCells& cells, uint32_t parent, uint32_t scope);
+
+inline ThreadCells& cells() {
+    ThreadCells* cells = current_cells;
+    if (__builtin_expect(cells == nullptr, 0)) {
+        cells = registerThread();
+    }
+    return *cells;
+}
+
+inline void add(std::atomic<uint64_t>& slot, uint64_t value) {
+    slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// Открывает участок в дереве: узел участка под текущим, он становится текущим.
+// Если узлу не хватило места, текущим до выхода из участка остается kNoNode:
+// вложенные участки тоже не попадают в дерево, а не цепляются к чужому
+// родителю. Их время остается собственным временем ближнего предка в дереве
+inline uint32_t enter(ThreadCells& cells, uint32_t scope) {
+    const uint32_t parent = cells.current_node;
+    if (parent == kNoNode) {
+        return kNoNode;
+    }
+    uint32_t child = cells.nodes[parent].first_child;
+    while (child != kNoNode && cells.nodes[child].scope != scope) {
+        child = cells.nodes[child].next_sibling;
+    }
+    if (child == kNoNode) {
+        child = addNode(cells, parent, scope);
+    }
+    cells.current_node = child;
+    return child;
+}
+
+inline void record(ThreadCells& cells, uint32_t scope, uint64_t ticks) {
+    ScopeCell* cell = cells.scopes[scope].load(std::memory_order_relaxed);
+    if (__builtin_expect(cell == nullptr, 0)) {
+        cell = createCell(cells, scope);
+    }
+    add(cell->calls, 1);
+    add(cell->ticks, ticks);
+    add(cell->buckets[bucketOf(ticks)], 1);
+    if (ticks > cell->max_ticks.load(std::memory_order_relaxed)) {
+        cell->max_ticks.store(ticks, std::memory_order_relaxed);
+    }
+}
+
+}  // namespace hot_path
 
-class HotPathAnalyzer {
+class HotPathAnalyzer : public prometheus::Collectable {
 public:
     struct PathStats {
         std::string path;
         std::chrono::microseconds total_time{0};
         uint64_t calls{0};
-        double avg_time{0.0};
+        double avg_time{0.0};  // мкс
+        double p50{0.0};       // мкс
+        double p99{0.0};       // мкс
+        double max{0.0};       // мкс
     };
 
-    void recordPath(
-        const std::string& path,
-        std::chrono::microseconds duration
-    );
-    
-    std::vector<PathStats> getHotPaths(size_t top_n = 10) const;
-    void reset();
-    
-    // Макрос для автоматического профилирования функции
-    #define PROFILE_FUNCTION() \
-        HotPathAnalyzer::ScopedProfile __profile( \
-            __FUNCTION__, \
-            HotPathAnalyzer::getInstance() \
-        )
+    // Узел дерева вызовов, сведенного по всем потокам. Время в мкс
+    struct CallNode {
+        std::string name;
+        uint64_t calls{0};
+        double total_time{0.0};
+        double self_time{0.0};
+        std::vector<CallNode> children;
+    };
 
-private:
+    // Замер участка от конструктора до деструктора
     class ScopedProfile {
     public:
-        ScopedProfile(
-            const std::string& path,
-            HotPathAnalyzer& analyzer
-        );
-        ~ScopedProfile();
+        explicit ScopedProfile(uint32_t scope)
+            : cells_(hot_path::cells())
+            , scope_(scope)
+            , parent_(cells_.current_node)
+            , node_(hot_path::enter(cells_, scope))
+            , start_(hot_path::now()) {
+        }
+        ~ScopedProfile() {
+            const uint64_t ticks = hot_path::now() - start_;
+            hot_path::record(cells_, scope_, ticks);
+            if (node_ != hot_path::kNoNode) {
+                hot_path::add(cells_.nodes[node_].calls, 1);
+                hot_path::add(cells_.nodes[node_].ticks, ticks);
+            }
+            cells_.current_node = parent_;
+        }
+
+        ScopedProfile(const ScopedProfile&) = delete;
+        ScopedProfile& operator=(const ScopedProfile&) = delete;
 
     private:
-        std::string path_;
-        HotPathAnalyzer& analyzer_;
-        std::chrono::steady_clock::time_point start_;
+        hot_path::ThreadCells& cells_;
+        const uint32_t scope_;
+        const uint32_t parent_;
+        const uint32_t node_;
+        const uint64_t start_;
     };
 
-    mutable std::mutex mutex_;
-    std::unordered_map<std::string, PathStats> stats_;
-
     static HotPathAnalyzer& getInstance();
-}; 
\ No newline at end of file
+    // Для Metrics::registerCollectable; экземпляр живет до конца процесса
+    static std::shared_ptr<HotPathAnalyzer> shared();
+
+    // Номер участка по имени; повторная регистрация имени дает тот же номер.
+    // Бросает std::length_error, если участков больше kMaxScopes
+    static uint32_t registerScope(const char* name);
+
+    // Участки по убыванию суммарного времени
+    std::vector<PathStats> getHotPaths(size_t top_n = 10) const;
+    // Дерево вызовов по всем потокам; корень без имени, его дети -
+    // участки верхнего уровня
+    CallNode getCallTree() const;
+    // Collapsed stacks: строка "a;b;c N" на путь, N - собственное время в мкс
+    std::string getCollapsedStacks() const;
+    // Бросает std::runtime_error, если файл не записан
+    void writeCollapsedStacks(const std::string& path) const;
+
+    // Дальше статистика считается от текущего момента
+    void reset();
+
+    std::vector<prometheus::MetricFamily> Collect() const override;
+
+private:
+    HotPathAnalyzer();
+};
+
+#define HOT_PATH_CONCAT_INNER(a, b) a##b
+#define HOT_PATH_CONCAT(a, b) HOT_PATH_CONCAT_INNER(a, b)
+
+// name копируется один раз, при первом проходе через место вызова
+#define PROFILE_SCOPE(name) \
+    static const uint32_t HOT_PATH_CONCAT(hot_path_scope_, __LINE__) = \
+        HotPathAnalyzer::registerScope(name); \
+    HotPathAnalyzer::ScopedProfile HOT_PATH_CONCAT(hot_path_profile_, __LINE__)( \
+        HOT_PATH_CONCAT(hot_path_scope_, __LINE__))
+
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
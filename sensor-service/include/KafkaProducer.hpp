@@ -2,31 +2,180 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
 #include <librdkafka/rdkafkacpp.h>
+#include "BufferPool.hpp"
+#include "LatencyTracker.hpp"
 #include "RetryManager.hpp"
 
+class Metrics;
+
 class KafkaProducer {
 public:
+    // Снимок счетчиков. sent/failed считаются по отчетам о доставке:
+    // sent - подтверждено брокером, failed - окончательно потеряно
     struct Stats {
-        std::atomic<uint64_t> messages_sent{0};
-        std::atomic<uint64_t> messages_failed{0};
-        std::atomic<uint64_t> retries{0};
-        std::atomic<uint64_t> errors{0};
+        uint64_t messages_sent{0};
+        uint64_t messages_failed{0};
+        uint64_t retries{0};
+        uint64_t errors{0};
+        uint64_t outq_len{0};           // ждут подтверждения в librdkafka
+        uint64_t pending_retries{0};    // ждут повтора в нашей очереди
     };
 
+    using Buffer = BufferPool::Buffer;
+
     KafkaProducer(const std::string& brokers, const std::string& topic);
     ~KafkaProducer();
 
-    bool produce(const std::string& message);
-    bool produceWithRetry(const std::string& message);
+    // Куда экспортировать задержки доставки и статистику librdkafka.
+    // Metrics должен пережить продюсер
+    void setMetrics(Metrics* metrics);
+    // Отмечает PRODUCED и ACKED на буферах с трассой (Buffer::trace).
+    // Трекер должен пережить продюсер
+    void setLatencyTracker(LatencyTracker* tracker);
+
+    // Буфер из пула, в который вызывающий сериализует сообщение
+    // напрямую, выставляя buffer->size
+    Buffer* acquireBuffer(size_t size);
+    // Возвращает в пул буфер, который так и не был передан в produce.
+    // Его группа доставки считается неудавшейся
+    void releaseBuffer(Buffer* buffer);
+    // Ключ определяет партицию: сообщения с одним ключом идут в одну
+    // партицию в порядке отправки, в том числе через очередь повторов.
+    // Длиннее kMaxKeySize обрезается
+    static void setKey(Buffer* buffer, std::string_view key);
+    static void setKey(Buffer* buffer, int64_t key);
+
+    // Передают буфер librdkafka без копирования и не бросают. Владение
+    // переходит к продюсеру в любом случае: буфер вернется в пул из отчета
+    // о доставке или сразу, если сообщение так и не удалось поставить в очередь
+    bool produce(Buffer* buffer);
+    // Не блокируется: при ошибке сообщение паркуется в очереди повторов
+    // и отправляется фоновым потоком. Пока у ключа есть сообщения на
+    // повторе, новые с тем же ключом ждут за ними. false - очередь повторов
+    // переполнена
+    bool produceWithRetry(Buffer* buffer);
+    // Ставит в очередь librdkafka весь пакет. Не принятые сообщения уходят
+    // в очередь повторов. Возвращает число окончательно отброшенных
+    size_t produceBatch(const std::vector<Buffer*>& buffers);
+
+    // Копируют сообщение в буфер пула
+    bool produce(std::string_view message, std::string_view key = {});
+    bool produceWithRetry(std::string_view message, std::string_view key = {});
+
     void flush(int timeout_ms = 10000);
     Stats getStats() const;
+    BufferPool::Stats getBufferPoolStats() const;
+    size_t pendingRetries() const;
+    // Брокер не успевает: в очереди librdkafka и на повторе вместе больше
+    // kBackpressureOutqLen сообщений. Обработчикам стоит притормозить, а не
+    // набивать очереди до отбрасывания. Отдельные повторы свежий поток не
+    // тормозят: за ними ждут только сообщения того же ключа. Без блокировок
+    bool isBackedUp() const;
+
+    // Предел очереди повторов; сверх него сообщения отбрасываются
+    static constexpr size_t kMaxPendingRetries = 100000;
+    // Половина queue.buffering.max.messages
+    static constexpr int kBackpressureOutqLen = 50000;
+    // Период JSON-статистики librdkafka (statistics.interval.ms)
+    static constexpr int kStatisticsIntervalMs = 5000;
 
 private:
+    // Возвращает буфер в пул, когда брокер подтвердил сообщение,
+    // или ставит его на повтор при ошибке доставки
+    class DeliveryReportHandler : public RdKafka::DeliveryReportCb {
+    public:
+        explicit DeliveryReportHandler(KafkaProducer& producer) : producer_(producer) {}
+        void dr_cb(RdKafka::Message& message) override;
+
+    private:
+        KafkaProducer& producer_;
+    };
+
+    // Разбирает JSON из statistics.interval.ms и ошибки клиента
+    class EventHandler : public RdKafka::EventCb {
+    public:
+        explicit EventHandler(KafkaProducer& producer) : producer_(producer) {}
+        void event_cb(RdKafka::Event& event) override;
+
+    private:
+        KafkaProducer& producer_;
+    };
+
+    struct Counters {
+        std::atomic<uint64_t> messages_sent{0};
+        std::atomic<uint64_t> messages_failed{0};
+        std::atomic<uint64_t> retries{0};
+        std::atomic<uint64_t> errors{0};
+    };
+
+    // Время повтора ключа; по одному на очередь в backlogs_
+    struct PendingRetry {
+        std::chrono::steady_clock::time_point due;
+        std::string key;
+
+        bool operator>(const PendingRetry& other) const { return due > other.due; }
+    };
+
+    // Сообщения одного ключа, ждущие повтора, в порядке отправки
+    struct Backlog {
+        std::deque<Buffer*> failed;  // уже были в librdkafka, в порядке отчетов
+        std::deque<Buffer*> held;    // новые, придержаны за failed
+    };
+
+    Buffer* copyToBuffer(std::string_view message, std::string_view key);
+    RdKafka::ErrorCode enqueue(Buffer* buffer);
+    void onDelivery(RdKafka::Message& message);
+    void onStatistics(const std::string& json);
+    // Сообщение окончательно отброшено: группа не подтверждается, буфер - в пул
+    void discard(Buffer* buffer);
+    void recordFailure(Buffer* buffer);
+    // Отправка без проверки очереди ключа; при ошибке - scheduleRetry
+    bool send(Buffer* buffer);
+    bool scheduleRetry(Buffer* buffer);
+    // true - у ключа есть повторы, и буфер встал за ними (accepted - не
+    // отброшен из-за переполнения). false - буфер надо отправлять
+    bool holdBack(Buffer* buffer, bool& accepted);
+    // Отправляет очередь ключа по порядку; ошибка снова ставит остаток на повтор
+    void sendBacklog(Backlog backlog);
+    // Под retry_mutex_: вынимает очередь ключа из backlogs_
+    Backlog takeBacklog(const std::string& key);
+    void serviceLoop();
+    // Возвращает время до ближайшего повтора
+    std::chrono::milliseconds processDueRetries();
+    void dropPendingRetries();
+
+    // Пул и обработчик должны пережить producer_, поэтому объявлены раньше
+    BufferPool buffer_pool_;
+    DeliveryReportHandler delivery_handler_{*this};
+    EventHandler event_handler_{*this};
     std::unique_ptr<RdKafka::Producer> producer_;
     std::string topic_;
     std::unique_ptr<RdKafka::Topic> topic_ptr_;
     RetryManager retry_manager_;
-    Stats stats_;
+    Counters counters_;
+    std::atomic<Metrics*> metrics_{nullptr};
+    std::atomic<LatencyTracker*> latency_{nullptr};
+
+    // Очереди повторов по ключам и их времена. Мьютекс берется только на
+    // пути ошибок, в фоновом потоке и для ключей с повторами: быстрый путь
+    // проверяет лишь held_keys_
+    std::mutex retry_mutex_;
+    std::unordered_map<std::string, Backlog> backlogs_;
+    std::priority_queue<PendingRetry, std::vector<PendingRetry>, std::greater<PendingRetry>> retry_queue_;
+    std::atomic<size_t> held_keys_{0};        // backlogs_.size()
+    std::atomic<size_t> pending_retries_{0};  // буферов во всех очередях
+
+    // Фоновый поток: poll для отчетов о доставке и отправка повторов
+    std::atomic<bool> running_{true};
+    std::thread service_thread_;
 }; 
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+class Metrics;
+
+// Задержки этапов конвейера для выборки образцов. Попавший в выборку
+// образец получает номер трассы (SensorData::trace, BufferPool::Buffer::trace),
+// и каждый этап отмечает на нем монотонное время. Отметка сразу дает
+// задержку этапа относительно предыдущего, а ack брокера - полную задержку
+// от чтения датчика.
+//
+// Трассы лежат в кольце фиксированного размера: памяти не прибавляется, а
+// трасса, которую кольцо успело перезаписать, просто теряется. Образцы
+// без трассы стоят одной проверки trace != 0 на этап.
+class LatencyTracker {
+public:
+    enum class Stage : uint8_t {
+        READ,        // драйвер вернул значение
+        BUFFERED,    // образец положен в буфер обработчика
+        DEQUEUED,    // образец забран обработчиком
+        SERIALIZED,  // запись или пакет сериализованы
+        PRODUCED,    // сообщение принято librdkafka
+        ACKED        // брокер подтвердил доставку
+    };
+    static constexpr size_t kStageCount = 6;
+
+    struct Config {
+        // Трассируется каждый sample_every-й образец потока опроса; 0 - выключено
+        uint32_t sample_every = 1000;
+        // Одновременно живущих трасс
+        uint32_t capacity = 4096;
+    };
+
+    // Бросает std::invalid_argument при нулевой емкости. metrics должен
+    // пережить трекер
+    LatencyTracker(Config config, Metrics* metrics);
+
+    uint32_t sampleEvery() const { return config_.sample_every; }
+
+    // Новая трасса с отметкой READ; всегда не 0
+    uint32_t begin(std::chrono::steady_clock::time_point read_time);
+    // Отметка этапа; trace == 0 и перезаписанные трассы пропускаются
+    void mark(uint32_t trace, Stage stage, std::chrono::steady_clock::time_point now);
+
+    static const char* stageName(Stage stage);
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> trace{0};
+        std::atomic<int64_t> stamps[kStageCount];
+    };
+
+    int64_t toNanos(std::chrono::steady_clock::time_point time) const;
+
+    const Config config_;
+    Metrics* const metrics_;
+    const std::chrono::steady_clock::time_point epoch_{std::chrono::steady_clock::now()};
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<uint32_t> next_trace_{0};
+};
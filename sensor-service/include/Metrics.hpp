@@ -5,44 +5,132 @@
 #include <prometheus/histogram.h>
 #include <prometheus/exposer.h>
 #include <prometheus/registry.h>
+#include <array>
 #include <memory>
 #include <string>
+#include "AlertManager.hpp"
+#include "BufferPool.hpp"
+#include "HotMetrics.hpp"
+#include "LatencyTracker.hpp"
+#include "SensorStatistics.hpp"
+#include "SpillLog.hpp"
 
+// Счетчики и гистограммы, которые пишутся на каждое сообщение или
+// образец, живут в HotMetrics: запись в них не трогает общих атомиков,
+// а суммируются они только при scrape
 class Metrics {
 public:
+    // Этапы конвейера от колбэка опроса до librdkafka
+    enum class Stage {
+        BUFFERED,    // образец положен в буфер обработчика
+        SPILLED,     // образец ушел в журнал переполнения
+        DEQUEUED,    // образец забран из буфера
+        REPLAYED,    // образец прочитан из журнала
+        SERIALIZED,  // запись сериализована
+        PRODUCED     // сообщение принято librdkafka
+    };
+
+    // bind_address - адрес экспортера. Кроме /metrics на нем может быть
+    // /profile (SensorService::enableProfileEndpoint), который запускает
+    // захват профиля без авторизации
     explicit Metrics(const std::string& bind_address = "0.0.0.0:8080");
+
+    std::shared_ptr<prometheus::Registry> getRegistry() const { return registry_; }
+    // Отдает экспортеру метрики, которые собираются в момент scrape.
+    // Metrics не продлевает жизнь collectable: разрушенный просто пропускается.
+    // uri - путь экспортера, на котором отдаются его метрики
+    void registerCollectable(const std::weak_ptr<prometheus::Collectable>& collectable,
+                             const std::string& uri = "/metrics");
     
-    // Счетчики
+    // Счетчики горячего пути, можно звать из любых потоков
+    void countStage(Stage stage, uint64_t count = 1);
+    void addSerializedBytes(uint64_t bytes);
     void incrementMessagesSent();
     void incrementMessagesFailures();
     void incrementRetries();
     void incrementErrors();
     
-    // Метрики датчиков
-    void recordSensorValue(int sensor_id, double value);
-    void setSensorStatus(int sensor_id, bool online);
+    // Метрики датчиков. Текущие значения и статус отдает SensorCollector
+    // EWMA и квантили по датчикам, аномалии
+    void setSensorStatistics(const std::vector<SensorStatistics::Snapshot>& statistics);
+    void incrementAnomalies(double count);
+    // Отправка алертов на вебхук. Из одного потока
+    void setAlertStats(const AlertManager::Stats& stats);
     
     // Метрики производительности
     void observeProcessingTime(double seconds);
+    // Выборочные задержки: этап относительно предыдущего и от чтения до ack
+    void observeStageLatency(LatencyTracker::Stage stage, double seconds);
+    void observeEndToEndLatency(double seconds);
+    // Для триггеров профилирования по SLO
+    const HotHistogram& endToEndLatency() const { return end_to_end_latency_; }
     void setBufferSize(double size);
     void setKafkaLag(double lag);
+    // Из одного потока: итог heap_fallbacks переводится в прирост счетчика
+    void setKafkaBufferPoolUsage(const BufferPool::Stats& stats);
+    // Суммарно по журналам переполнения всех обработчиков
+    void setSpillStats(const SpillLog::Stats& stats);
+    // Агрегация по окнам: отправленные итоги и измерения в закрытые окна
+    void incrementRollups(double count);
+    void incrementLateSamples(double count);
+    // Фильтр измерений до буфера: пропущенные и отсеянные
+    void incrementFilteredSamples(double forwarded, double suppressed);
+
+    // Планировщик опроса: опоздание опроса относительно срока и пропуски
+    void observeSchedulingJitter(double seconds);
+    void incrementMissedPolls(double count);
+
+    // Продюсер: отчеты о доставке и статистика librdkafka
+    void observeDeliveryLatency(double seconds);
+    void setKafkaOutqLen(double messages);
+    void setBrokerRtt(const std::string& broker, double avg_seconds, double p99_seconds);
+    void setProducerBatchStats(double avg_messages, double avg_bytes);
 
 private:
     std::unique_ptr<prometheus::Exposer> exposer_;
     std::shared_ptr<prometheus::Registry> registry_;
+    std::shared_ptr<HotMetrics> hot_;
     
     // Счетчики
-    prometheus::Counter& messages_sent_;
-    prometheus::Counter& messages_failed_;
-    prometheus::Counter& retries_;
-    prometheus::Counter& errors_;
+    std::array<HotCounter*, 6> stages_;
+    HotCounter& serialized_bytes_;
+    HotCounter& messages_sent_;
+    HotCounter& messages_failed_;
+    HotCounter& retries_;
+    HotCounter& errors_;
     
     // Датчики
-    prometheus::Family<prometheus::Gauge>& sensor_values_;
-    prometheus::Family<prometheus::Gauge>& sensor_status_;
+    prometheus::Family<prometheus::Gauge>& sensor_ewma_;
+    prometheus::Family<prometheus::Gauge>& sensor_quantile_;
+    prometheus::Counter& anomalies_;
+    prometheus::Family<prometheus::Counter>& alerts_;
+    AlertManager::Stats reported_alerts_{};
+    prometheus::Gauge& alerts_queued_;
     
     // Производительность
-    prometheus::Histogram& processing_time_;
+    HotHistogram& processing_time_;
+    std::array<HotHistogram*, LatencyTracker::kStageCount> stage_latency_;
+    HotHistogram& end_to_end_latency_;
+    prometheus::Histogram& scheduling_jitter_;
+    prometheus::Counter& missed_polls_;
     prometheus::Gauge& buffer_size_;
     prometheus::Gauge& kafka_lag_;
+    prometheus::Gauge& buffer_pool_in_use_;
+    prometheus::Gauge& buffer_pool_capacity_;
+    prometheus::Counter& buffer_pool_heap_fallbacks_;
+    uint64_t reported_heap_fallbacks_{0};
+    prometheus::Gauge& spill_pending_;
+    prometheus::Gauge& spill_bytes_;
+    prometheus::Gauge& spill_spilled_;
+    prometheus::Gauge& spill_replayed_;
+    prometheus::Gauge& spill_dropped_;
+    prometheus::Counter& rollups_;
+    prometheus::Counter& late_samples_;
+    prometheus::Counter& filter_forwarded_;
+    prometheus::Counter& filter_suppressed_;
+    HotHistogram& delivery_latency_;
+    prometheus::Gauge& kafka_outq_len_;
+    prometheus::Family<prometheus::Gauge>& broker_rtt_;
+    prometheus::Gauge& batch_messages_avg_;
+    prometheus::Gauge& batch_bytes_avg_;
 }; 
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <prometheus/collectable.h>
+#include <prometheus/metric_family.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Запрос профиля по HTTP без отдельного сервера: регистрируется в
+// экспортере Prometheus на своем URI (/profile), и каждый GET вызывает
+// request. Ответ - gauge sensor_service_profile_capture_started: 1, если
+// захват начат, 0, если отклонен (идет другой или не вышел cooldown).
+//
+// Авторизации нет, а GET меняет состояние: экспортер не дает ни своих
+// обработчиков, ни методов кроме GET. Поэтому endpoint выключен, пока его
+// явно не включат (SensorService::enableProfileEndpoint), и годится только
+// для экспортера, закрытого от чужих. Частоту захватов ограничивает cooldown.
+class ProfileEndpoint : public prometheus::Collectable {
+public:
+    // Возвращает, начат ли захват; не должен блокировать
+    using Request = std::function<bool(const std::string& reason)>;
+
+    explicit ProfileEndpoint(Request request);
+
+    // Дальше запросы отклоняются. Ждет идущий запрос
+    void detach();
+
+    std::vector<prometheus::MetricFamily> Collect() const override;
+
+private:
+    mutable std::mutex mutex_;
+    Request request_;
+};
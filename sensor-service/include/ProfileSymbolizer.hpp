@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Имена функций по адресам из профилей gperftools без pprof: карта
+// отображений берется из самого профиля (формат /proc/<pid>/maps), а
+// символы - из таблиц .symtab/.dynsym ELF-файлов этих отображений.
+//
+// Таблицы символов файла читаются один раз, найденные имена кэшируются
+// по адресу, пока карта отображений не изменилась. Класс не
+// потокобезопасен: им пользуется один поток отрисовки Profiler.
+class ProfileSymbolizer {
+public:
+    // Строки формата /proc/<pid>/maps; при смене карты кэш адресов сбрасывается
+    void setMappings(const std::string& maps);
+
+    // Деманглированное имя функции; без символа - "файл+0xсмещение" или
+    // "0xадрес" вне отображений
+    const std::string& symbolize(uint64_t address);
+
+private:
+    struct Mapping {
+        uint64_t start;
+        uint64_t end;
+        uint64_t offset;
+        std::string path;
+    };
+
+    struct Symbol {
+        uint64_t address;
+        uint64_t size;
+        uint32_t name;  // смещение в strings
+    };
+
+    struct Segment {
+        uint64_t offset;
+        uint64_t file_size;
+        uint64_t address;
+    };
+
+    // Символы ELF-файла по возрастанию адреса; пусто, если файл не прочитан
+    struct ElfImage {
+        std::vector<Segment> segments;
+        std::vector<Symbol> symbols;
+        std::string strings;
+    };
+
+    const ElfImage& image(const std::string& path);
+    std::string lookup(uint64_t address);
+    static std::unique_ptr<ElfImage> loadImage(const std::string& path);
+    static std::string demangle(const char* name);
+
+    std::string maps_;
+    std::vector<Mapping> mappings_;
+    std::unordered_map<std::string, std::unique_ptr<ElfImage>> images_;
+    std::unordered_map<uint64_t, std::string> names_;
+};
@@ -4,12 +4,34 @@
 #include <gperftools/heap-profiler.h>
 #include <string>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <atomic>
 #include <thread>
+#include "ProfileSymbolizer.hpp"
+#include "StackSampler.hpp"
 
+// Профили gperftools и их flamegraph. Профили разбираются и
+// символизируются внутри процесса (GperfProfile, ProfileSymbolizer,
+// FlameGraph), без pprof и flamegraph.pl, в отдельном потоке с
+// планировщиком SCHED_IDLE: рабочим потокам он не мешает.
+//
+// Вместо постоянного профилирования - захват по триггеру: всегда работает
+// только StackSampler с низкой частотой, а triggerCapture() сразу выгружает
+// его кольцо (минуты до срабатывания) и затем на capture_duration включает
+// полный CPU-профиль gperftools в отдельный файл с суффиксом _full.
 class Profiler {
 public:
+    struct TriggerConfig {
+        StackSampler::Config sampler;
+        // Полный профиль gperftools после срабатывания; 0 - только кольцо
+        std::chrono::seconds capture_duration{30};
+        // Не чаще одного захвата за это время
+        std::chrono::seconds cooldown{600};
+    };
+
     enum class ProfileType {
         CPU,
         HEAP,
@@ -19,18 +41,36 @@ public:
     explicit Profiler(const std::string& output_dir);
     ~Profiler();
 
-    void startProfiling(ProfileType type);
+    // Возвращает путь профиля; для HEAP - префикс файлов <путь>.NNNN.heap
+    std::string startProfiling(ProfileType type);
     void stopProfiling(ProfileType type);
     void startContinuousProfiling(
         ProfileType type,
         std::chrono::seconds interval = std::chrono::seconds(60)
     );
     void stopContinuousProfiling();
+    // Запускает сэмплер и поток захвата; бросает, если сэмплер не запустился
+    void startTriggeredProfiling(TriggerConfig config);
+    void stopTriggeredProfiling();
+    // Не блокирует. false - захват уже идет, не вышел cooldown или
+    // профилирование по триггерам не запущено. reason попадает в имя файла
+    bool triggerCapture(const std::string& reason);
+    // <профиль>.collapsed и SVG в вызывающем потоке. Принимает CPU- и
+    // heap-профили (для heap - и префикс, берется последний дамп) и готовые
+    // .collapsed. Бросает std::runtime_error при ошибке
     void generateFlameGraph(const std::string& profile_path);
+    // То же в фоновом потоке; очередь ограничена, лишнее отбрасывается
+    void queueFlameGraph(const std::string& profile_path);
+    // Дерево участков HotPathAnalyzer в формате collapsed stacks, SVG -
+    // в фоне. Возвращает путь файла, бросает std::runtime_error при ошибке записи
+    std::string writeScopeProfile();
 
 private:
     void continuousProfilingLoop();
+    void renderLoop();
+    void captureLoop();
     std::string getProfilePath(ProfileType type);
+    std::string timestampedPath(const std::string& prefix) const;
     void setupProfilerOptions();
 
     std::string output_dir_;
@@ -39,6 +79,26 @@ private:
     ProfileType continuous_type_;
     std::chrono::seconds continuous_interval_;
 
+    // Поток отрисовки flamegraph
+    std::mutex render_mutex_;
+    std::condition_variable render_cv_;
+    std::deque<std::string> render_queue_;
+    bool render_stopping_{false};
+    std::thread render_thread_;
+    // Захват по триггеру; под capture_mutex_
+    std::mutex capture_mutex_;
+    std::condition_variable capture_cv_;
+    TriggerConfig trigger_config_;
+    std::unique_ptr<StackSampler> sampler_;
+    std::string capture_reason_;  // непусто, пока идет захват
+    bool capture_stopping_{false};
+    std::chrono::steady_clock::time_point last_capture_{};
+    std::thread capture_thread_;
+    // Кэш символов между профилями; под symbolizer_mutex_
+    std::mutex symbolizer_mutex_;
+    ProfileSymbolizer symbolizer_;
+
     static constexpr int kProfilerFrequency = 1000;  // 1000Hz sampling
     static constexpr int kHeapSamplingInterval = 524288;  // 512KB
+    static constexpr size_t kMaxQueuedRenders = 8;
 }; 
\ No newline at end of file
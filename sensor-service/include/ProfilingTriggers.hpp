@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "HotMetrics.hpp"
+
+// Условия, при которых стоит снять профиль: нарушение SLO по задержке
+// или признаки перегрузки. Каждый вызов evaluate() сравнивает показатели
+// с прошлым вызовом, так что зовется периодически из одного потока.
+class ProfilingTriggers {
+public:
+    struct Config {
+        // p99 задержки от чтения до ack; 0 отключает
+        std::chrono::milliseconds latency_p99{1000};
+        // Задержки выборочные: пока образцов меньше, они копятся между вызовами
+        uint64_t min_latency_samples = 50;
+        // Доля заполнения буферов обработчиков; 0 отключает
+        double buffer_occupancy = 0.75;
+        // Доля всех ядер, занятая процессом; 0 отключает
+        double cpu_usage = 0.9;
+    };
+
+    // Бросает std::invalid_argument при отрицательных порогах или долях больше 1
+    explicit ProfilingTriggers(Config config);
+
+    // Причина захвата ("latency_p99", "buffer_occupancy", "cpu_usage") или
+    // пустая строка. latency - некумулятивная гистограмма в секундах
+    std::string evaluate(const HotHistogram& latency, double buffer_occupancy);
+
+private:
+    // p99 по приросту корзин с прошлой оценки, с; отрицательное - образцов мало
+    double latencyP99(const HotHistogram& latency);
+    // Доля доступных процессу ядер (привязка и квота cgroup) с прошлого
+    // вызова; отрицательное - первый вызов
+    double cpuUsage();
+
+    const Config config_;
+    std::vector<uint64_t> latency_baseline_;
+    std::vector<uint64_t> latency_buckets_;
+    std::chrono::steady_clock::time_point cpu_wall_{};
+    std::chrono::microseconds cpu_time_{0};
+};
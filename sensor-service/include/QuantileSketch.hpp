@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Скетч квантилей с относительной погрешностью (по схеме DDSketch).
+// Значение попадает в корзину ceil(log_gamma |x|), gamma = (1+a)/(1-a),
+// так что любой квантиль отличается от точного не больше чем на долю a.
+// Скетчи с одинаковой точностью сливаются без потерь: счетчики корзин
+// просто складываются, поэтому можно собирать общий квантиль по потокам
+// или интервалам.
+//
+// Память ограничена max_bins корзинами на знак; при переполнении
+// сливаются корзины самых малых по модулю значений, и страдает точность
+// только нижних квантилей. Не потокобезопасен.
+class QuantileSketch {
+public:
+    explicit QuantileSketch(double relative_accuracy = 0.01, size_t max_bins = 512);
+
+    // NaN пропускается
+    void add(double value);
+    // Бросает std::invalid_argument, если точность скетчей разная
+    void merge(const QuantileSketch& other);
+
+    // q в [0, 1]; NaN для пустого скетча
+    double quantile(double q) const;
+    // Несколько квантилей за один проход; qs по возрастанию
+    void quantiles(const double* qs, size_t count, double* out) const;
+
+    uint64_t count() const { return count_; }
+    double relativeAccuracy() const { return relative_accuracy_; }
+
+private:
+    // Плотный массив счетчиков с индекса offset
+    struct Store {
+        int32_t offset{0};
+        std::vector<uint64_t> bins;
+
+        void add(int32_t index, uint64_t count, size_t max_bins);
+    };
+
+    int32_t indexOf(double magnitude) const;
+    double valueOf(int32_t index) const;
+
+    double relative_accuracy_;
+    double gamma_;
+    double log_gamma_;
+    size_t max_bins_;
+
+    Store positive_;
+    Store negative_;  // по модулю
+    uint64_t zero_count_{0};
+    uint64_t count_{0};
+};
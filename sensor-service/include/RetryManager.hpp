@@ -3,6 +3,7 @@
 #include <chrono>
 #include <random>
 #include <functional>
+#include <thread>
 
 class RetryManager {
 public:
@@ -15,9 +16,13 @@ public:
     template<typename Func>
     bool executeWithRetry(Func&& func);
 
-private:
+    // Экспоненциальная задержка перед попыткой attempt (с нуля) с разбросом ±25%.
+    // Не потокобезопасна: генератор случайных чисел общий
     std::chrono::milliseconds calculateDelay(int attempt);
-    
+    int maxRetries() const { return max_retries_; }
+
+private:
+
     const int max_retries_;
     const std::chrono::milliseconds initial_delay_;
     const std::chrono::milliseconds max_delay_;
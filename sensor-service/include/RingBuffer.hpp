@@ -0,0 +1,218 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Индексы производителя и потребителя разнесены по разным кэш-линиям,
+// чтобы потоки не инвалидировали линии друг друга (false sharing)
+inline constexpr size_t kCacheLineSize = 64;
+
+inline size_t roundUpToPowerOfTwo(size_t n) {
+    size_t result = 1;
+    while (result < n) {
+        result <<= 1;
+    }
+    return result;
+}
+
+// Кольцевой буфер без блокировок для одного производителя и одного потребителя.
+// Память под все слоты выделяется один раз в конструкторе.
+template<typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity);
+
+    bool tryPush(const T& item);
+    bool tryPop(T& item);
+    // Пакетные операции публикуют индекс один раз на весь пакет
+    size_t tryPushBatch(const T* items, size_t count);
+    size_t tryPopBatch(T* out, size_t max_count);
+    size_t size() const;
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    const size_t mask_;
+    std::unique_ptr<T[]> slots_;
+
+    // Сторона потребителя
+    alignas(kCacheLineSize) std::atomic<size_t> head_{0};
+    size_t cached_tail_{0};
+
+    // Сторона производителя
+    alignas(kCacheLineSize) std::atomic<size_t> tail_{0};
+    size_t cached_head_{0};
+};
+
+template<typename T>
+SpscRing<T>::SpscRing(size_t capacity)
+    : mask_(roundUpToPowerOfTwo(capacity) - 1)
+    , slots_(std::make_unique<T[]>(mask_ + 1))
+{}
+
+template<typename T>
+bool SpscRing<T>::tryPush(const T& item) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ > mask_) {
+        // Перечитываем голову только когда кэшированное значение говорит "полон"
+        cached_head_ = head_.load(std::memory_order_acquire);
+        if (tail - cached_head_ > mask_) {
+            return false;
+        }
+    }
+
+    slots_[tail & mask_] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool SpscRing<T>::tryPop(T& item) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+        cached_tail_ = tail_.load(std::memory_order_acquire);
+        if (head == cached_tail_) {
+            return false;
+        }
+    }
+
+    item = slots_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+size_t SpscRing<T>::tryPushBatch(const T* items, size_t count) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t free_slots = capacity() - (tail - cached_head_);
+    if (free_slots < count) {
+        cached_head_ = head_.load(std::memory_order_acquire);
+        free_slots = capacity() - (tail - cached_head_);
+    }
+
+    const size_t n = count < free_slots ? count : free_slots;
+    for (size_t i = 0; i < n; ++i) {
+        slots_[(tail + i) & mask_] = items[i];
+    }
+    if (n > 0) {
+        tail_.store(tail + n, std::memory_order_release);
+    }
+    return n;
+}
+
+template<typename T>
+size_t SpscRing<T>::tryPopBatch(T* out, size_t max_count) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    size_t available = cached_tail_ - head;
+    if (available < max_count) {
+        cached_tail_ = tail_.load(std::memory_order_acquire);
+        available = cached_tail_ - head;
+    }
+
+    const size_t n = max_count < available ? max_count : available;
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = slots_[(head + i) & mask_];
+    }
+    if (n > 0) {
+        head_.store(head + n, std::memory_order_release);
+    }
+    return n;
+}
+
+template<typename T>
+size_t SpscRing<T>::size() const {
+    const size_t head = head_.load(std::memory_order_acquire);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    return tail >= head ? tail - head : 0;
+}
+
+// Ограниченная MPMC очередь (схема Вьюкова): у каждого слота свой номер
+// последовательности, производители и потребители захватывают позиции CAS-ом.
+template<typename T>
+class MpmcRing {
+public:
+    explicit MpmcRing(size_t capacity);
+
+    bool tryPush(const T& item);
+    bool tryPop(T& item);
+    size_t size() const;
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    const size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+
+    alignas(kCacheLineSize) std::atomic<size_t> head_{0};
+    alignas(kCacheLineSize) std::atomic<size_t> tail_{0};
+};
+
+template<typename T>
+MpmcRing<T>::MpmcRing(size_t capacity)
+    : mask_(roundUpToPowerOfTwo(capacity) - 1)
+    , slots_(std::make_unique<Slot[]>(mask_ + 1))
+{
+    for (size_t i = 0; i <= mask_; ++i) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+template<typename T>
+bool MpmcRing<T>::tryPush(const T& item) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &slots_[pos & mask_];
+        const size_t seq = slot->sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = tail_.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->value = item;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool MpmcRing<T>::tryPop(T& item) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &slots_[pos & mask_];
+        const size_t seq = slot->sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0) {
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+
+    item = slot->value;
+    slot->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+size_t MpmcRing<T>::size() const {
+    const size_t head = head_.load(std::memory_order_acquire);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    return tail >= head ? tail - head : 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "SensorManager.hpp"
+
+// Отсев измерений, не несущих новой информации, до буфера отправки.
+//
+// DEADBAND: измерение отправляется, если отличается от последнего
+// отправленного больше порога. Порог - max(absolute, percent% от
+// последнего отправленного); при обоих нулях отправляется любое изменение.
+//
+// SWINGING_DOOR: сжатие «вращающейся дверью». Отправленные точки
+// образуют ломаную, от которой ни одно отброшенное измерение не отходит
+// больше порога. Точка отправляется с опозданием на одно измерение: только
+// когда следующее показывает, что линию дальше не продлить.
+//
+// NaN и бесконечности в обоих режимах отправляются при переходе в них и
+// обратно, а их повторы отсеиваются.
+//
+// max_silence - heartbeat: если столько времени ничего не отправлялось,
+// текущее измерение уходит без проверки порога.
+//
+// Не потокобезопасен: у каждого потока опроса свой экземпляр, а датчик
+// всегда опрашивается одним потоком.
+class SampleFilter {
+public:
+    enum class Mode {
+        NONE,
+        DEADBAND,
+        SWINGING_DOOR
+    };
+
+    struct Policy {
+        Mode mode = Mode::NONE;
+        double absolute = 0.0;
+        double percent = 0.0;
+        // 0 - без heartbeat
+        std::chrono::milliseconds max_silence{0};
+    };
+
+    struct Config {
+        Policy default_policy;
+        std::unordered_map<int, Policy> sensor_policies;
+    };
+
+    struct Stats {
+        uint64_t forwarded{0};
+        uint64_t suppressed{0};
+    };
+
+    // Бросает std::invalid_argument при отрицательных порогах
+    explicit SampleFilter(Config config);
+
+    // true, если хотя бы один датчик фильтруется
+    bool enabled() const;
+
+    // Дописывает в out измерения, которые нужно отправить, в порядке времени.
+    // Возвращает счетчики этого вызова
+    Stats filter(const SensorData* data, size_t count, std::vector<SensorData>& out);
+    // Дописывает в out точки, придержанные дверью, если после них измерений
+    // не было раньше before: иначе замолчавший датчик их так и не отправит
+    Stats flushHeld(std::chrono::system_clock::time_point before, std::vector<SensorData>& out);
+    // Удаленный датчик: придержанная точка дописывается в out, состояние забывается
+    Stats remove(int sensor_id, std::vector<SensorData>& out);
+
+private:
+    struct SensorState {
+        bool has_forwarded{false};
+        // Последнее отправленное; для SWINGING_DOOR - вершина двери
+        SensorData forwarded{};
+        // SWINGING_DOOR: последнее измерение внутри двери, еще не отправлено
+        bool has_held{false};
+        SensorData held{};
+        // Допустимые наклоны линии от вершины, в единицах значения на мс
+        double upper_slope{0.0};
+        double lower_slope{0.0};
+    };
+
+    const Policy& policyFor(int sensor_id) const;
+    bool deadband(const Policy& policy, SensorState& state, const SensorData& data);
+    void swingingDoor(const Policy& policy, SensorState& state, const SensorData& data,
+                      std::vector<SensorData>& out, Stats& stats);
+    static double threshold(const Policy& policy, double reference);
+    static bool silenceExpired(const Policy& policy, const SensorState& state, const SensorData& data);
+
+    const Config config_;
+    std::unordered_map<int, SensorState> sensors_;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "SensorManager.hpp"
+
+// Компактный бинарный формат пакета измерений (версия 1).
+//
+// Заголовок:
+//     magic "WPSB" | version:u8 | flags:u8 | record_count:varint
+//     | series_count:varint | base_timestamp_ms:zigzag varint
+// Далее по одной серии на датчик (датчики по возрастанию id,
+// внутри серии исходный порядок измерений сохраняется):
+//     sensor_id:zigzag varint | count:varint
+//     | count x zigzag varint - дельта времени в мс от предыдущего
+//       измерения серии (первое - от base_timestamp_ms)
+//     | битовый поток значений (Gorilla XOR, старший бит первым),
+//       выровненный до целого байта
+//
+// Кодек не потокобезопасен: он переиспользует внутренние буферы.
+class SensorBatchCodec {
+public:
+    static constexpr char kMagic[4] = {'W', 'P', 'S', 'B'};
+    static constexpr uint8_t kVersion = 1;
+
+    // Перезаписывает out закодированным пакетом
+    void encode(const std::vector<SensorData>& batch, std::string& out);
+
+    // Добавляет записи пакета в out. Бросает std::runtime_error
+    // при неизвестной версии или поврежденных данных
+    static void decode(const uint8_t* data, size_t size, std::vector<SensorData>& out);
+
+    static bool isBatch(const uint8_t* data, size_t size);
+
+private:
+    std::vector<uint32_t> order_;
+};
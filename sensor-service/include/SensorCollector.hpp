@@ -0,0 +1,33 @@
+#pragma once
+
+#include <prometheus/collectable.h>
+#include <prometheus/metric_family.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "SensorManager.hpp"
+
+// Метрики sensor_value и sensor_status, которые строятся из текущего
+// состояния SensorManager в момент scrape, а не обновляются циклом
+// мониторинга: значения не отстают на период цикла, и между scrape
+// работы нет совсем. Строка метки sensor_id создается один раз на датчик.
+class SensorCollector : public prometheus::Collectable {
+public:
+    // manager должен жить, пока не вызван detach()
+    explicit SensorCollector(const SensorManager& manager);
+
+    // Дальше Collect() отдает пустой список. Ждет идущий scrape, так что
+    // после возврата менеджер можно разрушать
+    void detach();
+
+    std::vector<prometheus::MetricFamily> Collect() const override;
+
+private:
+    const std::string& labelFor(int sensor_id) const;
+
+    mutable std::mutex mutex_;
+    const SensorManager* manager_;
+    // Кэш строк sensor_id; чистится, когда разрастается из-за удаленных датчиков
+    mutable std::unordered_map<int, std::string> labels_;
+};
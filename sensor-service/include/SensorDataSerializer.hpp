@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include "SensorManager.hpp"
+#include "WindowAggregator.hpp"
+
+// Сериализация SensorData в JSON без выделения памяти на каждую запись.
+// Формат совпадает с nlohmann::json::dump() побайтно:
+//     {"sensor_id":1,"timestamp":1700000000000,"value":20.5}
+// Состояния нет: записи пишутся прямо в буферы пула продюсера.
+class SensorDataSerializer {
+public:
+    // Пишет запись в out (не меньше kMaxRecordSize байт), возвращает ее длину
+    static size_t serializeInto(const SensorData& data, char* out);
+
+    // Итог окна. timestamp и value - конец окна и среднее, поэтому
+    // потребитель, знающий только обычные записи, прочитает его как точку:
+    //     {"count":10,"last":21.0,"max":22.5,"mean":20.1,"min":18.0,"sensor_id":1,
+    //      "stddev":1.2,"timestamp":1700000001000,"value":20.1,"window_start":1700000000000}
+    static size_t serializeRollupInto(const SensorRollup& rollup, char* out);
+
+    // Верхняя граница длины одной записи
+    static constexpr size_t kMaxRecordSize = 128;
+    static constexpr size_t kMaxRollupSize = 384;
+
+private:
+    static char* writeRecord(char* out, const SensorData& data);
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Источник значений датчиков. Поток чтения передает за раз пачку датчиков,
+// сработавших в одном тике, так что драйвер может выполнить чтения
+// одним пакетом. У каждого потока чтения свой экземпляр драйвера,
+// поэтому реализациям не нужна потокобезопасность.
+class SensorDriver {
+public:
+    virtual ~SensorDriver() = default;
+
+    // Заполняет values[i] и ok[i] для ids[i]; векторы изменяются до ids.size().
+    // ok[i] == 0 - датчик не прочитан, values[i] не определено
+    virtual void readBatch(
+        const std::vector<int>& ids,
+        std::vector<double>& values,
+        std::vector<uint8_t>& ok
+    ) = 0;
+};
+
+// Демо-драйвер: нормальное распределение вокруг 20.0
+class RandomSensorDriver : public SensorDriver {
+public:
+    void readBatch(
+        const std::vector<int>& ids,
+        std::vector<double>& values,
+        std::vector<uint8_t>& ok
+    ) override;
+
+private:
+    std::mt19937 gen_{std::random_device{}()};
+    std::normal_distribution<> dis_{20.0, 5.0};
+};
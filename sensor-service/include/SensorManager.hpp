@@ -3,35 +3,173 @@
 #include <vector>
 #include <string>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+#include "LatencyTracker.hpp"
+#include "SensorDriver.hpp"
+#include "SensorRegistry.hpp"
+#include "TimerWheel.hpp"
+
+class Metrics;
 
 struct SensorData {
     int sensor_id;
+    // Трасса LatencyTracker, 0 - образец не в выборке. Занимает
+    // выравнивание после sensor_id и не увеличивает запись
+    uint32_t trace;
     double value;
     std::chrono::system_clock::time_point timestamp;
 };
 
+// Опрос датчиков по расписанию. Датчики поровну делятся между потоками
+// опроса; у каждого потока свой непрерывный кусок состояния (SensorRegistry)
+// и свое колесо таймеров с абсолютными сроками, поэтому период не
+// накапливает время чтения и не дрейфует. Сами чтения, которые могут
+// блокироваться, поток опроса пачками до kReadChunk датчиков отдает общему
+// пулу чтения и не ждет их: медленное чтение задерживает только свою пачку.
+// У датчика не больше одного чтения в работе; если предыдущее не успело,
+// очередной опрос пропускается. Готовые пачки поток опроса разбирает сам
+// и отдает каждую одним вызовом колбэка.
 class SensorManager {
 public:
-    using SensorCallback = std::function<void(const SensorData&)>;
+    // Измерения одного пробуждения потока опроса. Вызывается из разных
+    // потоков опроса, но измерения одного датчика всегда из одного;
+    // thread - номер потока, 0..pollingThreads()-1
+    using BatchCallback = std::function<void(size_t thread, const SensorData* data, size_t count)>;
+    // Создает драйвер для одного потока чтения
+    using DriverFactory = std::function<std::unique_ptr<SensorDriver>()>;
+
+    // Снимок состояния датчика для мониторинга
+    struct SensorState {
+        int id;
+        double value;
+        std::chrono::system_clock::time_point last_seen;
+        std::chrono::milliseconds interval;
+        bool online;
+
+        double getCurrentValue() const { return value; }
+        bool isOnline() const { return online; }
+    };
 
     SensorManager(int polling_interval_ms = 100);
     ~SensorManager();
 
-    void addSensor(int sensor_id);
+    // Можно вызывать и во время работы. interval <= 0 - интервал по умолчанию
+    // из конструктора. phase сдвигает первый опрос от start(), чтобы разнести
+    // датчики с одинаковым периодом. false - датчик с таким id уже есть
+    bool addSensor(
+        int sensor_id,
+        std::chrono::milliseconds interval = std::chrono::milliseconds(0),
+        std::chrono::milliseconds phase = std::chrono::milliseconds(0)
+    );
+    bool removeSensor(int sensor_id);
+    size_t sensorCount() const;
+    std::vector<SensorState> getSensors() const;
+    // Обходит состояние датчиков без копии всего списка: порции по
+    // kVisitChunk копируются под мьютексом шарда, visitor зовется уже без
+    // мьютексов. Датчик, удаленный или добавленный во время обхода, может
+    // в него не попасть
+    void visitSensors(const std::function<void(const SensorState& sensor)>& visitor) const;
+
     void start();
     void stop();
-    void setCallback(SensorCallback callback);
+    void setBatchCallback(BatchCallback callback);
+    // Вызывать до start(); уже добавленные датчики перераспределяются
+    void setPollingThreads(size_t count);
+    size_t pollingThreads() const;
+    // Вызывать до start(). Потоков чтения, у каждого свой драйвер
+    void setReadWorkers(size_t count);
+    size_t readWorkers() const;
+    // Вызывать до start(). По умолчанию - RandomSensorDriver
+    void setDriverFactory(DriverFactory factory);
+    // Куда экспортировать джиттер расписания. Metrics должен пережить менеджер
+    void setMetrics(Metrics* metrics);
+    // Вызывать до start(): каждому sampleEvery()-му образцу потока опроса
+    // заводится трасса задержек. Трекер должен пережить менеджер
+    void setLatencyTracker(LatencyTracker* tracker);
 
 private:
-    void pollingSensorLoop();
-    double readSensorValue(int sensor_id);
+    struct Shard;
+
+    // Пачка чтений одного пробуждения шарда. Переиспользуется через
+    // Shard::spare, чтобы не выделять векторы на каждый опрос
+    struct ReadJob {
+        Shard* shard{nullptr};
+        // Индексы в registry на момент постановки; могут сдвинуться
+        std::vector<uint32_t> due;
+        std::vector<int> ids;
+        std::vector<double> values;
+        std::vector<uint8_t> read_ok;
+        std::chrono::system_clock::time_point timestamp;
+        std::chrono::steady_clock::time_point read_time;
+    };
+
+    struct Shard {
+        size_t index{0};
+        // Защищает registry, wheel и чтения в работе: registry и wheel
+        // меняют addSensor/removeSensor, готовые пачки кладет пул чтения
+        mutable std::mutex mutex;
+        std::condition_variable changed;
+        SensorRegistry registry;
+        TimerWheel wheel;
+        std::unordered_set<int> reading;
+        std::deque<std::unique_ptr<ReadJob>> completed;
+        std::vector<std::unique_ptr<ReadJob>> spare;
+        std::thread thread;
+
+        // Только поток шарда: сработавшие за пробуждение датчики
+        std::vector<uint32_t> due;
+        std::vector<SensorData> batch;
+        uint32_t since_trace{0};
+    };
+
+    void createShards(size_t count);
+    void pollingLoop(Shard& shard);
+    // Ставит сработавшие датчики в пул чтения. Под мьютексом шарда
+    void dispatchReads(Shard& shard);
+    // Разбирает готовую пачку; lock - мьютекс шарда, отпускается на колбэк
+    void deliverReads(Shard& shard, std::unique_ptr<ReadJob> job, std::unique_lock<std::mutex>& lock);
+    void readWorkerLoop(SensorDriver& driver);
+    static void readJob(SensorDriver& driver, ReadJob& job);
+    TimerWheel::Tick toTick(std::chrono::steady_clock::time_point time) const;
+    std::chrono::steady_clock::time_point fromTick(TimerWheel::Tick tick) const;
+
+    // Разрешение колеса
+    static constexpr std::chrono::milliseconds kTick{1};
+    // Датчик считается офлайн, если не отвечал дольше стольких интервалов
+    static constexpr int kOfflineAfterIntervals = 3;
+    // Больше датчиков в одной пачке чтения
+    static constexpr size_t kReadChunk = 64;
+    // Столько датчиков visitSensors копирует за одно взятие мьютекса шарда
+    static constexpr size_t kVisitChunk = 256;
 
-    std::vector<int> sensor_ids_;
     int polling_interval_ms_;
-    SensorCallback callback_;
+    BatchCallback callback_;
+    DriverFactory driver_factory_;
+    Metrics* metrics_{nullptr};
+    LatencyTracker* latency_{nullptr};
+    const std::chrono::steady_clock::time_point epoch_{std::chrono::steady_clock::now()};
+
+    // Порядок блокировок: registry_mutex_, затем мьютекс шарда
+    mutable std::mutex registry_mutex_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::unordered_map<int, uint32_t> shard_of_;
+
+    // Пул чтения общий для всех шардов
+    size_t read_worker_count_{4};
+    std::vector<std::unique_ptr<SensorDriver>> read_drivers_;
+    std::vector<std::thread> read_workers_;
+    std::mutex read_mutex_;
+    std::condition_variable read_ready_;
+    std::deque<std::unique_ptr<ReadJob>> read_queue_;
+    bool read_pool_running_{false};
+
     std::atomic<bool> running_{false};
-    std::thread polling_thread_;
-}; 
\ No newline at end of file
+};
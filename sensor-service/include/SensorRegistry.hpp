@@ -0,0 +1,45 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "TimerWheel.hpp"
+
+// Состояние датчиков в виде структуры массивов: цикл опроса проходит только
+// по нужным ему колонкам подряд. Добавление и удаление - O(1): на место
+// удаленного встает последний датчик, индекс по id ищется в хеш-таблице.
+// Индекс датчика меняется только при удалении другого датчика.
+// Не потокобезопасен - владелец защищает его сам.
+class SensorRegistry {
+public:
+    using Tick = TimerWheel::Tick;
+
+    enum class Status : uint8_t {
+        UNKNOWN,    // еще не опрашивался
+        ONLINE,
+        OFFLINE     // последнее чтение завершилось ошибкой
+    };
+
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    // Возвращает индекс нового датчика или npos, если id уже есть
+    uint32_t add(int id, Tick interval, Tick phase);
+    // Удаляет датчик index. Возвращает прежний индекс датчика, переехавшего
+    // на его место (он же новый size()), или npos, если никто не переезжал
+    uint32_t removeAt(uint32_t index);
+    uint32_t indexOf(int id) const;
+    size_t size() const { return ids.size(); }
+
+    // Колонки; i-й элемент каждой относится к одному датчику
+    std::vector<int> ids;
+    std::vector<Tick> intervals;
+    std::vector<Tick> phases;
+    std::vector<Tick> next_deadlines;
+    std::vector<double> last_values;
+    std::vector<std::chrono::system_clock::time_point> last_seen;
+    std::vector<Status> statuses;
+
+private:
+    std::unordered_map<int, uint32_t> index_;
+};
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AlertRuleEngine.hpp"
+#include "DataBuffer.hpp"
+#include "KafkaProducer.hpp"
+#include "LatencyTracker.hpp"
+#include "Profiler.hpp"
+#include "ProfilingTriggers.hpp"
+#include "SampleFilter.hpp"
+#include "SensorBatchCodec.hpp"
+#include "SensorCollector.hpp"
+#include "SensorDataSerializer.hpp"
+#include "SensorManager.hpp"
+#include "SensorStatistics.hpp"
+#include "SpillLog.hpp"
+#include "Tracer.hpp"
+#include "WindowAggregator.hpp"
+
+class Metrics;
+class AlertManager;
+class SystemMonitor;
+class ProfileEndpoint;
+
+class SensorService {
+public:
+    enum class WireFormat {
+        JSON,           // одно JSON-сообщение на измерение
+        BINARY_BATCH    // один пакет SensorBatchCodec на пачку измерений
+    };
+
+    SensorService(
+        const std::string& kafka_brokers,
+        const std::string& topic,
+        int polling_interval_ms = 100
+    );
+    ~SensorService();
+
+    // Можно вызывать и во время работы; см. SensorManager::addSensor
+    bool addSensor(
+        int sensor_id,
+        std::chrono::milliseconds interval = std::chrono::milliseconds(0),
+        std::chrono::milliseconds phase = std::chrono::milliseconds(0)
+    );
+    bool removeSensor(int sensor_id);
+    // Вызывать до start()
+    void setWireFormat(WireFormat format);
+    // Число потоков обработки, вызывать до start(). Датчик закреплен за одним
+    // потоком, поэтому его измерения уходят в Kafka в порядке опроса
+    void setProcessingWorkers(size_t count);
+    // Число потоков опроса датчиков, вызывать до start()
+    void setPollingThreads(size_t count);
+    // Число потоков чтения датчиков, вызывать до start()
+    void setReadWorkers(size_t count);
+    // Источник значений, вызывать до start(). Фабрика вызывается по разу на
+    // поток чтения, например для SysfsSensorDriver
+    void setSensorDriverFactory(SensorManager::DriverFactory factory);
+    // Журнал переполнения, вызывать до start(). У каждого обработчика свой
+    // подкаталог shard-N; пустой directory отключает журнал, и тогда
+    // переполненный буфер, как раньше, блокирует опрос
+    void setSpillConfig(SpillLog::Config config);
+    // Агрегация по окнам перед отправкой в Kafka, вызывать до start().
+    // Итоги окон всегда уходят JSON-записями, независимо от формата сырых.
+    // Бросает std::invalid_argument при неверной политике
+    void setRollupConfig(WindowAggregator::Config config);
+    // Отсев неизменившихся значений до буфера, вызывать до start().
+    // Датчики с окнами агрегации не фильтруются: итоги окон считаются по
+    // всем измерениям. Бросает std::invalid_argument при неверной политике
+    void setFilterConfig(SampleFilter::Config config);
+    // Потоковая статистика и поиск аномалий, вызывать до start().
+    // Статистика видит все измерения, до фильтра
+    void setStatisticsConfig(SensorStatistics::Config config);
+    // Файл правил алертов в формате Prometheus (alert_rules.yml), вызывать
+    // до start(). Изменения файла подхватываются на ходу; пустой путь
+    // отключает правила
+    void setAlertRulesPath(std::string path);
+    // Выборка образцов для задержек по этапам, вызывать до start().
+    // sample_every = 0 отключает трассы
+    void setLatencyTracing(LatencyTracker::Config config);
+    // Выборка и экспорт спанов OpenTelemetry, вызывать до start()
+    void setTracingConfig(Tracer::Config config);
+    // Профили по триггерам, вызывать до start(). Сэмплер работает всегда, а
+    // при нарушении порогов его кольцо и полный CPU-профиль пишутся в profiles/.
+    // Бросает std::invalid_argument при неверных порогах
+    void setProfilingTriggers(ProfilingTriggers::Config triggers,
+                              Profiler::TriggerConfig capture = {});
+    // Захват по запросу: SIGUSR2 или GET /profile, если он включен.
+    // false - уже идет захват, не вышел cooldown или сервис не запущен
+    bool requestProfile(const std::string& reason = "manual");
+    // GET /profile на адресе экспортера метрик, вызывать до start(). По
+    // умолчанию выключен: авторизации нет, и захват может запустить любой,
+    // кто достучится до порта экспортера (см. Metrics). Включать, только
+    // если порт закрыт от чужих
+    void enableProfileEndpoint();
+    void start();
+    void stop();
+
+private:
+    // Шард конвейера: своя очередь и свой поток обработки
+    struct ProcessingWorker {
+        size_t index;
+        std::unique_ptr<DataBuffer> buffer;
+        // Разделяется с группами доставки, которые подтверждают воспроизведенное
+        std::shared_ptr<SpillLog> spill;
+        // Пакет из журнала: сдвигает позицию чтения по отчетам о доставке
+        // его сообщений; nullptr - пакет из памяти
+        DeliveryGroup* replay{nullptr};
+        // Выше этого заполнения буфера новые образцы уходят в журнал
+        size_t high_water{0};
+        // Пока журнал не опустеет, пишем в него, иначе новые образцы
+        // обогнали бы пролитые. Меняется под spill_mutex
+        std::atomic<bool> spilling{false};
+        std::mutex spill_mutex;
+        // nullptr, если все датчики отправляются как есть
+        std::unique_ptr<WindowAggregator> aggregator;
+        std::chrono::steady_clock::time_point next_rollup_flush;
+        uint64_t reported_late_samples{0};
+        std::thread thread;
+
+        // Переиспользуемые между итерациями буферы потока обработки
+        std::vector<SensorData> batch;
+        std::vector<SensorRollup> rollups;
+        std::vector<KafkaProducer::Buffer*> messages;
+        SensorBatchCodec batch_codec;
+        std::string encoded_batch;
+        std::string batch_key;  // ключ Kafka для пакетов BINARY_BATCH
+    };
+
+    // Состояние потока опроса: поток пишет только в свое
+    struct PollingState {
+        SensorStatistics statistics;
+        std::vector<SensorStatistics::Anomaly> anomalies;
+        // nullptr, если фильтрация выключена. Кроме потока опроса фильтр
+        // трогают removeSensor, мониторинг и stop(), поэтому он под мьютексом.
+        // Выпущенные фильтром точки буферизуются, пока мьютекс еще взят
+        std::unique_ptr<SampleFilter> filter;
+        std::mutex filter_mutex;
+        std::vector<SensorData> passed;
+
+        explicit PollingState(const SensorStatistics::Config& config) : statistics(config) {}
+    };
+
+    void createWorkers(size_t count);
+    void createPollingStates(size_t count);
+    void reportAnomalies(const std::vector<SensorStatistics::Anomaly>& anomalies);
+    ProcessingWorker& workerFor(int sensor_id);
+    size_t bufferedSamples() const;
+    SpillLog::Stats spillStats() const;
+
+    void handleSensorBatch(size_t thread, const SensorData* data, size_t count);
+    // true - образец ушел в журнал переполнения. Бросает при ошибке журнала
+    bool bufferSample(const SensorData& data);
+    // Отправляет точки, придержанные фильтром дольше before
+    void flushHeldSamples(std::chrono::system_clock::time_point before);
+    void bufferHeldSamples(const std::vector<SensorData>& samples, const SampleFilter::Stats& stats);
+    void processingLoop(ProcessingWorker& worker);
+    // Заменяет пакет измерениями, которые уходят как есть, и добавляет итоги окон
+    void aggregate(ProcessingWorker& worker);
+    void processBatch(ProcessingWorker& worker);
+    // Отмечает этап на образцах пакета, попавших в выборку
+    void markLatency(const std::vector<SensorData>& batch, LatencyTracker::Stage stage);
+    void monitoringLoop();
+
+    // Сколько образцов обработчик забирает из буфера за одно пробуждение
+    static constexpr size_t kMaxBatchSize = 512;
+    static constexpr std::chrono::milliseconds kBatchWait{100};
+    // Общая емкость очередей, делится между обработчиками поровну
+    static constexpr size_t kBufferCapacity = 100000;
+    // Доля емкости буфера, после которой включается журнал переполнения
+    static constexpr double kSpillHighWater = 0.9;
+    // Пауза обработчика, пока брокер не разгребет очередь
+    static constexpr std::chrono::milliseconds kBackpressureWait{50};
+    // Как часто закрывать по часам окна замолчавших датчиков
+    static constexpr std::chrono::milliseconds kRollupFlushInterval{1000};
+    // Сколько фильтр придерживает точку датчика, от которого нет измерений
+    static constexpr std::chrono::milliseconds kHeldSampleTimeout{10000};
+
+    // Metrics объявлен первым: поток продюсера пишет в него до самого разрушения
+    std::unique_ptr<Metrics> metrics_;
+    // Переживает продюсер и менеджер датчиков, которые в него пишут
+    std::unique_ptr<LatencyTracker> latency_;
+    std::unique_ptr<KafkaProducer> producer_;
+    std::unique_ptr<SensorManager> sensor_manager_;
+    // Экспортер держит только weak_ptr; отвязывается от менеджера в деструкторе
+    std::shared_ptr<SensorCollector> sensor_collector_;
+    std::unique_ptr<AlertManager> alert_manager_;
+    std::unique_ptr<AlertRuleEngine> alert_rules_;
+    std::unique_ptr<SystemMonitor> system_monitor_;
+    std::unique_ptr<Tracer> tracer_;
+    std::unique_ptr<Profiler> profiler_;
+    // Экспортер держит только weak_ptr; отвязывается в деструкторе
+    std::shared_ptr<ProfileEndpoint> profile_endpoint_;
+
+    WireFormat wire_format_{WireFormat::JSON};
+    size_t worker_count_{1};
+    SpillLog::Config spill_config_;
+    WindowAggregator::Config rollup_config_;
+    SampleFilter::Config filter_config_;
+    SensorStatistics::Config statistics_config_;
+    std::string alert_rules_path_{"alert_rules.yml"};
+    ProfilingTriggers::Config trigger_config_;
+    Profiler::TriggerConfig capture_config_;
+    std::atomic<bool> running_{false};
+    std::vector<std::unique_ptr<ProcessingWorker>> workers_;
+    // По одному на поток опроса
+    std::vector<std::unique_ptr<PollingState>> polling_states_;
+    std::thread monitoring_thread_;
+};
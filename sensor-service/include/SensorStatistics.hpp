@@ -0,0 +1,108 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "QuantileSketch.hpp"
+#include "SensorManager.hpp"
+
+// Потоковая статистика по каждому измерению каждого датчика:
+// - EWMA среднего и дисперсии (z-оценка относительно них);
+// - стохастические оценки медианы и MAD - устойчивая оценка, которую
+//   не раскачивает сам выброс;
+// - скетч квантилей (QuantileSketch).
+//
+// Состояние хранится по столбцам, а пакет обновляется в три прохода:
+// сбор столбцов датчиков пакета в плотные массивы, общий цикл без
+// ветвлений, который компилятор векторизует (SSE2/AVX на x86, NEON на
+// ARM), и раскладка результатов обратно.
+//
+// update() вызывает один поток опроса; snapshot() можно звать из любого
+// потока, он берет тот же мьютекс, что и update() на время пакета.
+class SensorStatistics {
+public:
+    struct Config {
+        // Вес нового измерения в EWMA
+        double alpha = 0.05;
+        // Шаг оценок медианы и MAD в долях текущего разброса
+        double robust_rate = 0.05;
+        // Пороги аномалии; 0 отключает проверку
+        double z_threshold = 5.0;
+        double robust_threshold = 7.0;
+        // Сколько измерений датчика накопить, прежде чем искать аномалии
+        uint32_t warmup_samples = 30;
+        double sketch_accuracy = 0.01;
+        // Датчики, чья статистика уходит в Prometheus (sensor_value_ewma,
+        // sensor_value_quantile). Ряды на каждый датчик - лишняя
+        // кардинальность, поэтому по умолчанию не экспортируется ни один;
+        // аномалии ищутся по всем
+        std::unordered_set<int> exported_sensors;
+    };
+
+    struct Anomaly {
+        int sensor_id;
+        double value;
+        double zscore;
+        double robust_score;  // (x - медиана) / (1.4826 * MAD)
+        std::chrono::system_clock::time_point timestamp;
+    };
+
+    struct Snapshot {
+        int sensor_id;
+        uint64_t count;
+        double mean;
+        double stddev;
+        double median;
+        double mad;
+        double p50;
+        double p90;
+        double p99;
+    };
+
+    // Бросает std::invalid_argument при неверной конфигурации
+    explicit SensorStatistics(Config config);
+
+    // Учитывает все конечные значения пакета; аномалии дописываются в anomalies
+    void update(const SensorData* data, size_t count, std::vector<Anomaly>& anomalies);
+
+    // Только датчики из exported_sensors
+    void snapshot(std::vector<Snapshot>& out) const;
+
+private:
+    // Общий цикл по плотным массивам одного прохода
+    void runKernel(size_t count);
+    uint32_t slotFor(int sensor_id, double first_value);
+
+    const Config config_;
+    mutable std::mutex mutex_;
+
+    // Состояние датчиков, столбец на величину
+    std::unordered_map<int, uint32_t> index_;
+    std::vector<int> ids_;
+    std::vector<double> samples_;
+    std::vector<double> means_;
+    std::vector<double> variances_;
+    std::vector<double> abs_deviations_;  // EWMA |x - mean|, запасной масштаб
+    std::vector<double> medians_;
+    std::vector<double> mads_;
+    std::vector<QuantileSketch> sketches_;
+    // Номер последнего пакета, в котором встречался датчик
+    std::vector<uint64_t> stamps_;
+    uint64_t batch_stamp_{0};
+
+    // Плотные массивы текущего прохода
+    std::vector<uint32_t> slots_;
+    std::vector<size_t> sources_;
+    std::vector<double> x_;
+    std::vector<double> n_;
+    std::vector<double> mean_;
+    std::vector<double> var_;
+    std::vector<double> abs_dev_;
+    std::vector<double> median_;
+    std::vector<double> mad_;
+    std::vector<double> z2_;      // z-оценка в квадрате со знаком
+    std::vector<double> robust_;
+};
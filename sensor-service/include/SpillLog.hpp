@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "SensorManager.hpp"
+
+// Журнал переполнения на диске: последовательность сегментов фиксированного
+// размера, отображенных в память (mmap). Запись - memcpy в отображение,
+// без системных вызовов на каждое измерение.
+//
+// Сегмент:
+//     заголовок 64 байта: magic "WPSL" | version:u32 | record_size:u32
+//         | reserved:u32 | sequence:u64 | created_ms:i64
+//         | read_offset:u64 (сколько записей уже доставлено)
+//     далее записи по 24 байта: timestamp_ns:i64 | value:f64
+//         | sensor_id:i32 | checksum:u32
+// Конец данных - первая запись с неверной контрольной суммой, так что
+// после рестарта журнал восстанавливается без отдельного индекса.
+//
+// Один писатель и один читатель (поток обработки); если пишут несколько
+// потоков, вызывающий сериализует append сам. Прочитанное остается на
+// диске, пока не подтверждено commit(): после падения до ответа брокера
+// оно воспроизводится снова (at-least-once).
+class SpillLog {
+public:
+    enum class FsyncPolicy {
+        NONE,       // сбрасывает ОС, переживает падение процесса, но не питания
+        ON_ROLL,    // msync при закрытии сегмента
+        INTERVAL    // msync записанного не реже fsync_interval
+    };
+
+    struct Config {
+        std::string directory;
+        size_t segment_size = 64 * 1024 * 1024;
+        // Старые непрочитанные сегменты удаляются сверх этих пределов
+        size_t max_bytes = 4ull * 1024 * 1024 * 1024;
+        std::chrono::seconds max_age{std::chrono::hours(24)};
+        FsyncPolicy fsync_policy = FsyncPolicy::ON_ROLL;
+        std::chrono::milliseconds fsync_interval{1000};
+    };
+
+    struct Stats {
+        uint64_t spilled{0};        // записано на диск
+        uint64_t replayed{0};       // прочитано обратно
+        uint64_t dropped{0};        // удалено по retention или из-за ошибок записи
+        uint64_t pending{0};        // ждут чтения
+        uint64_t bytes_on_disk{0};
+    };
+
+    // Открывает каталог и подхватывает сегменты, оставшиеся от прошлого запуска.
+    // Бросает std::runtime_error, если каталог недоступен
+    explicit SpillLog(Config config);
+    ~SpillLog();
+
+    SpillLog(const SpillLog&) = delete;
+    SpillLog& operator=(const SpillLog&) = delete;
+
+    // Писатель. false - запись не удалась (диск), измерение потеряно
+    bool append(const SensorData& data);
+
+    // Читатель: добавляет в out до max_n записей в порядке записи
+    size_t readBatch(std::vector<SensorData>& out, size_t max_n);
+    // Сквозной номер следующей читаемой записи; записи пакета readBatch -
+    // [позиция до вызова, позиция после). Только поток читателя
+    uint64_t readPosition() const { return read_position_; }
+    // Записи [begin, end) доставлены, их можно не воспроизводить после
+    // рестарта. Диапазоны могут приходить не по порядку, из любого потока:
+    // на диск попадает только непрерывно подтвержденное начало
+    void commit(uint64_t begin, uint64_t end);
+
+    // Применяет пределы хранения вне смены сегментов: иначе при тихом
+    // писателе старые сегменты не стареют. Из любого потока
+    void expire();
+
+    bool empty() const { return pending() == 0; }
+    uint64_t pending() const;
+    Stats getStats() const;
+
+private:
+    struct Segment;
+
+    std::shared_ptr<Segment> createSegment(uint64_t sequence);
+    std::shared_ptr<Segment> openSegment(const std::string& path);
+    void roll();
+    void applyRetention();
+    void removeSegment(Segment& segment, bool drop_unread);
+    void syncActive(bool force);
+    // Под commit_mutex_: read_offset по committed_ и удаление доставленных сегментов
+    void applyCommitted();
+
+    const Config config_;
+    const size_t records_per_segment_;
+
+    // Сегменты, которые читатель еще не начал; последний - активный для записи
+    mutable std::mutex segments_mutex_;
+    std::deque<std::shared_ptr<Segment>> segments_;
+    uint64_t next_sequence_{0};
+
+    // Состояние писателя
+    std::shared_ptr<Segment> active_;
+    size_t synced_records_{0};
+    uint32_t appends_since_sync_check_{0};
+    std::chrono::steady_clock::time_point last_sync_;
+
+    // Состояние читателя
+    std::shared_ptr<Segment> reading_;
+    uint64_t read_position_{0};
+
+    // Сегменты, из которых читали, но доставили не все. Позиция записи i
+    // сегмента - base + (i - offset)
+    struct Unacked {
+        std::shared_ptr<Segment> segment;
+        uint64_t base;    // позиция первой записи, прочитанной в этом запуске
+        size_t offset;    // read_offset, восстановленный из заголовка
+        bool finished;    // закрыт и прочитан до конца, records - все записи
+        size_t records;
+    };
+    std::mutex commit_mutex_;
+    std::deque<Unacked> unacked_;
+    uint64_t committed_{0};
+    // Подтвержденные после разрыва: begin -> end
+    std::map<uint64_t, uint64_t> committed_ranges_;
+
+    std::atomic<uint64_t> spilled_{0};
+    std::atomic<uint64_t> replayed_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> pending_{0};
+    std::atomic<uint64_t> bytes_on_disk_{0};
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <sys/types.h>
+
+// Постоянно включенный сэмплер стеков с низкой частотой. У каждого потока
+// свой таймер по его процессорному времени (timer_create с SIGEV_THREAD_ID,
+// свой real-time сигнал, а не SIGPROF gperftools), так что сигнал прерывает
+// именно тот поток, который тратил CPU. Таймер по времени всего процесса
+// на ядрах до 6.3 будил бы лидера группы потоков. Новые потоки находятся
+// раз в секунду по /proc/self/task. Обработчик кладет стек в кольцо за
+// последние window секунд; простаивающий процесс образцов не дает.
+//
+// Стек разматывается по указателям кадров, поэтому сервис собирается с
+// -fno-omit-frame-pointer; на кадре без указателя стек обрывается. Кадры
+// читаются через process_vm_readv: битый указатель обрывает стек, а не
+// роняет процесс. Так обработчик обходится async-signal-safe вызовами.
+//
+// Кольцо нужно, чтобы профиль, снятый по срабатыванию триггера, включал и
+// то, что происходило до него: writeProfile() выгружает образцы в формате
+// CPU-профиля gperftools, который дальше разбирает Profiler.
+class StackSampler {
+public:
+    struct Config {
+        // Образцов в секунду процессорного времени
+        int frequency_hz = 29;
+        // Сколько последних секунд процессорного времени хранит кольцо
+        std::chrono::seconds window{60};
+    };
+
+    // Бросает std::invalid_argument при неположительных частоте или окне
+    explicit StackSampler(Config config);
+    ~StackSampler();
+
+    StackSampler(const StackSampler&) = delete;
+    StackSampler& operator=(const StackSampler&) = delete;
+
+    // В процессе может работать один сэмплер: иначе std::logic_error.
+    // Бросает std::runtime_error, если таймер не создан
+    void start();
+    void stop();
+    bool running() const { return running_; }
+
+    // Образцы не старше since - в файл CPU-профиля gperftools; возвращает
+    // их число. Бросает std::runtime_error, если файл не записан
+    size_t writeProfile(const std::string& path, std::chrono::steady_clock::time_point since) const;
+
+private:
+    static constexpr int kMaxDepth = 64;
+
+    // Запись - seqlock: нечетный sequence - слот пишется
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<int64_t> stamp{0};  // steady_clock, нс
+        std::atomic<uint32_t> depth{0};
+        std::atomic<uintptr_t> pcs[kMaxDepth];
+    };
+
+    static void handleSignal(int signal, siginfo_t* info, void* context);
+    static int signalNumber();
+    void record(uintptr_t pc, uintptr_t frame, uintptr_t sp);
+    // Заводит таймеры новым потокам и удаляет таймеры завершившихся;
+    // возвращает число потоков с таймером
+    size_t syncThreadTimers();
+    void watchThreads();
+
+    const Config config_;
+    const size_t capacity_;
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<uint64_t> next_{0};
+    bool running_{false};
+
+    // Только поток наблюдения, а до его запуска и после остановки - start()/stop()
+    std::unordered_map<pid_t, timer_t> timers_;
+    std::thread watcher_;
+    std::mutex watcher_mutex_;
+    std::condition_variable watcher_wakeup_;
+    bool stopping_{false};
+
+    static std::atomic<StackSampler*> active_;
+    // Обработчики, которые могли увидеть active_ до его сброса: stop() ждет
+    // их, иначе сэмплер удалили бы под работающим обработчиком
+    static std::atomic<int> handlers_in_flight_;
+};
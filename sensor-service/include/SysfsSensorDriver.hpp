@@ -0,0 +1,74 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/uio.h>
+#include "SensorDriver.hpp"
+
+// Драйвер для файлов значений в стиле hwmon/sysfs/IIO: в файле одно число
+// текстом, каждое чтение с нулевого смещения дает свежее значение
+// (например /sys/class/hwmon/hwmon0/temp1_input в миллиградусах).
+//
+// Дескрипторы открываются при первом чтении и остаются открытыми; после
+// ошибки чтения файл переоткрывается на следующем опросе. Все чтения
+// пакета отправляются одним io_uring_enter, если ядро позволяет создать
+// кольцо, иначе - по preadv на файл.
+class SysfsSensorDriver : public SensorDriver {
+public:
+    struct Config {
+        // Путь к файлу датчика; "{id}" заменяется на sensor_id.
+        // Пустой - читаются только каналы, заданные через addChannel
+        std::string path_pattern;
+        // value = raw * scale + offset
+        double scale = 1.0;
+        double offset = 0.0;
+        // Глубина кольца; пакет больше этого отправляется частями
+        unsigned ring_entries = 256;
+        bool use_io_uring = true;
+    };
+
+    explicit SysfsSensorDriver(Config config);
+    ~SysfsSensorDriver() override;
+
+    // Явный файл для датчика, например IIO in_voltage0_raw со своим scale
+    void addChannel(int sensor_id, std::string path, double scale = 1.0, double offset = 0.0);
+
+    void readBatch(
+        const std::vector<int>& ids,
+        std::vector<double>& values,
+        std::vector<uint8_t>& ok
+    ) override;
+
+    bool usingIoUring() const { return ring_ != nullptr; }
+
+private:
+    class IoUring;
+
+    struct Channel {
+        std::string path;
+        double scale;
+        double offset;
+        int fd{-1};
+    };
+
+    // Текст значения короткий; остаток буфера - место под завершающий ноль
+    static constexpr size_t kReadSize = 63;
+
+    Channel* channelFor(int sensor_id);
+    void readWithIoUring(size_t count);
+    void readWithPreadv(size_t count);
+    void complete(size_t index, ssize_t result);
+
+    const Config config_;
+    std::unordered_map<int, Channel> channels_;
+    std::unique_ptr<IoUring> ring_;
+
+    // Состояние текущего пакета
+    std::vector<Channel*> batch_channels_;
+    std::vector<char> buffers_;
+    std::vector<iovec> iovecs_;
+    std::vector<double>* values_{nullptr};
+    std::vector<uint8_t>* ok_{nullptr};
+};
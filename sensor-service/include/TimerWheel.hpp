@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Иерархическое колесо таймеров: kLevels уровней по kSlots слотов,
+// слот уровня L покрывает kSlots^L тиков. Постановка и отмена - O(1),
+// таймер переносится на нижний уровень не больше kLevels - 1 раз.
+// Таймеры адресуются индексами, которые выдает вызывающий (0, 1, 2, ...),
+// списки слотов интрузивные, поэтому в работе колесо не выделяет память.
+// Не потокобезопасно.
+class TimerWheel {
+public:
+    using Tick = uint64_t;
+
+    static constexpr int kSlotBits = 6;
+    static constexpr int kSlots = 1 << kSlotBits;
+    static constexpr int kLevels = 4;
+
+    explicit TimerWheel(Tick now = 0) : current_(now) {}
+
+    // Ставит (или переставляет) таймер id на тик deadline. Прошедший
+    // deadline срабатывает при ближайшем advance
+    void schedule(uint32_t id, Tick deadline);
+    void cancel(uint32_t id);
+    bool scheduled(uint32_t id) const;
+
+    // Обрабатывает все тики до now включительно, вызывая fn(id, deadline)
+    // для сработавших таймеров. Из fn можно снова ставить таймеры
+    template<typename Fn>
+    void advance(Tick now, Fn&& fn);
+
+    // Не позже ближайшего срабатывания: до него можно спать.
+    // nullopt - таймеров нет
+    std::optional<Tick> nextWakeup() const;
+
+    Tick now() const { return current_; }
+
+private:
+    static constexpr uint32_t kNil = UINT32_MAX;
+    static constexpr Tick kSlotMask = kSlots - 1;
+
+    struct Node {
+        Tick deadline{0};
+        uint32_t prev{kNil};
+        uint32_t next{kNil};
+        int16_t level{-1};   // -1 - таймер не стоит
+        uint8_t slot{0};
+    };
+
+    void link(uint32_t id);
+    void unlink(uint32_t id);
+    // Пересыпает слот верхнего уровня на нижние
+    void cascade(int level, size_t slot);
+    // Снимает все таймеры слота нулевого уровня, возвращает голову списка
+    uint32_t detachSlot(size_t slot);
+
+    // Следующий необработанный тик
+    Tick current_;
+    std::vector<Node> nodes_;
+    std::array<std::array<uint32_t, kSlots>, kLevels> heads_ = [] {
+        std::array<std::array<uint32_t, kSlots>, kLevels> heads{};
+        for (auto& level : heads) {
+            level.fill(kNil);
+        }
+        return heads;
+    }();
+    // Бит на непустой слот, чтобы проскакивать пустые тики
+    std::array<uint64_t, kLevels> occupied_{};
+};
+
+template<typename Fn>
+void TimerWheel::advance(Tick now, Fn&& fn) {
+    while (current_ <= now) {
+        // Нижний уровень пуст - до следующего переноса срабатывать нечему
+        if ((current_ & kSlotMask) != 0 && occupied_[0] == 0) {
+            const Tick next_block = (current_ | kSlotMask) + 1;
+            if (next_block > now) {
+                current_ = now + 1;
+                break;
+            }
+            current_ = next_block;
+            continue;
+        }
+
+        const Tick tick = current_;
+        if ((tick & kSlotMask) == 0) {
+            // Сначала верхние уровни: их таймеры могут попасть в только что
+            // пересыпанные слоты нижних
+            int top = 1;
+            while (top < kLevels - 1 && ((tick >> (kSlotBits * top)) & kSlotMask) == 0) {
+                ++top;
+            }
+            for (int level = top; level >= 1; --level) {
+                cascade(level, (tick >> (kSlotBits * level)) & kSlotMask);
+            }
+        }
+
+        uint32_t id = detachSlot(tick & kSlotMask);
+        // Таймеры, поставленные из fn на прошедшее время, уйдут на следующий тик
+        current_ = tick + 1;
+        while (id != kNil) {
+            const uint32_t next = nodes_[id].next;
+            nodes_[id].next = kNil;
+            fn(id, nodes_[id].deadline);
+            id = next;
+        }
+    }
+}
@@ -2,30 +2,86 @@
 
 #include <opentelemetry/trace/provider.h>
 #include <opentelemetry/exporters/jaeger/jaeger_exporter.h>
+#include <array>
+#include <chrono>
+#include <cstdint>
 #include <string>
 #include <memory>
+#include <unordered_map>
+#include "SensorManager.hpp"
 
+// Трассировка с выборкой. Решение принимается в начале спана (голова):
+// не попавший в выборку спан - это только имя и время начала, без
+// обращений к OpenTelemetry и без форматирования атрибутов. В конце
+// такой спан все же экспортируется задним числом, если он завершился
+// ошибкой или шел дольше slow_threshold (хвост).
+//
+// Готовые спаны уходят в Jaeger пачками через BatchSpanProcessor с
+// ограниченной очередью, а не синхронно в End().
 class Tracer {
 public:
+    struct Config {
+        // Доля спанов в выборке по голове
+        double sample_ratio = 0.01;
+        // Своя доля для пакетов с этими датчиками
+        std::unordered_map<int, double> sensor_ratios;
+        // Хвост: медленные и завершившиеся ошибкой спаны; 0 - не проверять
+        std::chrono::milliseconds slow_threshold{100};
+        bool sample_errors = true;
+        // BatchSpanProcessor: переполнение очереди отбрасывает спаны
+        size_t max_queue_size = 2048;
+        std::chrono::milliseconds export_delay{5000};
+        size_t max_export_batch_size = 512;
+    };
+
+    // Спан с отложенным решением о выборке. Только перемещается
+    class Span {
+    public:
+        Span() = default;
+        Span(Span&&) = default;
+        Span& operator=(Span&&) = default;
+
+        bool sampled() const { return span_ != nullptr; }
+
+    private:
+        friend class Tracer;
+        static constexpr size_t kMaxDeferredAttributes = 4;
+
+        std::shared_ptr<opentelemetry::trace::Span> span_;
+        const char* name_{nullptr};
+        bool tail_{false};  // решение отложено до endSpan()
+        bool ended_{false};
+        std::chrono::steady_clock::time_point start_steady_;
+        // Для хвоста: атрибуты и последнее событие, пока спана нет
+        std::array<std::pair<const char*, int64_t>, kMaxDeferredAttributes> attributes_{};
+        size_t attribute_count_{0};
+        const char* event_{nullptr};
+        std::string error_;
+    };
+
     explicit Tracer(const std::string& service_name);
-    
-    std::shared_ptr<opentelemetry::trace::Span> startSpan(
-        const std::string& name,
-        const std::unordered_map<std::string, std::string>& attributes = {}
-    );
-
-    void addEvent(
-        const std::shared_ptr<opentelemetry::trace::Span>& span,
-        const std::string& name,
-        const std::unordered_map<std::string, std::string>& attributes = {}
-    );
-
-    void setError(
-        const std::shared_ptr<opentelemetry::trace::Span>& span,
-        const std::string& error_message
-    );
+    // Бросает std::invalid_argument при долях вне [0, 1]
+    Tracer(const std::string& service_name, Config config);
+
+    // name должен жить до endSpan() - обычно строковый литерал.
+    // always_sample - спан вне выборки (события жизненного цикла)
+    Span startSpan(const char* name, bool always_sample = false);
+    // Спан пакета измерений: в выборке по общей доле или по доле
+    // любого датчика из sensor_ratios
+    Span startBatchSpan(const char* name, const SensorData* data, size_t count);
+
+    void setAttribute(Span& span, const char* key, int64_t value);
+    void setAttribute(Span& span, const char* key, const std::string& value);
+    void addEvent(Span& span, const char* name);
+    void setError(Span& span, const std::string& error_message);
+    // Завершает спан; для отложенного здесь решается, экспортировать ли его
+    void endSpan(Span& span);
 
 private:
+    bool sampleHead(double ratio) const;
+    Span begin(const char* name, bool sampled);
+
+    const Config config_;
     std::shared_ptr<opentelemetry::trace::TracerProvider> provider_;
     std::shared_ptr<opentelemetry::trace::Tracer> tracer_;
-}; 
\ No newline at end of file
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "SensorManager.hpp"
+
+// Итог одного окна по одному датчику
+struct SensorRollup {
+    int sensor_id;
+    std::chrono::system_clock::time_point window_start;
+    std::chrono::system_clock::time_point window_end;
+    uint64_t count;
+    double min;
+    double max;
+    double mean;
+    double last;
+    double stddev;  // по генеральной совокупности окна
+};
+
+// Агрегация измерений по окнам во времени измерения (timestamp образца).
+//
+// Окна выровнены по эпохе: окно размера window со сдвигом slide
+// заканчивается на каждой границе, кратной slide. slide == window -
+// неперекрывающиеся (tumbling) окна, slide < window - скользящие. Для
+// скользящих окон хранятся частичные итоги по отрезкам длины slide
+// (панели), и каждое окно собирается слиянием window / slide панелей,
+// поэтому память и время на измерение не зависят от частоты опроса.
+//
+// Окно закрывается, когда у датчика приходит измерение за его границей,
+// либо по flush(), когда граница отстала от часов больше чем на lateness.
+// Измерение в уже закрытое окно не агрегируется и, чтобы не потеряться,
+// уходит как есть даже при политике ROLLUP.
+//
+// Не потокобезопасен: у каждого потока обработки свой экземпляр, а датчик
+// закреплен за одним потоком.
+class WindowAggregator {
+public:
+    enum class Output {
+        RAW,        // измерения как есть, окна не считаются
+        ROLLUP,     // только итоги окон
+        BOTH        // и то и другое
+    };
+
+    struct Policy {
+        Output output = Output::RAW;
+        std::chrono::milliseconds window{0};
+        // 0 - равно window (tumbling). window должно делиться на slide
+        std::chrono::milliseconds slide{0};
+    };
+
+    struct Config {
+        Policy default_policy;
+        std::unordered_map<int, Policy> sensor_policies;
+        // Сколько ждать опоздавших измерений, прежде чем закрыть окно по часам
+        std::chrono::milliseconds lateness{5000};
+    };
+
+    struct Stats {
+        uint64_t rollups{0};
+        uint64_t late_samples{0};
+    };
+
+    // Бросает std::invalid_argument при неверной политике
+    explicit WindowAggregator(Config config);
+
+    // Проверка политики без создания агрегатора
+    static void validate(const Policy& policy);
+
+    // true, если хотя бы одному датчику нужны окна
+    bool enabled() const;
+
+    // Учитывает измерение; закрытые им окна дописываются в rollups.
+    // Возвращает true, если само измерение нужно отправить как есть
+    bool add(const SensorData& data, std::vector<SensorRollup>& rollups);
+
+    // Закрывает окна, граница которых раньше now - lateness, и забывает
+    // датчики, замолчавшие еще на lateness после своего последнего окна
+    void flush(std::chrono::system_clock::time_point now, std::vector<SensorRollup>& rollups);
+
+    const Stats& getStats() const { return stats_; }
+
+private:
+    // Частичные итоги отрезка [index * slide, (index + 1) * slide)
+    struct Pane {
+        int64_t index{-1};
+        uint64_t count{0};
+        double min{0};
+        double max{0};
+        double mean{0};
+        double m2{0};  // сумма квадратов отклонений (Уэлфорд)
+        double last{0};
+        int64_t last_ms{0};
+    };
+
+    struct SensorWindows {
+        int64_t slide_ms;
+        // Кольцо из window / slide панелей, панель index лежит в index % size
+        std::vector<Pane> panes;
+        // Первая незакрытая панель и последняя панель с данными
+        int64_t next_close{INT64_MIN};
+        int64_t last_data{INT64_MIN};
+    };
+
+    // Ограничение на window / slide: память на датчик растет линейно
+    static constexpr int64_t kMaxPanes = 1024;
+
+    const Policy& policyFor(int sensor_id) const;
+    SensorWindows& windowsFor(int sensor_id, const Policy& policy);
+    void closeUntil(int sensor_id, SensorWindows& windows, int64_t pane_index,
+                    std::vector<SensorRollup>& rollups);
+    void emitWindow(int sensor_id, const SensorWindows& windows, int64_t last_pane,
+                    std::vector<SensorRollup>& rollups);
+
+    const Config config_;
+    std::unordered_map<int, SensorWindows> sensors_;
+    Stats stats_;
+};
@@ -1,111 +1,324 @@
 #include "AlertManager.hpp"
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
+#include <nlohmann/json.hpp>
+
+namespace {
+
+// Дольше этого поток отправки не спит даже без дел
+constexpr std::chrono::milliseconds kIdlePoll{1000};
+// Как часто вычищать истекшие cooldown
+constexpr std::chrono::seconds kPruneInterval{60};
+
+const char* severityName(AlertSeverity severity) {
+    switch (severity) {
+        case AlertSeverity::INFO: return "INFO";
+        case AlertSeverity::WARNING: return "WARNING";
+        case AlertSeverity::CRITICAL: return "CRITICAL";
+    }
+    return "UNKNOWN";
+}
+
+}  // namespace
 
 AlertManager::AlertManager(const std::string& webhook_url)
-    : webhook_url_(webhook_url) {
-    curl_ = curl_easy_init();
-    if (!curl_) {
+    : AlertManager(webhook_url, Config{}) {
+}
+
+AlertManager::AlertManager(const std::string& webhook_url, Config config)
+    : webhook_url_(webhook_url)
+    , config_(config) {
+    if (config_.max_batch == 0 || config_.max_queued == 0 || config_.max_in_flight == 0
+        || config_.max_attempts == 0) {
+        throw std::invalid_argument("Alert batch, queue, concurrency and attempt limits must be positive");
+    }
+    if (config_.cooldown.count() < 0 || config_.batch_window.count() < 0
+        || config_.retry_backoff.count() < 0
+        || config_.connect_timeout.count() <= 0 || config_.request_timeout.count() <= 0) {
+        throw std::invalid_argument("Alert timeouts must be positive");
+    }
+
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
         throw std::runtime_error("Failed to initialize CURL");
     }
+    multi_ = curl_multi_init();
+    if (!multi_) {
+        curl_global_cleanup();
+        throw std::runtime_error("Failed to initialize CURL");
+    }
+    curl_multi_setopt(multi_, CURLMOPT_MAX_TOTAL_CONNECTIONS, static_cast<long>(config_.max_in_flight));
+    headers_ = curl_slist_append(nullptr, "Content-Type: application/json");
+
+    dispatcher_ = std::thread(&AlertManager::dispatchLoop, this);
 }
 
 AlertManager::~AlertManager() {
-    if (curl_) {
-        curl_easy_cleanup(curl_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
     }
+    curl_multi_wakeup(multi_);
+    if (dispatcher_.joinable()) {
+        dispatcher_.join();
+    }
+    curl_slist_free_all(headers_);
+    curl_multi_cleanup(multi_);
+    curl_global_cleanup();
 }
 
 void AlertManager::sendAlert(const Alert& alert) {
-    auto now = std::chrono::system_clock::now();
-    if (now - last_alert_time_ < ALERT_COOLDOWN) {
-        return;  // Предотвращаем слишком частые алерты
-    }
-
-    nlohmann::json payload = {
-        {"text", alert.description},
-        {"severity", [&alert]() {
-            switch (alert.severity) {
-                case AlertSeverity::INFO: return "INFO";
-                case AlertSeverity::WARNING: return "WARNING";
-                case AlertSeverity::CRITICAL: return "CRITICAL";
-            }
-            return "UNKNOWN";
-        }()},
-        {"timestamp", std::chrono::duration_cast<std::chrono::seconds>(
-            alert.timestamp.time_since_epoch()).count()}
-    };
+    const auto now = std::chrono::steady_clock::now();
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        auto key = cooldownKey(alert);
+        auto it = last_sent_.find(key);
+        if (it != last_sent_.end() && now - it->second < config_.cooldown) {
+            ++stats_.suppressed;
+            return;
+        }
+        if (queue_.size() >= config_.max_queued) {
+            ++stats_.dropped;
+            return;
+        }
+        if (it != last_sent_.end()) {
+            it->second = now;
+        } else {
+            last_sent_.emplace(std::move(key), now);
+        }
+        queue_.push_back({alert, now});
+        // Поток отправки будим, только когда у него меняется срок:
+        // началась новая пачка или набралась полная
+        wake = queue_.size() == 1 || queue_.size() == config_.max_batch;
+    }
+    if (wake) {
+        curl_multi_wakeup(multi_);
+    }
+}
+
+AlertManager::Stats AlertManager::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.queued = queue_.size();
+    return stats;
+}
+
+void AlertManager::dispatchLoop() {
+    std::vector<std::unique_ptr<Request>> ready;
+    while (true) {
+        bool stopping;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping = stopping_;
+            // При остановке очередь и повторы уходят сразу, без ожидания пачки
+            takeBatches(std::chrono::steady_clock::now(), stopping, ready);
+        }
+        for (auto& request : ready) {
+            startRequest(std::move(request));
+        }
+        ready.clear();
+
+        int running = 0;
+        curl_multi_perform(multi_, &running);
+        auto now = std::chrono::steady_clock::now();
+        completeRequests(now, !stopping);
 
-    sendWebhook(payload);
-    last_alert_time_ = now;
+        std::chrono::milliseconds timeout;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_ && queue_.empty() && active_.empty() && retries_.empty()) {
+                return;
+            }
+            if (now >= next_prune_) {
+                pruneCooldowns(now);
+                next_prune_ = now + kPruneInterval;
+            }
+            timeout = pollTimeout(now);
+        }
+        curl_multi_poll(multi_, nullptr, 0, static_cast<int>(timeout.count()), nullptr);
+    }
 }
 
-void AlertManager::checkThresholds(
-    double buffer_size,
-    double kafka_lag,
-    const std::vector<std::pair<int, double>>& sensor_values
+void AlertManager::takeBatches(
+    std::chrono::steady_clock::time_point now,
+    bool flush,
+    std::vector<std::unique_ptr<Request>>& ready
 ) {
-    // Проверка размера буфера
-    if (buffer_size > 90000) {
-        sendAlert({
-            "Buffer Nearly Full",
-            "Data buffer is approaching maximum capacity",
-            AlertSeverity::CRITICAL,
-            std::chrono::system_clock::now()
-        });
-    } else if (buffer_size > 70000) {
-        sendAlert({
-            "Buffer Warning",
-            "Data buffer is filling up",
-            AlertSeverity::WARNING,
-            std::chrono::system_clock::now()
-        });
-    }
-
-    // Проверка задержки Kafka
-    if (kafka_lag > 1000) {
-        sendAlert({
-            "High Kafka Lag",
-            "Kafka producer is experiencing high lag",
-            AlertSeverity::CRITICAL,
-            std::chrono::system_clock::now()
-        });
-    }
-
-    // Проверка значений датчиков
-    for (const auto& [sensor_id, value] : sensor_values) {
-        if (value < -50 || value > 100) {
-            sendAlert({
-                "Sensor Value Out of Range",
-                "Sensor " + std::to_string(sensor_id) + " reported abnormal value: " + std::to_string(value),
-                AlertSeverity::WARNING,
-                std::chrono::system_clock::now()
-            });
+    size_t slots = config_.max_in_flight - std::min(active_.size(), config_.max_in_flight);
+
+    // Повторы старше новых алертов
+    for (auto it = retries_.begin(); it != retries_.end() && slots > 0;) {
+        if (flush || (*it)->retry_at <= now) {
+            ready.push_back(std::move(*it));
+            it = retries_.erase(it);
+            --slots;
+        } else {
+            ++it;
+        }
+    }
+
+    while (slots > 0 && !queue_.empty()) {
+        const bool full = queue_.size() >= config_.max_batch;
+        if (!flush && !full && now - queue_.front().queued < config_.batch_window) {
+            break;
+        }
+        auto request = std::make_unique<Request>();
+        const size_t count = std::min(queue_.size(), config_.max_batch);
+        request->alerts.reserve(count);
+        request->queued.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            request->alerts.push_back(std::move(queue_.front().alert));
+            request->queued.push_back(queue_.front().queued);
+            queue_.pop_front();
         }
+        stats_.in_flight += count;
+        ready.push_back(std::move(request));
+        --slots;
     }
 }
 
-size_t AlertManager::WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-    ((std::string*)userp)->append((char*)contents, size * nmemb);
-    return size * nmemb;
+void AlertManager::startRequest(std::unique_ptr<Request> request) {
+    if (request->body.empty()) {
+        request->body = buildPayload(request->alerts);
+    }
+    ++request->attempt;
+
+    CURL* easy = curl_easy_init();
+    if (!easy) {
+        std::cerr << "Failed to send alerts: cannot create CURL handle" << std::endl;
+        finishRequest(std::move(request), false);
+        return;
+    }
+    curl_easy_setopt(easy, CURLOPT_URL, webhook_url_.c_str());
+    // Тело живет в Request до конца запроса, копировать его не нужно
+    curl_easy_setopt(easy, CURLOPT_POSTFIELDS, request->body.c_str());
+    curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE, static_cast<long>(request->body.size()));
+    curl_easy_setopt(easy, CURLOPT_HTTPHEADER, headers_);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT_MS, static_cast<long>(config_.connect_timeout.count()));
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, static_cast<long>(config_.request_timeout.count()));
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+
+    if (curl_multi_add_handle(multi_, easy) != CURLM_OK) {
+        curl_easy_cleanup(easy);
+        std::cerr << "Failed to send alerts: cannot start request" << std::endl;
+        finishRequest(std::move(request), false);
+        return;
+    }
+    request->easy = easy;
+    active_.emplace(easy, std::move(request));
 }
 
-void AlertManager::sendWebhook(const nlohmann::json& payload) {
-    std::string response;
-    std::string payload_str = payload.dump();
+void AlertManager::completeRequests(std::chrono::steady_clock::time_point now, bool retry) {
+    int remaining = 0;
+    while (CURLMsg* message = curl_multi_info_read(multi_, &remaining)) {
+        if (message->msg != CURLMSG_DONE) {
+            continue;
+        }
+        CURL* easy = message->easy_handle;
+        const CURLcode result = message->data.result;
+        long status = 0;
+        curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
+        curl_multi_remove_handle(multi_, easy);
+        curl_easy_cleanup(easy);
+
+        auto it = active_.find(easy);
+        if (it == active_.end()) {
+            continue;
+        }
+        auto request = std::move(it->second);
+        active_.erase(it);
+        request->easy = nullptr;
 
-    curl_easy_setopt(curl_, CURLOPT_URL, webhook_url_.c_str());
-    curl_easy_setopt(curl_, CURLOPT_POSTFIELDS, payload_str.c_str());
-    curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &response);
+        if (result == CURLE_OK && status >= 200 && status < 300) {
+            finishRequest(std::move(request), true);
+            continue;
+        }
+        std::cerr << "Failed to send " << request->alerts.size() << " alerts (attempt "
+                  << request->attempt << "): "
+                  << (result != CURLE_OK ? curl_easy_strerror(result) : "HTTP " + std::to_string(status))
+                  << std::endl;
+        if (retry && request->attempt < config_.max_attempts) {
+            request->retry_at = now + config_.retry_backoff;
+            retries_.push_back(std::move(request));
+        } else {
+            finishRequest(std::move(request), false);
+        }
+    }
+}
+
+void AlertManager::finishRequest(std::unique_ptr<Request> request, bool delivered) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const size_t count = request->alerts.size();
+    stats_.in_flight -= count;
+    if (delivered) {
+        stats_.sent += count;
+        return;
+    }
+    stats_.failed += count;
+    for (size_t i = 0; i < count; ++i) {
+        // Ключ мог занять более поздний алерт, его cooldown не трогаем
+        auto it = last_sent_.find(cooldownKey(request->alerts[i]));
+        if (it != last_sent_.end() && it->second == request->queued[i]) {
+            last_sent_.erase(it);
+        }
+    }
+}
 
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, headers);
+std::chrono::milliseconds AlertManager::pollTimeout(std::chrono::steady_clock::time_point now) const {
+    auto deadline = now + kIdlePoll;
+    if (active_.size() < config_.max_in_flight) {
+        if (!queue_.empty()) {
+            deadline = std::min(deadline, queue_.front().queued + config_.batch_window);
+        }
+        for (const auto& request : retries_) {
+            deadline = std::min(deadline, request->retry_at);
+        }
+    }
+    // Вверх, чтобы не проснуться за миг до срока и не крутиться вхолостую
+    return std::max(std::chrono::milliseconds(0),
+                    std::chrono::ceil<std::chrono::milliseconds>(deadline - now));
+}
 
-    CURLcode res = curl_easy_perform(curl_);
-    curl_slist_free_all(headers);
+void AlertManager::pruneCooldowns(std::chrono::steady_clock::time_point now) {
+    for (auto it = last_sent_.begin(); it != last_sent_.end();) {
+        if (now - it->second >= config_.cooldown) {
+            it = last_sent_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
 
-    if (res != CURLE_OK) {
-        std::cerr << "Failed to send alert: " << curl_easy_strerror(res) << std::endl;
+std::string AlertManager::buildPayload(const std::vector<Alert>& alerts) {
+    nlohmann::json items = nlohmann::json::array();
+    for (const auto& alert : alerts) {
+        nlohmann::json item = {
+            {"name", alert.name},
+            {"text", alert.description},
+            {"severity", severityName(alert.severity)},
+            {"timestamp", std::chrono::duration_cast<std::chrono::seconds>(
+                alert.timestamp.time_since_epoch()).count()}
+        };
+        if (alert.sensor_id >= 0) {
+            item["sensor_id"] = alert.sensor_id;
+        }
+        items.push_back(std::move(item));
     }
-}
\ No newline at end of file
+    return nlohmann::json{{"alerts", std::move(items)}}.dump();
+}
+
+std::string AlertManager::cooldownKey(const Alert& alert) {
+    return alert.name + '\n' + std::to_string(alert.sensor_id);
+}
+
+size_t AlertManager::WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+    // Ответ вебхука не нужен, важен только код
+    (void)contents;
+    (void)userp;
+    return size * nmemb;
+}
@@ -0,0 +1,424 @@
+#include "AlertRuleEngine.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <yaml-cpp/yaml.h>
+
+namespace {
+
+// Метка серии для метрик без sensor_id
+constexpr int kNoSensor = -1;
+
+void skipSpaces(const std::string& text, size_t& pos) {
+    while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) {
+        ++pos;
+    }
+}
+
+bool isMetricChar(char c, bool first) {
+    const auto u = static_cast<unsigned char>(c);
+    return std::isalpha(u) || c == '_' || c == ':' || (!first && std::isdigit(u));
+}
+
+AlertSeverity parseSeverity(const std::string& text) {
+    if (text == "critical") {
+        return AlertSeverity::CRITICAL;
+    }
+    if (text == "info") {
+        return AlertSeverity::INFO;
+    }
+    return AlertSeverity::WARNING;
+}
+
+}  // namespace
+
+AlertRuleEngine::AlertRuleEngine(AlertCallback callback)
+    : callback_(std::move(callback))
+    , rules_(std::make_shared<RuleSet>()) {
+}
+
+std::shared_ptr<const AlertRuleEngine::RuleSet> AlertRuleEngine::currentRules() const {
+    return std::atomic_load(&rules_);
+}
+
+size_t AlertRuleEngine::ruleCount() const {
+    return currentRules()->rules.size();
+}
+
+std::chrono::milliseconds AlertRuleEngine::parseDuration(const std::string& text) {
+    // Формат Prometheus: 1h30m, 5m, 30s, 500ms
+    using namespace std::chrono;
+    milliseconds total{0};
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t digits = pos;
+        while (digits < text.size() && std::isdigit(static_cast<unsigned char>(text[digits]))) {
+            ++digits;
+        }
+        if (digits == pos) {
+            throw std::runtime_error("Invalid duration: " + text);
+        }
+        const long long amount = std::stoll(text.substr(pos, digits - pos));
+        size_t unit_end = digits;
+        while (unit_end < text.size() && std::isalpha(static_cast<unsigned char>(text[unit_end]))) {
+            ++unit_end;
+        }
+        const std::string unit = text.substr(digits, unit_end - digits);
+        if (unit.empty() && amount == 0) {
+            // for: 0
+        } else if (unit == "ms") {
+            total += milliseconds(amount);
+        } else if (unit == "s") {
+            total += seconds(amount);
+        } else if (unit == "m") {
+            total += minutes(amount);
+        } else if (unit == "h") {
+            total += hours(amount);
+        } else if (unit == "d") {
+            total += hours(24 * amount);
+        } else if (unit == "w") {
+            total += hours(24 * 7 * amount);
+        } else {
+            throw std::runtime_error("Invalid duration unit in: " + text);
+        }
+        pos = unit_end;
+    }
+    return total;
+}
+
+std::shared_ptr<AlertRuleEngine::Rule> AlertRuleEngine::compile(std::string name, std::string expr) {
+    auto rule = std::make_shared<Rule>();
+    rule->name = std::move(name);
+    rule->expr = std::move(expr);
+    const std::string& text = rule->expr;
+    auto unsupported = [&text](const std::string& reason) {
+        return std::runtime_error("unsupported expression '" + text + "': " + reason);
+    };
+
+    size_t pos = 0;
+    skipSpaces(text, pos);
+    const size_t metric_begin = pos;
+    while (pos < text.size() && isMetricChar(text[pos], pos == metric_begin)) {
+        ++pos;
+    }
+    if (pos == metric_begin) {
+        throw unsupported("expected a metric name");
+    }
+    rule->metric = text.substr(metric_begin, pos - metric_begin);
+
+    skipSpaces(text, pos);
+    if (pos < text.size() && text[pos] == '{') {
+        ++pos;
+        skipSpaces(text, pos);
+        while (pos < text.size() && text[pos] != '}') {
+            const size_t label_begin = pos;
+            while (pos < text.size() && isMetricChar(text[pos], pos == label_begin)) {
+                ++pos;
+            }
+            const std::string label = text.substr(label_begin, pos - label_begin);
+            if (label != "sensor_id") {
+                throw unsupported("only the sensor_id label can be matched");
+            }
+            skipSpaces(text, pos);
+            if (text.compare(pos, 2, "!=") == 0) {
+                rule->sensor_id_negated = true;
+                pos += 2;
+            } else if (pos < text.size() && text[pos] == '=' && text.compare(pos, 2, "=~") != 0) {
+                ++pos;
+            } else {
+                throw unsupported("only = and != label matchers are supported");
+            }
+            skipSpaces(text, pos);
+            const size_t close = pos < text.size() && text[pos] == '"' ? text.find('"', pos + 1) : std::string::npos;
+            if (close == std::string::npos) {
+                throw unsupported("expected a quoted label value");
+            }
+            const std::string value = text.substr(pos + 1, close - pos - 1);
+            char* end = nullptr;
+            const long id = std::strtol(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0') {
+                throw unsupported("sensor_id must be an integer");
+            }
+            rule->sensor_id = static_cast<int>(id);
+            pos = close + 1;
+            skipSpaces(text, pos);
+            if (pos < text.size() && text[pos] == ',') {
+                ++pos;
+                skipSpaces(text, pos);
+            }
+        }
+        if (pos >= text.size()) {
+            throw unsupported("unterminated label matcher");
+        }
+        ++pos;
+        skipSpaces(text, pos);
+    }
+
+    static const std::pair<const char*, Op> kOps[] = {
+        {">=", Op::GE}, {"<=", Op::LE}, {"==", Op::EQ}, {"!=", Op::NE}, {">", Op::GT}, {"<", Op::LT}
+    };
+    bool found = false;
+    for (const auto& [token, op] : kOps) {
+        const size_t length = std::char_traits<char>::length(token);
+        if (text.compare(pos, length, token) == 0) {
+            rule->op = op;
+            pos += length;
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        throw unsupported("expected a comparison operator");
+    }
+
+    skipSpaces(text, pos);
+    const char* begin = text.c_str() + pos;
+    char* end = nullptr;
+    rule->threshold = std::strtod(begin, &end);
+    if (end == begin) {
+        throw unsupported("expected a numeric threshold");
+    }
+    pos += static_cast<size_t>(end - begin);
+    skipSpaces(text, pos);
+    if (pos != text.size()) {
+        throw unsupported("unexpected trailing input");
+    }
+    return rule;
+}
+
+void AlertRuleEngine::load(const std::string& path) {
+    std::lock_guard<std::mutex> load_lock(load_mutex_);
+    // Путь запоминается и при ошибке: reloadIfChanged() подхватит файл,
+    // когда его создадут или исправят
+    path_ = path;
+    const auto mtime = std::filesystem::last_write_time(path);
+    const YAML::Node root = YAML::LoadFile(path);
+
+    // Состояние переносится по имени и выражению: правило с новым for:
+    // или порогом начинает отсчет заново
+    const auto previous = currentRules();
+    std::unordered_map<std::string, std::shared_ptr<Rule>> reusable;
+    for (const auto& rule : previous->rules) {
+        reusable.emplace(rule->name + '\n' + rule->expr, rule);
+    }
+
+    auto set = std::make_shared<RuleSet>();
+    for (const auto& group : root["groups"]) {
+        for (const auto& node : group["rules"]) {
+            if (!node["alert"] || !node["expr"]) {
+                continue;  // recording rules не алерты
+            }
+            const auto name = node["alert"].as<std::string>();
+            const auto expr = node["expr"].as<std::string>();
+
+            std::shared_ptr<Rule> rule;
+            try {
+                rule = compile(name, expr);
+                rule->for_duration = node["for"]
+                    ? parseDuration(node["for"].as<std::string>())
+                    : std::chrono::milliseconds(0);
+            } catch (const std::runtime_error& e) {
+                std::cerr << "Alert rule " << name << " is left to Prometheus: " << e.what() << std::endl;
+                continue;
+            }
+            if (const auto labels = node["labels"]) {
+                if (labels["severity"]) {
+                    rule->severity = parseSeverity(labels["severity"].as<std::string>());
+                }
+            }
+            if (const auto annotations = node["annotations"]) {
+                if (annotations["summary"]) {
+                    rule->summary = annotations["summary"].as<std::string>();
+                }
+                if (annotations["description"]) {
+                    rule->description = annotations["description"].as<std::string>();
+                }
+            }
+
+            auto old = reusable.find(name + '\n' + expr);
+            if (old != reusable.end() && old->second->for_duration == rule->for_duration) {
+                std::lock_guard<std::mutex> lock(old->second->mutex);
+                rule->series = old->second->series;
+            }
+            set->rules.push_back(std::move(rule));
+        }
+    }
+
+    for (const auto& rule : set->rules) {
+        auto it = std::find_if(set->by_metric.begin(), set->by_metric.end(),
+            [&rule](const auto& entry) { return entry.first == rule->metric; });
+        if (it == set->by_metric.end()) {
+            set->by_metric.emplace_back(rule->metric, std::vector<Rule*>{});
+            it = std::prev(set->by_metric.end());
+        }
+        it->second.push_back(rule.get());
+    }
+
+    std::atomic_store(&rules_, std::shared_ptr<const RuleSet>(std::move(set)));
+    loaded_mtime_ = mtime;
+}
+
+bool AlertRuleEngine::reloadIfChanged() {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(load_mutex_);
+        if (path_.empty()) {
+            return false;
+        }
+        std::error_code error;
+        const auto mtime = std::filesystem::last_write_time(path_, error);
+        if (error || mtime == loaded_mtime_) {
+            return false;
+        }
+        path = path_;
+    }
+    try {
+        load(path);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to reload alert rules from " << path << ": " << e.what() << std::endl;
+        // Не пытаемся снова, пока файл не поменяется еще раз
+        std::lock_guard<std::mutex> lock(load_mutex_);
+        std::error_code error;
+        loaded_mtime_ = std::filesystem::last_write_time(path_, error);
+        return false;
+    }
+}
+
+const std::vector<AlertRuleEngine::Rule*>* AlertRuleEngine::rulesFor(
+    const RuleSet& set,
+    std::string_view metric
+) const {
+    for (const auto& [name, rules] : set.by_metric) {
+        if (name == metric) {
+            return &rules;
+        }
+    }
+    return nullptr;
+}
+
+void AlertRuleEngine::observe(
+    std::string_view metric,
+    double value,
+    std::chrono::system_clock::time_point timestamp
+) {
+    observeSensor(metric, kNoSensor, value, timestamp);
+}
+
+void AlertRuleEngine::observeSensor(
+    std::string_view metric,
+    int sensor_id,
+    double value,
+    std::chrono::system_clock::time_point timestamp
+) {
+    const auto set = currentRules();
+    const auto* rules = rulesFor(*set, metric);
+    if (rules == nullptr) {
+        return;
+    }
+    for (Rule* rule : *rules) {
+        std::lock_guard<std::mutex> lock(rule->mutex);
+        evaluate(*rule, sensor_id, value, timestamp);
+    }
+}
+
+void AlertRuleEngine::evaluate(
+    Rule& rule,
+    int sensor_id,
+    double value,
+    std::chrono::system_clock::time_point timestamp
+) {
+    if (rule.sensor_id) {
+        // Как в PromQL: у серии без метки sensor_id значение метки пустое
+        const bool equal = sensor_id != kNoSensor && sensor_id == *rule.sensor_id;
+        if (equal == rule.sensor_id_negated) {
+            return;
+        }
+    }
+
+    bool breached = false;
+    switch (rule.op) {
+        case Op::GT: breached = value > rule.threshold; break;
+        case Op::GE: breached = value >= rule.threshold; break;
+        case Op::LT: breached = value < rule.threshold; break;
+        case Op::LE: breached = value <= rule.threshold; break;
+        case Op::EQ: breached = value == rule.threshold; break;
+        case Op::NE: breached = value != rule.threshold; break;
+    }
+
+    if (!breached) {
+        // Серии без нарушения не храним: память растет только с нарушениями
+        if (!rule.series.empty()) {
+            rule.series.erase(sensor_id);
+        }
+        return;
+    }
+
+    auto [it, inserted] = rule.series.try_emplace(sensor_id);
+    SeriesState& state = it->second;
+    if (inserted) {
+        state.active_since = timestamp;
+    }
+    if (!state.firing && timestamp - state.active_since >= rule.for_duration) {
+        state.firing = true;
+        fire(rule, sensor_id, value, timestamp);
+    }
+}
+
+void AlertRuleEngine::fire(
+    const Rule& rule,
+    int sensor_id,
+    double value,
+    std::chrono::system_clock::time_point timestamp
+) {
+    std::string description = render(
+        rule.description.empty() ? rule.summary : rule.description, sensor_id, value
+    );
+    if (!rule.summary.empty() && !rule.description.empty()) {
+        description = render(rule.summary, sensor_id, value) + ": " + description;
+    }
+    callback_(Alert{
+        rule.name,
+        description,
+        rule.severity,
+        timestamp,
+        sensor_id == kNoSensor ? -1 : sensor_id
+    });
+}
+
+std::string AlertRuleEngine::render(const std::string& text, int sensor_id, double value) {
+    // Подстановки шаблонов Prometheus, которые встречаются в правилах
+    std::string out;
+    size_t pos = 0;
+    while (true) {
+        const size_t open = text.find("{{", pos);
+        const size_t close = open == std::string::npos ? open : text.find("}}", open + 2);
+        if (close == std::string::npos) {
+            out.append(text, pos, std::string::npos);
+            return out;
+        }
+        out.append(text, pos, open - pos);
+
+        size_t begin = open + 2;
+        skipSpaces(text, begin);
+        size_t end = close;
+        while (end > begin && std::isspace(static_cast<unsigned char>(text[end - 1]))) {
+            --end;
+        }
+        const std::string field = text.substr(begin, end - begin);
+        if (field == "$value") {
+            std::ostringstream formatted;
+            formatted << value;
+            out += formatted.str();
+        } else if (field == "$labels.sensor_id") {
+            out += sensor_id == kNoSensor ? std::string() : std::to_string(sensor_id);
+        } else {
+            out.append(text, open, close + 2 - open);
+        }
+        pos = close + 2;
+    }
+}
@@ -0,0 +1,90 @@
+#include "BufferPool.hpp"
+
+BufferPool::BufferPool()
+    : BufferPool(Config()) {}
+
+BufferPool::BufferPool(const Config& config) {
+    addSizeClass(256, config.small_buffers);
+    addSizeClass(4096, config.medium_buffers);
+    addSizeClass(65536, config.large_buffers);
+}
+
+BufferPool::~BufferPool() = default;
+
+void BufferPool::addSizeClass(size_t buffer_size, size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    SizeClass size_class;
+    size_class.buffer_size = buffer_size;
+    size_class.slab = std::make_unique<char[]>(buffer_size * count);
+    size_class.headers = std::make_unique<Buffer[]>(count);
+    size_class.free_list = std::make_unique<MpmcRing<Buffer*>>(count);
+
+    const int index = static_cast<int>(classes_.size());
+    for (size_t i = 0; i < count; ++i) {
+        Buffer& buffer = size_class.headers[i];
+        buffer.data = size_class.slab.get() + i * buffer_size;
+        buffer.capacity = buffer_size;
+        buffer.size = 0;
+        buffer.size_class = index;
+        buffer.attempts = 0;
+        buffer.key_size = 0;
+        buffer.trace = 0;
+        buffer.group = nullptr;
+        size_class.free_list->tryPush(&buffer);
+    }
+
+    capacity_ += count;
+    classes_.push_back(std::move(size_class));
+}
+
+BufferPool::Buffer* BufferPool::acquire(size_t size) {
+    Buffer* buffer = nullptr;
+    for (auto& size_class : classes_) {
+        if (size_class.buffer_size >= size) {
+            if (size_class.free_list->tryPop(buffer)) {
+                buffer->size = 0;
+                buffer->attempts = 0;
+                buffer->key_size = 0;
+                buffer->trace = 0;
+                in_use_.fetch_add(1, std::memory_order_relaxed);
+                return buffer;
+            }
+            break;
+        }
+    }
+
+    heap_fallbacks_.fetch_add(1, std::memory_order_relaxed);
+    buffer = new Buffer{new char[size], size, 0, -1, 0, {}, 0, 0, nullptr};
+    return buffer;
+}
+
+void BufferPool::release(Buffer* buffer) {
+    if (!buffer) {
+        return;
+    }
+    if (DeliveryGroup* group = buffer->group) {
+        buffer->group = nullptr;
+        group->release();
+    }
+
+    if (buffer->size_class < 0) {
+        delete[] buffer->data;
+        delete buffer;
+        return;
+    }
+
+    // Кольцо рассчитано ровно на все буферы класса, поэтому возврат не может не пройти
+    classes_[static_cast<size_t>(buffer->size_class)].free_list->tryPush(buffer);
+    in_use_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+BufferPool::Stats BufferPool::getStats() const {
+    return Stats{
+        in_use_.load(std::memory_order_relaxed),
+        capacity_,
+        heap_fallbacks_.load(std::memory_order_relaxed)
+    };
+}
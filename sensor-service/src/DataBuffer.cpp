@@ -1,48 +1,145 @@
 #include "DataBuffer.hpp"
 
-DataBuffer::DataBuffer(size_t max_size)
-    : max_size_(max_size) {}
+DataBuffer::DataBuffer(size_t max_size, Mode mode)
+    : mode_(mode) {
+    if (mode_ == Mode::SPSC) {
+        spsc_ = std::make_unique<SpscRing<SensorData>>(max_size);
+    } else {
+        mpmc_ = std::make_unique<MpmcRing<SensorData>>(max_size);
+    }
+}
+
+bool DataBuffer::tryPush(const SensorData& data) {
+    return mode_ == Mode::SPSC ? spsc_->tryPush(data) : mpmc_->tryPush(data);
+}
+
+bool DataBuffer::tryPop(SensorData& data) {
+    return mode_ == Mode::SPSC ? spsc_->tryPop(data) : mpmc_->tryPop(data);
+}
+
+size_t DataBuffer::tryPushBatch(const SensorData* data, size_t count) {
+    if (mode_ == Mode::SPSC) {
+        return spsc_->tryPushBatch(data, count);
+    }
+
+    size_t pushed = 0;
+    while (pushed < count && mpmc_->tryPush(data[pushed])) {
+        ++pushed;
+    }
+    return pushed;
+}
+
+size_t DataBuffer::tryPopBatch(SensorData* out, size_t max_n) {
+    if (mode_ == Mode::SPSC) {
+        return spsc_->tryPopBatch(out, max_n);
+    }
+
+    size_t popped = 0;
+    while (popped < max_n && mpmc_->tryPop(out[popped])) {
+        ++popped;
+    }
+    return popped;
+}
+
+bool DataBuffer::waitNotEmpty(std::chrono::steady_clock::time_point deadline) {
+    for (;;) {
+        auto key = not_empty_.prepareWait();
+        if (!empty()) {
+            not_empty_.cancelWait();
+            return true;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            not_empty_.cancelWait();
+            return false;
+        }
+        not_empty_.wait(key, deadline - now);
+    }
+}
 
 void DataBuffer::push(const SensorData& data) {
-    std::unique_lock<std::mutex> lock(mutex_);
-    
-    not_full_.wait(lock, [this]() {
-        return buffer_.size() < max_size_;
-    });
+    while (!tryPush(data)) {
+        auto key = not_full_.prepareWait();
+        if (tryPush(data)) {
+            not_full_.cancelWait();
+            break;
+        }
+        not_full_.wait(key, std::chrono::milliseconds(100));
+    }
 
-    buffer_.push_back(data);
-    lock.unlock();
-    not_empty_.notify_one();
+    not_empty_.notifyOne();
 }
 
 bool DataBuffer::pop(SensorData& data, std::chrono::milliseconds timeout) {
-    std::unique_lock<std::mutex> lock(mutex_);
-    
-    if (!not_empty_.wait_for(lock, timeout, [this]() {
-        return !buffer_.empty();
-    })) {
-        return false;
-    }
-
-    data = buffer_.front();
-    buffer_.pop_front();
-    lock.unlock();
-    not_full_.notify_one();
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!tryPop(data)) {
+        if (!waitNotEmpty(deadline)) {
+            return false;
+        }
+    }
+
+    not_full_.notifyOne();
     return true;
 }
 
+void DataBuffer::pushBatch(const SensorData* data, size_t count) {
+    size_t pushed = tryPushBatch(data, count);
+    while (pushed < count) {
+        not_empty_.notifyOne();
+
+        auto key = not_full_.prepareWait();
+        size_t n = tryPushBatch(data + pushed, count - pushed);
+        if (n > 0) {
+            not_full_.cancelWait();
+            pushed += n;
+            continue;
+        }
+        not_full_.wait(key, std::chrono::milliseconds(100));
+    }
+
+    if (count > 0) {
+        not_empty_.notifyOne();
+    }
+}
+
+size_t DataBuffer::popBatch(
+    std::vector<SensorData>& out,
+    size_t max_n,
+    std::chrono::milliseconds max_wait
+) {
+    auto deadline = std::chrono::steady_clock::now() + max_wait;
+    const size_t offset = out.size();
+    out.resize(offset + max_n);
+
+    size_t popped = tryPopBatch(out.data() + offset, max_n);
+    while (popped == 0 && waitNotEmpty(deadline)) {
+        popped = tryPopBatch(out.data() + offset, max_n);
+    }
+    out.resize(offset + popped);
+
+    if (popped > 0) {
+        // Освободилось сразу много места - будим всех припаркованных производителей
+        not_full_.notifyAll();
+    }
+    return popped;
+}
+
 size_t DataBuffer::size() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return buffer_.size();
+    return mode_ == Mode::SPSC ? spsc_->size() : mpmc_->size();
+}
+
+size_t DataBuffer::capacity() const {
+    return mode_ == Mode::SPSC ? spsc_->capacity() : mpmc_->capacity();
 }
 
 bool DataBuffer::empty() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return buffer_.empty();
+    return size() == 0;
 }
 
 void DataBuffer::clear() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    buffer_.clear();
-    not_full_.notify_all();
-} 
\ No newline at end of file
+    SensorData data;
+    while (tryPop(data)) {
+    }
+    not_full_.notifyAll();
+}
@@ -0,0 +1,68 @@
+#include "EventCount.hpp"
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+uint32_t* futexAddress(std::atomic<uint32_t>& word) {
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                  "futex word must be a plain 32-bit integer");
+    return reinterpret_cast<uint32_t*>(&word);
+}
+
+}  // namespace
+
+uint32_t EventCount::prepareWait() {
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    // Парный барьер к барьеру в notify(): либо мы увидим новые данные,
+    // либо уведомляющий поток увидит нас в waiters_
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return epoch_.load(std::memory_order_acquire);
+}
+
+void EventCount::cancelWait() {
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool EventCount::wait(uint32_t key, std::chrono::nanoseconds timeout) {
+    bool notified = true;
+    if (timeout.count() <= 0) {
+        notified = epoch_.load(std::memory_order_acquire) != key;
+    } else {
+        struct timespec ts;
+        ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+        ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+
+        long rc = syscall(SYS_futex, futexAddress(epoch_), FUTEX_WAIT_PRIVATE,
+                          key, &ts, nullptr, 0);
+        if (rc != 0 && errno == ETIMEDOUT) {
+            notified = false;
+        }
+    }
+
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+    return notified;
+}
+
+void EventCount::notifyOne() {
+    notify(1);
+}
+
+void EventCount::notifyAll() {
+    notify(INT_MAX);
+}
+
+void EventCount::notify(int count) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    epoch_.fetch_add(1, std::memory_order_release);
+    syscall(SYS_futex, futexAddress(epoch_), FUTEX_WAKE_PRIVATE,
+            count, nullptr, nullptr, 0);
+}
@@ -0,0 +1,186 @@
+#include "FlameGraph.hpp"
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr double kImageWidth = 1200.0;
+constexpr double kFrameHeight = 16.0;
+constexpr double kPadding = 10.0;
+constexpr double kTitleHeight = 24.0;
+constexpr double kFontWidth = 0.59 * 12.0;  // средняя ширина символа шрифта 12px
+constexpr double kMinWidth = 0.1;           // более узкие кадры не рисуются
+
+std::string escapeXml(const std::string& text) {
+    std::string out;
+    out.reserve(text.size());
+    for (char c : text) {
+        switch (c) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            default: out += c;
+        }
+    }
+    return out;
+}
+
+// Теплая палитра flamegraph.pl; цвет зависит только от имени, так что
+// функция одного цвета на всех графиках
+std::string frameColor(const std::string& name) {
+    const size_t hash = std::hash<std::string>{}(name);
+    const unsigned red = 205 + static_cast<unsigned>(hash % 50);
+    const unsigned green = static_cast<unsigned>((hash >> 8) % 230);
+    const unsigned blue = static_cast<unsigned>((hash >> 16) % 55);
+    return "rgb(" + std::to_string(red) + "," + std::to_string(green) + "," + std::to_string(blue) + ")";
+}
+
+void writeFile(const std::string& path, const std::string& content) {
+    std::ofstream out(path, std::ios::trunc);
+    out << content;
+    if (!out) {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+}  // namespace
+
+FlameGraph::FlameGraph()
+    : nodes_(1) {
+}
+
+void FlameGraph::add(const std::vector<std::string>& frames, uint64_t weight) {
+    if (frames.empty() || weight == 0) {
+        return;
+    }
+    size_t node = 0;
+    nodes_[0].weight += weight;
+    for (const auto& frame : frames) {
+        auto it = nodes_[node].children.find(frame);
+        if (it == nodes_[node].children.end()) {
+            const size_t child = nodes_.size();
+            nodes_.push_back(Node{frame, 0, 0, {}});
+            it = nodes_[node].children.emplace(frame, child).first;
+        }
+        node = it->second;
+        nodes_[node].weight += weight;
+    }
+    nodes_[node].self_weight += weight;
+}
+
+void FlameGraph::readCollapsed(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+    std::string line;
+    std::vector<std::string> frames;
+    while (std::getline(in, line)) {
+        const auto space = line.rfind(' ');
+        if (space == std::string::npos) {
+            continue;
+        }
+        uint64_t weight = 0;
+        try {
+            weight = std::stoull(line.substr(space + 1));
+        } catch (const std::exception&) {
+            continue;
+        }
+        frames.clear();
+        std::istringstream stack(line.substr(0, space));
+        std::string frame;
+        while (std::getline(stack, frame, ';')) {
+            frames.push_back(frame);
+        }
+        add(frames, weight);
+    }
+}
+
+void FlameGraph::writeCollapsed(const std::string& path) const {
+    std::string out;
+    std::function<void(size_t, const std::string&)> walk =
+        [&](size_t index, const std::string& stack) {
+            const auto& node = nodes_[index];
+            if (index != 0 && node.self_weight > 0) {
+                out += stack;
+                out += ' ';
+                out += std::to_string(node.self_weight);
+                out += '\n';
+            }
+            for (const auto& [name, child] : node.children) {
+                walk(child, stack.empty() ? name : stack + ";" + name);
+            }
+        };
+    walk(0, "");
+    writeFile(path, out);
+}
+
+size_t FlameGraph::depth(size_t node) const {
+    size_t deepest = 0;
+    for (const auto& [name, child] : nodes_[node].children) {
+        deepest = std::max(deepest, depth(child) + 1);
+    }
+    return deepest;
+}
+
+void FlameGraph::writeSvg(
+    const std::string& path,
+    const std::string& title,
+    const std::string& count_name
+) const {
+    const double total = static_cast<double>(std::max<uint64_t>(totalWeight(), 1));
+    const double scale = (kImageWidth - 2 * kPadding) / total;
+    const size_t levels = depth(0);
+    const double height = kTitleHeight + static_cast<double>(levels) * kFrameHeight + 2 * kPadding;
+
+    std::ostringstream svg;
+    svg << "<?xml version=\"1.0\" standalone=\"no\"?>\n"
+        << "<svg version=\"1.1\" xmlns=\"http://www.w3.org/2000/svg\" width=\"" << kImageWidth
+        << "\" height=\"" << height << "\" viewBox=\"0 0 " << kImageWidth << " " << height << "\">\n"
+        << "<rect x=\"0\" y=\"0\" width=\"100%\" height=\"100%\" fill=\"#eeeeee\"/>\n"
+        << "<text x=\"" << kImageWidth / 2 << "\" y=\"" << kTitleHeight - 6
+        << "\" text-anchor=\"middle\" font-family=\"Verdana\" font-size=\"17\">"
+        << escapeXml(title) << "</text>\n"
+        << "<g font-family=\"Verdana\" font-size=\"12\">\n";
+
+    // Корень - нижний ряд, дети над родителем слева направо
+    std::function<void(size_t, double, size_t)> draw = [&](size_t index, double x, size_t level) {
+        const auto& node = nodes_[index];
+        const double width = static_cast<double>(node.weight) * scale;
+        if (width < kMinWidth) {
+            return;
+        }
+        if (index != 0) {
+            const double y = height - kPadding - static_cast<double>(level) * kFrameHeight;
+            const std::string name = escapeXml(node.name);
+            svg << "<g><title>" << name << " (" << node.weight << " " << escapeXml(count_name)
+                << ", " << static_cast<double>(node.weight) * 100.0 / total << "%)</title>"
+                << "<rect x=\"" << x << "\" y=\"" << y << "\" width=\"" << width
+                << "\" height=\"" << kFrameHeight - 1 << "\" fill=\"" << frameColor(node.name)
+                << "\" rx=\"2\" ry=\"2\"/>";
+            const auto fits = static_cast<size_t>(width / kFontWidth);
+            if (fits >= 3) {
+                std::string label = node.name;
+                if (label.size() > fits) {
+                    label = label.substr(0, fits - 2) + "..";
+                }
+                svg << "<text x=\"" << x + 3 << "\" y=\"" << y + kFrameHeight - 4.5 << "\">"
+                    << escapeXml(label) << "</text>";
+            }
+            svg << "</g>\n";
+        }
+        double child_x = x;
+        for (const auto& [name, child] : node.children) {
+            draw(child, child_x, level + 1);
+            child_x += static_cast<double>(nodes_[child].weight) * scale;
+        }
+    };
+    draw(0, kPadding, 0);
+
+    svg << "</g>\n</svg>\n";
+    writeFile(path, svg.str());
+}
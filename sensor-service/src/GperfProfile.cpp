@@ -0,0 +1,120 @@
+#include "GperfProfile.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr const char* kHeapHeader = "heap profile:";
+constexpr const char* kHeapMappings = "MAPPED_LIBRARIES:";
+
+GperfProfile readCpu(const std::string& data) {
+    using Word = uintptr_t;
+    const size_t words = data.size() / sizeof(Word);
+    auto word = [&data](size_t index) {
+        Word value;
+        std::memcpy(&value, data.data() + index * sizeof(Word), sizeof(Word));
+        return value;
+    };
+
+    // Заголовок: 0, 3 (слов дальше), 0 (версия), период в мкс, 0
+    if (words < 5 || word(0) != 0 || word(1) != 3 || word(2) != 0) {
+        throw std::runtime_error("Not a gperftools CPU profile");
+    }
+    GperfProfile profile;
+    profile.kind = GperfProfile::Kind::CPU;
+    profile.period_us = word(3);
+
+    size_t index = 5;
+    while (index + 2 <= words) {
+        const Word count = word(index);
+        const Word depth = word(index + 1);
+        index += 2;
+        if (index + depth > words) {
+            throw std::runtime_error("Truncated gperftools CPU profile");
+        }
+        // Трейлер - запись 0, 1, 0
+        if (count == 0 && depth == 1 && word(index) == 0) {
+            index += 1;
+            break;
+        }
+        GperfProfile::Sample sample;
+        sample.weight = count;
+        sample.stack.reserve(depth);
+        for (Word i = 0; i < depth; ++i) {
+            sample.stack.push_back(word(index + i));
+        }
+        index += depth;
+        profile.samples.push_back(std::move(sample));
+    }
+
+    profile.mappings = data.substr(std::min(data.size(), index * sizeof(Word)));
+    return profile;
+}
+
+GperfProfile readHeap(const std::string& data) {
+    GperfProfile profile;
+    profile.kind = GperfProfile::Kind::HEAP;
+
+    std::istringstream lines(data);
+    std::string line;
+    std::getline(lines, line);
+    // heap_v2/<интервал>: байты записаны по выборке, их надо "развыбрать" как pprof
+    double sample_interval = 0.0;
+    const auto v2 = line.find("heap_v2/");
+    if (v2 != std::string::npos) {
+        sample_interval = std::strtod(line.c_str() + v2 + 8, nullptr);
+    }
+
+    while (std::getline(lines, line)) {
+        if (line.rfind(kHeapMappings, 0) == 0) {
+            profile.mappings = std::string(std::istreambuf_iterator<char>(lines), {});
+            break;
+        }
+        // "     1:   262144 [     1:   262144] @ 0x4005d1 0x400a2b"
+        unsigned long long objects = 0;
+        unsigned long long bytes = 0;
+        const auto at = line.find('@');
+        if (at == std::string::npos
+            || std::sscanf(line.c_str(), " %llu: %llu", &objects, &bytes) != 2
+            || bytes == 0) {
+            continue;
+        }
+        GperfProfile::Sample sample;
+        double weight = static_cast<double>(bytes);
+        if (sample_interval > 0.0 && objects > 0) {
+            const double average = weight / static_cast<double>(objects);
+            weight /= 1.0 - std::exp(-average / sample_interval);
+        }
+        sample.weight = static_cast<uint64_t>(weight);
+        std::istringstream addresses(line.substr(at + 1));
+        std::string address;
+        while (addresses >> address) {
+            sample.stack.push_back(std::stoull(address, nullptr, 16));
+        }
+        if (!sample.stack.empty()) {
+            profile.samples.push_back(std::move(sample));
+        }
+    }
+    return profile;
+}
+
+}  // namespace
+
+GperfProfile GperfProfile::read(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Failed to open profile " + path);
+    }
+    const std::string data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    if (data.rfind(kHeapHeader, 0) == 0) {
+        return readHeap(data);
+    }
+    return readCpu(data);
+}
@@ -0,0 +1,243 @@
+#include "HotMetrics.hpp"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+// Ячейки всех потоков и сумма завершившихся. Не разрушается: потоки могут
+// завершаться и после выхода из main()
+struct SlotRegistry {
+    std::mutex mutex;
+    std::vector<hot_metrics::ThreadSlots*> live;
+    uint64_t retired_counts[hot_metrics::kCountSlots]{};
+    double retired_sums[hot_metrics::kSumSlots]{};
+    uint32_t next_count{0};
+    uint32_t next_sum{0};
+};
+
+SlotRegistry& slotRegistry() {
+    static SlotRegistry* registry = new SlotRegistry;
+    return *registry;
+}
+
+// Переносит ячейки завершающегося потока в общую сумму
+struct ThreadSlotsOwner {
+    hot_metrics::ThreadSlots* slots{nullptr};
+
+    ~ThreadSlotsOwner() {
+        if (slots == nullptr) {
+            return;
+        }
+        auto& registry = slotRegistry();
+        {
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            for (uint32_t i = 0; i < registry.next_count; ++i) {
+                registry.retired_counts[i] += slots->counts[i].load(std::memory_order_relaxed);
+            }
+            for (uint32_t i = 0; i < registry.next_sum; ++i) {
+                registry.retired_sums[i] += slots->sums[i].load(std::memory_order_relaxed);
+            }
+            registry.live.erase(std::find(registry.live.begin(), registry.live.end(), slots));
+        }
+        hot_metrics::current_slots = nullptr;
+        delete slots;
+    }
+};
+
+thread_local ThreadSlotsOwner slots_owner;
+
+uint64_t sumCount(const SlotRegistry& registry, uint32_t slot) {
+    uint64_t total = registry.retired_counts[slot];
+    for (const auto* slots : registry.live) {
+        total += slots->counts[slot].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+double sumValue(const SlotRegistry& registry, uint32_t slot) {
+    double total = registry.retired_sums[slot];
+    for (const auto* slots : registry.live) {
+        total += slots->sums[slot].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+}  // namespace
+
+namespace hot_metrics {
+
+ThreadSlots* registerThread() {
+    auto* slots = new ThreadSlots;
+    for (auto& count : slots->counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    for (auto& sum : slots->sums) {
+        sum.store(0.0, std::memory_order_relaxed);
+    }
+    {
+        auto& registry = slotRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.live.push_back(slots);
+    }
+    // Первое обращение к slots_owner создает его, и деструктор вернет
+    // ячейки при завершении потока
+    slots_owner.slots = slots;
+    current_slots = slots;
+    return slots;
+}
+
+}  // namespace hot_metrics
+
+uint64_t HotCounter::value() const {
+    auto& registry = slotRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    return sumCount(registry, slot_);
+}
+
+HotHistogram::HotHistogram(std::vector<double> bounds, uint32_t first_slot, uint32_t sum_slot)
+    : bounds_(std::move(bounds))
+    , first_slot_(first_slot)
+    , sum_slot_(sum_slot) {
+}
+
+void HotHistogram::snapshot(std::vector<uint64_t>& buckets, double& sum) const {
+    auto& registry = slotRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    buckets.resize(bounds_.size() + 1);
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        buckets[i] = sumCount(registry, first_slot_ + static_cast<uint32_t>(i));
+    }
+    sum = sumValue(registry, sum_slot_);
+}
+
+HotMetrics::Family& HotMetrics::family(
+    const std::string& name,
+    const std::string& help,
+    prometheus::MetricType type
+) {
+    for (auto& family : families_) {
+        if (family->name == name) {
+            if (family->type != type) {
+                throw std::invalid_argument("Metric " + name + " is already registered with another type");
+            }
+            return *family;
+        }
+    }
+    auto family = std::make_unique<Family>();
+    family->name = name;
+    family->help = help;
+    family->type = type;
+    families_.push_back(std::move(family));
+    return *families_.back();
+}
+
+HotCounter& HotMetrics::counter(
+    const std::string& name,
+    const std::string& help,
+    const prometheus::Labels& labels
+) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& counters = family(name, help, prometheus::MetricType::Counter).counters;
+    for (auto& [existing, counter] : counters) {
+        if (existing == labels) {
+            return *counter;
+        }
+    }
+
+    uint32_t slot;
+    {
+        auto& registry = slotRegistry();
+        std::lock_guard<std::mutex> registry_lock(registry.mutex);
+        if (registry.next_count >= hot_metrics::kCountSlots) {
+            throw std::length_error("Out of hot metric slots registering " + name);
+        }
+        slot = registry.next_count++;
+    }
+    counters.emplace_back(labels, std::unique_ptr<HotCounter>(new HotCounter(slot)));
+    return *counters.back().second;
+}
+
+HotHistogram& HotMetrics::histogram(
+    const std::string& name,
+    const std::string& help,
+    std::vector<double> bounds,
+    const prometheus::Labels& labels
+) {
+    if (!std::is_sorted(bounds.begin(), bounds.end())) {
+        throw std::invalid_argument("Histogram " + name + " bounds must be ascending");
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& histograms = family(name, help, prometheus::MetricType::Histogram).histograms;
+    for (auto& [existing, histogram] : histograms) {
+        if (existing == labels) {
+            return *histogram;
+        }
+    }
+
+    uint32_t first_slot;
+    uint32_t sum_slot;
+    {
+        auto& registry = slotRegistry();
+        std::lock_guard<std::mutex> registry_lock(registry.mutex);
+        const auto needed = static_cast<uint32_t>(bounds.size() + 1);
+        if (registry.next_count + needed > hot_metrics::kCountSlots
+            || registry.next_sum >= hot_metrics::kSumSlots) {
+            throw std::length_error("Out of hot metric slots registering " + name);
+        }
+        first_slot = registry.next_count;
+        registry.next_count += needed;
+        sum_slot = registry.next_sum++;
+    }
+    histograms.emplace_back(labels, std::unique_ptr<HotHistogram>(
+        new HotHistogram(std::move(bounds), first_slot, sum_slot)));
+    return *histograms.back().second;
+}
+
+std::vector<prometheus::MetricFamily> HotMetrics::Collect() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<prometheus::MetricFamily> result;
+    result.reserve(families_.size());
+
+    std::vector<uint64_t> buckets;
+    for (const auto& family : families_) {
+        prometheus::MetricFamily out;
+        out.name = family->name;
+        out.help = family->help;
+        out.type = family->type;
+
+        for (const auto& [labels, counter] : family->counters) {
+            prometheus::ClientMetric metric;
+            for (const auto& [name, value] : labels) {
+                metric.label.push_back({name, value});
+            }
+            metric.counter.value = static_cast<double>(counter->value());
+            out.metric.push_back(std::move(metric));
+        }
+
+        for (const auto& [labels, histogram] : family->histograms) {
+            prometheus::ClientMetric metric;
+            for (const auto& [name, value] : labels) {
+                metric.label.push_back({name, value});
+            }
+            double sum = 0.0;
+            histogram->snapshot(buckets, sum);
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < buckets.size(); ++i) {
+                cumulative += buckets[i];
+                prometheus::ClientMetric::Bucket bucket;
+                bucket.cumulative_count = cumulative;
+                bucket.upper_bound = i < histogram->bounds().size()
+                    ? histogram->bounds()[i]
+                    : std::numeric_limits<double>::infinity();
+                metric.histogram.bucket.push_back(bucket);
+            }
+            metric.histogram.sample_count = cumulative;
+            metric.histogram.sample_sum = sum;
+            out.metric.push_back(std::move(metric));
+        }
+
+        result.push_back(std::move(out));
+    }
+    return result;
+}
@@ -1,65 +1,485 @@
 #include "HotPathAnalyzer.hpp"
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+using hot_path::kBuckets;
+using hot_path::kMaxScopes;
+using hot_path::kNoNode;
+
+// Итоги участка по всем потокам
+struct ScopeTotals {
+    uint64_t calls{0};
+    uint64_t ticks{0};
+    uint64_t max_ticks{0};
+    std::array<uint64_t, kBuckets> buckets{};
+};
+
+// Дерево вызовов, сведенное по путям из деревьев потоков
+struct CallTree {
+    struct Node {
+        uint32_t scope{kNoNode};
+        uint64_t calls{0};
+        uint64_t ticks{0};
+        std::vector<uint32_t> children;
+    };
+
+    // Узел 0 - корень
+    std::vector<Node> nodes = std::vector<Node>(1);
+
+    uint32_t child(uint32_t parent, uint32_t scope, bool create) {
+        for (uint32_t child : nodes[parent].children) {
+            if (nodes[child].scope == scope) {
+                return child;
+            }
+        }
+        if (!create) {
+            return kNoNode;
+        }
+        const auto index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(Node{scope, 0, 0, {}});
+        nodes[parent].children.push_back(index);
+        return index;
+    }
+
+    void add(const hot_path::ThreadCells& cells) {
+        // Родитель создается раньше детей, так что его узел уже сопоставлен
+        const uint32_t count = cells.node_count.load(std::memory_order_acquire);
+        std::vector<uint32_t> mapped(count, 0);
+        for (uint32_t i = 1; i < count; ++i) {
+            const auto& node = cells.nodes[i];
+            mapped[i] = child(mapped[node.parent], node.scope, true);
+            nodes[mapped[i]].calls += node.calls.load(std::memory_order_relaxed);
+            nodes[mapped[i]].ticks += node.ticks.load(std::memory_order_relaxed);
+        }
+    }
+
+    void subtract(const CallTree& base, uint32_t mine = 0, uint32_t theirs = 0) {
+        for (uint32_t base_child : base.nodes[theirs].children) {
+            const auto& from = base.nodes[base_child];
+            const uint32_t own = child(mine, from.scope, false);
+            if (own == kNoNode) {
+                continue;
+            }
+            nodes[own].calls -= std::min(nodes[own].calls, from.calls);
+            nodes[own].ticks -= std::min(nodes[own].ticks, from.ticks);
+            subtract(base, own, base_child);
+        }
+    }
+};
+
+// Имена участков, ячейки живых потоков и сумма завершившихся.
+// Не разрушается: потоки могут завершаться и после выхода из main()
+struct ScopeRegistry {
+    std::mutex mutex;
+    std::vector<std::string> names;
+    std::vector<hot_path::ThreadCells*> live;
+    hot_path::ThreadCells retired;
+    CallTree retired_tree;
+    // Снимок на момент reset(); вычитается из итогов
+    std::vector<ScopeTotals> baseline;
+    CallTree baseline_tree;
+    // Опорная точка для пересчета тактов в секунды
+    const uint64_t origin_ticks{hot_path::now()};
+    const std::chrono::steady_clock::time_point origin_time{std::chrono::steady_clock::now()};
+};
+
+ScopeRegistry& scopeRegistry() {
+    static ScopeRegistry* registry = new ScopeRegistry;
+    return *registry;
+}
+
+void mergeCell(hot_path::ScopeCell& into, const hot_path::ScopeCell& from) {
+    hot_path::add(into.calls, from.calls.load(std::memory_order_relaxed));
+    hot_path::add(into.ticks, from.ticks.load(std::memory_order_relaxed));
+    const uint64_t max = from.max_ticks.load(std::memory_order_relaxed);
+    if (max > into.max_ticks.load(std::memory_order_relaxed)) {
+        into.max_ticks.store(max, std::memory_order_relaxed);
+    }
+    for (uint32_t i = 0; i < kBuckets; ++i) {
+        hot_path::add(into.buckets[i], from.buckets[i].load(std::memory_order_relaxed));
+    }
+}
+
+void accumulate(ScopeTotals& totals, const hot_path::ScopeCell& cell) {
+    totals.calls += cell.calls.load(std::memory_order_relaxed);
+    totals.ticks += cell.ticks.load(std::memory_order_relaxed);
+    totals.max_ticks = std::max(totals.max_ticks, cell.max_ticks.load(std::memory_order_relaxed));
+    for (uint32_t i = 0; i < kBuckets; ++i) {
+        totals.buckets[i] += cell.buckets[i].load(std::memory_order_relaxed);
+    }
+}
+
+// Ячейки завершающегося потока переносятся в retired
+struct ThreadCellsOwner {
+    hot_path::ThreadCells* cells{nullptr};
+
+    ~ThreadCellsOwner() {
+        if (cells == nullptr) {
+            return;
+        }
+        auto& registry = scopeRegistry();
+        {
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            for (uint32_t scope = 0; scope < kMaxScopes; ++scope) {
+                auto* cell = cells->scopes[scope].load(std::memory_order_acquire);
+                if (cell == nullptr) {
+                    continue;
+                }
+                auto* retired = registry.retired.scopes[scope].load(std::memory_order_relaxed);
+                if (retired == nullptr) {
+                    retired = new hot_path::ScopeCell;
+                    registry.retired.scopes[scope].store(retired, std::memory_order_release);
+                }
+                mergeCell(*retired, *cell);
+            }
+            registry.retired_tree.add(*cells);
+            registry.live.erase(std::find(registry.live.begin(), registry.live.end(), cells));
+        }
+        hot_path::current_cells = nullptr;
+        for (auto& scope : cells->scopes) {
+            delete scope.load(std::memory_order_relaxed);
+        }
+        delete cells;
+    }
+};
+
+thread_local ThreadCellsOwner cells_owner;
+
+// Итоги всех участков с вычетом baseline. Под мьютексом реестра
+std::vector<ScopeTotals> collectTotals(const ScopeRegistry& registry) {
+    std::vector<ScopeTotals> totals(registry.names.size());
+    auto add_cells = [&](const hot_path::ThreadCells& cells) {
+        for (size_t scope = 0; scope < totals.size(); ++scope) {
+            const auto* cell = cells.scopes[scope].load(std::memory_order_acquire);
+            if (cell != nullptr) {
+                accumulate(totals[scope], *cell);
+            }
+        }
+    };
+    add_cells(registry.retired);
+    for (const auto* cells : registry.live) {
+        add_cells(*cells);
+    }
+
+    for (size_t scope = 0; scope < registry.baseline.size() && scope < totals.size(); ++scope) {
+        auto& total = totals[scope];
+        const auto& base = registry.baseline[scope];
+        total.calls -= std::min(total.calls, base.calls);
+        total.ticks -= std::min(total.ticks, base.ticks);
+        uint32_t highest = kBuckets;
+        for (uint32_t i = 0; i < kBuckets; ++i) {
+            total.buckets[i] -= std::min(total.buckets[i], base.buckets[i]);
+            if (total.buckets[i] != 0) {
+                highest = i;
+            }
+        }
+        // Точный максимум с reset() не сбрасывается; после него он не
+        // больше верхней границы старшей непустой корзины
+        if (highest == kBuckets) {
+            total.max_ticks = 0;
+        } else if (highest + 1 < kBuckets) {
+            total.max_ticks = std::min(total.max_ticks, hot_path::bucketFloor(highest + 1) - 1);
+        }
+    }
+    return totals;
+}
+
+CallTree collectTree(const ScopeRegistry& registry) {
+    CallTree tree = registry.retired_tree;
+    for (const auto* cells : registry.live) {
+        tree.add(*cells);
+    }
+    tree.subtract(registry.baseline_tree);
+    return tree;
+}
+
+// Имя кадра для collapsed stacks: ';' разделяет кадры, перевод строки - записи
+std::string frameName(const std::string& name) {
+    std::string frame = name;
+    std::replace(frame.begin(), frame.end(), ';', ':');
+    std::replace(frame.begin(), frame.end(), '\n', ' ');
+    return frame;
+}
+
+// Длительность такта по опорной точке реестра. Сразу после старта
+// интервал слишком короткий для точной оценки, и его приходится дождаться
+double secondsPerTick(const ScopeRegistry& registry) {
+#if defined(__x86_64__) || defined(__i386__)
+    constexpr auto kMinInterval = std::chrono::milliseconds(10);
+    auto elapsed = std::chrono::steady_clock::now() - registry.origin_time;
+    while (elapsed < kMinInterval) {
+        elapsed = std::chrono::steady_clock::now() - registry.origin_time;
+    }
+    const uint64_t ticks = hot_path::now() - registry.origin_ticks;
+    return std::chrono::duration<double>(elapsed).count() / static_cast<double>(ticks);
+#else
+    (void)registry;
+    return 1e-9;
+#endif
+}
+
+// Квантиль в тактах: середина корзины, в которую попал ранг, но не больше максимума
+double quantileTicks(const ScopeTotals& totals, double quantile) {
+    if (totals.calls == 0) {
+        return 0.0;
+    }
+    const auto rank = static_cast<uint64_t>(std::ceil(quantile * static_cast<double>(totals.calls)));
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < kBuckets; ++i) {
+        seen += totals.buckets[i];
+        if (seen >= rank && totals.buckets[i] != 0) {
+            const double floor = static_cast<double>(hot_path::bucketFloor(i));
+            const double width = i + 1 < kBuckets
+                ? static_cast<double>(hot_path::bucketFloor(i + 1)) - floor
+                : 0.0;
+            return std::min(floor + (width - 1.0) / 2.0, static_cast<double>(totals.max_ticks));
+        }
+    }
+    return static_cast<double>(totals.max_ticks);
+}
+
+}  // namespace
+
+namespace hot_path {
+
+ScopeCell::ScopeCell() {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+ThreadCells::ThreadCells()
+    : nodes(std::make_unique<TreeNode[]>(kMaxNodes)) {
+    for (auto& scope : scopes) {
+        scope.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+ThreadCells* registerThread() {
+    auto* cells = new ThreadCells;
+    {
+        auto& registry = scopeRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.live.push_back(cells);
+    }
+    cells_owner.cells = cells;
+    current_cells = cells;
+    return cells;
+}
+
+ScopeCell* createCell(ThreadCells& cells, uint32_t scope) {
+    // Одна аллокация на участок и поток; release - чтобы Collect()
+    // увидел обнуленную ячейку
+    auto* cell = new ScopeCell;
+    cells.scopes[scope].store(cell, std::memory_order_release);
+    return cell;
+}
+
+uint32_t addNode(ThreadCells& cells, uint32_t parent, uint32_t scope) {
+    const uint32_t index = cells.node_count.load(std::memory_order_relaxed);
+    if (index >= kMaxNodes) {
+        return kNoNode;
+    }
+    auto& node = cells.nodes[index];
+    node.parent = parent;
+    node.scope = scope;
+    node.next_sibling = cells.nodes[parent].first_child;
+    cells.nodes[parent].first_child = index;
+    // Узел виден читателям только заполненным
+    cells.node_count.store(index + 1, std::memory_order_release);
+    return index;
+}
+
+}  // namespace hot_path
+
+HotPathAnalyzer::HotPathAnalyzer() = default;
 
 HotPathAnalyzer& HotPathAnalyzer::getInstance() {
-    static HotPathAnalyzer instance;
-    return instance;
-}
-
-void HotPathAnalyzer::recordPath(
-    const std::string& path,
-    std::chrono::microseconds duration
-) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto& stats = stats_[path];
-    stats.path = path;
-    stats.total_time += duration;
-    stats.calls++;
-    stats.avg_time = static_cast<double>(stats.total_time.count()) / stats.calls;
-}
-
-std::vector<HotPathAnalyzer::PathStats> HotPathAnalyzer::getHotPaths(
-    size_t top_n
-) const {
-    std::lock_guard<std::mutex> lock(mutex_);
+    return *shared();
+}
+
+std::shared_ptr<HotPathAnalyzer> HotPathAnalyzer::shared() {
+    static auto* instance = new std::shared_ptr<HotPathAnalyzer>(new HotPathAnalyzer);
+    return *instance;
+}
+
+uint32_t HotPathAnalyzer::registerScope(const char* name) {
+    auto& registry = scopeRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (size_t scope = 0; scope < registry.names.size(); ++scope) {
+        if (registry.names[scope] == name) {
+            return static_cast<uint32_t>(scope);
+        }
+    }
+    if (registry.names.size() >= kMaxScopes) {
+        throw std::length_error(std::string("Out of profile scopes registering ") + name);
+    }
+    registry.names.emplace_back(name);
+    return static_cast<uint32_t>(registry.names.size() - 1);
+}
+
+std::vector<HotPathAnalyzer::PathStats> HotPathAnalyzer::getHotPaths(size_t top_n) const {
+    auto& registry = scopeRegistry();
     std::vector<PathStats> paths;
-    paths.reserve(stats_.size());
-    
-    for (const auto& [_, stats] : stats_) {
-        paths.push_back(stats);
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        const auto totals = collectTotals(registry);
+        const double us_per_tick = secondsPerTick(registry) * 1e6;
+        for (size_t scope = 0; scope < totals.size(); ++scope) {
+            const auto& total = totals[scope];
+            if (total.calls == 0) {
+                continue;
+            }
+            PathStats stats;
+            stats.path = registry.names[scope];
+            stats.calls = total.calls;
+            stats.total_time = std::chrono::microseconds(
+                static_cast<int64_t>(static_cast<double>(total.ticks) * us_per_tick));
+            stats.avg_time = static_cast<double>(total.ticks) * us_per_tick / static_cast<double>(total.calls);
+            stats.p50 = quantileTicks(total, 0.5) * us_per_tick;
+            stats.p99 = quantileTicks(total, 0.99) * us_per_tick;
+            stats.max = static_cast<double>(total.max_ticks) * us_per_tick;
+            paths.push_back(std::move(stats));
+        }
     }
-    
+
     std::sort(paths.begin(), paths.end(),
         [](const PathStats& a, const PathStats& b) {
-            return a.avg_time > b.avg_time;
+            return a.total_time > b.total_time;
         }
     );
-    
     if (paths.size() > top_n) {
         paths.resize(top_n);
     }
-    
     return paths;
 }
 
+HotPathAnalyzer::CallNode HotPathAnalyzer::getCallTree() const {
+    auto& registry = scopeRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    const CallTree tree = collectTree(registry);
+    const double us_per_tick = secondsPerTick(registry) * 1e6;
+
+    std::function<CallNode(uint32_t)> convert = [&](uint32_t index) {
+        const auto& node = tree.nodes[index];
+        CallNode out;
+        if (node.scope != kNoNode) {
+            out.name = registry.names[node.scope];
+        }
+        out.calls = node.calls;
+        out.total_time = static_cast<double>(node.ticks) * us_per_tick;
+        double children_time = 0.0;
+        for (uint32_t child : node.children) {
+            CallNode converted = convert(child);
+            // Пути, по которым с reset() не было вызовов
+            if (converted.calls == 0 && converted.children.empty()) {
+                continue;
+            }
+            children_time += converted.total_time;
+            out.children.push_back(std::move(converted));
+        }
+        if (node.scope == kNoNode) {
+            out.total_time = children_time;
+        }
+        // Открытые сейчас участки еще не добавили свое время, а дети уже
+        out.self_time = std::max(0.0, out.total_time - children_time);
+        std::sort(out.children.begin(), out.children.end(),
+            [](const CallNode& a, const CallNode& b) {
+                return a.total_time > b.total_time;
+            }
+        );
+        return out;
+    };
+    return convert(0);
+}
+
+std::string HotPathAnalyzer::getCollapsedStacks() const {
+    std::string result;
+    std::function<void(const CallNode&, const std::string&)> walk =
+        [&](const CallNode& node, const std::string& stack) {
+            const auto self = std::llround(node.self_time);
+            if (!stack.empty() && self > 0) {
+                result += stack;
+                result += ' ';
+                result += std::to_string(self);
+                result += '\n';
+            }
+            for (const auto& child : node.children) {
+                walk(child, stack.empty() ? frameName(child.name) : stack + ";" + frameName(child.name));
+            }
+        };
+    walk(getCallTree(), "");
+    return result;
+}
+
+void HotPathAnalyzer::writeCollapsedStacks(const std::string& path) const {
+    const std::string stacks = getCollapsedStacks();
+    std::ofstream out(path, std::ios::trunc);
+    out << stacks;
+    if (!out) {
+        throw std::runtime_error("Failed to write collapsed stacks to " + path);
+    }
+}
+
 void HotPathAnalyzer::reset() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    stats_.clear();
-}
-
-HotPathAnalyzer::ScopedProfile::ScopedProfile(
-    const std::string& path,
-    HotPathAnalyzer& analyzer
-)
-    : path_(path)
-    , analyzer_(analyzer)
-    , start_(std::chrono::steady_clock::now())
-{}
-
-HotPathAnalyzer::ScopedProfile::~ScopedProfile() {
-    auto end = std::chrono::steady_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
-        end - start_
-    );
-    analyzer_.recordPath(path_, duration);
-} 
\ No newline at end of file
+    // Ячейки пишет только поток-владелец, поэтому обнулить их отсюда нельзя:
+    // вместо этого запоминаются текущие итоги
+    auto& registry = scopeRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.baseline.clear();
+    registry.baseline_tree = CallTree{};
+    auto totals = collectTotals(registry);
+    auto tree = collectTree(registry);
+    registry.baseline = std::move(totals);
+    registry.baseline_tree = std::move(tree);
+}
+
+std::vector<prometheus::MetricFamily> HotPathAnalyzer::Collect() const {
+    prometheus::MetricFamily durations;
+    durations.name = "sensor_service_scope_duration_seconds";
+    durations.help = "Duration of profiled code scopes";
+    durations.type = prometheus::MetricType::Summary;
+
+    prometheus::MetricFamily maxima;
+    maxima.name = "sensor_service_scope_duration_max_seconds";
+    maxima.help = "Longest observed duration of profiled code scopes";
+    maxima.type = prometheus::MetricType::Gauge;
+
+    auto& registry = scopeRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    const auto totals = collectTotals(registry);
+    if (totals.empty()) {
+        return {};
+    }
+    const double seconds_per_tick = secondsPerTick(registry);
+
+    for (size_t scope = 0; scope < totals.size(); ++scope) {
+        const auto& total = totals[scope];
+
+        prometheus::ClientMetric duration;
+        duration.label.push_back({"scope", registry.names[scope]});
+        duration.summary.sample_count = total.calls;
+        duration.summary.sample_sum = static_cast<double>(total.ticks) * seconds_per_tick;
+        for (double quantile : {0.5, 0.99}) {
+            duration.summary.quantile.push_back({quantile, quantileTicks(total, quantile) * seconds_per_tick});
+        }
+        durations.metric.push_back(std::move(duration));
+
+        prometheus::ClientMetric max;
+        max.label.push_back({"scope", registry.names[scope]});
+        max.gauge.value = static_cast<double>(total.max_ticks) * seconds_per_tick;
+        maxima.metric.push_back(std::move(max));
+    }
+
+    std::vector<prometheus::MetricFamily> families;
+    families.push_back(std::move(durations));
+    families.push_back(std::move(maxima));
+    return families;
+}
@@ -1,5 +1,11 @@
 #include "KafkaProducer.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <iostream>
+#include <new>
+#include <nlohmann/json.hpp>
+#include "Metrics.hpp"
 
 KafkaProducer::KafkaProducer(const std::string& brokers, const std::string& topic) 
     : topic_(topic) {
@@ -11,6 +17,16 @@ KafkaProducer::KafkaProducer(const std::string& brokers, const std::string& topi
     conf->set("queue.buffering.max.messages", "100000", errstr);
     conf->set("queue.buffering.max.ms", "50", errstr);
     conf->set("batch.num.messages", "10000", errstr);
+    // Внутренние повторы librdkafka не должны менять порядок сообщений одного ключа
+    conf->set("enable.idempotence", "true", errstr);
+
+    if (conf->set("dr_cb", &delivery_handler_, errstr) != RdKafka::Conf::CONF_OK) {
+        throw std::runtime_error("Failed to set delivery report callback: " + errstr);
+    }
+    conf->set("statistics.interval.ms", std::to_string(kStatisticsIntervalMs), errstr);
+    if (conf->set("event_cb", &event_handler_, errstr) != RdKafka::Conf::CONF_OK) {
+        throw std::runtime_error("Failed to set event callback: " + errstr);
+    }
 
     producer_.reset(RdKafka::Producer::create(conf, errstr));
     if (!producer_) {
@@ -25,32 +41,430 @@ KafkaProducer::KafkaProducer(const std::string& brokers, const std::string& topi
 
     delete conf;
     delete tconf;
+
+    service_thread_ = std::thread(&KafkaProducer::serviceLoop, this);
 }
 
 KafkaProducer::~KafkaProducer() {
     flush();
+
+    running_ = false;
+    if (service_thread_.joinable()) {
+        service_thread_.join();
+    }
+    dropPendingRetries();
+}
+
+namespace {
+
+// Ошибки, которые не исправятся повторной отправкой того же сообщения
+bool isRetriable(RdKafka::ErrorCode err) {
+    switch (err) {
+        case RdKafka::ERR_MSG_SIZE_TOO_LARGE:
+        case RdKafka::ERR__INVALID_ARG:
+        case RdKafka::ERR__UNKNOWN_TOPIC:
+        case RdKafka::ERR__UNKNOWN_PARTITION:
+            return false;
+        default:
+            return true;
+    }
+}
+
+}  // namespace
+
+void KafkaProducer::DeliveryReportHandler::dr_cb(RdKafka::Message& message) {
+    producer_.onDelivery(message);
+}
+
+void KafkaProducer::EventHandler::event_cb(RdKafka::Event& event) {
+    switch (event.type()) {
+        case RdKafka::Event::EVENT_STATS:
+            producer_.onStatistics(event.str());
+            break;
+        case RdKafka::Event::EVENT_ERROR:
+            producer_.counters_.errors++;
+            std::cerr << "Kafka error: " << RdKafka::err2str(event.err())
+                      << " " << event.str() << std::endl;
+            break;
+        default:
+            break;
+    }
 }
 
-bool KafkaProducer::produce(const std::string& message) {
-    RdKafka::ErrorCode err = producer_->produce(
+void KafkaProducer::setMetrics(Metrics* metrics) {
+    metrics_.store(metrics, std::memory_order_release);
+}
+
+void KafkaProducer::setLatencyTracker(LatencyTracker* tracker) {
+    latency_.store(tracker, std::memory_order_release);
+}
+
+void KafkaProducer::discard(Buffer* buffer) {
+    if (buffer->group != nullptr) {
+        buffer->group->fail();
+    }
+    buffer_pool_.release(buffer);
+}
+
+void KafkaProducer::recordFailure(Buffer* buffer) {
+    discard(buffer);
+    counters_.messages_failed++;
+    if (Metrics* metrics = metrics_.load(std::memory_order_acquire)) {
+        metrics->incrementMessagesFailures();
+    }
+}
+
+void KafkaProducer::onDelivery(RdKafka::Message& message) {
+    auto* buffer = static_cast<Buffer*>(message.msg_opaque());
+    Metrics* metrics = metrics_.load(std::memory_order_acquire);
+
+    if (message.err() == RdKafka::ERR_NO_ERROR) {
+        counters_.messages_sent++;
+        if (buffer->trace != 0) {
+            if (LatencyTracker* latency = latency_.load(std::memory_order_acquire)) {
+                latency->mark(buffer->trace, LatencyTracker::Stage::ACKED,
+                              std::chrono::steady_clock::now());
+            }
+        }
+        if (metrics) {
+            metrics->incrementMessagesSent();
+            // latency() - микросекунды от produce() до подтверждения брокера
+            metrics->observeDeliveryLatency(static_cast<double>(message.latency()) / 1e6);
+        }
+        buffer_pool_.release(buffer);
+        return;
+    }
+
+    counters_.errors++;
+    if (metrics) {
+        metrics->incrementErrors();
+    }
+    if (!isRetriable(message.err())) {
+        recordFailure(buffer);
+        return;
+    }
+
+    // librdkafka уже исчерпал свои повторы (message.timeout.ms),
+    // оставляем сообщение себе и пробуем позже
+    scheduleRetry(buffer);
+}
+
+KafkaProducer::Buffer* KafkaProducer::acquireBuffer(size_t size) {
+    return buffer_pool_.acquire(size);
+}
+
+void KafkaProducer::releaseBuffer(Buffer* buffer) {
+    discard(buffer);
+}
+
+void KafkaProducer::setKey(Buffer* buffer, std::string_view key) {
+    buffer->key_size = std::min(key.size(), BufferPool::kMaxKeySize);
+    std::memcpy(buffer->key, key.data(), buffer->key_size);
+}
+
+void KafkaProducer::setKey(Buffer* buffer, int64_t key) {
+    auto result = std::to_chars(buffer->key, buffer->key + BufferPool::kMaxKeySize, key);
+    buffer->key_size = static_cast<size_t>(result.ptr - buffer->key);
+}
+
+KafkaProducer::Buffer* KafkaProducer::copyToBuffer(std::string_view message, std::string_view key) {
+    Buffer* buffer = buffer_pool_.acquire(message.size());
+    std::memcpy(buffer->data, message.data(), message.size());
+    buffer->size = message.size();
+    setKey(buffer, key);
+    return buffer;
+}
+
+RdKafka::ErrorCode KafkaProducer::enqueue(Buffer* buffer) {
+    // Без RK_MSG_COPY и RK_MSG_FREE: librdkafka читает прямо из буфера пула,
+    // а освобождает его наш DeliveryReportHandler через msg_opaque
+    const RdKafka::ErrorCode err = producer_->produce(
         topic_ptr_.get(),
         RdKafka::Topic::PARTITION_UA,
-        RdKafka::Producer::RK_MSG_COPY,
-        const_cast<char*>(message.c_str()),
-        message.size(),
-        nullptr, nullptr
+        0,
+        buffer->data,
+        buffer->size,
+        buffer->key_size > 0 ? buffer->key : nullptr,
+        buffer->key_size,
+        buffer
     );
+    if (err == RdKafka::ERR_NO_ERROR) {
+        if (Metrics* metrics = metrics_.load(std::memory_order_acquire)) {
+            metrics->countStage(Metrics::Stage::PRODUCED);
+        }
+        if (buffer->trace != 0) {
+            if (LatencyTracker* latency = latency_.load(std::memory_order_acquire)) {
+                latency->mark(buffer->trace, LatencyTracker::Stage::PRODUCED,
+                              std::chrono::steady_clock::now());
+            }
+        }
+    }
+    return err;
+}
+
+bool KafkaProducer::produce(Buffer* buffer) {
+    RdKafka::ErrorCode err = enqueue(buffer);
 
     if (err != RdKafka::ERR_NO_ERROR) {
         std::cerr << "Failed to produce message: " 
                   << RdKafka::err2str(err) << std::endl;
+        discard(buffer);
         return false;
     }
+    return true;
+}
+
+bool KafkaProducer::produceWithRetry(Buffer* buffer) {
+    bool accepted = true;
+    if (held_keys_.load(std::memory_order_acquire) > 0 && holdBack(buffer, accepted)) {
+        return accepted;
+    }
+    return send(buffer);
+}
+
+bool KafkaProducer::send(Buffer* buffer) {
+    RdKafka::ErrorCode err = enqueue(buffer);
+    if (err == RdKafka::ERR_NO_ERROR) {
+        return true;
+    }
+    if (!isRetriable(err)) {
+        std::cerr << "Failed to produce message: "
+                  << RdKafka::err2str(err) << std::endl;
+        recordFailure(buffer);
+        return false;
+    }
+    return scheduleRetry(buffer);
+}
+
+size_t KafkaProducer::produceBatch(const std::vector<Buffer*>& buffers) {
+    size_t failed = 0;
+    for (Buffer* buffer : buffers) {
+        if (!produceWithRetry(buffer)) {
+            ++failed;
+        }
+    }
+    return failed;
+}
 
-    producer_->poll(0);
+bool KafkaProducer::holdBack(Buffer* buffer, bool& accepted) {
+    // Без ключа порядок не гарантируется, и ждать нечего
+    if (buffer->key_size == 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(retry_mutex_);
+    auto it = backlogs_.find(std::string(buffer->key, buffer->key_size));
+    if (it == backlogs_.end()) {
+        return false;
+    }
+    accepted = pending_retries_.load(std::memory_order_relaxed) < kMaxPendingRetries;
+    if (!accepted) {
+        recordFailure(buffer);
+        return true;
+    }
+    try {
+        it->second.held.push_back(buffer);
+    } catch (const std::bad_alloc&) {
+        recordFailure(buffer);
+        accepted = false;
+        return true;
+    }
+    pending_retries_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool KafkaProducer::scheduleRetry(Buffer* buffer) {
+    const int attempt = buffer->attempts++;
+    if (attempt >= retry_manager_.maxRetries()) {
+        recordFailure(buffer);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(retry_mutex_);
+    if (pending_retries_.load(std::memory_order_relaxed) >= kMaxPendingRetries) {
+        recordFailure(buffer);
+        return false;
+    }
+
+    try {
+        // Повтор встает за уже отложенными сообщениями ключа; время
+        // повтора задает первое из них
+        std::string key(buffer->key, buffer->key_size);
+        auto [it, created] = backlogs_.try_emplace(key);
+        if (created) {
+            try {
+                retry_queue_.push({
+                    std::chrono::steady_clock::now() + retry_manager_.calculateDelay(attempt),
+                    std::move(key)
+                });
+            } catch (...) {
+                backlogs_.erase(it);
+                throw;
+            }
+            held_keys_.fetch_add(1, std::memory_order_release);
+        }
+        it->second.failed.push_back(buffer);
+    } catch (const std::bad_alloc&) {
+        // produce не бросает: вызывающий уже отдал буфер
+        recordFailure(buffer);
+        return false;
+    }
+    pending_retries_.fetch_add(1, std::memory_order_relaxed);
+
+    if (Metrics* metrics = metrics_.load(std::memory_order_acquire)) {
+        metrics->incrementRetries();
+    }
+    counters_.retries++;
     return true;
 }
 
+void KafkaProducer::sendBacklog(Backlog backlog) {
+    // Если повтор снова не ушел, у ключа опять есть очередь, и остаток
+    // встает за ним через produceWithRetry
+    for (Buffer* buffer : backlog.failed) {
+        produceWithRetry(buffer);
+    }
+    for (Buffer* buffer : backlog.held) {
+        produceWithRetry(buffer);
+    }
+}
+
+void KafkaProducer::serviceLoop() {
+    constexpr auto kMaxPollInterval = std::chrono::milliseconds(100);
+
+    while (running_) {
+        auto wait = std::min(processDueRetries(), kMaxPollInterval);
+        // Отчеты о доставке обрабатываются здесь, а не в потоке обработки
+        producer_->poll(static_cast<int>(wait.count()));
+    }
+}
+
+std::chrono::milliseconds KafkaProducer::processDueRetries() {
+    std::vector<Backlog> due;
+    std::chrono::milliseconds next_due = std::chrono::milliseconds::max();
+    {
+        std::lock_guard<std::mutex> lock(retry_mutex_);
+        auto now = std::chrono::steady_clock::now();
+        while (!retry_queue_.empty() && retry_queue_.top().due <= now) {
+            due.push_back(takeBacklog(retry_queue_.top().key));
+            retry_queue_.pop();
+        }
+        if (!retry_queue_.empty()) {
+            next_due = std::chrono::duration_cast<std::chrono::milliseconds>(
+                retry_queue_.top().due - now
+            );
+        }
+    }
+
+    // Повторная ошибка снова попадает в очередь с увеличенной задержкой
+    for (auto& backlog : due) {
+        sendBacklog(std::move(backlog));
+    }
+    return next_due;
+}
+
+KafkaProducer::Backlog KafkaProducer::takeBacklog(const std::string& key) {
+    auto it = backlogs_.find(key);
+    Backlog backlog = std::move(it->second);
+    backlogs_.erase(it);
+    held_keys_.fetch_sub(1, std::memory_order_release);
+    pending_retries_.fetch_sub(backlog.failed.size() + backlog.held.size(), std::memory_order_relaxed);
+    return backlog;
+}
+
+void KafkaProducer::dropPendingRetries() {
+    std::lock_guard<std::mutex> lock(retry_mutex_);
+    while (!retry_queue_.empty()) {
+        Backlog backlog = takeBacklog(retry_queue_.top().key);
+        retry_queue_.pop();
+        for (auto* queue : {&backlog.failed, &backlog.held}) {
+            for (Buffer* buffer : *queue) {
+                recordFailure(buffer);
+            }
+        }
+    }
+}
+
+void KafkaProducer::onStatistics(const std::string& json) {
+    Metrics* metrics = metrics_.load(std::memory_order_acquire);
+    if (!metrics) {
+        return;
+    }
+
+    try {
+        auto stats = nlohmann::json::parse(json);
+
+        // Времена в статистике librdkafka - в микросекундах
+        for (const auto& [name, broker] : stats.value("brokers", nlohmann::json::object()).items()) {
+            // Брокеры из bootstrap.servers до получения метаданных имеют nodeid -1
+            if (broker.value("nodeid", -1) < 0 || !broker.contains("rtt")) {
+                continue;
+            }
+            const auto& rtt = broker["rtt"];
+            metrics->setBrokerRtt(
+                name,
+                rtt.value("avg", 0.0) / 1e6,
+                rtt.value("p99", 0.0) / 1e6
+            );
+        }
+
+        auto topics = stats.value("topics", nlohmann::json::object());
+        if (topics.contains(topic_)) {
+            const auto& topic = topics[topic_];
+            metrics->setProducerBatchStats(
+                topic.value("batchcnt", nlohmann::json::object()).value("avg", 0.0),
+                topic.value("batchsize", nlohmann::json::object()).value("avg", 0.0)
+            );
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to parse Kafka statistics: " << e.what() << std::endl;
+    }
+}
+
+KafkaProducer::Stats KafkaProducer::getStats() const {
+    Stats stats;
+    stats.messages_sent = counters_.messages_sent.load(std::memory_order_relaxed);
+    stats.messages_failed = counters_.messages_failed.load(std::memory_order_relaxed);
+    stats.retries = counters_.retries.load(std::memory_order_relaxed);
+    stats.errors = counters_.errors.load(std::memory_order_relaxed);
+    stats.outq_len = static_cast<uint64_t>(producer_->outq_len());
+    stats.pending_retries = pendingRetries();
+    return stats;
+}
+
+size_t KafkaProducer::pendingRetries() const {
+    return pending_retries_.load(std::memory_order_relaxed);
+}
+
+bool KafkaProducer::isBackedUp() const {
+    return static_cast<size_t>(producer_->outq_len()) + pendingRetries()
+        >= static_cast<size_t>(kBackpressureOutqLen);
+}
+
+bool KafkaProducer::produce(std::string_view message, std::string_view key) {
+    return produce(copyToBuffer(message, key));
+}
+
+bool KafkaProducer::produceWithRetry(std::string_view message, std::string_view key) {
+    return produceWithRetry(copyToBuffer(message, key));
+}
+
 void KafkaProducer::flush(int timeout_ms) {
+    // Отложенные повторы отправляем сразу, не дожидаясь их времени
+    std::vector<Backlog> pending;
+    {
+        std::lock_guard<std::mutex> lock(retry_mutex_);
+        while (!retry_queue_.empty()) {
+            pending.push_back(takeBacklog(retry_queue_.top().key));
+            retry_queue_.pop();
+        }
+    }
+    for (auto& backlog : pending) {
+        sendBacklog(std::move(backlog));
+    }
+
     producer_->flush(timeout_ms);
-} 
\ No newline at end of file
+}
+
+BufferPool::Stats KafkaProducer::getBufferPoolStats() const {
+    return buffer_pool_.getStats();
+}
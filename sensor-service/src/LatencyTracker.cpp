@@ -0,0 +1,72 @@
+#include "LatencyTracker.hpp"
+#include <stdexcept>
+#include "Metrics.hpp"
+
+LatencyTracker::LatencyTracker(Config config, Metrics* metrics)
+    : config_(config)
+    , metrics_(metrics) {
+    if (config_.capacity == 0) {
+        throw std::invalid_argument("Latency tracker capacity must be positive");
+    }
+    slots_ = std::make_unique<Slot[]>(config_.capacity);
+}
+
+int64_t LatencyTracker::toNanos(std::chrono::steady_clock::time_point time) const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - epoch_).count();
+}
+
+uint32_t LatencyTracker::begin(std::chrono::steady_clock::time_point read_time) {
+    uint32_t trace = next_trace_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (trace == 0) {
+        trace = next_trace_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+    Slot& slot = slots_[trace % config_.capacity];
+    for (auto& stamp : slot.stamps) {
+        stamp.store(0, std::memory_order_relaxed);
+    }
+    slot.stamps[static_cast<size_t>(Stage::READ)].store(toNanos(read_time), std::memory_order_relaxed);
+    // Метки пишут разные потоки по очереди, но образец между ними
+    // передается через очереди с release/acquire, так что relaxed хватает
+    slot.trace.store(trace, std::memory_order_relaxed);
+    return trace;
+}
+
+void LatencyTracker::mark(uint32_t trace, Stage stage, std::chrono::steady_clock::time_point now) {
+    if (trace == 0) {
+        return;
+    }
+    Slot& slot = slots_[trace % config_.capacity];
+    if (slot.trace.load(std::memory_order_relaxed) != trace) {
+        return;  // кольцо уже отдало слот новой трассе
+    }
+
+    const auto index = static_cast<size_t>(stage);
+    const int64_t stamp = toNanos(now);
+    slot.stamps[index].store(stamp, std::memory_order_relaxed);
+
+    // Предыдущий отмеченный этап: пропущенные (например, DEQUEUED у
+    // повтора из журнала) не ломают задержку следующего
+    for (size_t previous = index; previous-- > 0;) {
+        const int64_t previous_stamp = slot.stamps[previous].load(std::memory_order_relaxed);
+        if (previous_stamp != 0) {
+            metrics_->observeStageLatency(stage, static_cast<double>(stamp - previous_stamp) / 1e9);
+            break;
+        }
+    }
+    if (stage == Stage::ACKED) {
+        const int64_t read = slot.stamps[static_cast<size_t>(Stage::READ)].load(std::memory_order_relaxed);
+        metrics_->observeEndToEndLatency(static_cast<double>(stamp - read) / 1e9);
+    }
+}
+
+const char* LatencyTracker::stageName(Stage stage) {
+    switch (stage) {
+        case Stage::READ: return "read";
+        case Stage::BUFFERED: return "buffered";
+        case Stage::DEQUEUED: return "dequeued";
+        case Stage::SERIALIZED: return "serialized";
+        case Stage::PRODUCED: return "produced";
+        case Stage::ACKED: return "acked";
+    }
+    return "unknown";
+}
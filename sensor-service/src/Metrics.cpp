@@ -1,77 +1,253 @@
 #include "Metrics.hpp"
 
+namespace {
+
+// От десятков микросекунд до секунд - достаточно для p999 через histogram_quantile
+const std::vector<double> kLatencyBuckets = {
+    0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005,
+    0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+    0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0
+};
+
+}  // namespace
+
 Metrics::Metrics(const std::string& bind_address) 
     : exposer_(std::make_unique<prometheus::Exposer>(bind_address))
     , registry_(std::make_shared<prometheus::Registry>())
-    , messages_sent_(prometheus::BuildCounter()
-        .Name("sensor_service_messages_sent_total")
-        .Help("Total number of messages sent to Kafka")
-        .Register(*registry_))
-    , messages_failed_(prometheus::BuildCounter()
-        .Name("sensor_service_messages_failed_total")
-        .Help("Total number of failed message sends")
-        .Register(*registry_))
-    , retries_(prometheus::BuildCounter()
-        .Name("sensor_service_retries_total")
-        .Help("Total number of retry attempts")
-        .Register(*registry_))
-    , errors_(prometheus::BuildCounter()
-        .Name("sensor_service_errors_total")
-        .Help("Total number of errors")
+    , hot_(std::make_shared<HotMetrics>())
+    , stages_{}
+    , serialized_bytes_(hot_->counter(
+        "sensor_service_serialized_bytes_total",
+        "Bytes of serialized Kafka records"))
+    , messages_sent_(hot_->counter(
+        "sensor_service_messages_sent_total",
+        "Total number of messages sent to Kafka"))
+    , messages_failed_(hot_->counter(
+        "sensor_service_messages_failed_total",
+        "Total number of failed message sends"))
+    , retries_(hot_->counter(
+        "sensor_service_retries_total",
+        "Total number of retry attempts"))
+    , errors_(hot_->counter(
+        "sensor_service_errors_total",
+        "Total number of errors"))
+    , sensor_ewma_(prometheus::BuildGauge()
+        .Name("sensor_value_ewma")
+        .Help("Exponentially weighted mean and standard deviation of sensor values")
         .Register(*registry_))
-    , sensor_values_(prometheus::BuildGauge()
-        .Name("sensor_value")
-        .Help("Current sensor values")
-        .Labels({{"sensor_id", ""}})
+    , sensor_quantile_(prometheus::BuildGauge()
+        .Name("sensor_value_quantile")
+        .Help("Sensor value quantiles since start (1% relative error)")
         .Register(*registry_))
-    , sensor_status_(prometheus::BuildGauge()
-        .Name("sensor_status")
-        .Help("Sensor online status (1=online, 0=offline)")
-        .Labels({{"sensor_id", ""}})
-        .Register(*registry_))
-    , processing_time_(prometheus::BuildHistogram()
-        .Name("sensor_service_processing_time_seconds")
-        .Help("Time spent processing sensor data")
-        .Buckets({0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1.0})
+    , anomalies_(prometheus::BuildCounter()
+        .Name("sensor_service_anomalies_total")
+        .Help("Sensor samples flagged as anomalous by z-score or MAD")
+        .Register(*registry_).Add({}))
+    , alerts_(prometheus::BuildCounter()
+        .Name("sensor_service_alerts_total")
+        .Help("Alerts since start by outcome: sent, failed, dropped, suppressed")
         .Register(*registry_))
+    , alerts_queued_(prometheus::BuildGauge()
+        .Name("sensor_service_alerts_queued")
+        .Help("Alerts queued or in flight to the webhook")
+        .Register(*registry_).Add({}))
+    , processing_time_(hot_->histogram(
+        "sensor_service_processing_time_seconds",
+        "Time spent processing sensor data",
+        {0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1.0}))
+    , stage_latency_{}
+    , end_to_end_latency_(hot_->histogram(
+        "sensor_service_end_to_end_latency_seconds",
+        "Sampled time from sensor read to broker acknowledgement",
+        kLatencyBuckets))
+    , scheduling_jitter_(prometheus::BuildHistogram()
+        .Name("sensor_service_scheduling_jitter_seconds")
+        .Help("Delay between a sensor poll deadline and its dispatch")
+        .Register(*registry_)
+        .Add({}, prometheus::Histogram::BucketBoundaries{
+            0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1
+        }))
+    , missed_polls_(prometheus::BuildCounter()
+        .Name("sensor_service_missed_polls_total")
+        .Help("Sensor polls skipped because the previous read was still running or the scheduler fell behind")
+        .Register(*registry_).Add({}))
     , buffer_size_(prometheus::BuildGauge()
         .Name("sensor_service_buffer_size")
         .Help("Current size of the data buffer")
-        .Register(*registry_))
+        .Register(*registry_).Add({}))
     , kafka_lag_(prometheus::BuildGauge()
         .Name("sensor_service_kafka_lag")
         .Help("Current Kafka producer lag")
+        .Register(*registry_).Add({}))
+    , buffer_pool_in_use_(prometheus::BuildGauge()
+        .Name("sensor_service_kafka_buffer_pool_in_use")
+        .Help("Pooled Kafka payload buffers awaiting delivery reports")
+        .Register(*registry_).Add({}))
+    , buffer_pool_capacity_(prometheus::BuildGauge()
+        .Name("sensor_service_kafka_buffer_pool_capacity")
+        .Help("Total number of pooled Kafka payload buffers")
+        .Register(*registry_).Add({}))
+    , buffer_pool_heap_fallbacks_(prometheus::BuildCounter()
+        .Name("sensor_service_kafka_buffer_pool_heap_fallbacks_total")
+        .Help("Payload buffers allocated on the heap because the pool was exhausted")
+        .Register(*registry_).Add({}))
+    , spill_pending_(prometheus::BuildGauge()
+        .Name("sensor_service_spill_pending")
+        .Help("Samples in the on-disk spill log awaiting replay")
+        .Register(*registry_).Add({}))
+    , spill_bytes_(prometheus::BuildGauge()
+        .Name("sensor_service_spill_bytes")
+        .Help("Disk space taken by spill log segments")
+        .Register(*registry_).Add({}))
+    , spill_spilled_(prometheus::BuildGauge()
+        .Name("sensor_service_spill_spilled_samples")
+        .Help("Samples written to the spill log since start")
+        .Register(*registry_).Add({}))
+    , spill_replayed_(prometheus::BuildGauge()
+        .Name("sensor_service_spill_replayed_samples")
+        .Help("Samples replayed from the spill log since start")
+        .Register(*registry_).Add({}))
+    , spill_dropped_(prometheus::BuildGauge()
+        .Name("sensor_service_spill_dropped_samples")
+        .Help("Samples lost to spill retention limits or disk errors since start")
+        .Register(*registry_).Add({}))
+    , rollups_(prometheus::BuildCounter()
+        .Name("sensor_service_rollups_total")
+        .Help("Window rollups sent to Kafka")
+        .Register(*registry_).Add({}))
+    , late_samples_(prometheus::BuildCounter()
+        .Name("sensor_service_rollup_late_samples_total")
+        .Help("Samples that arrived after their rollup window was closed and were sent raw")
+        .Register(*registry_).Add({}))
+    , filter_forwarded_(prometheus::BuildCounter()
+        .Name("sensor_service_filter_forwarded_samples_total")
+        .Help("Samples that passed deadband/swinging door filtering")
+        .Register(*registry_).Add({}))
+    , filter_suppressed_(prometheus::BuildCounter()
+        .Name("sensor_service_filter_suppressed_samples_total")
+        .Help("Samples dropped by deadband/swinging door filtering")
+        .Register(*registry_).Add({}))
+    , delivery_latency_(hot_->histogram(
+        "sensor_service_kafka_delivery_latency_seconds",
+        "Time from produce() to broker acknowledgement",
+        {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0}))
+    , kafka_outq_len_(prometheus::BuildGauge()
+        .Name("sensor_service_kafka_outq_len")
+        .Help("Messages queued in librdkafka awaiting delivery")
+        .Register(*registry_).Add({}))
+    , broker_rtt_(prometheus::BuildGauge()
+        .Name("sensor_service_kafka_broker_rtt_seconds")
+        .Help("Broker round-trip time reported by librdkafka statistics")
         .Register(*registry_))
+    , batch_messages_avg_(prometheus::BuildGauge()
+        .Name("sensor_service_kafka_batch_messages_avg")
+        .Help("Average number of messages per produce request batch")
+        .Register(*registry_).Add({}))
+    , batch_bytes_avg_(prometheus::BuildGauge()
+        .Name("sensor_service_kafka_batch_bytes_avg")
+        .Help("Average size of produce request batches in bytes")
+        .Register(*registry_).Add({}))
 {
+    const std::pair<Stage, const char*> stages[] = {
+        {Stage::BUFFERED, "buffered"},
+        {Stage::SPILLED, "spilled"},
+        {Stage::DEQUEUED, "dequeued"},
+        {Stage::REPLAYED, "replayed"},
+        {Stage::SERIALIZED, "serialized"},
+        {Stage::PRODUCED, "produced"}
+    };
+    for (const auto& [stage, name] : stages) {
+        stages_[static_cast<size_t>(stage)] = &hot_->counter(
+            "sensor_service_pipeline_events_total",
+            "Samples and messages passing each pipeline stage",
+            {{"stage", name}});
+    }
+
+    // У READ нет предыдущего этапа и своей задержки
+    for (size_t i = 1; i < LatencyTracker::kStageCount; ++i) {
+        const auto stage = static_cast<LatencyTracker::Stage>(i);
+        stage_latency_[i] = &hot_->histogram(
+            "sensor_service_stage_latency_seconds",
+            "Sampled time a sample spends reaching each pipeline stage from the previous one",
+            kLatencyBuckets,
+            {{"stage", LatencyTracker::stageName(stage)}});
+    }
+
     exposer_->RegisterCollectable(registry_);
+    exposer_->RegisterCollectable(hot_);
+}
+
+void Metrics::registerCollectable(
+    const std::weak_ptr<prometheus::Collectable>& collectable,
+    const std::string& uri
+) {
+    exposer_->RegisterCollectable(collectable, uri);
+}
+
+void Metrics::countStage(Stage stage, uint64_t count) {
+    stages_[static_cast<size_t>(stage)]->increment(count);
+}
+
+void Metrics::addSerializedBytes(uint64_t bytes) {
+    serialized_bytes_.increment(bytes);
 }
 
 void Metrics::incrementMessagesSent() {
-    messages_sent_.Increment();
+    messages_sent_.increment();
 }
 
 void Metrics::incrementMessagesFailures() {
-    messages_failed_.Increment();
+    messages_failed_.increment();
 }
 
 void Metrics::incrementRetries() {
-    retries_.Increment();
+    retries_.increment();
 }
 
 void Metrics::incrementErrors() {
-    errors_.Increment();
+    errors_.increment();
+}
+
+void Metrics::setSensorStatistics(const std::vector<SensorStatistics::Snapshot>& statistics) {
+    for (const auto& sensor : statistics) {
+        const std::string id = std::to_string(sensor.sensor_id);
+        sensor_ewma_.Add({{"sensor_id", id}, {"stat", "mean"}}).Set(sensor.mean);
+        sensor_ewma_.Add({{"sensor_id", id}, {"stat", "stddev"}}).Set(sensor.stddev);
+        sensor_quantile_.Add({{"sensor_id", id}, {"quantile", "0.5"}}).Set(sensor.p50);
+        sensor_quantile_.Add({{"sensor_id", id}, {"quantile", "0.9"}}).Set(sensor.p90);
+        sensor_quantile_.Add({{"sensor_id", id}, {"quantile", "0.99"}}).Set(sensor.p99);
+    }
 }
 
-void Metrics::recordSensorValue(int sensor_id, double value) {
-    sensor_values_.Add({{"sensor_id", std::to_string(sensor_id)}}).Set(value);
+void Metrics::incrementAnomalies(double count) {
+    anomalies_.Increment(count);
 }
 
-void Metrics::setSensorStatus(int sensor_id, bool online) {
-    sensor_status_.Add({{"sensor_id", std::to_string(sensor_id)}}).Set(online ? 1 : 0);
+void Metrics::setAlertStats(const AlertManager::Stats& stats) {
+    // Менеджер отдает итоги с запуска, счетчикам нужен прирост
+    const auto advance = [this](const char* result, uint64_t total, uint64_t& reported) {
+        if (total > reported) {
+            alerts_.Add({{"result", result}}).Increment(static_cast<double>(total - reported));
+            reported = total;
+        }
+    };
+    advance("sent", stats.sent, reported_alerts_.sent);
+    advance("failed", stats.failed, reported_alerts_.failed);
+    advance("dropped", stats.dropped, reported_alerts_.dropped);
+    advance("suppressed", stats.suppressed, reported_alerts_.suppressed);
+    alerts_queued_.Set(static_cast<double>(stats.queued + stats.in_flight));
 }
 
 void Metrics::observeProcessingTime(double seconds) {
-    processing_time_.Observe(seconds);
+    processing_time_.observe(seconds);
+}
+
+void Metrics::observeSchedulingJitter(double seconds) {
+    scheduling_jitter_.Observe(seconds);
+}
+
+void Metrics::incrementMissedPolls(double count) {
+    missed_polls_.Increment(count);
 }
 
 void Metrics::setBufferSize(double size) {
@@ -80,4 +256,63 @@ void Metrics::setBufferSize(double size) {
 
 void Metrics::setKafkaLag(double lag) {
     kafka_lag_.Set(lag);
-}
\ No newline at end of file
+}
+
+void Metrics::setKafkaBufferPoolUsage(const BufferPool::Stats& stats) {
+    buffer_pool_in_use_.Set(static_cast<double>(stats.in_use));
+    buffer_pool_capacity_.Set(static_cast<double>(stats.capacity));
+    // Пул отдает итог с запуска, счетчику нужен прирост
+    if (stats.heap_fallbacks > reported_heap_fallbacks_) {
+        buffer_pool_heap_fallbacks_.Increment(static_cast<double>(stats.heap_fallbacks - reported_heap_fallbacks_));
+        reported_heap_fallbacks_ = stats.heap_fallbacks;
+    }
+}
+
+void Metrics::setSpillStats(const SpillLog::Stats& stats) {
+    spill_pending_.Set(static_cast<double>(stats.pending));
+    spill_bytes_.Set(static_cast<double>(stats.bytes_on_disk));
+    spill_spilled_.Set(static_cast<double>(stats.spilled));
+    spill_replayed_.Set(static_cast<double>(stats.replayed));
+    spill_dropped_.Set(static_cast<double>(stats.dropped));
+}
+
+void Metrics::incrementRollups(double count) {
+    rollups_.Increment(count);
+}
+
+void Metrics::incrementLateSamples(double count) {
+    late_samples_.Increment(count);
+}
+
+void Metrics::incrementFilteredSamples(double forwarded, double suppressed) {
+    filter_forwarded_.Increment(forwarded);
+    filter_suppressed_.Increment(suppressed);
+}
+
+void Metrics::observeStageLatency(LatencyTracker::Stage stage, double seconds) {
+    if (HotHistogram* histogram = stage_latency_[static_cast<size_t>(stage)]) {
+        histogram->observe(seconds);
+    }
+}
+
+void Metrics::observeEndToEndLatency(double seconds) {
+    end_to_end_latency_.observe(seconds);
+}
+
+void Metrics::observeDeliveryLatency(double seconds) {
+    delivery_latency_.observe(seconds);
+}
+
+void Metrics::setKafkaOutqLen(double messages) {
+    kafka_outq_len_.Set(messages);
+}
+
+void Metrics::setBrokerRtt(const std::string& broker, double avg_seconds, double p99_seconds) {
+    broker_rtt_.Add({{"broker", broker}, {"stat", "avg"}}).Set(avg_seconds);
+    broker_rtt_.Add({{"broker", broker}, {"stat", "p99"}}).Set(p99_seconds);
+}
+
+void Metrics::setProducerBatchStats(double avg_messages, double avg_bytes) {
+    batch_messages_avg_.Set(avg_messages);
+    batch_bytes_avg_.Set(avg_bytes);
+}
@@ -0,0 +1,29 @@
+#include "ProfileEndpoint.hpp"
+
+ProfileEndpoint::ProfileEndpoint(Request request)
+    : request_(std::move(request)) {
+}
+
+void ProfileEndpoint::detach() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    request_ = nullptr;
+}
+
+std::vector<prometheus::MetricFamily> ProfileEndpoint::Collect() const {
+    bool started = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (request_) {
+            started = request_("http");
+        }
+    }
+
+    prometheus::MetricFamily family;
+    family.name = "sensor_service_profile_capture_started";
+    family.help = "Whether this request started a profile capture (1) or was rejected (0)";
+    family.type = prometheus::MetricType::Gauge;
+    prometheus::ClientMetric metric;
+    metric.gauge.value = started ? 1.0 : 0.0;
+    family.metric.push_back(std::move(metric));
+    return {family};
+}
@@ -0,0 +1,177 @@
+#include "ProfileSymbolizer.hpp"
+#include <cxxabi.h>
+#include <elf.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+template <typename T>
+bool readAt(std::ifstream& file, uint64_t offset, T* out, size_t count = 1) {
+    file.seekg(static_cast<std::streamoff>(offset));
+    file.read(reinterpret_cast<char*>(out), static_cast<std::streamsize>(sizeof(T) * count));
+    return static_cast<bool>(file);
+}
+
+std::string hex(uint64_t value) {
+    std::ostringstream out;
+    out << "0x" << std::hex << value;
+    return out.str();
+}
+
+std::string baseName(const std::string& path) {
+    const auto slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+}  // namespace
+
+void ProfileSymbolizer::setMappings(const std::string& maps) {
+    if (maps == maps_) {
+        return;
+    }
+    maps_ = maps;
+    mappings_.clear();
+    names_.clear();
+
+    std::istringstream lines(maps);
+    std::string line;
+    while (std::getline(lines, line)) {
+        // 00400000-00452000 r-xp 00000000 08:02 173521 /usr/bin/sensor-service
+        std::istringstream fields(line);
+        std::string range, perms, offset, device, inode, path;
+        if (!(fields >> range >> perms >> offset >> device >> inode)) {
+            continue;
+        }
+        std::getline(fields >> std::ws, path);
+        const auto dash = range.find('-');
+        if (dash == std::string::npos || perms.size() < 3 || perms[2] != 'x'
+            || path.empty() || path[0] != '/') {
+            continue;
+        }
+        try {
+            mappings_.push_back({
+                std::stoull(range.substr(0, dash), nullptr, 16),
+                std::stoull(range.substr(dash + 1), nullptr, 16),
+                std::stoull(offset, nullptr, 16),
+                path
+            });
+        } catch (const std::exception&) {
+            // Не строка карты отображений
+        }
+    }
+}
+
+const std::string& ProfileSymbolizer::symbolize(uint64_t address) {
+    auto it = names_.find(address);
+    if (it == names_.end()) {
+        it = names_.emplace(address, lookup(address)).first;
+    }
+    return it->second;
+}
+
+std::string ProfileSymbolizer::lookup(uint64_t address) {
+    const auto mapping = std::find_if(mappings_.begin(), mappings_.end(),
+        [address](const Mapping& m) { return address >= m.start && address < m.end; });
+    if (mapping == mappings_.end()) {
+        return hex(address);
+    }
+
+    // Адрес в процессе -> смещение в файле -> адрес в ELF. Для
+    // неперемещаемого исполняемого файла последний совпадает с первым
+    const uint64_t file_offset = address - mapping->start + mapping->offset;
+    const auto& elf = image(mapping->path);
+    for (const auto& segment : elf.segments) {
+        if (file_offset < segment.offset || file_offset >= segment.offset + segment.file_size) {
+            continue;
+        }
+        const uint64_t elf_address = file_offset - segment.offset + segment.address;
+        auto symbol = std::upper_bound(elf.symbols.begin(), elf.symbols.end(), elf_address,
+            [](uint64_t value, const Symbol& s) { return value < s.address; });
+        if (symbol != elf.symbols.begin()) {
+            --symbol;
+            if (symbol->size == 0 || elf_address < symbol->address + symbol->size) {
+                return demangle(elf.strings.c_str() + symbol->name);
+            }
+        }
+        break;
+    }
+    return baseName(mapping->path) + "+" + hex(file_offset);
+}
+
+const ProfileSymbolizer::ElfImage& ProfileSymbolizer::image(const std::string& path) {
+    auto it = images_.find(path);
+    if (it == images_.end()) {
+        it = images_.emplace(path, loadImage(path)).first;
+    }
+    return *it->second;
+}
+
+std::unique_ptr<ProfileSymbolizer::ElfImage> ProfileSymbolizer::loadImage(const std::string& path) {
+    auto elf = std::make_unique<ElfImage>();
+    std::ifstream file(path, std::ios::binary);
+    Elf64_Ehdr header;
+    if (!file || !readAt(file, 0, &header)
+        || std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0
+        || header.e_ident[EI_CLASS] != ELFCLASS64
+        || header.e_shentsize != sizeof(Elf64_Shdr)) {
+        // Только 64-битные ELF; остальное символизируется смещениями
+        return elf;
+    }
+
+    std::vector<Elf64_Phdr> programs(header.e_phnum);
+    if (!programs.empty() && readAt(file, header.e_phoff, programs.data(), programs.size())) {
+        for (const auto& program : programs) {
+            if (program.p_type == PT_LOAD) {
+                elf->segments.push_back({program.p_offset, program.p_filesz, program.p_vaddr});
+            }
+        }
+    }
+
+    std::vector<Elf64_Shdr> sections(header.e_shnum);
+    if (sections.empty() || !readAt(file, header.e_shoff, sections.data(), sections.size())) {
+        return elf;
+    }
+    // .symtab есть у нестрипнутых файлов, .dynsym - у всех разделяемых
+    for (const auto& section : sections) {
+        if ((section.sh_type != SHT_SYMTAB && section.sh_type != SHT_DYNSYM)
+            || section.sh_entsize != sizeof(Elf64_Sym) || section.sh_link >= sections.size()) {
+            continue;
+        }
+        const auto& strtab = sections[section.sh_link];
+        std::string strings(strtab.sh_size, '\0');
+        std::vector<Elf64_Sym> symbols(section.sh_size / sizeof(Elf64_Sym));
+        if (!readAt(file, strtab.sh_offset, strings.data(), strings.size())
+            || !readAt(file, section.sh_offset, symbols.data(), symbols.size())) {
+            continue;
+        }
+        const auto base = static_cast<uint32_t>(elf->strings.size());
+        for (const auto& symbol : symbols) {
+            const auto type = ELF64_ST_TYPE(symbol.st_info);
+            if ((type != STT_FUNC && type != STT_GNU_IFUNC) || symbol.st_value == 0
+                || symbol.st_name >= strings.size()) {
+                continue;
+            }
+            elf->symbols.push_back({symbol.st_value, symbol.st_size, base + symbol.st_name});
+        }
+        elf->strings += strings;
+        elf->strings += '\0';
+    }
+    std::sort(elf->symbols.begin(), elf->symbols.end(),
+        [](const Symbol& a, const Symbol& b) { return a.address < b.address; });
+    return elf;
+}
+
+std::string ProfileSymbolizer::demangle(const char* name) {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (status != 0 || demangled == nullptr) {
+        return name;
+    }
+    std::string result(demangled);
+    std::free(demangled);
+    return result;
+}
@@ -1,17 +1,90 @@
 #include "Profiler.hpp"
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <sstream>
 #include <ctime>
 #include <filesystem>
+#include <iomanip>
+#include <cctype>
 #include <iostream>
+#include <stdexcept>
+#include "FlameGraph.hpp"
+#include "GperfProfile.hpp"
+#include "HotPathAnalyzer.hpp"
+
+namespace {
+
+bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size()
+        && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Путь профиля: сам файл или, для heap, последний дамп <префикс>.NNNN.heap
+std::string resolveProfilePath(const std::string& profile_path) {
+    namespace fs = std::filesystem;
+    if (fs::exists(profile_path)) {
+        return profile_path;
+    }
+    const fs::path prefix(profile_path);
+    const std::string stem = prefix.filename().string() + ".";
+    std::string latest;
+    std::error_code error;
+    const auto directory = prefix.has_parent_path() ? prefix.parent_path() : fs::path(".");
+    for (const auto& entry : fs::directory_iterator(directory, error)) {
+        const std::string name = entry.path().filename().string();
+        // Номера дампов дополнены нулями, так что последний - наибольший по строке
+        if (name.rfind(stem, 0) == 0 && endsWith(name, ".heap") && name > latest) {
+            latest = name;
+        }
+    }
+    if (latest.empty()) {
+        throw std::runtime_error("Profile not found: " + profile_path);
+    }
+    return (directory / latest).string();
+}
+
+// Причина захвата идет в имя файла
+std::string fileSafe(const std::string& reason) {
+    std::string safe = reason.empty() ? "manual" : reason;
+    for (char& c : safe) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-') {
+            c = '_';
+        }
+    }
+    return safe;
+}
+
+// Фоновая работа не должна отнимать CPU у конвейера
+void lowerThreadPriority() {
+    sched_param param{};
+    if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0) {
+        setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+    }
+}
+
+}  // namespace
 
 Profiler::Profiler(const std::string& output_dir)
     : output_dir_(output_dir) {
     std::filesystem::create_directories(output_dir);
     setupProfilerOptions();
+    render_thread_ = std::thread(&Profiler::renderLoop, this);
 }
 
 Profiler::~Profiler() {
     stopContinuousProfiling();
+    stopTriggeredProfiling();
+    {
+        std::lock_guard<std::mutex> lock(render_mutex_);
+        render_stopping_ = true;
+    }
+    render_cv_.notify_all();
+    if (render_thread_.joinable()) {
+        render_thread_.join();
+    }
 }
 
 void Profiler::setupProfilerOptions() {
@@ -27,28 +100,34 @@ void Profiler::setupProfilerOptions() {
 }
 
 std::string Profiler::getProfilePath(ProfileType type) {
-    auto now = std::chrono::system_clock::now();
-    auto time = std::chrono::system_clock::to_time_t(now);
-    std::stringstream ss;
-    ss << output_dir_ << "/";
-    
     switch (type) {
         case ProfileType::CPU:
-            ss << "cpu_profile_";
-            break;
+            return timestampedPath("cpu_profile_");
         case ProfileType::HEAP:
-            ss << "heap_profile_";
-            break;
+            return timestampedPath("heap_profile_");
         case ProfileType::GROWTH:
-            ss << "growth_profile_";
-            break;
+            return timestampedPath("growth_profile_");
     }
-    
+    return timestampedPath("profile_");
+}
+
+std::string Profiler::timestampedPath(const std::string& prefix) const {
+    auto now = std::chrono::system_clock::now();
+    auto time = std::chrono::system_clock::to_time_t(now);
+    std::stringstream ss;
+    ss << output_dir_ << "/" << prefix;
     ss << std::put_time(std::localtime(&time), "%Y%m%d_%H%M%S");
     return ss.str();
 }
 
-void Profiler::startProfiling(ProfileType type) {
+std::string Profiler::writeScopeProfile() {
+    std::string path = timestampedPath("scope_profile_") + ".collapsed";
+    HotPathAnalyzer::getInstance().writeCollapsedStacks(path);
+    queueFlameGraph(path);
+    return path;
+}
+
+std::string Profiler::startProfiling(ProfileType type) {
     std::string profile_path = getProfilePath(type);
     
     switch (type) {
@@ -62,6 +141,7 @@ void Profiler::startProfiling(ProfileType type) {
             HeapProfilerStart(profile_path.c_str());
             break;
     }
+    return profile_path;
 }
 
 void Profiler::stopProfiling(ProfileType type) {
@@ -71,6 +151,8 @@ void Profiler::stopProfiling(ProfileType type) {
             break;
         case ProfileType::HEAP:
         case ProfileType::GROWTH:
+            // Последний дамп - состояние на момент остановки
+            HeapProfilerDump("stop");
             HeapProfilerStop();
             break;
     }
@@ -100,43 +182,167 @@ void Profiler::stopContinuousProfiling() {
     }
 }
 
+void Profiler::startTriggeredProfiling(TriggerConfig config) {
+    std::lock_guard<std::mutex> lock(capture_mutex_);
+    if (sampler_) {
+        return;
+    }
+    auto sampler = std::make_unique<StackSampler>(config.sampler);
+    sampler->start();
+    sampler_ = std::move(sampler);
+    trigger_config_ = config;
+    capture_stopping_ = false;
+    capture_thread_ = std::thread(&Profiler::captureLoop, this);
+}
+
+void Profiler::stopTriggeredProfiling() {
+    {
+        std::lock_guard<std::mutex> lock(capture_mutex_);
+        if (!sampler_) {
+            return;
+        }
+        capture_stopping_ = true;
+    }
+    capture_cv_.notify_all();
+    if (capture_thread_.joinable()) {
+        capture_thread_.join();
+    }
+    std::lock_guard<std::mutex> lock(capture_mutex_);
+    sampler_->stop();
+    sampler_.reset();
+}
+
+bool Profiler::triggerCapture(const std::string& reason) {
+    {
+        std::lock_guard<std::mutex> lock(capture_mutex_);
+        const auto now = std::chrono::steady_clock::now();
+        if (!sampler_ || capture_stopping_ || !capture_reason_.empty()
+            || (last_capture_ != std::chrono::steady_clock::time_point{}
+                && now - last_capture_ < trigger_config_.cooldown)) {
+            return false;
+        }
+        capture_reason_ = fileSafe(reason);
+        last_capture_ = now;
+    }
+    capture_cv_.notify_all();
+    return true;
+}
+
+void Profiler::captureLoop() {
+    std::unique_lock<std::mutex> lock(capture_mutex_);
+    while (true) {
+        capture_cv_.wait(lock, [this] { return capture_stopping_ || !capture_reason_.empty(); });
+        if (capture_stopping_) {
+            return;
+        }
+        const auto triggered = std::chrono::steady_clock::now();
+        const std::string path = timestampedPath("cpu_profile_") + "_" + capture_reason_;
+        std::cerr << "Capturing profile on trigger: " << capture_reason_ << std::endl;
+
+        // Кольцо выгружается сразу: за время полного профиля оно перезаписало
+        // бы окно до срабатывания. Что было после, покажет полный профиль
+        lock.unlock();
+        try {
+            sampler_->writeProfile(path, triggered - trigger_config_.sampler.window);
+            queueFlameGraph(path);
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to save sampled stacks: " << e.what() << std::endl;
+        }
+        lock.lock();
+
+        // Полный профиль - только если gperftools не занят непрерывным профилированием
+        const std::string full_path = path + "_full";
+        const bool profiling = trigger_config_.capture_duration.count() > 0
+            && ProfilerStart(full_path.c_str()) != 0;
+        if (profiling) {
+            // Остановка сервиса прерывает ожидание, профиль все равно сохраняется
+            capture_cv_.wait_for(lock, trigger_config_.capture_duration,
+                [this] { return capture_stopping_; });
+        }
+        if (profiling) {
+            lock.unlock();
+            ProfilerStop();
+            queueFlameGraph(full_path);
+            lock.lock();
+        }
+        capture_reason_.clear();
+    }
+}
+
 void Profiler::continuousProfilingLoop() {
     while (continuous_running_) {
-        std::string profile_path = getProfilePath(continuous_type_);
-        startProfiling(continuous_type_);
+        std::string profile_path = startProfiling(continuous_type_);
         
         std::this_thread::sleep_for(continuous_interval_);
         
         stopProfiling(continuous_type_);
-        generateFlameGraph(profile_path);
+        queueFlameGraph(profile_path);
     }
 }
 
 void Profiler::generateFlameGraph(const std::string& profile_path) {
-    // Генерация FlameGraph с использованием perf
-    std::string cmd;
-    
-    if (std::filesystem::exists(profile_path)) {
-        switch (continuous_type_) {
-            case ProfileType::CPU:
-                cmd = "pprof --collapsed " + profile_path + " > " +
-                      profile_path + ".collapsed && " +
-                      "flamegraph.pl " + profile_path + ".collapsed > " +
-                      profile_path + ".svg";
-                break;
-                
-            case ProfileType::HEAP:
-            case ProfileType::GROWTH:
-                cmd = "pprof --collapsed --inuse_space " + profile_path + " > " +
-                      profile_path + ".collapsed && " +
-                      "flamegraph.pl " + profile_path + ".collapsed > " +
-                      profile_path + ".svg";
-                break;
+    const std::string path = resolveProfilePath(profile_path);
+    FlameGraph graph;
+    std::string svg_path;
+    std::string count_name;
+
+    if (endsWith(path, ".collapsed")) {
+        // Уже свернутые стеки, например от HotPathAnalyzer
+        graph.readCollapsed(path);
+        svg_path = path.substr(0, path.size() - std::string(".collapsed").size()) + ".svg";
+        count_name = "us";
+    } else {
+        const auto profile = GperfProfile::read(path);
+        std::lock_guard<std::mutex> lock(symbolizer_mutex_);
+        symbolizer_.setMappings(profile.mappings);
+        std::vector<std::string> frames;
+        for (const auto& sample : profile.samples) {
+            // Стек в профиле от листа; адрес возврата указывает на
+            // инструкцию после call, поэтому символизируется адрес - 1
+            frames.clear();
+            for (size_t i = sample.stack.size(); i-- > 0;) {
+                frames.push_back(symbolizer_.symbolize(sample.stack[i] - (i > 0 ? 1 : 0)));
+            }
+            graph.add(frames, sample.weight);
         }
-        
-        if (system(cmd.c_str()) != 0) {
-            std::cerr << "Failed to generate FlameGraph for " 
-                      << profile_path << std::endl;
+        graph.writeCollapsed(path + ".collapsed");
+        svg_path = path + ".svg";
+        count_name = profile.kind == GperfProfile::Kind::CPU ? "samples" : "bytes";
+    }
+
+    graph.writeSvg(svg_path, std::filesystem::path(path).filename().string(), count_name);
+}
+
+void Profiler::queueFlameGraph(const std::string& profile_path) {
+    {
+        std::lock_guard<std::mutex> lock(render_mutex_);
+        if (render_queue_.size() >= kMaxQueuedRenders) {
+            std::cerr << "FlameGraph queue is full, skipping " << profile_path << std::endl;
+            return;
+        }
+        render_queue_.push_back(profile_path);
+    }
+    render_cv_.notify_one();
+}
+
+void Profiler::renderLoop() {
+    lowerThreadPriority();
+    std::unique_lock<std::mutex> lock(render_mutex_);
+    while (true) {
+        render_cv_.wait(lock, [this] { return render_stopping_ || !render_queue_.empty(); });
+        // При остановке очередь дорисовывается: в ней профили последних минут
+        if (render_queue_.empty()) {
+            return;
         }
+        const std::string profile_path = std::move(render_queue_.front());
+        render_queue_.pop_front();
+        lock.unlock();
+        try {
+            generateFlameGraph(profile_path);
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to generate FlameGraph for "
+                      << profile_path << ": " << e.what() << std::endl;
+        }
+        lock.lock();
     }
-} 
\ No newline at end of file
+}
@@ -0,0 +1,130 @@
+#include "ProfilingTriggers.hpp"
+#include <sched.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+
+std::chrono::microseconds toMicros(const timeval& time) {
+    return std::chrono::seconds(time.tv_sec) + std::chrono::microseconds(time.tv_usec);
+}
+
+// Квота CFS в ядрах: cgroup v2 cpu.max "quota period", v1 - два файла.
+// 0 - квоты нет
+double cgroupCpuLimit() {
+    std::ifstream v2("/sys/fs/cgroup/cpu.max");
+    std::string quota;
+    double period = 0.0;
+    if (v2 >> quota >> period) {
+        return quota == "max" || period <= 0.0 ? 0.0 : std::stod(quota) / period;
+    }
+    std::ifstream v1_quota("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    std::ifstream v1_period("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+    double quota_us = 0.0;
+    if (v1_quota >> quota_us && v1_period >> period && quota_us > 0.0 && period > 0.0) {
+        return quota_us / period;
+    }
+    return 0.0;
+}
+
+// Ядра, которые процессу реально доступны: маска привязки и квота cgroup.
+// hardware_concurrency видит все ядра машины, и в контейнере загрузка
+// получалась бы заниженной
+double availableCpus() {
+    double cpus = static_cast<double>(std::max(1u, std::thread::hardware_concurrency()));
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0 && CPU_COUNT(&mask) > 0) {
+        cpus = static_cast<double>(CPU_COUNT(&mask));
+    }
+    try {
+        const double limit = cgroupCpuLimit();
+        if (limit > 0.0) {
+            cpus = std::min(cpus, limit);
+        }
+    } catch (const std::exception&) {
+        // Нечитаемая квота - считаем по маске
+    }
+    return cpus;
+}
+
+}  // namespace
+
+ProfilingTriggers::ProfilingTriggers(Config config)
+    : config_(config) {
+    if (config.latency_p99.count() < 0
+        || config.buffer_occupancy < 0.0 || config.buffer_occupancy > 1.0
+        || config.cpu_usage < 0.0 || config.cpu_usage > 1.0) {
+        throw std::invalid_argument("Profiling trigger thresholds must be non-negative fractions and durations");
+    }
+}
+
+std::string ProfilingTriggers::evaluate(const HotHistogram& latency, double buffer_occupancy) {
+    // Базы обновляются при каждом вызове, даже если причина уже найдена
+    const double p99 = config_.latency_p99.count() > 0 ? latencyP99(latency) : -1.0;
+    const double cpu = config_.cpu_usage > 0.0 ? cpuUsage() : -1.0;
+
+    if (p99 >= 0.0 && p99 > std::chrono::duration<double>(config_.latency_p99).count()) {
+        return "latency_p99";
+    }
+    if (config_.buffer_occupancy > 0.0 && buffer_occupancy >= config_.buffer_occupancy) {
+        return "buffer_occupancy";
+    }
+    if (cpu >= config_.cpu_usage) {
+        return "cpu_usage";
+    }
+    return {};
+}
+
+double ProfilingTriggers::latencyP99(const HotHistogram& latency) {
+    double sum = 0.0;
+    latency.snapshot(latency_buckets_, sum);
+    latency_baseline_.resize(latency_buckets_.size(), 0);
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < latency_buckets_.size(); ++i) {
+        total += latency_buckets_[i] - latency_baseline_[i];
+    }
+    if (total == 0 || total < config_.min_latency_samples) {
+        return -1.0;
+    }
+
+    // Интерполяция внутри корзины, как histogram_quantile в Prometheus
+    const auto& bounds = latency.bounds();
+    const double rank = 0.99 * static_cast<double>(total);
+    double p99 = bounds.empty() ? 0.0 : bounds.back();
+    uint64_t below = 0;
+    for (size_t i = 0; i < bounds.size(); ++i) {
+        const uint64_t count = latency_buckets_[i] - latency_baseline_[i];
+        if (static_cast<double>(below + count) >= rank) {
+            const double lower = i == 0 ? 0.0 : bounds[i - 1];
+            p99 = lower + (bounds[i] - lower) * (rank - static_cast<double>(below)) / static_cast<double>(count);
+            break;
+        }
+        below += count;
+    }
+    latency_baseline_.swap(latency_buckets_);
+    return p99;
+}
+
+double ProfilingTriggers::cpuUsage() {
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1.0;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    const auto cpu_time = toMicros(usage.ru_utime) + toMicros(usage.ru_stime);
+    const bool first = cpu_wall_ == std::chrono::steady_clock::time_point{};
+    const double wall = std::chrono::duration<double>(now - cpu_wall_).count();
+    const double busy = std::chrono::duration<double>(cpu_time - cpu_time_).count();
+    cpu_wall_ = now;
+    cpu_time_ = cpu_time;
+    if (first || wall <= 0.0) {
+        return -1.0;
+    }
+    return busy / wall / availableCpus();
+}
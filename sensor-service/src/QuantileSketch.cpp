@@ -0,0 +1,129 @@
+#include "QuantileSketch.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+// Меньшие по модулю значения считаются нулем
+constexpr double kMinMagnitude = 1e-9;
+
+}  // namespace
+
+QuantileSketch::QuantileSketch(double relative_accuracy, size_t max_bins)
+    : relative_accuracy_(relative_accuracy)
+    , gamma_((1.0 + relative_accuracy) / (1.0 - relative_accuracy))
+    , log_gamma_(std::log(gamma_))
+    , max_bins_(max_bins) {
+    if (!(relative_accuracy > 0.0 && relative_accuracy < 1.0) || max_bins == 0) {
+        throw std::invalid_argument("Quantile sketch accuracy must be in (0, 1) and max_bins positive");
+    }
+}
+
+void QuantileSketch::Store::add(int32_t index, uint64_t count, size_t max_bins) {
+    if (bins.empty()) {
+        offset = index;
+        bins.assign(1, 0);
+    }
+
+    int64_t lo = std::min<int64_t>(index, offset);
+    const int64_t hi = std::max<int64_t>(index, offset + static_cast<int64_t>(bins.size()) - 1);
+    if (hi - lo + 1 > static_cast<int64_t>(max_bins)) {
+        // Не помещаемся: нижние корзины сливаются в самую нижнюю оставшуюся
+        lo = hi - static_cast<int64_t>(max_bins) + 1;
+    }
+    if (lo != offset || hi != offset + static_cast<int64_t>(bins.size()) - 1) {
+        std::vector<uint64_t> resized(static_cast<size_t>(hi - lo + 1), 0);
+        for (size_t i = 0; i < bins.size(); ++i) {
+            const int64_t old_index = offset + static_cast<int64_t>(i);
+            resized[static_cast<size_t>(std::max(old_index, lo) - lo)] += bins[i];
+        }
+        bins.swap(resized);
+        offset = static_cast<int32_t>(lo);
+    }
+    bins[static_cast<size_t>(std::max<int64_t>(index, lo) - offset)] += count;
+}
+
+int32_t QuantileSketch::indexOf(double magnitude) const {
+    return static_cast<int32_t>(std::ceil(std::log(magnitude) / log_gamma_));
+}
+
+double QuantileSketch::valueOf(int32_t index) const {
+    // Середина корзины (gamma^(i-1), gamma^i] по относительной ошибке
+    return 2.0 * std::pow(gamma_, index) / (gamma_ + 1.0);
+}
+
+void QuantileSketch::add(double value) {
+    if (std::isnan(value)) {
+        return;
+    }
+    const double magnitude = std::min(std::fabs(value), std::numeric_limits<double>::max());
+    if (magnitude < kMinMagnitude) {
+        ++zero_count_;
+    } else if (value > 0) {
+        positive_.add(indexOf(magnitude), 1, max_bins_);
+    } else {
+        negative_.add(indexOf(magnitude), 1, max_bins_);
+    }
+    ++count_;
+}
+
+void QuantileSketch::merge(const QuantileSketch& other) {
+    if (other.gamma_ != gamma_) {
+        throw std::invalid_argument("Cannot merge quantile sketches with different accuracy");
+    }
+    for (size_t i = 0; i < other.positive_.bins.size(); ++i) {
+        if (other.positive_.bins[i] > 0) {
+            positive_.add(other.positive_.offset + static_cast<int32_t>(i),
+                          other.positive_.bins[i], max_bins_);
+        }
+    }
+    for (size_t i = 0; i < other.negative_.bins.size(); ++i) {
+        if (other.negative_.bins[i] > 0) {
+            negative_.add(other.negative_.offset + static_cast<int32_t>(i),
+                          other.negative_.bins[i], max_bins_);
+        }
+    }
+    zero_count_ += other.zero_count_;
+    count_ += other.count_;
+}
+
+double QuantileSketch::quantile(double q) const {
+    double result;
+    quantiles(&q, 1, &result);
+    return result;
+}
+
+void QuantileSketch::quantiles(const double* qs, size_t count, double* out) const {
+    if (count_ == 0) {
+        std::fill(out, out + count, std::numeric_limits<double>::quiet_NaN());
+        return;
+    }
+
+    // Обход по возрастанию значения: отрицательные от больших модулей к
+    // меньшим, затем нули, затем положительные
+    size_t next = 0;
+    uint64_t seen = 0;
+    auto visit = [&](uint64_t bin_count, double value) {
+        seen += bin_count;
+        while (next < count) {
+            const double q = std::clamp(qs[next], 0.0, 1.0);
+            const double rank = q * static_cast<double>(count_ - 1);
+            if (static_cast<double>(seen) <= rank) {
+                break;
+            }
+            out[next++] = value;
+        }
+    };
+
+    for (size_t i = negative_.bins.size(); i-- > 0 && next < count;) {
+        visit(negative_.bins[i], -valueOf(negative_.offset + static_cast<int32_t>(i)));
+    }
+    if (next < count) {
+        visit(zero_count_, 0.0);
+    }
+    for (size_t i = 0; i < positive_.bins.size() && next < count; ++i) {
+        visit(positive_.bins[i], valueOf(positive_.offset + static_cast<int32_t>(i)));
+    }
+}
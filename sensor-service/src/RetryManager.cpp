@@ -1,4 +1,5 @@
 #include "RetryManager.hpp"
+#include <cmath>
 
 RetryManager::RetryManager(
     int max_retries,
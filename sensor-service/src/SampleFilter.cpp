@@ -0,0 +1,216 @@
+#include "SampleFilter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+double millisBetween(
+    std::chrono::system_clock::time_point from,
+    std::chrono::system_clock::time_point to
+) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// Повтор того же значения, включая NaN, новой информации не несет
+bool sameValue(double a, double b) {
+    return (std::isnan(a) && std::isnan(b)) || a == b;
+}
+
+void validate(const SampleFilter::Policy& policy) {
+    if (!(policy.absolute >= 0.0) || !(policy.percent >= 0.0)) {
+        throw std::invalid_argument("Sample filter thresholds must be non-negative numbers");
+    }
+    if (policy.max_silence.count() < 0) {
+        throw std::invalid_argument("Sample filter max_silence must not be negative");
+    }
+}
+
+}  // namespace
+
+SampleFilter::SampleFilter(Config config)
+    : config_(std::move(config)) {
+    validate(config_.default_policy);
+    for (const auto& [sensor_id, policy] : config_.sensor_policies) {
+        validate(policy);
+    }
+}
+
+bool SampleFilter::enabled() const {
+    if (config_.default_policy.mode != Mode::NONE) {
+        return true;
+    }
+    return std::any_of(
+        config_.sensor_policies.begin(), config_.sensor_policies.end(),
+        [](const auto& entry) { return entry.second.mode != Mode::NONE; }
+    );
+}
+
+const SampleFilter::Policy& SampleFilter::policyFor(int sensor_id) const {
+    auto it = config_.sensor_policies.find(sensor_id);
+    return it != config_.sensor_policies.end() ? it->second : config_.default_policy;
+}
+
+double SampleFilter::threshold(const Policy& policy, double reference) {
+    return std::max(policy.absolute, std::fabs(reference) * policy.percent / 100.0);
+}
+
+bool SampleFilter::silenceExpired(const Policy& policy, const SensorState& state, const SensorData& data) {
+    return policy.max_silence.count() > 0
+        && data.timestamp - state.forwarded.timestamp >= policy.max_silence;
+}
+
+SampleFilter::Stats SampleFilter::filter(
+    const SensorData* data,
+    size_t count,
+    std::vector<SensorData>& out
+) {
+    Stats stats;
+    for (size_t i = 0; i < count; ++i) {
+        const SensorData& sample = data[i];
+        const Policy& policy = policyFor(sample.sensor_id);
+        if (policy.mode == Mode::NONE) {
+            out.push_back(sample);
+            ++stats.forwarded;
+            continue;
+        }
+
+        SensorState& state = sensors_[sample.sensor_id];
+        if (policy.mode == Mode::SWINGING_DOOR) {
+            swingingDoor(policy, state, sample, out, stats);
+        } else if (deadband(policy, state, sample)) {
+            out.push_back(sample);
+            state.forwarded = sample;
+            state.has_forwarded = true;
+            ++stats.forwarded;
+        } else {
+            ++stats.suppressed;
+        }
+    }
+    return stats;
+}
+
+SampleFilter::Stats SampleFilter::flushHeld(
+    std::chrono::system_clock::time_point before,
+    std::vector<SensorData>& out
+) {
+    Stats stats;
+    for (auto& [sensor_id, state] : sensors_) {
+        // Придержанная точка - всегда последнее измерение датчика
+        if (state.has_held && state.held.timestamp < before) {
+            out.push_back(state.held);
+            state.forwarded = state.held;
+            state.has_held = false;
+            ++stats.forwarded;
+        }
+    }
+    return stats;
+}
+
+SampleFilter::Stats SampleFilter::remove(int sensor_id, std::vector<SensorData>& out) {
+    Stats stats;
+    auto it = sensors_.find(sensor_id);
+    if (it == sensors_.end()) {
+        return stats;
+    }
+    if (it->second.has_held) {
+        out.push_back(it->second.held);
+        ++stats.forwarded;
+    }
+    sensors_.erase(it);
+    return stats;
+}
+
+bool SampleFilter::deadband(const Policy& policy, SensorState& state, const SensorData& data) {
+    if (!state.has_forwarded || silenceExpired(policy, state, data)) {
+        return true;
+    }
+    const double reference = state.forwarded.value;
+    if (!std::isfinite(reference) || !std::isfinite(data.value)) {
+        // Переход в NaN/бесконечность и обратно всегда отправляется
+        return !sameValue(reference, data.value);
+    }
+    return std::fabs(data.value - reference) > threshold(policy, reference);
+}
+
+void SampleFilter::swingingDoor(
+    const Policy& policy,
+    SensorState& state,
+    const SensorData& data,
+    std::vector<SensorData>& out,
+    Stats& stats
+) {
+    auto forward = [&](const SensorData& sample) {
+        out.push_back(sample);
+        state.forwarded = sample;
+        state.has_forwarded = true;
+        ++stats.forwarded;
+    };
+    // Дверь от вершины через data: наклоны к data.value -/+ порог
+    auto openDoor = [&]() {
+        const SensorData& pivot = state.forwarded;
+        const double dt = millisBetween(pivot.timestamp, data.timestamp);
+        if (dt <= 0.0) {
+            // Время не растет - линию не построить, отправляем как есть
+            forward(data);
+            state.has_held = false;
+            return;
+        }
+        const double deviation = threshold(policy, pivot.value);
+        state.upper_slope = (data.value + deviation - pivot.value) / dt;
+        state.lower_slope = (data.value - deviation - pivot.value) / dt;
+        state.held = data;
+        state.has_held = true;
+    };
+
+    if (!state.has_forwarded
+        || !std::isfinite(data.value)
+        || !std::isfinite(state.forwarded.value)) {
+        // Через NaN и бесконечности линию не провести: начинаем заново.
+        // Повтор того же нечислового значения, как и в DEADBAND, не отправляется
+        if (state.has_forwarded && !state.has_held
+            && sameValue(state.forwarded.value, data.value)
+            && !silenceExpired(policy, state, data)) {
+            ++stats.suppressed;
+            return;
+        }
+        if (state.has_held) {
+            forward(state.held);
+            state.has_held = false;
+        }
+        forward(data);
+        return;
+    }
+
+    if (!state.has_held) {
+        openDoor();
+    } else {
+        const double dt = millisBetween(state.forwarded.timestamp, data.timestamp);
+        const double deviation = threshold(policy, state.forwarded.value);
+        const double upper = std::min(
+            state.upper_slope, (data.value + deviation - state.forwarded.value) / dt
+        );
+        const double lower = std::max(
+            state.lower_slope, (data.value - deviation - state.forwarded.value) / dt
+        );
+        const double slope = (data.value - state.forwarded.value) / dt;
+        if (dt > 0.0 && lower <= slope && slope <= upper) {
+            // Линия от вершины до data проходит в пределах порога от всех
+            // измерений после вершины, удерживаемое больше не нужно
+            state.upper_slope = upper;
+            state.lower_slope = lower;
+            state.held = data;
+            ++stats.suppressed;
+        } else {
+            // Дверь закрылась: удерживаемое измерение становится вершиной
+            forward(state.held);
+            state.has_held = false;
+            openDoor();
+        }
+    }
+
+    if (state.has_held && silenceExpired(policy, state, data)) {
+        forward(data);
+        state.has_held = false;
+    }
+}
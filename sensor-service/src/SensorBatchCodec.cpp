@@ -0,0 +1,308 @@
+#include "SensorBatchCodec.hpp"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+
+uint64_t zigzagEncode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t zigzagDecode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+uint64_t doubleBits(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+double bitsToDouble(uint64_t bits) {
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+int64_t toMillis(std::chrono::system_clock::time_point timestamp) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        timestamp.time_since_epoch()
+    ).count();
+}
+
+class BitWriter {
+public:
+    explicit BitWriter(std::string& out) : out_(out) {}
+
+    // Записывает младшие count бит value, старший бит первым (1 <= count <= 64)
+    void write(uint64_t value, int count) {
+        while (count > 0) {
+            const int free_bits = 8 - used_;
+            const int take = std::min(free_bits, count);
+            const auto chunk = static_cast<uint8_t>(
+                (value >> (count - take)) & ((1u << take) - 1)
+            );
+            current_ |= static_cast<uint8_t>(chunk << (free_bits - take));
+            used_ += take;
+            count -= take;
+            if (used_ == 8) {
+                out_.push_back(static_cast<char>(current_));
+                current_ = 0;
+                used_ = 0;
+            }
+        }
+    }
+
+    void flush() {
+        if (used_ > 0) {
+            out_.push_back(static_cast<char>(current_));
+            current_ = 0;
+            used_ = 0;
+        }
+    }
+
+private:
+    std::string& out_;
+    uint8_t current_{0};
+    int used_{0};
+};
+
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+    uint8_t byte() {
+        alignToByte();
+        if (pos_ >= size_) {
+            throw std::runtime_error("Sensor batch is truncated");
+        }
+        return data_[pos_++];
+    }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const uint8_t b = byte();
+            value |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if ((b & 0x80) == 0) {
+                return value;
+            }
+        }
+        throw std::runtime_error("Sensor batch contains a malformed varint");
+    }
+
+    uint64_t bits(int count) {
+        uint64_t value = 0;
+        while (count > 0) {
+            if (pos_ >= size_) {
+                throw std::runtime_error("Sensor batch is truncated");
+            }
+            const int available = 8 - bit_;
+            const int take = std::min(available, count);
+            const uint8_t chunk = static_cast<uint8_t>(
+                (data_[pos_] >> (available - take)) & ((1u << take) - 1)
+            );
+            value = (value << take) | chunk;
+            bit_ += take;
+            count -= take;
+            if (bit_ == 8) {
+                bit_ = 0;
+                ++pos_;
+            }
+        }
+        return value;
+    }
+
+    void alignToByte() {
+        if (bit_ > 0) {
+            bit_ = 0;
+            ++pos_;
+        }
+    }
+
+    size_t remaining() const { return pos_ < size_ ? size_ - pos_ : 0; }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_{0};
+    int bit_{0};
+};
+
+}  // namespace
+
+constexpr char SensorBatchCodec::kMagic[4];
+
+bool SensorBatchCodec::isBatch(const uint8_t* data, size_t size) {
+    return size >= sizeof(kMagic) + 1 && std::memcmp(data, kMagic, sizeof(kMagic)) == 0;
+}
+
+void SensorBatchCodec::encode(const std::vector<SensorData>& batch, std::string& out) {
+    out.clear();
+    out.append(kMagic, sizeof(kMagic));
+    out.push_back(static_cast<char>(kVersion));
+    out.push_back(0);  // flags, зарезервировано
+
+    // Группируем по датчику, сохраняя порядок измерений внутри серии
+    order_.resize(batch.size());
+    std::iota(order_.begin(), order_.end(), 0);
+    std::stable_sort(order_.begin(), order_.end(), [&batch](uint32_t a, uint32_t b) {
+        return batch[a].sensor_id < batch[b].sensor_id;
+    });
+
+    size_t series_count = 0;
+    for (size_t i = 0; i < order_.size(); ++i) {
+        if (i == 0 || batch[order_[i]].sensor_id != batch[order_[i - 1]].sensor_id) {
+            ++series_count;
+        }
+    }
+
+    const int64_t base_timestamp = batch.empty() ? 0 : toMillis(batch.front().timestamp);
+    putVarint(out, batch.size());
+    putVarint(out, series_count);
+    putVarint(out, zigzagEncode(base_timestamp));
+
+    size_t begin = 0;
+    while (begin < order_.size()) {
+        const int sensor_id = batch[order_[begin]].sensor_id;
+        size_t end = begin + 1;
+        while (end < order_.size() && batch[order_[end]].sensor_id == sensor_id) {
+            ++end;
+        }
+
+        putVarint(out, zigzagEncode(sensor_id));
+        putVarint(out, end - begin);
+
+        int64_t prev_timestamp = base_timestamp;
+        for (size_t i = begin; i < end; ++i) {
+            const int64_t timestamp = toMillis(batch[order_[i]].timestamp);
+            putVarint(out, zigzagEncode(timestamp - prev_timestamp));
+            prev_timestamp = timestamp;
+        }
+
+        BitWriter writer(out);
+        uint64_t prev = doubleBits(batch[order_[begin]].value);
+        writer.write(prev, 64);
+        int prev_leading = -1;
+        int prev_trailing = 0;
+
+        for (size_t i = begin + 1; i < end; ++i) {
+            const uint64_t current = doubleBits(batch[order_[i]].value);
+            const uint64_t x = current ^ prev;
+            prev = current;
+
+            if (x == 0) {
+                writer.write(0, 1);
+                continue;
+            }
+            writer.write(1, 1);
+
+            const int leading = std::min(__builtin_clzll(x), 31);
+            const int trailing = __builtin_ctzll(x);
+            if (prev_leading >= 0 && leading >= prev_leading && trailing >= prev_trailing) {
+                // Значащие биты помещаются в окно предыдущего значения
+                writer.write(0, 1);
+                writer.write(x >> prev_trailing, 64 - prev_leading - prev_trailing);
+            } else {
+                const int meaningful = 64 - leading - trailing;
+                writer.write(1, 1);
+                writer.write(static_cast<uint64_t>(leading), 5);
+                writer.write(static_cast<uint64_t>(meaningful - 1), 6);
+                writer.write(x >> trailing, meaningful);
+                prev_leading = leading;
+                prev_trailing = trailing;
+            }
+        }
+        writer.flush();
+
+        begin = end;
+    }
+}
+
+void SensorBatchCodec::decode(const uint8_t* data, size_t size, std::vector<SensorData>& out) {
+    if (!isBatch(data, size)) {
+        throw std::runtime_error("Not a sensor batch");
+    }
+
+    Reader reader(data + sizeof(kMagic), size - sizeof(kMagic));
+    const uint8_t version = reader.byte();
+    if (version != kVersion) {
+        throw std::runtime_error(
+            "Unsupported sensor batch version: " + std::to_string(version)
+        );
+    }
+    reader.byte();  // flags
+
+    const uint64_t record_count = reader.varint();
+    const uint64_t series_count = reader.varint();
+    const int64_t base_timestamp = zigzagDecode(reader.varint());
+
+    // Каждая запись занимает минимум байт, это защищает reserve от мусора
+    if (record_count > reader.remaining()) {
+        throw std::runtime_error("Sensor batch record count is corrupted");
+    }
+    out.reserve(out.size() + record_count);
+
+    uint64_t decoded = 0;
+    for (uint64_t s = 0; s < series_count; ++s) {
+        const int sensor_id = static_cast<int>(zigzagDecode(reader.varint()));
+        const uint64_t count = reader.varint();
+        if (count == 0 || decoded + count > record_count) {
+            throw std::runtime_error("Sensor batch series is corrupted");
+        }
+
+        const size_t first = out.size();
+        int64_t timestamp = base_timestamp;
+        for (uint64_t i = 0; i < count; ++i) {
+            timestamp += zigzagDecode(reader.varint());
+            SensorData record;
+            record.sensor_id = sensor_id;
+            record.trace = 0;
+            record.value = 0.0;
+            record.timestamp = std::chrono::system_clock::time_point(
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                    std::chrono::milliseconds(timestamp)
+                )
+            );
+            out.push_back(record);
+        }
+
+        uint64_t prev = reader.bits(64);
+        out[first].value = bitsToDouble(prev);
+        int leading = 0;
+        int trailing = 0;
+
+        for (uint64_t i = 1; i < count; ++i) {
+            if (reader.bits(1) != 0) {
+                if (reader.bits(1) != 0) {
+                    leading = static_cast<int>(reader.bits(5));
+                    const int meaningful = static_cast<int>(reader.bits(6)) + 1;
+                    trailing = 64 - leading - meaningful;
+                    if (trailing < 0) {
+                        throw std::runtime_error("Sensor batch value stream is corrupted");
+                    }
+                }
+                const int meaningful = 64 - leading - trailing;
+                prev ^= reader.bits(meaningful) << trailing;
+            }
+            out[first + i].value = bitsToDouble(prev);
+        }
+        reader.alignToByte();
+
+        decoded += count;
+    }
+
+    if (decoded != record_count) {
+        throw std::runtime_error("Sensor batch record count mismatch");
+    }
+}
@@ -0,0 +1,64 @@
+#include "SensorCollector.hpp"
+
+SensorCollector::SensorCollector(const SensorManager& manager)
+    : manager_(&manager) {
+}
+
+void SensorCollector::detach() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    manager_ = nullptr;
+}
+
+const std::string& SensorCollector::labelFor(int sensor_id) const {
+    auto it = labels_.find(sensor_id);
+    if (it == labels_.end()) {
+        it = labels_.emplace(sensor_id, std::to_string(sensor_id)).first;
+    }
+    return it->second;
+}
+
+std::vector<prometheus::MetricFamily> SensorCollector::Collect() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (manager_ == nullptr) {
+        return {};
+    }
+
+    prometheus::MetricFamily values;
+    values.name = "sensor_value";
+    values.help = "Current sensor values";
+    values.type = prometheus::MetricType::Gauge;
+
+    prometheus::MetricFamily statuses;
+    statuses.name = "sensor_status";
+    statuses.help = "Sensor online status (1=online, 0=offline)";
+    statuses.type = prometheus::MetricType::Gauge;
+
+    const size_t expected = labels_.size();
+    values.metric.reserve(expected);
+    statuses.metric.reserve(expected);
+
+    manager_->visitSensors([&](const SensorManager::SensorState& sensor) {
+        const std::string& id = labelFor(sensor.id);
+
+        prometheus::ClientMetric value;
+        value.label.push_back({"sensor_id", id});
+        value.gauge.value = sensor.value;
+        values.metric.push_back(std::move(value));
+
+        prometheus::ClientMetric status;
+        status.label.push_back({"sensor_id", id});
+        status.gauge.value = sensor.online ? 1.0 : 0.0;
+        statuses.metric.push_back(std::move(status));
+    });
+
+    // Удаленные датчики копятся в кэше; пересобрать его дешевле, чем
+    // отслеживать удаления
+    if (labels_.size() > 2 * values.metric.size() + 64) {
+        labels_.clear();
+    }
+
+    std::vector<prometheus::MetricFamily> families;
+    families.push_back(std::move(values));
+    families.push_back(std::move(statuses));
+    return families;
+}
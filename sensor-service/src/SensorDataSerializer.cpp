@@ -0,0 +1,79 @@
+#include "SensorDataSerializer.hpp"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <nlohmann/json.hpp>
+
+namespace {
+
+template<size_t N>
+char* appendLiteral(char* out, const char (&literal)[N]) {
+    std::memcpy(out, literal, N - 1);
+    return out + N - 1;
+}
+
+template<typename Int>
+char* appendInteger(char* out, Int value) {
+    // 20 знаков хватает для любого 64-битного целого со знаком
+    return std::to_chars(out, out + 21, value).ptr;
+}
+
+char* appendDouble(char* out, double value) {
+    if (!std::isfinite(value)) {
+        // dump() сериализует NaN и бесконечности как null
+        return appendLiteral(out, "null");
+    }
+    // Те же Grisu2 и правила форматирования, что использует dump(): кратчайшее
+    // представление std::to_chars в редких случаях расходится с ним в цифрах
+    return nlohmann::detail::to_chars(out, out + 32, value);
+}
+
+int64_t toMillis(std::chrono::system_clock::time_point timestamp) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        timestamp.time_since_epoch()
+    ).count();
+}
+
+}  // namespace
+
+char* SensorDataSerializer::writeRecord(char* out, const SensorData& data) {
+    // Ключи в порядке сортировки, как их выводит nlohmann::json
+    out = appendLiteral(out, "{\"sensor_id\":");
+    out = appendInteger(out, data.sensor_id);
+    out = appendLiteral(out, ",\"timestamp\":");
+    out = appendInteger(out, toMillis(data.timestamp));
+    out = appendLiteral(out, ",\"value\":");
+    out = appendDouble(out, data.value);
+    *out++ = '}';
+    return out;
+}
+
+size_t SensorDataSerializer::serializeInto(const SensorData& data, char* out) {
+    return static_cast<size_t>(writeRecord(out, data) - out);
+}
+
+size_t SensorDataSerializer::serializeRollupInto(const SensorRollup& rollup, char* out) {
+    char* begin = out;
+    out = appendLiteral(out, "{\"count\":");
+    out = appendInteger(out, rollup.count);
+    out = appendLiteral(out, ",\"last\":");
+    out = appendDouble(out, rollup.last);
+    out = appendLiteral(out, ",\"max\":");
+    out = appendDouble(out, rollup.max);
+    out = appendLiteral(out, ",\"mean\":");
+    out = appendDouble(out, rollup.mean);
+    out = appendLiteral(out, ",\"min\":");
+    out = appendDouble(out, rollup.min);
+    out = appendLiteral(out, ",\"sensor_id\":");
+    out = appendInteger(out, rollup.sensor_id);
+    out = appendLiteral(out, ",\"stddev\":");
+    out = appendDouble(out, rollup.stddev);
+    out = appendLiteral(out, ",\"timestamp\":");
+    out = appendInteger(out, toMillis(rollup.window_end));
+    out = appendLiteral(out, ",\"value\":");
+    out = appendDouble(out, rollup.mean);
+    out = appendLiteral(out, ",\"window_start\":");
+    out = appendInteger(out, toMillis(rollup.window_start));
+    *out++ = '}';
+    return static_cast<size_t>(out - begin);
+}
@@ -0,0 +1,14 @@
+#include "SensorDriver.hpp"
+
+void RandomSensorDriver::readBatch(
+    const std::vector<int>& ids,
+    std::vector<double>& values,
+    std::vector<uint8_t>& ok
+) {
+    // Демо-реализация, в реальности значения читает драйвер устройства
+    values.resize(ids.size());
+    ok.assign(ids.size(), 1);
+    for (size_t i = 0; i < ids.size(); ++i) {
+        values[i] = dis_(gen_);
+    }
+}
@@ -1,62 +1,480 @@
 #include "SensorManager.hpp"
-#include <random> // Для демонстрации, в реальности здесь будет код работы с реальными датчиками
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include "Metrics.hpp"
 
 SensorManager::SensorManager(int polling_interval_ms)
-    : polling_interval_ms_(polling_interval_ms) {}
+    : polling_interval_ms_(polling_interval_ms)
+    , driver_factory_([] { return std::make_unique<RandomSensorDriver>(); }) {
+    createShards(2);
+}
 
 SensorManager::~SensorManager() {
     stop();
 }
 
-void SensorManager::addSensor(int sensor_id) {
-    sensor_ids_.push_back(sensor_id);
+void SensorManager::createShards(size_t count) {
+    std::vector<std::unique_ptr<Shard>> shards;
+    for (size_t i = 0; i < count; ++i) {
+        shards.push_back(std::make_unique<Shard>());
+        shards.back()->index = i;
+    }
+
+    // Перераспределяем уже добавленные датчики по новым шардам
+    shard_of_.clear();
+    size_t next = 0;
+    for (const auto& old_shard : shards_) {
+        const auto& old = old_shard->registry;
+        for (size_t i = 0; i < old.size(); ++i) {
+            shards[next]->registry.add(old.ids[i], old.intervals[i], old.phases[i]);
+            shard_of_[old.ids[i]] = static_cast<uint32_t>(next);
+            next = (next + 1) % count;
+        }
+    }
+    shards_ = std::move(shards);
+}
+
+bool SensorManager::addSensor(
+    int sensor_id,
+    std::chrono::milliseconds interval,
+    std::chrono::milliseconds phase
+) {
+    if (interval.count() <= 0) {
+        interval = std::chrono::milliseconds(polling_interval_ms_);
+    }
+    const auto interval_ticks = std::max<TimerWheel::Tick>(1, interval / kTick);
+    const auto phase_ticks = static_cast<TimerWheel::Tick>(std::max<int64_t>(0, phase / kTick));
+
+    std::lock_guard<std::mutex> registry_lock(registry_mutex_);
+    if (shard_of_.count(sensor_id) != 0) {
+        return false;
+    }
+
+    // В наименее загруженный шард
+    uint32_t target = 0;
+    for (uint32_t i = 1; i < shards_.size(); ++i) {
+        if (shards_[i]->registry.size() < shards_[target]->registry.size()) {
+            target = i;
+        }
+    }
+
+    Shard& shard = *shards_[target];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const uint32_t index = shard.registry.add(sensor_id, interval_ticks, phase_ticks);
+        if (running_) {
+            const auto deadline = toTick(std::chrono::steady_clock::now()) + phase_ticks;
+            shard.registry.next_deadlines[index] = deadline;
+            shard.wheel.schedule(index, deadline);
+        }
+    }
+    shard.changed.notify_one();
+    shard_of_[sensor_id] = target;
+    return true;
+}
+
+bool SensorManager::removeSensor(int sensor_id) {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex_);
+    auto it = shard_of_.find(sensor_id);
+    if (it == shard_of_.end()) {
+        return false;
+    }
+
+    Shard& shard = *shards_[it->second];
+    shard_of_.erase(it);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const uint32_t index = shard.registry.indexOf(sensor_id);
+    shard.wheel.cancel(index);
+    const uint32_t moved = shard.registry.removeAt(index);
+    if (moved != SensorRegistry::npos) {
+        // Таймер переехавшего датчика переставляется на его новый индекс
+        const bool scheduled = shard.wheel.scheduled(moved);
+        shard.wheel.cancel(moved);
+        if (scheduled) {
+            shard.wheel.schedule(index, shard.registry.next_deadlines[index]);
+        }
+    }
+    return true;
+}
+
+size_t SensorManager::sensorCount() const {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex_);
+    return shard_of_.size();
+}
+
+std::vector<SensorManager::SensorState> SensorManager::getSensors() const {
+    std::vector<SensorState> sensors;
+    {
+        std::lock_guard<std::mutex> registry_lock(registry_mutex_);
+        sensors.reserve(shard_of_.size());
+    }
+    visitSensors([&sensors](const SensorState& sensor) {
+        sensors.push_back(sensor);
+    });
+    return sensors;
+}
+
+void SensorManager::visitSensors(const std::function<void(const SensorState& sensor)>& visitor) const {
+    const auto now = std::chrono::system_clock::now();
+
+    // Мьютекс шарда нужен и его потоку опроса, а visitor может быть
+    // медленным: под мьютексом только копия порции
+    std::vector<SensorState> chunk;
+    chunk.reserve(kVisitChunk);
+    size_t shard_index = 0;
+    size_t next = 0;
+    for (;;) {
+        chunk.clear();
+        {
+            std::lock_guard<std::mutex> registry_lock(registry_mutex_);
+            if (shard_index >= shards_.size()) {
+                break;
+            }
+            const auto& shard = *shards_[shard_index];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            const auto& registry = shard.registry;
+            for (; next < registry.size() && chunk.size() < kVisitChunk; ++next) {
+                const auto interval = std::chrono::milliseconds(registry.intervals[next] * kTick);
+                const bool online = registry.statuses[next] == SensorRegistry::Status::ONLINE
+                    && now - registry.last_seen[next] <= kOfflineAfterIntervals * interval;
+                chunk.push_back(SensorState{
+                    registry.ids[next],
+                    registry.last_values[next],
+                    registry.last_seen[next],
+                    interval,
+                    online
+                });
+            }
+            if (next >= registry.size()) {
+                ++shard_index;
+                next = 0;
+            }
+        }
+        for (const auto& sensor : chunk) {
+            visitor(sensor);
+        }
+    }
 }
 
 void SensorManager::start() {
-    if (!running_) {
-        running_ = true;
-        polling_thread_ = std::thread(&SensorManager::pollingSensorLoop, this);
+    std::lock_guard<std::mutex> registry_lock(registry_mutex_);
+    if (running_) {
+        return;
+    }
+
+    if (read_drivers_.size() != read_worker_count_) {
+        read_drivers_.clear();
+        for (size_t i = 0; i < read_worker_count_; ++i) {
+            read_drivers_.push_back(driver_factory_());
+        }
+    }
+
+    const auto start_tick = toTick(std::chrono::steady_clock::now());
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        auto& registry = shard->registry;
+        shard->wheel = TimerWheel(start_tick);
+        for (uint32_t i = 0; i < registry.size(); ++i) {
+            registry.next_deadlines[i] = start_tick + registry.phases[i];
+            shard->wheel.schedule(i, registry.next_deadlines[i]);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> read_lock(read_mutex_);
+        read_pool_running_ = true;
+    }
+    for (auto& driver : read_drivers_) {
+        read_workers_.emplace_back(&SensorManager::readWorkerLoop, this, std::ref(*driver));
+    }
+
+    running_ = true;
+    for (auto& shard : shards_) {
+        shard->thread = std::thread(&SensorManager::pollingLoop, this, std::ref(*shard));
     }
 }
 
 void SensorManager::stop() {
-    if (running_) {
-        running_ = false;
-        if (polling_thread_.joinable()) {
-            polling_thread_.join();
+    if (!running_) {
+        return;
+    }
+
+    running_ = false;
+    for (auto& shard : shards_) {
+        {
+            // Под мьютексом, чтобы поток не пропустил пробуждение между
+            // проверкой running_ и ожиданием
+            std::lock_guard<std::mutex> lock(shard->mutex);
+        }
+        shard->changed.notify_all();
+    }
+    for (auto& shard : shards_) {
+        if (shard->thread.joinable()) {
+            shard->thread.join();
+        }
+    }
+
+    // Начатые чтения дочитываются, стоящие в очереди отбрасываются
+    {
+        std::lock_guard<std::mutex> read_lock(read_mutex_);
+        read_pool_running_ = false;
+        read_queue_.clear();
+    }
+    read_ready_.notify_all();
+    for (auto& worker : read_workers_) {
+        worker.join();
+    }
+    read_workers_.clear();
+
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->reading.clear();
+        for (auto& job : shard->completed) {
+            shard->spare.push_back(std::move(job));
         }
+        shard->completed.clear();
     }
 }
 
-void SensorManager::setCallback(SensorCallback callback) {
+void SensorManager::setBatchCallback(BatchCallback callback) {
     callback_ = std::move(callback);
 }
 
-void SensorManager::pollingSensorLoop() {
+void SensorManager::setPollingThreads(size_t count) {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex_);
+    if (running_) {
+        throw std::logic_error("Polling threads must be configured before start()");
+    }
+    createShards(std::max<size_t>(count, 1));
+}
+
+size_t SensorManager::pollingThreads() const {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex_);
+    return shards_.size();
+}
+
+void SensorManager::setReadWorkers(size_t count) {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex_);
+    if (running_) {
+        throw std::logic_error("Read workers must be configured before start()");
+    }
+    read_worker_count_ = std::max<size_t>(count, 1);
+}
+
+size_t SensorManager::readWorkers() const {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex_);
+    return read_worker_count_;
+}
+
+void SensorManager::setDriverFactory(DriverFactory factory) {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex_);
+    if (running_) {
+        throw std::logic_error("Sensor driver must be configured before start()");
+    }
+    driver_factory_ = std::move(factory);
+    read_drivers_.clear();
+}
+
+void SensorManager::setMetrics(Metrics* metrics) {
+    metrics_ = metrics;
+}
+
+void SensorManager::setLatencyTracker(LatencyTracker* tracker) {
+    if (running_) {
+        throw std::logic_error("Latency tracker must be set before start()");
+    }
+    latency_ = tracker != nullptr && tracker->sampleEvery() > 0 ? tracker : nullptr;
+}
+
+TimerWheel::Tick SensorManager::toTick(std::chrono::steady_clock::time_point time) const {
+    return time <= epoch_ ? 0 : static_cast<TimerWheel::Tick>((time - epoch_) / kTick);
+}
+
+std::chrono::steady_clock::time_point SensorManager::fromTick(TimerWheel::Tick tick) const {
+    return epoch_ + tick * kTick;
+}
+
+void SensorManager::pollingLoop(Shard& shard) {
+    std::unique_lock<std::mutex> lock(shard.mutex);
     while (running_) {
-        for (int sensor_id : sensor_ids_) {
-            SensorData data{
-                sensor_id,
-                readSensorValue(sensor_id),
-                std::chrono::system_clock::now()
-            };
+        if (!shard.completed.empty()) {
+            auto job = std::move(shard.completed.front());
+            shard.completed.pop_front();
+            deliverReads(shard, std::move(job), lock);
+            continue;
+        }
+
+        auto wakeup = shard.wheel.nextWakeup();
+        if (!wakeup) {
+            shard.changed.wait(lock);
+            continue;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now < fromTick(*wakeup)) {
+            // Ждем до абсолютного срока; новый датчик или готовое
+            // чтение разбудят раньше
+            shard.changed.wait_until(lock, fromTick(*wakeup));
+            continue;
+        }
+
+        const std::chrono::duration<double> jitter = now - fromTick(*wakeup);
+        const TimerWheel::Tick now_tick = toTick(now);
+        TimerWheel::Tick missed = 0;
+
+        auto& registry = shard.registry;
+        shard.due.clear();
+        shard.wheel.advance(now_tick, [&](uint32_t index, TimerWheel::Tick deadline) {
+            if (shard.reading.count(registry.ids[index]) == 0) {
+                shard.due.push_back(index);
+            } else {
+                ++missed;  // предыдущее чтение еще в работе
+            }
 
-            if (callback_) {
-                callback_(data);
+            // Следующий срок считается от предыдущего, а не от момента опроса.
+            // Если поток отстал больше чем на период, пропущенные опросы
+            // не догоняются пачкой
+            const TimerWheel::Tick interval = registry.intervals[index];
+            TimerWheel::Tick next = deadline + interval;
+            if (next <= now_tick) {
+                const TimerWheel::Tick behind = (now_tick - deadline) / interval;
+                next = deadline + (behind + 1) * interval;
+                missed += behind;
             }
+            registry.next_deadlines[index] = next;
+            shard.wheel.schedule(index, next);
+        });
+
+        if (shard.due.empty() && missed == 0) {
+            continue;  // пробуждение только для переноса таймеров между уровнями
         }
+        dispatchReads(shard);
 
-        std::this_thread::sleep_for(
-            std::chrono::milliseconds(polling_interval_ms_)
-        );
+        lock.unlock();
+        if (metrics_) {
+            metrics_->observeSchedulingJitter(jitter.count());
+            if (missed > 0) {
+                metrics_->incrementMissedPolls(static_cast<double>(missed));
+            }
+        }
+        lock.lock();
     }
 }
 
-double SensorManager::readSensorValue(int sensor_id) {
-    // Демо-реализация, в реальности здесь будет код чтения с реального датчика
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::normal_distribution<> dis(20.0, 5.0);
-    
-    return dis(gen);
-} 
\ No newline at end of file
+void SensorManager::dispatchReads(Shard& shard) {
+    const auto& registry = shard.registry;
+    for (size_t begin = 0; begin < shard.due.size(); begin += kReadChunk) {
+        const size_t end = std::min(shard.due.size(), begin + kReadChunk);
+
+        std::unique_ptr<ReadJob> job;
+        if (shard.spare.empty()) {
+            job = std::make_unique<ReadJob>();
+            job->shard = &shard;
+        } else {
+            job = std::move(shard.spare.back());
+            shard.spare.pop_back();
+        }
+
+        // id копируются под мьютексом: пока идут чтения, индексы могут сдвинуться
+        job->due.assign(shard.due.begin() + begin, shard.due.begin() + end);
+        job->ids.clear();
+        for (uint32_t index : job->due) {
+            job->ids.push_back(registry.ids[index]);
+            shard.reading.insert(registry.ids[index]);
+        }
+
+        {
+            std::lock_guard<std::mutex> read_lock(read_mutex_);
+            read_queue_.push_back(std::move(job));
+        }
+        read_ready_.notify_one();
+    }
+}
+
+void SensorManager::deliverReads(
+    Shard& shard,
+    std::unique_ptr<ReadJob> job,
+    std::unique_lock<std::mutex>& lock
+) {
+    auto& registry = shard.registry;
+    for (size_t i = 0; i < job->ids.size(); ++i) {
+        shard.reading.erase(job->ids[i]);
+
+        uint32_t index = job->due[i];
+        if (index >= registry.size() || registry.ids[index] != job->ids[i]) {
+            index = registry.indexOf(job->ids[i]);
+            if (index == SensorRegistry::npos) {
+                // Удален, пока шло чтение: измерение не отдается, чтобы
+                // состояние датчика дальше по конвейеру не завелось снова
+                job->read_ok[i] = 0;
+                continue;
+            }
+        }
+        if (job->read_ok[i]) {
+            registry.last_values[index] = job->values[i];
+            registry.last_seen[index] = job->timestamp;
+            registry.statuses[index] = SensorRegistry::Status::ONLINE;
+        } else {
+            registry.statuses[index] = SensorRegistry::Status::OFFLINE;
+        }
+    }
+
+    shard.batch.clear();
+    for (size_t i = 0; i < job->ids.size(); ++i) {
+        if (job->read_ok[i]) {
+            uint32_t trace = 0;
+            if (latency_ && ++shard.since_trace >= latency_->sampleEvery()) {
+                shard.since_trace = 0;
+                trace = latency_->begin(job->read_time);
+            }
+            shard.batch.push_back(SensorData{job->ids[i], trace, job->values[i], job->timestamp});
+        }
+    }
+    shard.spare.push_back(std::move(job));
+
+    // Колбэк без мьютекса: он может долго ждать места в буфере
+    if (!shard.batch.empty() && callback_) {
+        lock.unlock();
+        callback_(shard.index, shard.batch.data(), shard.batch.size());
+        lock.lock();
+    }
+}
+
+void SensorManager::readWorkerLoop(SensorDriver& driver) {
+    for (;;) {
+        std::unique_ptr<ReadJob> job;
+        {
+            std::unique_lock<std::mutex> read_lock(read_mutex_);
+            read_ready_.wait(read_lock, [this] {
+                return !read_pool_running_ || !read_queue_.empty();
+            });
+            if (!read_pool_running_) {
+                return;
+            }
+            job = std::move(read_queue_.front());
+            read_queue_.pop_front();
+        }
+
+        readJob(driver, *job);
+
+        Shard& shard = *job->shard;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.completed.push_back(std::move(job));
+        }
+        shard.changed.notify_one();
+    }
+}
+
+void SensorManager::readJob(SensorDriver& driver, ReadJob& job) {
+    try {
+        driver.readBatch(job.ids, job.values, job.read_ok);
+    } catch (const std::exception& e) {
+        // Вся пачка помечается офлайн, следующий опрос попробует снова
+        job.read_ok.assign(job.ids.size(), 0);
+        std::cerr << "Sensor driver read failed: " << e.what() << std::endl;
+    }
+    job.timestamp = std::chrono::system_clock::now();
+    job.read_time = std::chrono::steady_clock::now();
+}
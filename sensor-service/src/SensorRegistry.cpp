@@ -0,0 +1,49 @@
+#include "SensorRegistry.hpp"
+
+uint32_t SensorRegistry::add(int id, Tick interval, Tick phase) {
+    const auto index = static_cast<uint32_t>(ids.size());
+    if (!index_.emplace(id, index).second) {
+        return npos;
+    }
+
+    ids.push_back(id);
+    intervals.push_back(interval);
+    phases.push_back(phase);
+    next_deadlines.push_back(0);
+    last_values.push_back(0.0);
+    last_seen.emplace_back();
+    statuses.push_back(Status::UNKNOWN);
+    return index;
+}
+
+uint32_t SensorRegistry::removeAt(uint32_t index) {
+    index_.erase(ids[index]);
+
+    const auto last = static_cast<uint32_t>(ids.size() - 1);
+    uint32_t moved = npos;
+    if (index != last) {
+        ids[index] = ids[last];
+        intervals[index] = intervals[last];
+        phases[index] = phases[last];
+        next_deadlines[index] = next_deadlines[last];
+        last_values[index] = last_values[last];
+        last_seen[index] = last_seen[last];
+        statuses[index] = statuses[last];
+        index_[ids[index]] = index;
+        moved = last;
+    }
+
+    ids.pop_back();
+    intervals.pop_back();
+    phases.pop_back();
+    next_deadlines.pop_back();
+    last_values.pop_back();
+    last_seen.pop_back();
+    statuses.pop_back();
+    return moved;
+}
+
+uint32_t SensorRegistry::indexOf(int id) const {
+    auto it = index_.find(id);
+    return it == index_.end() ? npos : it->second;
+}
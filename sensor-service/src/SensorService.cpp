@@ -1,83 +1,389 @@
 #include "SensorService.hpp"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <iomanip>
+#include <stdexcept>
 #include "Metrics.hpp"
 #include "AlertManager.hpp"
 #include "SystemMonitor.hpp"
 #include "Tracer.hpp"
-#include "Profiler.hpp"
 #include "HotPathAnalyzer.hpp"
+#include "ProfileEndpoint.hpp"
+
+namespace {
+
+// Датчики с окнами агрегации фильтр пропускает как есть, иначе окна
+// считались бы по прореженным измерениям
+SampleFilter::Config withoutRollupSensors(
+    SampleFilter::Config filter,
+    const WindowAggregator::Config& rollups
+) {
+    const auto windowed = [&rollups](int sensor_id) {
+        auto it = rollups.sensor_policies.find(sensor_id);
+        const auto& policy = it != rollups.sensor_policies.end() ? it->second : rollups.default_policy;
+        return policy.output != WindowAggregator::Output::RAW;
+    };
+    if (rollups.default_policy.output != WindowAggregator::Output::RAW) {
+        // Политика по умолчанию остается только у датчиков, явно оставленных без окон
+        for (const auto& [sensor_id, policy] : rollups.sensor_policies) {
+            if (policy.output == WindowAggregator::Output::RAW) {
+                filter.sensor_policies.emplace(sensor_id, filter.default_policy);
+            }
+        }
+        filter.default_policy = SampleFilter::Policy{};
+    }
+    for (auto& [sensor_id, policy] : filter.sensor_policies) {
+        if (windowed(sensor_id)) {
+            policy = SampleFilter::Policy{};
+        }
+    }
+    return filter;
+}
+
+// Буферы пула, еще не отданные продюсеру. Если до передачи что-то бросит,
+// они вернутся в пул, а не потеряются до конца работы
+class UnsentBuffers {
+public:
+    // group - общий итог доставки всех добавленных буферов, может быть nullptr
+    UnsentBuffers(KafkaProducer& producer, std::vector<KafkaProducer::Buffer*>& buffers,
+                  DeliveryGroup* group)
+        : producer_(producer), buffers_(buffers), group_(group) {
+        buffers_.clear();
+    }
+    ~UnsentBuffers() {
+        for (auto* buffer : buffers_) {
+            producer_.releaseBuffer(buffer);
+        }
+        buffers_.clear();
+    }
+
+    UnsentBuffers(const UnsentBuffers&) = delete;
+    UnsentBuffers& operator=(const UnsentBuffers&) = delete;
+
+    // Вектор зарезервирован под все буферы, и add после захвата не бросает
+    void reserve(size_t count) { buffers_.reserve(count); }
+    void add(KafkaProducer::Buffer* buffer) {
+        buffers_.push_back(buffer);
+        if (group_ != nullptr) {
+            group_->retain();
+            buffer->group = group_;
+        }
+    }
+    // produce не бросает и забирает владение в любом случае
+    void produce() {
+        producer_.produceBatch(buffers_);
+        buffers_.clear();
+    }
+
+private:
+    KafkaProducer& producer_;
+    std::vector<KafkaProducer::Buffer*>& buffers_;
+    DeliveryGroup* group_;
+};
+
+}  // namespace
 
 SensorService::SensorService(
     const std::string& kafka_brokers,
     const std::string& topic,
     int polling_interval_ms
 ) {
+    metrics_ = std::make_unique<Metrics>();
+    latency_ = std::make_unique<LatencyTracker>(LatencyTracker::Config{}, metrics_.get());
     producer_ = std::make_unique<KafkaProducer>(kafka_brokers, topic);
     sensor_manager_ = std::make_unique<SensorManager>(polling_interval_ms);
-    buffer_ = std::make_unique<DataBuffer>();
+    spill_config_.directory = "spill";
     
-    sensor_manager_->setCallback(
-        [this](const SensorData& data) {
-            handleSensorData(data);
+    sensor_manager_->setBatchCallback(
+        [this](size_t thread, const SensorData* data, size_t count) {
+            handleSensorBatch(thread, data, count);
         }
     );
     
-    metrics_ = std::make_unique<Metrics>();
+    producer_->setMetrics(metrics_.get());
+    producer_->setLatencyTracker(latency_.get());
+    sensor_manager_->setMetrics(metrics_.get());
+    sensor_manager_->setLatencyTracker(latency_.get());
+    sensor_collector_ = std::make_shared<SensorCollector>(*sensor_manager_);
+    metrics_->registerCollectable(sensor_collector_);
+    metrics_->registerCollectable(HotPathAnalyzer::shared());
     alert_manager_ = std::make_unique<AlertManager>("http://localhost:8080/alert");
+    alert_rules_ = std::make_unique<AlertRuleEngine>(
+        [this](const Alert& alert) {
+            alert_manager_->sendAlert(alert);
+        }
+    );
     system_monitor_ = std::make_unique<SystemMonitor>(metrics_->getRegistry());
     tracer_ = std::make_unique<Tracer>("sensor_service");
     profiler_ = std::make_unique<Profiler>("profiles");
 }
 
 SensorService::~SensorService() {
+    if (profile_endpoint_) {
+        profile_endpoint_->detach();
+    }
     stop();
+    sensor_collector_->detach();
+}
+
+bool SensorService::addSensor(
+    int sensor_id,
+    std::chrono::milliseconds interval,
+    std::chrono::milliseconds phase
+) {
+    return sensor_manager_->addSensor(sensor_id, interval, phase);
+}
+
+bool SensorService::removeSensor(int sensor_id) {
+    if (!sensor_manager_->removeSensor(sensor_id)) {
+        return false;
+    }
+    // Следующего измерения не будет: точка, придержанная фильтром, уходит сейчас
+    std::vector<SensorData> held;
+    for (auto& polling : polling_states_) {
+        if (polling->filter) {
+            std::lock_guard<std::mutex> lock(polling->filter_mutex);
+            held.clear();
+            bufferHeldSamples(held, polling->filter->remove(sensor_id, held));
+        }
+    }
+    return true;
+}
+
+void SensorService::setWireFormat(WireFormat format) {
+    wire_format_ = format;
+}
+
+void SensorService::setProcessingWorkers(size_t count) {
+    if (running_) {
+        throw std::logic_error("Processing workers must be configured before start()");
+    }
+    worker_count_ = std::max<size_t>(count, 1);
+}
+
+void SensorService::setPollingThreads(size_t count) {
+    sensor_manager_->setPollingThreads(count);
+}
+
+void SensorService::setReadWorkers(size_t count) {
+    sensor_manager_->setReadWorkers(count);
+}
+
+void SensorService::setSensorDriverFactory(SensorManager::DriverFactory factory) {
+    sensor_manager_->setDriverFactory(std::move(factory));
+}
+
+void SensorService::setSpillConfig(SpillLog::Config config) {
+    if (running_) {
+        throw std::logic_error("Spill log must be configured before start()");
+    }
+    spill_config_ = std::move(config);
+}
+
+void SensorService::setRollupConfig(WindowAggregator::Config config) {
+    if (running_) {
+        throw std::logic_error("Rollups must be configured before start()");
+    }
+    // Проверяем сразу, а не при создании обработчиков в start()
+    WindowAggregator validated(config);
+    rollup_config_ = std::move(config);
+}
+
+void SensorService::setFilterConfig(SampleFilter::Config config) {
+    if (running_) {
+        throw std::logic_error("Sample filter must be configured before start()");
+    }
+    SampleFilter validated(config);
+    filter_config_ = std::move(config);
+}
+
+void SensorService::setStatisticsConfig(SensorStatistics::Config config) {
+    if (running_) {
+        throw std::logic_error("Sensor statistics must be configured before start()");
+    }
+    SensorStatistics validated(config);
+    statistics_config_ = config;
+}
+
+void SensorService::setLatencyTracing(LatencyTracker::Config config) {
+    if (running_) {
+        throw std::logic_error("Latency tracing must be configured before start()");
+    }
+    auto tracker = std::make_unique<LatencyTracker>(config, metrics_.get());
+    producer_->setLatencyTracker(tracker.get());
+    sensor_manager_->setLatencyTracker(tracker.get());
+    latency_ = std::move(tracker);
+}
+
+void SensorService::setTracingConfig(Tracer::Config config) {
+    if (running_) {
+        throw std::logic_error("Tracing must be configured before start()");
+    }
+    tracer_ = std::make_unique<Tracer>("sensor_service", std::move(config));
+}
+
+void SensorService::setProfilingTriggers(
+    ProfilingTriggers::Config triggers,
+    Profiler::TriggerConfig capture
+) {
+    if (running_) {
+        throw std::logic_error("Profiling triggers must be configured before start()");
+    }
+    ProfilingTriggers validated(triggers);
+    StackSampler validated_sampler(capture.sampler);
+    trigger_config_ = triggers;
+    capture_config_ = capture;
+}
+
+bool SensorService::requestProfile(const std::string& reason) {
+    return running_ && profiler_->triggerCapture(reason);
+}
+
+void SensorService::enableProfileEndpoint() {
+    if (running_) {
+        throw std::logic_error("Profile endpoint must be enabled before start()");
+    }
+    if (profile_endpoint_) {
+        return;
+    }
+    profile_endpoint_ = std::make_shared<ProfileEndpoint>(
+        [this](const std::string& reason) {
+            return requestProfile(reason);
+        }
+    );
+    metrics_->registerCollectable(profile_endpoint_, "/profile");
+}
+
+void SensorService::setAlertRulesPath(std::string path) {
+    if (running_) {
+        throw std::logic_error("Alert rules must be configured before start()");
+    }
+    alert_rules_path_ = std::move(path);
+}
+
+void SensorService::createWorkers(size_t count) {
+    workers_.clear();
+    workers_.reserve(count);
+    const size_t shard_capacity = std::max<size_t>(kBufferCapacity / count, kMaxBatchSize);
+    for (size_t i = 0; i < count; ++i) {
+        auto worker = std::make_unique<ProcessingWorker>();
+        worker->index = i;
+        // Читает очередь один обработчик, а пишут потоки опроса датчиков.
+        // Придержанные фильтром точки пишут еще мониторинг, stop() и
+        // removeSensor, так что с фильтром писателей всегда несколько
+        const bool filtering = !polling_states_.empty() && polling_states_.front()->filter;
+        const auto mode = sensor_manager_->pollingThreads() > 1 || filtering
+            ? DataBuffer::Mode::MPMC
+            : DataBuffer::Mode::SPSC;
+        worker->buffer = std::make_unique<DataBuffer>(shard_capacity, mode);
+        worker->high_water = static_cast<size_t>(worker->buffer->capacity() * kSpillHighWater);
+        worker->batch_key = std::to_string(i);
+        if (!spill_config_.directory.empty()) {
+            // Остаток прошлого запуска воспроизводится раньше новых данных.
+            // Если число обработчиков поменялось, порядок датчика между
+            // старым и новым шардом не гарантируется
+            SpillLog::Config config = spill_config_;
+            config.directory += "/shard-" + worker->batch_key;
+            worker->spill = std::make_shared<SpillLog>(std::move(config));
+            worker->spilling = !worker->spill->empty();
+        }
+        auto aggregator = std::make_unique<WindowAggregator>(rollup_config_);
+        if (aggregator->enabled()) {
+            worker->aggregator = std::move(aggregator);
+            worker->next_rollup_flush = std::chrono::steady_clock::now() + kRollupFlushInterval;
+        }
+        workers_.push_back(std::move(worker));
+    }
+}
+
+SensorService::ProcessingWorker& SensorService::workerFor(int sensor_id) {
+    return *workers_[static_cast<uint32_t>(sensor_id) % workers_.size()];
+}
+
+size_t SensorService::bufferedSamples() const {
+    size_t total = 0;
+    for (const auto& worker : workers_) {
+        total += worker->buffer->size();
+    }
+    return total;
+}
+
+SpillLog::Stats SensorService::spillStats() const {
+    SpillLog::Stats total;
+    for (const auto& worker : workers_) {
+        if (worker->spill) {
+            auto stats = worker->spill->getStats();
+            total.spilled += stats.spilled;
+            total.replayed += stats.replayed;
+            total.dropped += stats.dropped;
+            total.pending += stats.pending;
+            total.bytes_on_disk += stats.bytes_on_disk;
+        }
+    }
+    return total;
 }
 
 void SensorService::start() {
     PROFILE_FUNCTION();
-    auto span = tracer_->startSpan("service_start");
+    auto span = tracer_->startSpan("service_start", true);
     
     try {
+        if (!alert_rules_path_.empty()) {
+            try {
+                alert_rules_->load(alert_rules_path_);
+            } catch (const std::exception& e) {
+                // Без правил сервис работает, алерты остаются за Prometheus
+                std::cerr << "Alert rules are not loaded from " << alert_rules_path_
+                          << ": " << e.what() << std::endl;
+            }
+        }
+        createPollingStates(sensor_manager_->pollingThreads());
+        createWorkers(worker_count_);
         running_ = true;
         system_monitor_->start();
-        processing_thread_ = std::thread(&SensorService::processingLoop, this);
+        for (auto& worker : workers_) {
+            worker->thread = std::thread(&SensorService::processingLoop, this, std::ref(*worker));
+        }
         monitoring_thread_ = std::thread(&SensorService::monitoringLoop, this);
         sensor_manager_->start();
         
-        profiler_->startContinuousProfiling(
-            Profiler::ProfileType::CPU,
-            std::chrono::minutes(5)
-        );
-        
-        profiler_->startProfiling(Profiler::ProfileType::HEAP);
+        try {
+            profiler_->startTriggeredProfiling(capture_config_);
+        } catch (const std::exception& e) {
+            // Без профилей сервис работает
+            std::cerr << "Triggered profiling is not started: " << e.what() << std::endl;
+        }
         
         tracer_->addEvent(span, "service_started");
     } catch (const std::exception& e) {
         tracer_->setError(span, e.what());
+        tracer_->endSpan(span);
         throw;
     }
     
-    span->End();
+    tracer_->endSpan(span);
 }
 
 void SensorService::stop() {
     PROFILE_FUNCTION();
-    profiler_->stopContinuousProfiling();
-    profiler_->stopProfiling(Profiler::ProfileType::HEAP);
-    
-    auto hot_paths = HotPathAnalyzer::getInstance().getHotPaths();
-    for (const auto& path : hot_paths) {
-        std::cout << "Hot path: " << path.path
-                  << ", avg time: " << path.avg_time
-                  << "µs, calls: " << path.calls << std::endl;
+    profiler_->stopTriggeredProfiling();
+    try {
+        profiler_->writeScopeProfile();
+    } catch (const std::exception& e) {
+        std::cerr << "Scope profile is not written: " << e.what() << std::endl;
     }
     
-    running_ = false;
     sensor_manager_->stop();
+    // Колбэков больше нет: придержанные фильтром точки уходят в буфер,
+    // а обработчики отправят его остаток перед выходом
+    flushHeldSamples(std::chrono::system_clock::time_point::max());
+    running_ = false;
     
-    if (processing_thread_.joinable()) {
-        processing_thread_.join();
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
     }
     if (monitoring_thread_.joinable()) {
         monitoring_thread_.join();
@@ -86,70 +392,428 @@ void SensorService::stop() {
     producer_->flush();
 }
 
-void SensorService::handleSensorData(const SensorData& data) {
+void SensorService::createPollingStates(size_t count) {
+    polling_states_.clear();
+    const auto filter_config = withoutRollupSensors(filter_config_, rollup_config_);
+    const bool filtering = SampleFilter(filter_config).enabled();
+    for (size_t i = 0; i < count; ++i) {
+        auto state = std::make_unique<PollingState>(statistics_config_);
+        if (filtering) {
+            state->filter = std::make_unique<SampleFilter>(filter_config);
+        }
+        polling_states_.push_back(std::move(state));
+    }
+}
+
+void SensorService::reportAnomalies(const std::vector<SensorStatistics::Anomaly>& anomalies) {
     PROFILE_FUNCTION();
-    auto span = tracer_->startSpan("handle_sensor_data", {
-        {"sensor_id", std::to_string(data.sensor_id)},
-        {"value", std::to_string(data.value)}
-    });
+    metrics_->incrementAnomalies(static_cast<double>(anomalies.size()));
+    for (const auto& anomaly : anomalies) {
+        alert_manager_->sendAlert({
+            "Sensor Anomaly",
+            "Sensor " + std::to_string(anomaly.sensor_id) + " reported anomalous value "
+                + std::to_string(anomaly.value) + " (z-score " + std::to_string(anomaly.zscore)
+                + ", robust score " + std::to_string(anomaly.robust_score) + ")",
+            AlertSeverity::WARNING,
+            anomaly.timestamp,
+            anomaly.sensor_id
+        });
+    }
+}
 
-    try {
-        buffer_->push(data);
-        tracer_->addEvent(span, "data_buffered");
-    } catch (const std::exception& e) {
-        tracer_->setError(span, e.what());
-        std::cerr << "Error buffering sensor data: " << e.what() << std::endl;
+void SensorService::handleSensorBatch(size_t thread, const SensorData* data, size_t count) {
+    PROFILE_FUNCTION();
+    auto span = tracer_->startBatchSpan("handle_sensor_batch", data, count);
+
+    {
+        PROFILE_SCOPE("alert_rules");
+        // Пришедшее измерение - датчик в сети
+        alert_rules_->observeSensors("sensor_value", data, count,
+            [](const SensorData& sample) { return sample.value; });
+        alert_rules_->observeSensors("sensor_status", data, count,
+            [](const SensorData&) { return 1.0; });
     }
 
-    span->End();
-}
+    if (thread < polling_states_.size()) {
+        PROFILE_SCOPE("statistics");
+        auto& polling = *polling_states_[thread];
+        polling.anomalies.clear();
+        polling.statistics.update(data, count, polling.anomalies);
+        if (!polling.anomalies.empty()) {
+            reportAnomalies(polling.anomalies);
+        }
+    }
 
-void SensorService::processingLoop() {
-    while (running_) {
-        SensorData data;
-        if (buffer_->pop(data, std::chrono::milliseconds(100))) {
+    // Фильтр отпускается только после буферизации: иначе придержанная точка,
+    // вытолкнутая мониторингом, могла бы попасть в буфер позже новой
+    std::unique_lock<std::mutex> filter_lock;
+    if (thread < polling_states_.size() && polling_states_[thread]->filter) {
+        PROFILE_SCOPE("filter");
+        // До буфера доходят только измерения, прошедшие фильтр
+        auto& polling = *polling_states_[thread];
+        filter_lock = std::unique_lock<std::mutex>(polling.filter_mutex);
+        polling.passed.clear();
+        const auto stats = polling.filter->filter(data, count, polling.passed);
+        metrics_->incrementFilteredSamples(
+            static_cast<double>(stats.forwarded),
+            static_cast<double>(stats.suppressed)
+        );
+        data = polling.passed.data();
+        count = polling.passed.size();
+    }
+
+    size_t spilled = 0;
+    size_t failed = 0;
+    {
+        PROFILE_SCOPE("buffering");
+        for (size_t i = 0; i < count; ++i) {
             try {
-                std::string message = serializeSensorData(data);
-                producer_->produceWithRetry(message);
+                if (bufferSample(data[i])) {
+                    ++spilled;
+                }
             } catch (const std::exception& e) {
-                std::cerr << "Error processing sensor data: " << e.what() << std::endl;
+                // Остальные образцы пачки не должны теряться из-за одного
+                if (failed++ == 0) {
+                    tracer_->setError(span, e.what());
+                    std::cerr << "Error buffering sensor data: " << e.what() << std::endl;
+                }
             }
         }
     }
+
+    metrics_->countStage(Metrics::Stage::BUFFERED, count - spilled - failed);
+    if (spilled > 0) {
+        metrics_->countStage(Metrics::Stage::SPILLED, spilled);
+    }
+
+    tracer_->addEvent(span, spilled > 0 ? "data_spilled" : "data_buffered");
+    tracer_->endSpan(span);
+}
+
+bool SensorService::bufferSample(const SensorData& data) {
+    auto& worker = workerFor(data.sensor_id);
+    if (worker.spill
+        && (worker.spilling.load(std::memory_order_acquire)
+            || worker.buffer->size() >= worker.high_water)) {
+        // Журнал допускает одного писателя, а колбэк зовут несколько потоков
+        // опроса, поэтому переключение режима и запись - под мьютексом шарда.
+        // Образцы одного датчика приходят последовательно (придержанные
+        // фильтром - под тем же мьютексом фильтра), так что режим, увиденный
+        // без мьютекса на быстром пути, для него всегда актуален
+        std::lock_guard<std::mutex> lock(worker.spill_mutex);
+        bool spilling = worker.spilling.load(std::memory_order_relaxed);
+        if (spilling && worker.spill->empty()) {
+            spilling = false;
+        } else if (!spilling && worker.buffer->size() >= worker.high_water) {
+            spilling = true;
+        }
+        worker.spilling.store(spilling, std::memory_order_release);
+
+        if (spilling) {
+            if (!worker.spill->append(data)) {
+                throw std::runtime_error("spill log write failed, sample dropped");
+            }
+            return true;
+        }
+    }
+
+    // Отметка до push: после него обработчик может сразу забрать образец
+    // и отметить DEQUEUED раньше, чем BUFFERED
+    if (data.trace != 0) {
+        latency_->mark(data.trace, LatencyTracker::Stage::BUFFERED, std::chrono::steady_clock::now());
+    }
+    worker.buffer->push(data);
+    return false;
+}
+
+void SensorService::flushHeldSamples(std::chrono::system_clock::time_point before) {
+    std::vector<SensorData> held;
+    for (auto& polling : polling_states_) {
+        if (polling->filter) {
+            std::lock_guard<std::mutex> lock(polling->filter_mutex);
+            held.clear();
+            bufferHeldSamples(held, polling->filter->flushHeld(before, held));
+        }
+    }
+}
+
+void SensorService::bufferHeldSamples(
+    const std::vector<SensorData>& samples,
+    const SampleFilter::Stats& stats
+) {
+    if (samples.empty()) {
+        return;
+    }
+    metrics_->incrementFilteredSamples(static_cast<double>(stats.forwarded), 0.0);
+
+    size_t spilled = 0;
+    size_t failed = 0;
+    for (const auto& sample : samples) {
+        try {
+            if (bufferSample(sample)) {
+                ++spilled;
+            }
+        } catch (const std::exception& e) {
+            ++failed;
+            std::cerr << "Error buffering held sample: " << e.what() << std::endl;
+        }
+    }
+    metrics_->countStage(Metrics::Stage::BUFFERED, samples.size() - spilled - failed);
+    if (spilled > 0) {
+        metrics_->countStage(Metrics::Stage::SPILLED, spilled);
+    }
+}
+
+void SensorService::processingLoop(ProcessingWorker& worker) {
+    worker.batch.reserve(kMaxBatchSize);
+    worker.messages.reserve(kMaxBatchSize);
+
+    while (running_) {
+        // Пока брокер недоступен, не забираем данные: буфер заполняется до
+        // high_water, и дальше образцы копятся в журнале на диске
+        if (producer_->isBackedUp()) {
+            std::this_thread::sleep_for(kBackpressureWait);
+            continue;
+        }
+
+        // Сначала память: пока идет запись в журнал, в буфере лежат только
+        // образцы, пришедшие раньше пролитых
+        const bool has_spilled = worker.spill && !worker.spill->empty();
+        worker.batch.clear();
+        const size_t dequeued = worker.buffer->popBatch(
+            worker.batch, kMaxBatchSize,
+            has_spilled ? std::chrono::milliseconds(0) : kBatchWait);
+        if (dequeued > 0) {
+            metrics_->countStage(Metrics::Stage::DEQUEUED, dequeued);
+            markLatency(worker.batch, LatencyTracker::Stage::DEQUEUED);
+        } else if (has_spilled) {
+            const uint64_t begin = worker.spill->readPosition();
+            metrics_->countStage(Metrics::Stage::REPLAYED,
+                                 worker.spill->readBatch(worker.batch, kMaxBatchSize));
+            // Позиция журнала сдвигается, когда брокер подтвердил все сообщения
+            // пакета; до этого, или если хоть одно отброшено, после рестарта
+            // пакет воспроизведется снова
+            const uint64_t end = worker.spill->readPosition();
+            worker.replay = DeliveryGroup::create(
+                [spill = std::weak_ptr<SpillLog>(worker.spill), begin, end](bool delivered) {
+                    if (!delivered) {
+                        return;
+                    }
+                    if (auto log = spill.lock()) {
+                        log->commit(begin, end);
+                    }
+                }
+            );
+        }
+        if (worker.aggregator) {
+            aggregate(worker);
+        }
+        if (!worker.batch.empty() || !worker.rollups.empty()) {
+            processBatch(worker);
+        }
+        if (worker.replay != nullptr) {
+            // Образцы, ушедшие в открытые окна, подтверждаются с пакетом: итоги
+            // окон при падении теряются так же, как для образцов из памяти
+            worker.replay->release();
+            worker.replay = nullptr;
+        }
+    }
+
+    // Опрос уже остановлен: остаток буфера, вместе с точками, придержанными
+    // фильтром, уходит до выхода. Журнал дочитается после перезапуска
+    for (;;) {
+        worker.batch.clear();
+        const size_t dequeued = worker.buffer->popBatch(
+            worker.batch, kMaxBatchSize, std::chrono::milliseconds(0));
+        if (dequeued == 0) {
+            break;
+        }
+        metrics_->countStage(Metrics::Stage::DEQUEUED, dequeued);
+        markLatency(worker.batch, LatencyTracker::Stage::DEQUEUED);
+        if (worker.aggregator) {
+            aggregate(worker);
+        }
+        if (!worker.batch.empty() || !worker.rollups.empty()) {
+            processBatch(worker);
+        }
+    }
+}
+
+void SensorService::aggregate(ProcessingWorker& worker) {
+    auto& batch = worker.batch;
+    size_t kept = 0;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        if (worker.aggregator->add(batch[i], worker.rollups)) {
+            batch[kept++] = batch[i];
+        }
+    }
+    batch.resize(kept);
+
+    // Окна датчиков, от которых давно нет данных, закрываются по часам.
+    // Пока воспроизводится журнал, данные отстают от часов - не закрываем
+    const auto now = std::chrono::steady_clock::now();
+    const bool replaying = worker.spill && !worker.spill->empty();
+    if (now >= worker.next_rollup_flush && !replaying) {
+        worker.aggregator->flush(std::chrono::system_clock::now(), worker.rollups);
+        worker.next_rollup_flush = now + kRollupFlushInterval;
+    }
+
+    const uint64_t late = worker.aggregator->getStats().late_samples;
+    if (late != worker.reported_late_samples) {
+        metrics_->incrementLateSamples(static_cast<double>(late - worker.reported_late_samples));
+        worker.reported_late_samples = late;
+    }
+}
+
+void SensorService::markLatency(const std::vector<SensorData>& batch, LatencyTracker::Stage stage) {
+    std::chrono::steady_clock::time_point now{};
+    for (const auto& data : batch) {
+        if (data.trace != 0) {
+            if (now == std::chrono::steady_clock::time_point{}) {
+                now = std::chrono::steady_clock::now();
+            }
+            latency_->mark(data.trace, stage, now);
+        }
+    }
+}
+
+void SensorService::processBatch(ProcessingWorker& worker) {
+    PROFILE_FUNCTION();
+    const auto started = std::chrono::steady_clock::now();
+    const auto& batch = worker.batch;
+    auto span = tracer_->startBatchSpan("process_batch", batch.data(), batch.size());
+    tracer_->setAttribute(span, "worker", static_cast<int64_t>(worker.index));
+    tracer_->setAttribute(span, "rollups", static_cast<int64_t>(worker.rollups.size()));
+
+    try {
+        if (batch.empty()) {
+            // Только итоги окон
+        } else if (wire_format_ == WireFormat::BINARY_BATCH) {
+            // Пакет содержит несколько датчиков шарда, поэтому ключ - номер шарда:
+            // пакеты одного шарда попадают в одну партицию по порядку
+            worker.batch_codec.encode(batch, worker.encoded_batch);
+            metrics_->countStage(Metrics::Stage::SERIALIZED, batch.size());
+            metrics_->addSerializedBytes(worker.encoded_batch.size());
+            markLatency(batch, LatencyTracker::Stage::SERIALIZED);
+            UnsentBuffers unsent(*producer_, worker.messages, worker.replay);
+            unsent.reserve(1);
+            auto* buffer = producer_->acquireBuffer(worker.encoded_batch.size());
+            unsent.add(buffer);
+            std::memcpy(buffer->data, worker.encoded_batch.data(), worker.encoded_batch.size());
+            buffer->size = worker.encoded_batch.size();
+            KafkaProducer::setKey(buffer, worker.batch_key);
+            // Одно сообщение на пакет: дальше ack отслеживается по первой трассе
+            const auto traced = std::find_if(batch.begin(), batch.end(),
+                [](const SensorData& data) { return data.trace != 0; });
+            buffer->trace = traced != batch.end() ? traced->trace : 0;
+            unsent.produce();
+        } else {
+            // Сериализуем прямо в буферы пула продюсера, librdkafka их не копирует.
+            // Ключ - id датчика: его измерения остаются в одной партиции
+            UnsentBuffers unsent(*producer_, worker.messages, worker.replay);
+            unsent.reserve(batch.size());
+            size_t bytes = 0;
+            for (const auto& data : batch) {
+                auto* buffer = producer_->acquireBuffer(SensorDataSerializer::kMaxRecordSize);
+                unsent.add(buffer);
+                buffer->size = SensorDataSerializer::serializeInto(data, buffer->data);
+                bytes += buffer->size;
+                KafkaProducer::setKey(buffer, static_cast<int64_t>(data.sensor_id));
+                buffer->trace = data.trace;
+            }
+            metrics_->countStage(Metrics::Stage::SERIALIZED, batch.size());
+            metrics_->addSerializedBytes(bytes);
+            markLatency(batch, LatencyTracker::Stage::SERIALIZED);
+            unsent.produce();
+        }
+
+        if (!worker.rollups.empty()) {
+            // Тот же ключ, что у сырых записей датчика, - та же партиция
+            UnsentBuffers unsent(*producer_, worker.messages, worker.replay);
+            unsent.reserve(worker.rollups.size());
+            size_t bytes = 0;
+            for (const auto& rollup : worker.rollups) {
+                auto* buffer = producer_->acquireBuffer(SensorDataSerializer::kMaxRollupSize);
+                unsent.add(buffer);
+                buffer->size = SensorDataSerializer::serializeRollupInto(rollup, buffer->data);
+                bytes += buffer->size;
+                KafkaProducer::setKey(buffer, static_cast<int64_t>(rollup.sensor_id));
+            }
+            metrics_->countStage(Metrics::Stage::SERIALIZED, worker.rollups.size());
+            metrics_->addSerializedBytes(bytes);
+            unsent.produce();
+            metrics_->incrementRollups(static_cast<double>(worker.rollups.size()));
+        }
+        tracer_->addEvent(span, "batch_produced");
+    } catch (const std::exception& e) {
+        tracer_->setError(span, e.what());
+        std::cerr << "Error processing sensor data batch: " << e.what() << std::endl;
+    }
+    worker.rollups.clear();
+    metrics_->observeProcessingTime(
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+
+    tracer_->endSpan(span);
 }
 
 void SensorService::monitoringLoop() {
+    ProfilingTriggers triggers(trigger_config_);
+    size_t buffer_capacity = 0;
+    for (const auto& worker : workers_) {
+        buffer_capacity += worker->buffer->capacity();
+    }
     while (running_) {
         auto stats = producer_->getStats();
-        auto buffer_size = buffer_->size();
+        auto buffer_size = bufferedSamples();
         
         // Обновляем метрики
+        for (const auto& worker : workers_) {
+            if (worker->spill) {
+                worker->spill->expire();
+            }
+        }
+        // Лаг - сообщения, еще не подтвержденные брокером, включая журнал на диске
+        auto spill = spillStats();
+        auto kafka_lag = static_cast<double>(stats.outq_len + stats.pending_retries + spill.pending);
         metrics_->setBufferSize(buffer_size);
-        metrics_->setKafkaLag(stats.messages_failed);
+        metrics_->setKafkaLag(kafka_lag);
+        metrics_->setKafkaOutqLen(static_cast<double>(stats.outq_len));
+        metrics_->setKafkaBufferPoolUsage(producer_->getBufferPoolStats());
+        metrics_->setSpillStats(spill);
+        metrics_->setAlertStats(alert_manager_->getStats());
         
-        // Собираем значения датчиков
-        std::vector<std::pair<int, double>> sensor_values;
-        for (const auto& sensor : sensor_manager_->getSensors()) {
-            double value = sensor.getCurrentValue();
-            sensor_values.emplace_back(sensor.id, value);
-            metrics_->recordSensorValue(sensor.id, value);
-            metrics_->setSensorStatus(sensor.id, sensor.isOnline());
+        const auto now = std::chrono::system_clock::now();
+        // sensor_value и sensor_status Prometheus забирает сам через
+        // SensorCollector. Замолчавший датчик измерений не присылает, и для
+        // правил алертов его статус видно только здесь
+        sensor_manager_->visitSensors([this, now](const SensorManager::SensorState& sensor) {
+            if (!sensor.online) {
+                alert_rules_->observeSensor("sensor_status", sensor.id, 0.0, now);
+            }
+        });
+
+        flushHeldSamples(now - kHeldSampleTimeout);
+
+        // Значения датчиков проверяют статистика и правила на каждом
+        // измерении, здесь остаются только метрики самого сервиса
+        std::vector<SensorStatistics::Snapshot> statistics;
+        for (const auto& polling : polling_states_) {
+            polling->statistics.snapshot(statistics);
+        }
+        metrics_->setSensorStatistics(statistics);
+        if (!alert_rules_path_.empty()) {
+            alert_rules_->reloadIfChanged();
+        }
+        alert_rules_->observe("sensor_service_buffer_size", static_cast<double>(buffer_size), now);
+        alert_rules_->observe("sensor_service_kafka_lag", kafka_lag, now);
+
+        const auto reason = triggers.evaluate(
+            metrics_->endToEndLatency(),
+            static_cast<double>(buffer_size) / static_cast<double>(std::max<size_t>(buffer_capacity, 1)));
+        if (!reason.empty()) {
+            profiler_->triggerCapture(reason);
         }
-        
-        // Проверяем пороговые значения
-        alert_manager_->checkThresholds(buffer_size, stats.messages_failed, sensor_values);
         
         std::this_thread::sleep_for(std::chrono::seconds(10));
     }
 }
-
-std::string SensorService::serializeSensorData(const SensorData& data) {
-    nlohmann::json j;
-    j["sensor_id"] = data.sensor_id;
-    j["value"] = data.value;
-    j["timestamp"] = std::chrono::duration_cast<std::chrono::milliseconds>(
-        data.timestamp.time_since_epoch()
-    ).count();
-    
-    return j.dump();
-} 
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include "SensorStatistics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+// Нижняя граница разброса - доля уровня сигнала: у датчика, стоявшего на
+// одном значении, разброс почти нулевой, и первый же сдвиг на шаг АЦП давал
+// бы огромную оценку. Абсолютная граница - для уровня около нуля
+constexpr double kRelativeSpread = 1e-3;
+constexpr double kMinSpread = 1e-6;
+// MAD нормального распределения в единицах стандартного отклонения
+constexpr double kMadToSigma = 1.4826;
+
+// Общий цикл прохода. Без ветвлений и без sqrt (он ставит errno и мешает
+// векторизации): z-оценка считается в квадрате, сравнения - через выбор
+// значения. Указатели не пересекаются, restrict в параметрах дает это
+// знать компилятору
+inline double spreadFloor(double level) {
+    return std::max(kRelativeSpread * std::fabs(level), kMinSpread);
+}
+
+void updateKernel(
+    size_t count,
+    double alpha,
+    double rate,
+    const double* __restrict x,
+    double* __restrict n,
+    double* __restrict mean,
+    double* __restrict var,
+    double* __restrict abs_dev,
+    double* __restrict median,
+    double* __restrict mad,
+    double* __restrict z2,
+    double* __restrict robust
+) {
+    for (size_t i = 0; i < count; ++i) {
+        // Оценки считаются до обновления: выброс не смягчает сам себя
+        const double delta = x[i] - mean[i];
+        const double sigma_floor = spreadFloor(mean[i]);
+        z2[i] = delta * std::fabs(delta) / std::max(var[i], sigma_floor * sigma_floor);
+        const double deviation = x[i] - median[i];
+        robust[i] = deviation / std::max(mad[i] * kMadToSigma, spreadFloor(median[i]));
+
+        mean[i] += alpha * delta;
+        var[i] = (1.0 - alpha) * (var[i] + alpha * delta * delta);
+        abs_dev[i] += alpha * (std::fabs(delta) - abs_dev[i]);
+
+        // Стохастический градиент к медиане и к медиане |x - медиана|;
+        // шаг пропорционален текущему разбросу
+        const double step = rate * std::max(std::max(mad[i], abs_dev[i]), kMinSpread);
+        median[i] += step * ((deviation > 0.0 ? 1.0 : 0.0) - (deviation < 0.0 ? 1.0 : 0.0));
+        const double spread_error = std::fabs(deviation) - mad[i];
+        mad[i] += step * ((spread_error > 0.0 ? 1.0 : 0.0) - (spread_error < 0.0 ? 1.0 : 0.0));
+        n[i] += 1.0;
+    }
+}
+
+}  // namespace
+
+SensorStatistics::SensorStatistics(Config config)
+    : config_(config) {
+    if (!(config_.alpha > 0.0 && config_.alpha <= 1.0)
+        || !(config_.robust_rate > 0.0 && config_.robust_rate <= 1.0)) {
+        throw std::invalid_argument("Statistics alpha and robust_rate must be in (0, 1]");
+    }
+    if (!(config_.z_threshold >= 0.0) || !(config_.robust_threshold >= 0.0)) {
+        throw std::invalid_argument("Anomaly thresholds must be non-negative");
+    }
+    // Проверка точности скетча
+    QuantileSketch probe(config_.sketch_accuracy);
+}
+
+uint32_t SensorStatistics::slotFor(int sensor_id, double first_value) {
+    auto it = index_.find(sensor_id);
+    if (it != index_.end()) {
+        return it->second;
+    }
+    const auto slot = static_cast<uint32_t>(ids_.size());
+    index_.emplace(sensor_id, slot);
+    ids_.push_back(sensor_id);
+    samples_.push_back(0.0);
+    means_.push_back(first_value);
+    variances_.push_back(0.0);
+    abs_deviations_.push_back(0.0);
+    medians_.push_back(first_value);
+    mads_.push_back(0.0);
+    sketches_.emplace_back(config_.sketch_accuracy);
+    stamps_.push_back(0);
+    return slot;
+}
+
+void SensorStatistics::update(
+    const SensorData* data,
+    size_t count,
+    std::vector<Anomaly>& anomalies
+) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const double z2_threshold = config_.z_threshold * config_.z_threshold;
+    size_t i = 0;
+    while (i < count) {
+        // Проход: датчик входит не больше одного раза, иначе второе его
+        // измерение прочитало бы столбцы до записи первого
+        ++batch_stamp_;
+        slots_.clear();
+        sources_.clear();
+        x_.clear();
+        n_.clear();
+        mean_.clear();
+        var_.clear();
+        abs_dev_.clear();
+        median_.clear();
+        mad_.clear();
+
+        for (; i < count; ++i) {
+            const SensorData& sample = data[i];
+            if (!std::isfinite(sample.value)) {
+                continue;
+            }
+            const uint32_t slot = slotFor(sample.sensor_id, sample.value);
+            if (stamps_[slot] == batch_stamp_) {
+                break;
+            }
+            stamps_[slot] = batch_stamp_;
+            slots_.push_back(slot);
+            sources_.push_back(i);
+            x_.push_back(sample.value);
+            n_.push_back(samples_[slot]);
+            mean_.push_back(means_[slot]);
+            var_.push_back(variances_[slot]);
+            abs_dev_.push_back(abs_deviations_[slot]);
+            median_.push_back(medians_[slot]);
+            mad_.push_back(mads_[slot]);
+        }
+
+        const size_t pass = slots_.size();
+        if (pass == 0) {
+            continue;
+        }
+        z2_.resize(pass);
+        robust_.resize(pass);
+        runKernel(pass);
+
+        for (size_t k = 0; k < pass; ++k) {
+            const uint32_t slot = slots_[k];
+            const bool warmed_up = samples_[slot] >= config_.warmup_samples;
+            samples_[slot] = n_[k];
+            means_[slot] = mean_[k];
+            variances_[slot] = var_[k];
+            abs_deviations_[slot] = abs_dev_[k];
+            medians_[slot] = median_[k];
+            mads_[slot] = mad_[k];
+            sketches_[slot].add(x_[k]);
+
+            const bool z_anomaly = config_.z_threshold > 0.0 && std::fabs(z2_[k]) > z2_threshold;
+            const bool robust_anomaly = config_.robust_threshold > 0.0
+                && std::fabs(robust_[k]) > config_.robust_threshold;
+            if (warmed_up && (z_anomaly || robust_anomaly)) {
+                const SensorData& sample = data[sources_[k]];
+                anomalies.push_back(Anomaly{
+                    sample.sensor_id,
+                    sample.value,
+                    std::copysign(std::sqrt(std::fabs(z2_[k])), z2_[k]),
+                    robust_[k],
+                    sample.timestamp
+                });
+            }
+        }
+    }
+}
+
+void SensorStatistics::runKernel(size_t count) {
+    updateKernel(
+        count, config_.alpha, config_.robust_rate, x_.data(),
+        n_.data(), mean_.data(), var_.data(), abs_dev_.data(),
+        median_.data(), mad_.data(), z2_.data(), robust_.data()
+    );
+}
+
+void SensorStatistics::snapshot(std::vector<Snapshot>& out) const {
+    static constexpr double kQuantiles[] = {0.5, 0.9, 0.99};
+    double values[3];
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int sensor_id : config_.exported_sensors) {
+        auto it = index_.find(sensor_id);
+        if (it == index_.end()) {
+            continue;  // у этого потока опроса нет такого датчика
+        }
+        const uint32_t slot = it->second;
+        sketches_[slot].quantiles(kQuantiles, 3, values);
+        out.push_back(Snapshot{
+            ids_[slot],
+            static_cast<uint64_t>(samples_[slot]),
+            means_[slot],
+            std::sqrt(variances_[slot]),
+            medians_[slot],
+            mads_[slot],
+            values[0],
+            values[1],
+            values[2]
+        });
+    }
+}
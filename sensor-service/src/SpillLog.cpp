@@ -0,0 +1,462 @@
+#include "SpillLog.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[4] = {'W', 'P', 'S', 'L'};
+constexpr uint32_t kVersion = 1;
+// Проверка интервала fsync не на каждой записи, чтобы не читать часы
+constexpr uint32_t kSyncCheckEvery = 1024;
+
+struct SegmentHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t sequence;
+    int64_t created_ms;
+    uint64_t read_offset;
+    char padding[24];
+};
+static_assert(sizeof(SegmentHeader) == 64, "Spill segment header must be 64 bytes");
+
+struct Record {
+    int64_t timestamp_ns;
+    double value;
+    int32_t sensor_id;
+    uint32_t checksum;
+};
+static_assert(sizeof(Record) == 24, "Spill record must be 24 bytes");
+
+// FNV-1a по полям записи; ноль зарезервирован за незаписанной областью
+uint32_t recordChecksum(const Record& record) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&record);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(Record, checksum); ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash == 0 ? 1 : hash;
+}
+
+std::string segmentPath(const std::string& directory, uint64_t sequence) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%020llu.seg", static_cast<unsigned long long>(sequence));
+    return (std::filesystem::path(directory) / name).string();
+}
+
+int64_t nowMillis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+}
+
+std::string systemError(const std::string& what, const std::string& path) {
+    return what + " " + path + ": " + std::strerror(errno);
+}
+
+}  // namespace
+
+struct SpillLog::Segment {
+    uint64_t sequence{0};
+    std::string path;
+    int fd{-1};
+    char* base{nullptr};
+    size_t mapped_size{0};
+    SegmentHeader* header{nullptr};
+    Record* records{nullptr};
+    size_t capacity{0};
+
+    // Пишет только писатель, читатель видит записи до written
+    std::atomic<size_t> written{0};
+    std::atomic<bool> sealed{false};
+    // Только читатель
+    size_t read{0};
+
+    ~Segment() {
+        if (base != nullptr) {
+            munmap(base, mapped_size);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+};
+
+SpillLog::SpillLog(Config config)
+    : config_(std::move(config))
+    , records_per_segment_((config_.segment_size - sizeof(SegmentHeader)) / sizeof(Record)) {
+    if (config_.segment_size < sizeof(SegmentHeader) + sizeof(Record)) {
+        throw std::invalid_argument("Spill segment size is too small");
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(config_.directory, ec);
+    if (ec) {
+        throw std::runtime_error(
+            "Failed to create spill directory " + config_.directory + ": " + ec.message()
+        );
+    }
+
+    // Сегменты прошлого запуска: имена - номера с ведущими нулями
+    std::vector<std::string> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(config_.directory)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".seg") {
+            paths.push_back(entry.path().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    for (const auto& path : paths) {
+        try {
+            auto segment = openSegment(path);
+            next_sequence_ = std::max(next_sequence_, segment->sequence + 1);
+            bytes_on_disk_ += segment->mapped_size;
+            const size_t unread = segment->written.load() - segment->read;
+            if (unread == 0) {
+                removeSegment(*segment, false);
+                continue;
+            }
+            pending_ += unread;
+            segments_.push_back(std::move(segment));
+        } catch (const std::exception& e) {
+            std::cerr << "Skipping spill segment: " << e.what() << std::endl;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(segments_mutex_);
+    applyRetention();
+}
+
+SpillLog::~SpillLog() {
+    if (active_ && config_.fsync_policy != FsyncPolicy::NONE) {
+        syncActive(true);
+    }
+}
+
+std::shared_ptr<SpillLog::Segment> SpillLog::createSegment(uint64_t sequence) {
+    auto segment = std::make_shared<Segment>();
+    segment->sequence = sequence;
+    segment->path = segmentPath(config_.directory, sequence);
+    segment->mapped_size = config_.segment_size;
+    segment->capacity = records_per_segment_;
+
+    segment->fd = open(segment->path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (segment->fd < 0) {
+        throw std::runtime_error(systemError("Failed to create spill segment", segment->path));
+    }
+
+    // Место резервируется сразу: запись в mmap за пределами диска дала бы SIGBUS.
+    // Выделенные экстенты читаются нулями - это и есть маркер конца данных
+    const int err = posix_fallocate(segment->fd, 0, static_cast<off_t>(segment->mapped_size));
+    if (err != 0) {
+        unlink(segment->path.c_str());
+        errno = err;
+        throw std::runtime_error(systemError("Failed to allocate spill segment", segment->path));
+    }
+
+    void* base = mmap(nullptr, segment->mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+    if (base == MAP_FAILED) {
+        unlink(segment->path.c_str());
+        throw std::runtime_error(systemError("Failed to map spill segment", segment->path));
+    }
+    madvise(base, segment->mapped_size, MADV_SEQUENTIAL);
+
+    segment->base = static_cast<char*>(base);
+    segment->header = reinterpret_cast<SegmentHeader*>(segment->base);
+    segment->records = reinterpret_cast<Record*>(segment->base + sizeof(SegmentHeader));
+
+    std::memcpy(segment->header->magic, kMagic, sizeof(kMagic));
+    segment->header->version = kVersion;
+    segment->header->record_size = sizeof(Record);
+    segment->header->sequence = sequence;
+    segment->header->created_ms = nowMillis();
+    segment->header->read_offset = 0;
+    return segment;
+}
+
+std::shared_ptr<SpillLog::Segment> SpillLog::openSegment(const std::string& path) {
+    auto segment = std::make_shared<Segment>();
+    segment->path = path;
+
+    segment->fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (segment->fd < 0) {
+        throw std::runtime_error(systemError("Failed to open spill segment", path));
+    }
+
+    struct stat st{};
+    if (fstat(segment->fd, &st) != 0) {
+        throw std::runtime_error(systemError("Failed to stat spill segment", path));
+    }
+    if (static_cast<size_t>(st.st_size) < sizeof(SegmentHeader)) {
+        throw std::runtime_error("Spill segment is truncated: " + path);
+    }
+    segment->mapped_size = static_cast<size_t>(st.st_size);
+
+    void* base = mmap(nullptr, segment->mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+    if (base == MAP_FAILED) {
+        throw std::runtime_error(systemError("Failed to map spill segment", path));
+    }
+    segment->base = static_cast<char*>(base);
+    segment->header = reinterpret_cast<SegmentHeader*>(segment->base);
+    segment->records = reinterpret_cast<Record*>(segment->base + sizeof(SegmentHeader));
+    segment->capacity = (segment->mapped_size - sizeof(SegmentHeader)) / sizeof(Record);
+
+    if (std::memcmp(segment->header->magic, kMagic, sizeof(kMagic)) != 0
+        || segment->header->version != kVersion
+        || segment->header->record_size != sizeof(Record)) {
+        throw std::runtime_error("Unsupported spill segment format: " + path);
+    }
+    segment->sequence = segment->header->sequence;
+
+    // Записанная часть заканчивается на первой записи с неверной суммой
+    size_t written = 0;
+    while (written < segment->capacity
+           && segment->records[written].checksum == recordChecksum(segment->records[written])) {
+        ++written;
+    }
+    segment->written.store(written);
+    segment->sealed.store(true);
+    segment->read = std::min<size_t>(segment->header->read_offset, written);
+    return segment;
+}
+
+bool SpillLog::append(const SensorData& data) {
+    if (!active_ || active_->written.load(std::memory_order_relaxed) == active_->capacity) {
+        roll();
+        if (!active_) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    const size_t index = active_->written.load(std::memory_order_relaxed);
+    Record& record = active_->records[index];
+    record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        data.timestamp.time_since_epoch()
+    ).count();
+    record.value = data.value;
+    record.sensor_id = data.sensor_id;
+    record.checksum = recordChecksum(record);
+
+    // pending_ растет раньше публикации, чтобы читатель не увел его в минус
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    active_->written.store(index + 1, std::memory_order_release);
+    spilled_.fetch_add(1, std::memory_order_relaxed);
+
+    if (config_.fsync_policy == FsyncPolicy::INTERVAL && ++appends_since_sync_check_ >= kSyncCheckEvery) {
+        appends_since_sync_check_ = 0;
+        syncActive(false);
+    }
+    return true;
+}
+
+void SpillLog::roll() {
+    if (active_) {
+        if (config_.fsync_policy != FsyncPolicy::NONE) {
+            syncActive(true);
+        }
+        active_->sealed.store(true, std::memory_order_release);
+        active_.reset();
+    }
+
+    std::shared_ptr<Segment> segment;
+    try {
+        segment = createSegment(next_sequence_++);
+    } catch (const std::exception& e) {
+        std::cerr << "Spill log write failed: " << e.what() << std::endl;
+        return;
+    }
+
+    bytes_on_disk_.fetch_add(segment->mapped_size, std::memory_order_relaxed);
+    active_ = segment;
+    synced_records_ = 0;
+    last_sync_ = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(segments_mutex_);
+    segments_.push_back(std::move(segment));
+    applyRetention();
+}
+
+void SpillLog::expire() {
+    std::lock_guard<std::mutex> lock(segments_mutex_);
+    applyRetention();
+}
+
+void SpillLog::applyRetention() {
+    // Вызывается под segments_mutex_. Активный сегмент и тот, что сейчас
+    // читается, не трогаем: первый еще не закрыт, второго нет в очереди.
+    // active_ - состояние писателя, поэтому активный узнаем по sealed
+    const int64_t oldest_allowed_ms = nowMillis()
+        - std::chrono::duration_cast<std::chrono::milliseconds>(config_.max_age).count();
+
+    while (!segments_.empty() && segments_.front()->sealed.load(std::memory_order_acquire)) {
+        auto& oldest = *segments_.front();
+        const bool over_size = bytes_on_disk_.load(std::memory_order_relaxed) > config_.max_bytes;
+        const bool too_old = oldest.header->created_ms < oldest_allowed_ms;
+        if (!over_size && !too_old) {
+            break;
+        }
+        removeSegment(oldest, true);
+        segments_.pop_front();
+    }
+}
+
+void SpillLog::removeSegment(Segment& segment, bool drop_unread) {
+    if (drop_unread) {
+        const size_t unread = segment.written.load(std::memory_order_acquire) - segment.read;
+        dropped_.fetch_add(unread, std::memory_order_relaxed);
+        pending_.fetch_sub(unread, std::memory_order_release);
+    }
+    if (unlink(segment.path.c_str()) != 0) {
+        std::cerr << systemError("Failed to remove spill segment", segment.path) << std::endl;
+    }
+    bytes_on_disk_.fetch_sub(segment.mapped_size, std::memory_order_relaxed);
+}
+
+void SpillLog::syncActive(bool force) {
+    const auto now = std::chrono::steady_clock::now();
+    if (!force && now - last_sync_ < config_.fsync_interval) {
+        return;
+    }
+    last_sync_ = now;
+
+    const size_t written = active_->written.load(std::memory_order_relaxed);
+    if (written == synced_records_) {
+        return;
+    }
+
+    // msync требует адрес, выровненный по странице
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t begin = sizeof(SegmentHeader) + synced_records_ * sizeof(Record);
+    const size_t end = sizeof(SegmentHeader) + written * sizeof(Record);
+    const size_t aligned_begin = begin / page_size * page_size;
+    if (msync(active_->base + aligned_begin, end - aligned_begin, MS_SYNC) != 0) {
+        std::cerr << systemError("Failed to sync spill segment", active_->path) << std::endl;
+        return;
+    }
+    synced_records_ = written;
+}
+
+size_t SpillLog::readBatch(std::vector<SensorData>& out, size_t max_n) {
+    size_t total = 0;
+    while (total < max_n) {
+        if (!reading_) {
+            {
+                std::lock_guard<std::mutex> lock(segments_mutex_);
+                if (segments_.empty()) {
+                    break;
+                }
+                reading_ = segments_.front();
+                segments_.pop_front();
+            }
+            std::lock_guard<std::mutex> lock(commit_mutex_);
+            unacked_.push_back({reading_, read_position_, reading_->read, false, 0});
+        }
+
+        Segment& segment = *reading_;
+        // sealed читается первым: если сегмент закрыт, written уже окончательный
+        const bool sealed = segment.sealed.load(std::memory_order_acquire);
+        const size_t written = segment.written.load(std::memory_order_acquire);
+
+        if (segment.read < written) {
+            const size_t count = std::min(written - segment.read, max_n - total);
+            for (size_t i = 0; i < count; ++i) {
+                const Record& record = segment.records[segment.read + i];
+                SensorData data;
+                data.sensor_id = record.sensor_id;
+                data.trace = 0;  // трассы задержек в журнал не пишутся
+                data.value = record.value;
+                data.timestamp = std::chrono::system_clock::time_point(
+                    std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                        std::chrono::nanoseconds(record.timestamp_ns)
+                    )
+                );
+                out.push_back(data);
+            }
+            // read_offset в заголовке сдвигает только commit()
+            segment.read += count;
+            read_position_ += count;
+            total += count;
+            continue;
+        }
+
+        if (!sealed) {
+            break;  // догнали писателя
+        }
+
+        // Сегмент удалит commit(), когда будут доставлены все его записи
+        // Читаемый сегмент всегда последний в unacked_: раньше finished его не удалить
+        std::lock_guard<std::mutex> lock(commit_mutex_);
+        unacked_.back().finished = true;
+        unacked_.back().records = segment.read;
+        applyCommitted();
+        reading_.reset();
+    }
+
+    if (total > 0) {
+        replayed_.fetch_add(total, std::memory_order_relaxed);
+        pending_.fetch_sub(total, std::memory_order_release);
+    }
+    return total;
+}
+
+void SpillLog::commit(uint64_t begin, uint64_t end) {
+    if (begin >= end) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(commit_mutex_);
+    if (begin != committed_) {
+        committed_ranges_[begin] = end;
+        return;
+    }
+    committed_ = end;
+    for (auto it = committed_ranges_.begin();
+         it != committed_ranges_.end() && it->first == committed_;
+         it = committed_ranges_.erase(it)) {
+        committed_ = it->second;
+    }
+    applyCommitted();
+}
+
+void SpillLog::applyCommitted() {
+    while (!unacked_.empty()) {
+        auto& oldest = unacked_.front();
+        if (committed_ > oldest.base) {
+            // Заголовок в MAP_SHARED: позиция переживет падение процесса
+            const uint64_t delivered = oldest.offset + (committed_ - oldest.base);
+            oldest.segment->header->read_offset = oldest.finished
+                ? std::min<uint64_t>(delivered, oldest.records)
+                : delivered;
+        }
+        if (!oldest.finished || committed_ < oldest.base + (oldest.records - oldest.offset)) {
+            break;
+        }
+        removeSegment(*oldest.segment, false);
+        unacked_.pop_front();
+    }
+}
+
+uint64_t SpillLog::pending() const {
+    return pending_.load(std::memory_order_acquire);
+}
+
+SpillLog::Stats SpillLog::getStats() const {
+    Stats stats;
+    stats.spilled = spilled_.load(std::memory_order_relaxed);
+    stats.replayed = replayed_.load(std::memory_order_relaxed);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    stats.pending = pending();
+    stats.bytes_on_disk = bytes_on_disk_.load(std::memory_order_relaxed);
+    return stats;
+}
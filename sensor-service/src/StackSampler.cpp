@@ -0,0 +1,313 @@
+#include "StackSampler.hpp"
+#include <dirent.h>
+#include <sys/uio.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+// Старые glibc не объявляют поле для SIGEV_THREAD_ID
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+std::atomic<StackSampler*> StackSampler::active_{nullptr};
+std::atomic<int> StackSampler::handlers_in_flight_{0};
+
+namespace {
+
+// Дальше этого от вершины стека кадры не ищутся
+constexpr uintptr_t kMaxStackBytes = 8 << 20;
+constexpr auto kThreadScanInterval = std::chrono::seconds(1);
+
+// Прерванная инструкция, указатель кадра и стека из контекста сигнала;
+// нули, если архитектура не поддержана
+struct Interrupted {
+    uintptr_t pc{0};
+    uintptr_t frame{0};
+    uintptr_t sp{0};
+};
+
+Interrupted interruptedAt(void* context) {
+    auto* ucontext = static_cast<ucontext_t*>(context);
+    Interrupted at;
+#if defined(__x86_64__)
+    at.pc = static_cast<uintptr_t>(ucontext->uc_mcontext.gregs[REG_RIP]);
+    at.frame = static_cast<uintptr_t>(ucontext->uc_mcontext.gregs[REG_RBP]);
+    at.sp = static_cast<uintptr_t>(ucontext->uc_mcontext.gregs[REG_RSP]);
+#elif defined(__aarch64__)
+    at.pc = static_cast<uintptr_t>(ucontext->uc_mcontext.pc);
+    at.frame = static_cast<uintptr_t>(ucontext->uc_mcontext.regs[29]);
+    at.sp = static_cast<uintptr_t>(ucontext->uc_mcontext.sp);
+#else
+    (void)ucontext;
+#endif
+    return at;
+}
+
+// Запись кадра {указатель кадра вызывающего, адрес возврата}. Чтение через
+// ядро: на неотображенной памяти вернет ошибку, а не SIGSEGV
+bool readFrameRecord(uintptr_t frame, uintptr_t record[2]) {
+    iovec local{record, 2 * sizeof(uintptr_t)};
+    iovec remote{reinterpret_cast<void*>(frame), 2 * sizeof(uintptr_t)};
+    return process_vm_readv(getpid(), &local, 1, &remote, 1, 0)
+        == static_cast<ssize_t>(2 * sizeof(uintptr_t));
+}
+
+// Часы процессорного времени потока по tid - та же кодировка, что у
+// pthread_getcpuclockid (CPUCLOCK_SCHED | CPUCLOCK_PERTHREAD_MASK)
+clockid_t threadCpuClock(pid_t tid) {
+    return static_cast<clockid_t>((~static_cast<unsigned>(tid) << 3) | 6u);
+}
+
+int64_t steadyNanos(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+void writeWord(std::ofstream& out, uintptr_t word) {
+    out.write(reinterpret_cast<const char*>(&word), sizeof(word));
+}
+
+}  // namespace
+
+StackSampler::StackSampler(Config config)
+    : config_(config)
+    , capacity_(config.frequency_hz > 0 && config.window.count() > 0
+        ? static_cast<size_t>(config.frequency_hz) * static_cast<size_t>(config.window.count())
+        : 0) {
+    if (capacity_ == 0) {
+        throw std::invalid_argument("Stack sampler frequency and window must be positive");
+    }
+    slots_ = std::make_unique<Slot[]>(capacity_);
+}
+
+StackSampler::~StackSampler() {
+    stop();
+}
+
+int StackSampler::signalNumber() {
+    // SIGPROF занят профайлером gperftools, а он может работать одновременно
+    return SIGRTMIN + 3;
+}
+
+void StackSampler::start() {
+    if (running_) {
+        return;
+    }
+    StackSampler* expected = nullptr;
+    if (!active_.compare_exchange_strong(expected, this)) {
+        throw std::logic_error("Another stack sampler is already running");
+    }
+
+    uintptr_t probe[2];
+    if (!readFrameRecord(reinterpret_cast<uintptr_t>(&probe), probe)) {
+        std::cerr << "process_vm_readv is unavailable, stack samples keep only the "
+                  << "interrupted instruction: " << std::strerror(errno) << std::endl;
+    }
+
+    struct sigaction action {};
+    action.sa_sigaction = &StackSampler::handleSignal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(signalNumber(), &action, nullptr) != 0 || syncThreadTimers() == 0) {
+        for (const auto& [tid, timer] : timers_) {
+            timer_delete(timer);
+        }
+        timers_.clear();
+        active_.store(nullptr, std::memory_order_release);
+        throw std::runtime_error("Failed to create stack sampler timers");
+    }
+
+    stopping_ = false;
+    watcher_ = std::thread(&StackSampler::watchThreads, this);
+    running_ = true;
+}
+
+void StackSampler::stop() {
+    if (!running_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(watcher_mutex_);
+        stopping_ = true;
+    }
+    watcher_wakeup_.notify_all();
+    watcher_.join();
+
+    for (const auto& [tid, timer] : timers_) {
+        timer_delete(timer);
+    }
+    timers_.clear();
+    running_ = false;
+    // Обработчик остается установленным: опоздавший сигнал просто
+    // не найдет активного сэмплера. Начатые до сброса дописываются в кольцо
+    active_.store(nullptr, std::memory_order_seq_cst);
+    while (handlers_in_flight_.load(std::memory_order_seq_cst) != 0) {
+        std::this_thread::yield();
+    }
+}
+
+size_t StackSampler::syncThreadTimers() {
+    std::unordered_set<pid_t> threads;
+    if (DIR* tasks = opendir("/proc/self/task")) {
+        while (dirent* entry = readdir(tasks)) {
+            const pid_t tid = static_cast<pid_t>(std::atoi(entry->d_name));
+            if (tid > 0) {
+                threads.insert(tid);
+            }
+        }
+        closedir(tasks);
+    }
+
+    for (auto it = timers_.begin(); it != timers_.end();) {
+        if (threads.count(it->first) == 0) {
+            timer_delete(it->second);
+            it = timers_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    const long interval_ns = 1000000000L / config_.frequency_hz;
+    itimerspec spec{};
+    spec.it_interval.tv_sec = interval_ns / 1000000000L;
+    spec.it_interval.tv_nsec = interval_ns % 1000000000L;
+    spec.it_value = spec.it_interval;
+
+    for (pid_t tid : threads) {
+        if (timers_.count(tid) != 0) {
+            continue;
+        }
+        sigevent event{};
+        event.sigev_notify = SIGEV_THREAD_ID;
+        event.sigev_signo = signalNumber();
+        event.sigev_notify_thread_id = tid;
+        timer_t timer;
+        // Поток мог завершиться после чтения каталога - тогда просто пропускаем
+        if (timer_create(threadCpuClock(tid), &event, &timer) != 0) {
+            continue;
+        }
+        if (timer_settime(timer, 0, &spec, nullptr) != 0) {
+            timer_delete(timer);
+            continue;
+        }
+        timers_.emplace(tid, timer);
+    }
+    return timers_.size();
+}
+
+void StackSampler::watchThreads() {
+    std::unique_lock<std::mutex> lock(watcher_mutex_);
+    while (!watcher_wakeup_.wait_for(lock, kThreadScanInterval, [this] { return stopping_; })) {
+        lock.unlock();
+        syncThreadTimers();
+        lock.lock();
+    }
+}
+
+void StackSampler::handleSignal(int, siginfo_t*, void* context) {
+    const int saved_errno = errno;
+    // Счетчик растет до чтения active_: stop(), сбросив указатель, либо
+    // увидит этот обработчик, либо тот уже прочитает nullptr
+    handlers_in_flight_.fetch_add(1, std::memory_order_seq_cst);
+    if (auto* sampler = active_.load(std::memory_order_seq_cst)) {
+        const Interrupted at = interruptedAt(context);
+        sampler->record(at.pc, at.frame, at.sp);
+    }
+    handlers_in_flight_.fetch_sub(1, std::memory_order_release);
+    errno = saved_errno;
+}
+
+void StackSampler::record(uintptr_t pc, uintptr_t frame, uintptr_t sp) {
+    // Сначала прерванная инструкция, затем адреса возврата по цепочке кадров.
+    // Кадры лежат выше по стеку один другого; цепочка кончается нулем
+    uintptr_t pcs[kMaxDepth];
+    uint32_t captured = 0;
+    if (pc != 0) {
+        pcs[captured++] = pc;
+    }
+    uintptr_t floor = sp;
+    while (captured < kMaxDepth && frame != 0 && frame >= floor
+           && frame % sizeof(uintptr_t) == 0 && frame - sp < kMaxStackBytes) {
+        uintptr_t record[2];
+        if (!readFrameRecord(frame, record) || record[1] == 0) {
+            break;
+        }
+        pcs[captured++] = record[1];
+        floor = frame + sizeof(record);
+        frame = record[0];
+    }
+
+    const uint64_t ticket = next_.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots_[ticket % capacity_];
+    slot.sequence.store(2 * ticket + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (uint32_t i = 0; i < captured; ++i) {
+        slot.pcs[i].store(pcs[i], std::memory_order_relaxed);
+    }
+    slot.depth.store(captured, std::memory_order_relaxed);
+    slot.stamp.store(steadyNanos(std::chrono::steady_clock::now()), std::memory_order_relaxed);
+    slot.sequence.store(2 * ticket + 2, std::memory_order_release);
+}
+
+size_t StackSampler::writeProfile(const std::string& path, std::chrono::steady_clock::time_point since) const {
+    // Одинаковые стеки сворачиваются в одну запись с числом срабатываний
+    std::map<std::vector<uintptr_t>, uintptr_t> stacks;
+    const int64_t since_ns = steadyNanos(since);
+    size_t samples = 0;
+    std::vector<uintptr_t> stack;
+    for (size_t i = 0; i < capacity_; ++i) {
+        const Slot& slot = slots_[i];
+        const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before == 0 || (before & 1) != 0) {
+            continue;
+        }
+        const int64_t stamp = slot.stamp.load(std::memory_order_relaxed);
+        const uint32_t depth = std::min<uint32_t>(slot.depth.load(std::memory_order_relaxed), kMaxDepth);
+        stack.clear();
+        for (uint32_t d = 0; d < depth; ++d) {
+            stack.push_back(slot.pcs[d].load(std::memory_order_relaxed));
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before
+            || stamp < since_ns || stack.empty()) {
+            continue;  // перезаписан во время чтения или старше окна
+        }
+        ++stacks[stack];
+        ++samples;
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    // Заголовок: 0, 3, 0 (версия), период в мкс, 0
+    writeWord(out, 0);
+    writeWord(out, 3);
+    writeWord(out, 0);
+    writeWord(out, static_cast<uintptr_t>(1000000 / config_.frequency_hz));
+    writeWord(out, 0);
+    for (const auto& [pcs, count] : stacks) {
+        writeWord(out, count);
+        writeWord(out, pcs.size());
+        for (uintptr_t pc : pcs) {
+            writeWord(out, pc);
+        }
+    }
+    // Трейлер и карта отображений, по которой адреса символизируются
+    writeWord(out, 0);
+    writeWord(out, 1);
+    writeWord(out, 0);
+    std::ifstream maps("/proc/self/maps");
+    out << maps.rdbuf();
+    if (!out) {
+        throw std::runtime_error("Failed to write stack samples to " + path);
+    }
+    return samples;
+}
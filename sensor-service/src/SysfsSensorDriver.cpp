@@ -0,0 +1,295 @@
+#include "SysfsSensorDriver.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Минимальная обертка над io_uring на системных вызовах, без liburing:
+// нам нужны только пакетные readv и ожидание их завершения
+class SysfsSensorDriver::IoUring {
+public:
+    explicit IoUring(unsigned entries) {
+        io_uring_params params{};
+        fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+        }
+
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        }
+
+        sq_ptr_ = mapRing(sq_size_, IORING_OFF_SQ_RING);
+        cq_ptr_ = single_mmap ? sq_ptr_ : mapRing(cq_size_, IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(mapRing(sqes_size_, IORING_OFF_SQES));
+
+        auto* sq = static_cast<char*>(sq_ptr_);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        auto* cq = static_cast<char*>(cq_ptr_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // Очередь завершений вдвое длиннее: пакет до capacity() не переполнит ее
+        capacity_ = params.sq_entries;
+    }
+
+    ~IoUring() {
+        release();
+    }
+
+    unsigned capacity() const { return capacity_; }
+
+    void prepareReadv(int fd, const iovec* iov, uint64_t offset, uint64_t user_data) {
+        // Хвост SQ пишем только мы, ядро его лишь читает
+        const unsigned tail = *sq_tail_;
+        const unsigned index = tail & sq_mask_;
+        io_uring_sqe& sqe = sqes_[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(iov);
+        sqe.len = 1;
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++to_submit_;
+    }
+
+    // Отправляет подготовленные запросы и ждет хотя бы wait_nr завершений
+    void submitAndWait(unsigned wait_nr) {
+        for (;;) {
+            const long result = syscall(
+                __NR_io_uring_enter, fd_, to_submit_, wait_nr, IORING_ENTER_GETEVENTS, nullptr, 0
+            );
+            if (result >= 0) {
+                to_submit_ -= static_cast<unsigned>(result);
+                return;
+            }
+            if (errno != EINTR) {
+                throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+            }
+        }
+    }
+
+    // Вызывает fn(user_data, res) для готовых завершений, возвращает их число
+    template<typename Fn>
+    unsigned reap(Fn&& fn) {
+        unsigned head = *cq_head_;
+        const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        unsigned reaped = 0;
+        while (head != tail) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            fn(cqe.user_data, cqe.res);
+            ++head;
+            ++reaped;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        return reaped;
+    }
+
+private:
+    void* mapRing(size_t size, off_t offset) {
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+        if (ptr == MAP_FAILED) {
+            // Деструктор недостроенного объекта не вызовется, освобождаем сами
+            const int err = errno;
+            release();
+            throw std::system_error(err, std::generic_category(), "io_uring mmap");
+        }
+        return ptr;
+    }
+
+    void release() {
+        if (sqes_ != nullptr) {
+            munmap(sqes_, sqes_size_);
+            sqes_ = nullptr;
+        }
+        if (cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_) {
+            munmap(cq_ptr_, cq_size_);
+        }
+        cq_ptr_ = nullptr;
+        if (sq_ptr_ != nullptr) {
+            munmap(sq_ptr_, sq_size_);
+            sq_ptr_ = nullptr;
+        }
+        if (fd_ >= 0) {
+            // Закрытие кольца дожидается запросов, которые еще в работе
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    int fd_{-1};
+    unsigned capacity_{0};
+    unsigned to_submit_{0};
+
+    void* sq_ptr_{nullptr};
+    size_t sq_size_{0};
+    void* cq_ptr_{nullptr};
+    size_t cq_size_{0};
+    io_uring_sqe* sqes_{nullptr};
+    size_t sqes_size_{0};
+
+    unsigned* sq_tail_{nullptr};
+    unsigned sq_mask_{0};
+    unsigned* sq_array_{nullptr};
+    unsigned* cq_head_{nullptr};
+    unsigned* cq_tail_{nullptr};
+    unsigned cq_mask_{0};
+    io_uring_cqe* cqes_{nullptr};
+};
+
+SysfsSensorDriver::SysfsSensorDriver(Config config)
+    : config_(std::move(config)) {
+    if (config_.use_io_uring) {
+        try {
+            ring_ = std::make_unique<IoUring>(std::max(config_.ring_entries, 1u));
+        } catch (const std::system_error& e) {
+            // Старое ядро, seccomp или io_uring_disabled - читаем через preadv
+            std::cerr << "io_uring unavailable, falling back to preadv: " << e.what() << std::endl;
+        }
+    }
+}
+
+SysfsSensorDriver::~SysfsSensorDriver() {
+    for (auto& [id, channel] : channels_) {
+        if (channel.fd >= 0) {
+            close(channel.fd);
+        }
+    }
+}
+
+void SysfsSensorDriver::addChannel(int sensor_id, std::string path, double scale, double offset) {
+    auto& channel = channels_[sensor_id];
+    if (channel.fd >= 0) {
+        close(channel.fd);
+    }
+    channel = Channel{std::move(path), scale, offset, -1};
+}
+
+SysfsSensorDriver::Channel* SysfsSensorDriver::channelFor(int sensor_id) {
+    auto it = channels_.find(sensor_id);
+    if (it == channels_.end()) {
+        if (config_.path_pattern.empty()) {
+            return nullptr;
+        }
+        std::string path = config_.path_pattern;
+        const auto pos = path.find("{id}");
+        if (pos != std::string::npos) {
+            path.replace(pos, 4, std::to_string(sensor_id));
+        }
+        it = channels_.emplace(sensor_id, Channel{std::move(path), config_.scale, config_.offset, -1}).first;
+    }
+
+    Channel& channel = it->second;
+    if (channel.fd < 0) {
+        channel.fd = open(channel.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (channel.fd < 0) {
+            return nullptr;
+        }
+    }
+    return &channel;
+}
+
+void SysfsSensorDriver::readBatch(
+    const std::vector<int>& ids,
+    std::vector<double>& values,
+    std::vector<uint8_t>& ok
+) {
+    const size_t count = ids.size();
+    values.resize(count);
+    ok.assign(count, 0);
+    values_ = &values;
+    ok_ = &ok;
+
+    batch_channels_.resize(count);
+    buffers_.resize(count * (kReadSize + 1));
+    iovecs_.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        batch_channels_[i] = channelFor(ids[i]);
+        iovecs_[i] = iovec{buffers_.data() + i * (kReadSize + 1), kReadSize};
+    }
+
+    if (ring_) {
+        try {
+            readWithIoUring(count);
+            return;
+        } catch (const std::system_error& e) {
+            std::cerr << "io_uring read failed, falling back to preadv: " << e.what() << std::endl;
+            ring_.reset();
+            ok.assign(count, 0);
+            for (size_t i = 0; i < count; ++i) {
+                batch_channels_[i] = channelFor(ids[i]);
+            }
+        }
+    }
+    readWithPreadv(count);
+}
+
+void SysfsSensorDriver::readWithIoUring(size_t count) {
+    size_t next = 0;
+    while (next < count) {
+        unsigned submitted = 0;
+        for (; next < count && submitted < ring_->capacity(); ++next) {
+            if (batch_channels_[next] != nullptr) {
+                // sysfs отдает значение заново при каждом чтении с нулевого смещения
+                ring_->prepareReadv(batch_channels_[next]->fd, &iovecs_[next], 0, next);
+                ++submitted;
+            }
+        }
+
+        unsigned completed = 0;
+        while (completed < submitted) {
+            ring_->submitAndWait(submitted - completed);
+            completed += ring_->reap([this](uint64_t index, int result) {
+                complete(static_cast<size_t>(index), result);
+            });
+        }
+    }
+}
+
+void SysfsSensorDriver::readWithPreadv(size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (batch_channels_[i] != nullptr) {
+            const ssize_t result = preadv(batch_channels_[i]->fd, &iovecs_[i], 1, 0);
+            complete(i, result < 0 ? -errno : result);
+        }
+    }
+}
+
+void SysfsSensorDriver::complete(size_t index, ssize_t result) {
+    Channel& channel = *batch_channels_[index];
+    if (result <= 0) {
+        // Устройство могло исчезнуть: файл переоткроется на следующем опросе
+        close(channel.fd);
+        channel.fd = -1;
+        return;
+    }
+
+    char* text = static_cast<char*>(iovecs_[index].iov_base);
+    text[result] = '\0';
+    char* end = nullptr;
+    const double raw = std::strtod(text, &end);
+    if (end == text) {
+        return;
+    }
+    (*values_)[index] = raw * channel.scale + channel.offset;
+    (*ok_)[index] = 1;
+}
@@ -0,0 +1,122 @@
+#include "TimerWheel.hpp"
+
+void TimerWheel::schedule(uint32_t id, Tick deadline) {
+    if (id >= nodes_.size()) {
+        nodes_.resize(id + 1);
+    }
+    unlink(id);
+    nodes_[id].deadline = deadline;
+    link(id);
+}
+
+void TimerWheel::cancel(uint32_t id) {
+    if (id < nodes_.size()) {
+        unlink(id);
+    }
+}
+
+bool TimerWheel::scheduled(uint32_t id) const {
+    return id < nodes_.size() && nodes_[id].level >= 0;
+}
+
+void TimerWheel::link(uint32_t id) {
+    Node& node = nodes_[id];
+    // Уровень выбирается по расстоянию до срабатывания, слот - по самому
+    // тику, поэтому при переносе таймер попадает ровно в свой слот
+    const Tick deadline = node.deadline < current_ ? current_ : node.deadline;
+    const Tick delta = deadline - current_;
+
+    int level = 0;
+    while (level < kLevels - 1 && delta >= (Tick{1} << (kSlotBits * (level + 1)))) {
+        ++level;
+    }
+    Tick placed = deadline;
+    const Tick horizon = (Tick{1} << (kSlotBits * kLevels)) - 1;
+    if (delta > horizon) {
+        // Дальше горизонта: ставим на край, при переносе таймер встанет заново
+        placed = current_ + horizon;
+    }
+    const size_t slot = (placed >> (kSlotBits * level)) & kSlotMask;
+
+    node.level = static_cast<int16_t>(level);
+    node.slot = static_cast<uint8_t>(slot);
+    node.prev = kNil;
+    node.next = heads_[level][slot];
+    if (node.next != kNil) {
+        nodes_[node.next].prev = id;
+    }
+    heads_[level][slot] = id;
+    occupied_[level] |= uint64_t{1} << slot;
+}
+
+void TimerWheel::unlink(uint32_t id) {
+    Node& node = nodes_[id];
+    if (node.level < 0) {
+        return;
+    }
+
+    if (node.prev != kNil) {
+        nodes_[node.prev].next = node.next;
+    } else {
+        heads_[node.level][node.slot] = node.next;
+        if (node.next == kNil) {
+            occupied_[node.level] &= ~(uint64_t{1} << node.slot);
+        }
+    }
+    if (node.next != kNil) {
+        nodes_[node.next].prev = node.prev;
+    }
+
+    node.prev = kNil;
+    node.next = kNil;
+    node.level = -1;
+}
+
+void TimerWheel::cascade(int level, size_t slot) {
+    uint32_t id = heads_[level][slot];
+    heads_[level][slot] = kNil;
+    occupied_[level] &= ~(uint64_t{1} << slot);
+
+    while (id != kNil) {
+        const uint32_t next = nodes_[id].next;
+        nodes_[id].level = -1;
+        link(id);
+        id = next;
+    }
+}
+
+uint32_t TimerWheel::detachSlot(size_t slot) {
+    const uint32_t head = heads_[0][slot];
+    heads_[0][slot] = kNil;
+    occupied_[0] &= ~(uint64_t{1} << slot);
+
+    for (uint32_t id = head; id != kNil; id = nodes_[id].next) {
+        nodes_[id].level = -1;
+        nodes_[id].prev = kNil;
+    }
+    return head;
+}
+
+std::optional<TimerWheel::Tick> TimerWheel::nextWakeup() const {
+    bool upper_occupied = false;
+    for (int level = 1; level < kLevels; ++level) {
+        upper_occupied = upper_occupied || occupied_[level] != 0;
+    }
+    // Таймеры верхних уровней не сработают раньше следующего переноса;
+    // current_ еще не обработан, так что перенос может быть и на нем
+    const Tick next_cascade = (current_ + kSlotMask) & ~kSlotMask;
+
+    if (occupied_[0] != 0) {
+        // Ближайший занятый слот нижнего уровня, считая от текущего по кругу
+        const unsigned shift = static_cast<unsigned>(current_ & kSlotMask);
+        const uint64_t rotated = shift == 0
+            ? occupied_[0]
+            : (occupied_[0] >> shift) | (occupied_[0] << (kSlots - shift));
+        const Tick next = current_ + static_cast<Tick>(__builtin_ctzll(rotated));
+        return upper_occupied && next_cascade < next ? next_cascade : next;
+    }
+    if (upper_occupied) {
+        return next_cascade;
+    }
+    return std::nullopt;
+}
@@ -1,19 +1,57 @@
 #include "Tracer.hpp"
-#include <opentelemetry/sdk/trace/simple_processor.h>
+#include <opentelemetry/sdk/trace/batch_span_processor.h>
+#include <opentelemetry/sdk/trace/batch_span_processor_options.h>
 #include <opentelemetry/sdk/trace/tracer_provider.h>
 #include <opentelemetry/trace/provider.h>
+#include <stdexcept>
+#include "HotPathAnalyzer.hpp"
 
 namespace trace = opentelemetry::trace;
 namespace trace_sdk = opentelemetry::sdk::trace;
 namespace jaeger = opentelemetry::exporter::jaeger;
 
-Tracer::Tracer(const std::string& service_name) {
-    auto exporter = std::unique_ptr<jaeger::JaegerExporter>(
+namespace {
+
+// Свой генератор у каждого потока: выборка не трогает общих атомиков
+double nextUniform() {
+    thread_local uint64_t state = 0x9e3779b97f4a7c15ULL
+        ^ reinterpret_cast<uintptr_t>(&state)
+        ^ static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    // xorshift64*
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return static_cast<double>((state * 0x2545f4914f6cdd1dULL) >> 11) * 0x1.0p-53;
+}
+
+}  // namespace
+
+Tracer::Tracer(const std::string& service_name)
+    : Tracer(service_name, Config{}) {
+}
+
+Tracer::Tracer(const std::string& service_name, Config config)
+    : config_(std::move(config)) {
+    auto valid = [](double ratio) { return ratio >= 0.0 && ratio <= 1.0; };
+    bool ratios_valid = valid(config_.sample_ratio);
+    for (const auto& [sensor_id, ratio] : config_.sensor_ratios) {
+        ratios_valid = ratios_valid && valid(ratio);
+    }
+    if (!ratios_valid) {
+        throw std::invalid_argument("Trace sample ratios must be in [0, 1]");
+    }
+
+    auto exporter = std::unique_ptr<trace_sdk::SpanExporter>(
         new jaeger::JaegerExporter()
     );
 
+    trace_sdk::BatchSpanProcessorOptions options;
+    options.max_queue_size = config_.max_queue_size;
+    options.schedule_delay_millis = config_.export_delay;
+    options.max_export_batch_size = config_.max_export_batch_size;
+
     auto processor = std::unique_ptr<trace_sdk::SpanProcessor>(
-        new trace_sdk::SimpleSpanProcessor(std::move(exporter))
+        new trace_sdk::BatchSpanProcessor(std::move(exporter), options)
     );
 
     auto provider = std::shared_ptr<trace::TracerProvider>(
@@ -21,41 +59,122 @@ Tracer::Tracer(const std::string& service_name) {
     );
 
     trace::Provider::SetTracerProvider(provider);
-    
+
+    provider_ = provider;
     tracer_ = provider->GetTracer(service_name);
 }
 
-std::shared_ptr<trace::Span> Tracer::startSpan(
-    const std::string& name,
-    const std::unordered_map<std::string, std::string>& attributes
-) {
-    auto span = tracer_->StartSpan(name);
-    
-    for (const auto& [key, value] : attributes) {
-        span->SetAttribute(key, value);
+bool Tracer::sampleHead(double ratio) const {
+    if (ratio <= 0.0) {
+        return false;
+    }
+    return ratio >= 1.0 || nextUniform() < ratio;
+}
+
+Tracer::Span Tracer::begin(const char* name, bool sampled) {
+    Span span;
+    span.name_ = name;
+    if (sampled) {
+        span.span_ = tracer_->StartSpan(name);
+        return span;
+    }
+    span.tail_ = config_.sample_errors || config_.slow_threshold.count() > 0;
+    if (span.tail_) {
+        // Только монотонное время: системное восстанавливается в endSpan()
+        span.start_steady_ = std::chrono::steady_clock::now();
     }
-    
     return span;
 }
 
-void Tracer::addEvent(
-    const std::shared_ptr<trace::Span>& span,
-    const std::string& name,
-    const std::unordered_map<std::string, std::string>& attributes
-) {
-    if (span) {
-        span->AddEvent(name);
-        for (const auto& [key, value] : attributes) {
-            span->SetAttribute(key, value);
+Tracer::Span Tracer::startSpan(const char* name, bool always_sample) {
+    return begin(name, always_sample || sampleHead(config_.sample_ratio));
+}
+
+Tracer::Span Tracer::startBatchSpan(const char* name, const SensorData* data, size_t count) {
+    PROFILE_SCOPE("tracer_start");
+    bool sampled = sampleHead(config_.sample_ratio);
+    if (!sampled && !config_.sensor_ratios.empty()) {
+        for (size_t i = 0; i < count && !sampled; ++i) {
+            auto it = config_.sensor_ratios.find(data[i].sensor_id);
+            sampled = it != config_.sensor_ratios.end() && sampleHead(it->second);
         }
     }
+    Span span = begin(name, sampled);
+    setAttribute(span, "batch_size", static_cast<int64_t>(count));
+    return span;
 }
 
-void Tracer::setError(
-    const std::shared_ptr<trace::Span>& span,
-    const std::string& error_message
-) {
-    if (span) {
-        span->SetStatus(trace::StatusCode::kError, error_message);
+void Tracer::setAttribute(Span& span, const char* key, int64_t value) {
+    if (span.span_) {
+        span.span_->SetAttribute(key, value);
+    } else if (span.tail_ && span.attribute_count_ < Span::kMaxDeferredAttributes) {
+        span.attributes_[span.attribute_count_++] = {key, value};
     }
-} 
\ No newline at end of file
+}
+
+void Tracer::setAttribute(Span& span, const char* key, const std::string& value) {
+    // Строки отложенному спану не копируются - это и есть лишняя работа
+    if (span.span_) {
+        span.span_->SetAttribute(key, value);
+    }
+}
+
+void Tracer::addEvent(Span& span, const char* name) {
+    if (span.span_) {
+        span.span_->AddEvent(name);
+    } else if (span.tail_) {
+        span.event_ = name;
+    }
+}
+
+void Tracer::setError(Span& span, const std::string& error_message) {
+    if (span.span_) {
+        span.span_->SetStatus(trace::StatusCode::kError, error_message);
+    } else if (span.tail_ && span.error_.empty()) {
+        span.error_ = error_message.empty() ? "error" : error_message;
+    }
+}
+
+void Tracer::endSpan(Span& span) {
+    PROFILE_SCOPE("tracer_end");
+    if (span.ended_) {
+        return;
+    }
+    span.ended_ = true;
+    if (span.span_) {
+        span.span_->End();
+        return;
+    }
+    if (!span.tail_) {
+        return;
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    const bool failed = config_.sample_errors && !span.error_.empty();
+    const bool slow = config_.slow_threshold.count() > 0
+        && end - span.start_steady_ >= config_.slow_threshold;
+    if (!failed && !slow) {
+        return;
+    }
+
+    // Спан восстанавливается задним числом с настоящим временем начала
+    trace::StartSpanOptions start;
+    start.start_system_time = opentelemetry::common::SystemTimestamp(
+        std::chrono::system_clock::now()
+        - std::chrono::duration_cast<std::chrono::system_clock::duration>(end - span.start_steady_));
+    start.start_steady_time = opentelemetry::common::SteadyTimestamp(span.start_steady_);
+    auto recorded = tracer_->StartSpan(span.name_, start);
+    for (size_t i = 0; i < span.attribute_count_; ++i) {
+        recorded->SetAttribute(span.attributes_[i].first, span.attributes_[i].second);
+    }
+    recorded->SetAttribute("sampling", std::string(failed ? "tail_error" : "tail_slow"));
+    if (span.event_) {
+        recorded->AddEvent(span.event_);
+    }
+    if (failed) {
+        recorded->SetStatus(trace::StatusCode::kError, span.error_);
+    }
+    trace::EndSpanOptions options;
+    options.end_steady_time = opentelemetry::common::SteadyTimestamp(end);
+    recorded->End(options);
+}
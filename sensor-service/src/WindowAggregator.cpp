@@ -0,0 +1,231 @@
+#include "WindowAggregator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+int64_t toMillis(std::chrono::system_clock::time_point timestamp) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        timestamp.time_since_epoch()
+    ).count();
+}
+
+std::chrono::system_clock::time_point fromMillis(int64_t ms) {
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::milliseconds(ms)
+        )
+    );
+}
+
+// Деление с округлением вниз: окна выровнены и для отрицательного времени
+int64_t floorDiv(int64_t a, int64_t b) {
+    const int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+size_t slot(int64_t index, int64_t size) {
+    return static_cast<size_t>(((index % size) + size) % size);
+}
+
+std::chrono::milliseconds effectiveSlide(const WindowAggregator::Policy& policy) {
+    return policy.slide.count() > 0 ? policy.slide : policy.window;
+}
+
+}  // namespace
+
+WindowAggregator::WindowAggregator(Config config)
+    : config_(std::move(config)) {
+    validate(config_.default_policy);
+    for (const auto& [sensor_id, policy] : config_.sensor_policies) {
+        validate(policy);
+    }
+    if (config_.lateness.count() < 0) {
+        throw std::invalid_argument("Rollup lateness must not be negative");
+    }
+}
+
+void WindowAggregator::validate(const Policy& policy) {
+    if (policy.output == Output::RAW) {
+        return;
+    }
+    const auto slide = effectiveSlide(policy);
+    if (policy.window.count() <= 0 || slide.count() <= 0) {
+        throw std::invalid_argument("Rollup window and slide must be positive");
+    }
+    if (slide > policy.window || policy.window.count() % slide.count() != 0) {
+        throw std::invalid_argument(
+            "Rollup window " + std::to_string(policy.window.count())
+            + "ms must be a multiple of slide " + std::to_string(slide.count()) + "ms"
+        );
+    }
+    if (policy.window.count() / slide.count() > kMaxPanes) {
+        throw std::invalid_argument(
+            "Rollup window spans more than " + std::to_string(kMaxPanes) + " slides"
+        );
+    }
+}
+
+bool WindowAggregator::enabled() const {
+    if (config_.default_policy.output != Output::RAW) {
+        return true;
+    }
+    return std::any_of(
+        config_.sensor_policies.begin(), config_.sensor_policies.end(),
+        [](const auto& entry) { return entry.second.output != Output::RAW; }
+    );
+}
+
+const WindowAggregator::Policy& WindowAggregator::policyFor(int sensor_id) const {
+    auto it = config_.sensor_policies.find(sensor_id);
+    return it != config_.sensor_policies.end() ? it->second : config_.default_policy;
+}
+
+WindowAggregator::SensorWindows& WindowAggregator::windowsFor(int sensor_id, const Policy& policy) {
+    auto it = sensors_.find(sensor_id);
+    if (it == sensors_.end()) {
+        const int64_t slide_ms = effectiveSlide(policy).count();
+        SensorWindows windows{slide_ms, {}};
+        windows.panes.resize(static_cast<size_t>(policy.window.count() / slide_ms));
+        it = sensors_.emplace(sensor_id, std::move(windows)).first;
+    }
+    return it->second;
+}
+
+bool WindowAggregator::add(const SensorData& data, std::vector<SensorRollup>& rollups) {
+    const Policy& policy = policyFor(data.sensor_id);
+    if (policy.output == Output::RAW) {
+        return true;
+    }
+
+    SensorWindows& windows = windowsFor(data.sensor_id, policy);
+    const int64_t ms = toMillis(data.timestamp);
+    const int64_t pane_index = floorDiv(ms, windows.slide_ms);
+    if (windows.next_close == INT64_MIN) {
+        windows.next_close = pane_index;
+    }
+    if (pane_index < windows.next_close) {
+        // Окно уже отправлено: не теряем измерение, отдаем его как есть
+        ++stats_.late_samples;
+        return true;
+    }
+    closeUntil(data.sensor_id, windows, pane_index, rollups);
+
+    const auto size = static_cast<int64_t>(windows.panes.size());
+    Pane& pane = windows.panes[slot(pane_index, size)];
+    if (pane.index != pane_index) {
+        pane = Pane{};
+        pane.index = pane_index;
+    }
+
+    ++pane.count;
+    if (pane.count == 1) {
+        pane.min = pane.max = data.value;
+    } else {
+        pane.min = std::min(pane.min, data.value);
+        pane.max = std::max(pane.max, data.value);
+    }
+    const double delta = data.value - pane.mean;
+    pane.mean += delta / static_cast<double>(pane.count);
+    pane.m2 += delta * (data.value - pane.mean);
+    if (ms >= pane.last_ms || pane.count == 1) {
+        pane.last = data.value;
+        pane.last_ms = ms;
+    }
+    windows.last_data = std::max(windows.last_data, pane_index);
+
+    return policy.output == Output::BOTH;
+}
+
+void WindowAggregator::flush(
+    std::chrono::system_clock::time_point now,
+    std::vector<SensorRollup>& rollups
+) {
+    const int64_t watermark = toMillis(now) - config_.lateness.count();
+    // Датчик, у которого все окна с данными закрыты и который молчит еще
+    // lateness, скорее всего удален: его запись не держим. Если он вернется,
+    // окна начнутся заново
+    const int64_t idle_watermark = watermark - config_.lateness.count();
+    for (auto it = sensors_.begin(); it != sensors_.end();) {
+        auto& windows = it->second;
+        closeUntil(it->first, windows, floorDiv(watermark, windows.slide_ms), rollups);
+        const auto size = static_cast<int64_t>(windows.panes.size());
+        if (floorDiv(idle_watermark, windows.slide_ms) > windows.last_data + size - 1) {
+            it = sensors_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void WindowAggregator::closeUntil(
+    int sensor_id,
+    SensorWindows& windows,
+    int64_t pane_index,
+    std::vector<SensorRollup>& rollups
+) {
+    const auto size = static_cast<int64_t>(windows.panes.size());
+    while (windows.next_close < pane_index) {
+        if (windows.next_close > windows.last_data + size - 1) {
+            // Дальше окна без данных: после паузы датчика перескакиваем сразу
+            windows.next_close = pane_index;
+            break;
+        }
+        emitWindow(sensor_id, windows, windows.next_close, rollups);
+        ++windows.next_close;
+    }
+}
+
+void WindowAggregator::emitWindow(
+    int sensor_id,
+    const SensorWindows& windows,
+    int64_t last_pane,
+    std::vector<SensorRollup>& rollups
+) {
+    const auto size = static_cast<int64_t>(windows.panes.size());
+    const int64_t first_pane = last_pane - size + 1;
+
+    // Слияние панелей по Чану: среднее и m2 складываются без потери точности
+    Pane total;
+    int64_t last_ms = INT64_MIN;
+    for (int64_t index = first_pane; index <= last_pane; ++index) {
+        const Pane& pane = windows.panes[slot(index, size)];
+        if (pane.index != index || pane.count == 0) {
+            continue;
+        }
+        if (total.count == 0) {
+            total = pane;
+        } else {
+            const double n = static_cast<double>(total.count + pane.count);
+            const double delta = pane.mean - total.mean;
+            total.mean += delta * static_cast<double>(pane.count) / n;
+            total.m2 += pane.m2
+                + delta * delta * static_cast<double>(total.count) * static_cast<double>(pane.count) / n;
+            total.count += pane.count;
+            total.min = std::min(total.min, pane.min);
+            total.max = std::max(total.max, pane.max);
+        }
+        if (pane.last_ms >= last_ms) {
+            total.last = pane.last;
+            last_ms = pane.last_ms;
+        }
+    }
+    if (total.count == 0) {
+        return;
+    }
+
+    rollups.push_back(SensorRollup{
+        sensor_id,
+        fromMillis(first_pane * windows.slide_ms),
+        fromMillis((last_pane + 1) * windows.slide_ms),
+        total.count,
+        total.min,
+        total.max,
+        total.mean,
+        total.last,
+        std::sqrt(std::max(total.m2, 0.0) / static_cast<double>(total.count))
+    });
+    ++stats_.rollups;
+}
@@ -1,8 +1,15 @@
 #include "SensorService.hpp"
+#include <algorithm>
 #include <iostream>
 #include <csignal>
 
 std::unique_ptr<SensorService> service;
+// SIGUSR2 просит профиль; захват запускает main, не обработчик
+volatile std::sig_atomic_t profile_requested = 0;
+
+void profileSignalHandler(int) {
+    profile_requested = 1;
+}
 
 void signalHandler(int signum) {
     std::cout << "Stopping service..." << std::endl;
@@ -16,11 +23,13 @@ int main(int argc, char* argv[]) {
     try {
         signal(SIGINT, signalHandler);
         signal(SIGTERM, signalHandler);
+        signal(SIGUSR2, profileSignalHandler);
 
         const std::string kafka_brokers = "localhost:9092";
         const std::string topic = "sensor_data";
         
         service = std::make_unique<SensorService>(kafka_brokers, topic);
+        service->setProcessingWorkers(std::max(1u, std::thread::hardware_concurrency() / 2));
 
         // Добавляем датчики
         for (int i = 1; i <= 5; ++i) {
@@ -33,6 +42,12 @@ int main(int argc, char* argv[]) {
         // Держим main поток живым
         while (true) {
             std::this_thread::sleep_for(std::chrono::seconds(1));
+            if (profile_requested) {
+                profile_requested = 0;
+                if (!service->requestProfile("signal")) {
+                    std::cerr << "Profile request rejected: capture in progress or cooling down" << std::endl;
+                }
+            }
         }
 
     } catch (const std::exception& e) {
@@ -0,0 +1,267 @@
+// Тесты колец SpscRing и MpmcRing и DataBuffer поверх них: емкость,
+// переполнение, порядок, пакетные операции и конкурентный обмен, где
+// каждый элемент должен дойти ровно один раз.
+//
+//   g++ -std=c++17 -pthread -Iinclude tests/RingBufferTest.cpp src/DataBuffer.cpp src/EventCount.cpp -o ring_buffer_test
+//   ./ring_buffer_test
+//
+// Гонки удобнее всего ловить сборкой с -fsanitize=thread. Ожидание в
+// циклах - через yield, чтобы тест не растягивался на одном ядре.
+#include "DataBuffer.hpp"
+#include "RingBuffer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #condition << std::endl; \
+            ++failures;                                                           \
+        }                                                                         \
+    } while (0)
+
+constexpr int kProducers = 4;
+constexpr uint64_t kItemsPerProducer = 50000;
+
+// Элемент несет номер производителя и свой номер у него
+uint64_t item(int producer, uint64_t index) {
+    return static_cast<uint64_t>(producer) << 32 | index;
+}
+
+SensorData sample(int sensor_id, double value) {
+    return {sensor_id, 0, value, std::chrono::system_clock::time_point(std::chrono::milliseconds(1))};
+}
+
+template<typename Ring>
+void fillsToCapacityAndKeepsOrder() {
+    Ring ring(5);
+    CHECK(ring.capacity() == 8);
+    // Несколько оборотов кольца: индексы переходят через границу слотов
+    for (uint64_t round = 0; round < 3; ++round) {
+        for (uint64_t i = 0; i < 8; ++i) {
+            CHECK(ring.tryPush(round * 8 + i));
+        }
+        CHECK(!ring.tryPush(99));
+        CHECK(ring.size() == 8);
+        for (uint64_t i = 0; i < 8; ++i) {
+            uint64_t value = 0;
+            CHECK(ring.tryPop(value) && value == round * 8 + i);
+        }
+        uint64_t value = 0;
+        CHECK(!ring.tryPop(value));
+        CHECK(ring.size() == 0);
+    }
+}
+
+void spscBatchIsPartialWhenFull() {
+    SpscRing<uint64_t> ring(8);
+    const uint64_t items[] = {0, 1, 2, 3, 4, 5};
+    CHECK(ring.tryPushBatch(items, 6) == 6);
+    CHECK(ring.tryPushBatch(items, 6) == 2);
+    uint64_t out[16];
+    CHECK(ring.tryPopBatch(out, 3) == 3);
+    CHECK(out[0] == 0 && out[1] == 1 && out[2] == 2);
+    CHECK(ring.tryPopBatch(out, 16) == 5);
+    CHECK(out[2] == 5 && out[3] == 0 && out[4] == 1);
+    CHECK(ring.tryPopBatch(out, 16) == 0);
+    CHECK(ring.tryPushBatch(items, 0) == 0);
+}
+
+void spscConcurrentKeepsOrder() {
+    SpscRing<uint64_t> ring(64);
+    constexpr uint64_t kCount = 200000;
+    std::thread producer([&] {
+        uint64_t next = 0;
+        uint64_t batch[7];
+        while (next < kCount) {
+            // Вперемешку одиночные и пакетные вставки
+            if (next % 3 == 0) {
+                if (ring.tryPush(next)) {
+                    ++next;
+                } else {
+                    std::this_thread::yield();
+                }
+                continue;
+            }
+            const uint64_t n = std::min<uint64_t>(7, kCount - next);
+            for (uint64_t i = 0; i < n; ++i) {
+                batch[i] = next + i;
+            }
+            const size_t pushed = ring.tryPushBatch(batch, n);
+            if (pushed == 0) {
+                std::this_thread::yield();
+            }
+            next += pushed;
+        }
+    });
+
+    uint64_t expected = 0;
+    bool ordered = true;
+    uint64_t out[5];
+    while (expected < kCount) {
+        const size_t n = ring.tryPopBatch(out, 5);
+        if (n == 0) {
+            std::this_thread::yield();
+        }
+        for (size_t i = 0; i < n; ++i) {
+            ordered = ordered && out[i] == expected;
+            ++expected;
+        }
+    }
+    producer.join();
+    CHECK(ordered);
+    CHECK(ring.size() == 0);
+}
+
+// Несколько производителей и потребителей: каждый элемент ровно один раз,
+// а порядок одного производителя сохраняется у каждого потребителя
+void mpmcConcurrentDeliversEachOnce() {
+    constexpr int kConsumers = 3;
+    MpmcRing<uint64_t> ring(128);
+    std::vector<std::atomic<uint8_t>> seen(kProducers * kItemsPerProducer);
+    std::atomic<uint64_t> consumed{0};
+    std::atomic<bool> ordered{true};
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < kProducers; ++p) {
+        threads.emplace_back([&, p] {
+            for (uint64_t i = 0; i < kItemsPerProducer;) {
+                if (ring.tryPush(item(p, i))) {
+                    ++i;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (int c = 0; c < kConsumers; ++c) {
+        threads.emplace_back([&] {
+            std::vector<int64_t> last(kProducers, -1);
+            while (consumed.load(std::memory_order_relaxed) < kProducers * kItemsPerProducer) {
+                uint64_t value = 0;
+                if (!ring.tryPop(value)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                consumed.fetch_add(1, std::memory_order_relaxed);
+                const auto producer = static_cast<int>(value >> 32);
+                const auto index = static_cast<int64_t>(value & 0xffffffffu);
+                if (index <= last[producer]) {
+                    ordered = false;
+                }
+                last[producer] = index;
+                seen[producer * kItemsPerProducer + index].fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    bool once = true;
+    for (const auto& count : seen) {
+        once = once && count.load() == 1;
+    }
+    CHECK(once);
+    CHECK(ordered);
+    CHECK(ring.size() == 0);
+}
+
+void dataBufferBatchesAndTimesOut(DataBuffer::Mode mode) {
+    DataBuffer buffer(6, mode);
+    CHECK(buffer.capacity() == 8);
+    CHECK(buffer.empty());
+
+    std::vector<SensorData> out;
+    const auto started = std::chrono::steady_clock::now();
+    CHECK(buffer.popBatch(out, 10, std::chrono::milliseconds(30)) == 0);
+    CHECK(std::chrono::steady_clock::now() - started >= std::chrono::milliseconds(25));
+
+    const SensorData batch[] = {sample(1, 1), sample(2, 2), sample(3, 3)};
+    buffer.pushBatch(batch, 3);
+    buffer.push(sample(4, 4));
+    CHECK(buffer.size() == 4);
+    // popBatch дописывает в out, не очищая его
+    out.push_back(sample(0, 0));
+    CHECK(buffer.popBatch(out, 3, std::chrono::milliseconds(0)) == 3);
+    CHECK(out.size() == 4 && out[1].sensor_id == 1 && out[3].sensor_id == 3);
+
+    SensorData data{};
+    CHECK(buffer.pop(data, std::chrono::milliseconds(0)) && data.sensor_id == 4);
+    CHECK(!buffer.pop(data, std::chrono::milliseconds(0)));
+}
+
+// push на полном буфере ждет, пока потребитель освободит место
+void dataBufferPushBlocksUntilDrained(DataBuffer::Mode mode) {
+    DataBuffer buffer(4, mode);
+    constexpr int kCount = 10000;
+    std::thread producer([&] {
+        std::vector<SensorData> batch;
+        for (int i = 0; i < kCount; i += 10) {
+            batch.clear();
+            for (int j = i; j < i + 10; ++j) {
+                batch.push_back(sample(j, j));
+            }
+            buffer.pushBatch(batch.data(), batch.size());
+        }
+    });
+
+    std::vector<SensorData> out;
+    while (out.size() < static_cast<size_t>(kCount)) {
+        buffer.popBatch(out, 3, std::chrono::milliseconds(100));
+    }
+    producer.join();
+    bool ordered = true;
+    for (int i = 0; i < kCount; ++i) {
+        ordered = ordered && out[i].sensor_id == i;
+    }
+    CHECK(ordered);
+    CHECK(buffer.empty());
+}
+
+void dataBufferClear() {
+    DataBuffer buffer(8, DataBuffer::Mode::SPSC);
+    buffer.push(sample(1, 1));
+    buffer.push(sample(2, 2));
+    buffer.clear();
+    CHECK(buffer.empty() && buffer.size() == 0);
+}
+
+void run(const char* name, const std::function<void()>& test) {
+    const int before = failures;
+    test();
+    std::cout << (failures == before ? "ok   " : "FAIL ") << name << std::endl;
+}
+
+void run(const char* name, const std::function<void(DataBuffer::Mode)>& test) {
+    for (auto mode : {DataBuffer::Mode::SPSC, DataBuffer::Mode::MPMC}) {
+        const int before = failures;
+        test(mode);
+        std::cout << (failures == before ? "ok   " : "FAIL ") << name
+                  << (mode == DataBuffer::Mode::SPSC ? " [spsc]" : " [mpmc]") << std::endl;
+    }
+}
+
+}  // namespace
+
+int main() {
+    run("spsc fills to capacity and keeps order", fillsToCapacityAndKeepsOrder<SpscRing<uint64_t>>);
+    run("mpmc fills to capacity and keeps order", fillsToCapacityAndKeepsOrder<MpmcRing<uint64_t>>);
+    run("spsc batch is partial when full", spscBatchIsPartialWhenFull);
+    run("spsc concurrent keeps order", spscConcurrentKeepsOrder);
+    run("mpmc concurrent delivers each once", mpmcConcurrentDeliversEachOnce);
+    run("data buffer batches and times out", dataBufferBatchesAndTimesOut);
+    run("data buffer push blocks until drained", dataBufferPushBlocksUntilDrained);
+    run("data buffer clear", dataBufferClear);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
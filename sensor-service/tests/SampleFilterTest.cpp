@@ -0,0 +1,260 @@
+// Тесты SampleFilter: мертвая зона, вращающаяся дверь, heartbeat,
+// придержанные точки и одинаковая в обоих режимах обработка NaN.
+//
+//   g++ -std=c++17 -Iinclude tests/SampleFilterTest.cpp src/SampleFilter.cpp -o sample_filter_test
+//   ./sample_filter_test
+#include "SampleFilter.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #condition << std::endl; \
+            ++failures;                                                           \
+        }                                                                         \
+    } while (0)
+
+constexpr double kNaN = std::numeric_limits<double>::quiet_NaN();
+
+SensorData sample(int64_t ms, double value, int sensor_id = 1) {
+    return {sensor_id, 0, value, std::chrono::system_clock::time_point(std::chrono::milliseconds(ms))};
+}
+
+int64_t millis(const SensorData& data) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(data.timestamp.time_since_epoch()).count();
+}
+
+SampleFilter make(SampleFilter::Mode mode, double absolute, double percent = 0.0,
+                  std::chrono::milliseconds max_silence = std::chrono::milliseconds(0)) {
+    SampleFilter::Config config;
+    config.default_policy.mode = mode;
+    config.default_policy.absolute = absolute;
+    config.default_policy.percent = percent;
+    config.default_policy.max_silence = max_silence;
+    return SampleFilter(config);
+}
+
+// Подает значения по одному с шагом 100 мс; возвращает отправленное
+std::vector<SensorData> feed(SampleFilter& filter, const std::vector<double>& values,
+                             SampleFilter::Stats* total = nullptr) {
+    std::vector<SensorData> out;
+    int64_t ms = 0;
+    for (double value : values) {
+        const SensorData data = sample(ms, value);
+        const auto stats = filter.filter(&data, 1, out);
+        if (total != nullptr) {
+            total->forwarded += stats.forwarded;
+            total->suppressed += stats.suppressed;
+        }
+        ms += 100;
+    }
+    return out;
+}
+
+std::vector<double> values(const std::vector<SensorData>& samples) {
+    std::vector<double> result;
+    for (const auto& data : samples) {
+        result.push_back(data.value);
+    }
+    return result;
+}
+
+// Сравнение с NaN, равным самому себе
+bool same(const std::vector<double>& a, const std::vector<double>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (!(a[i] == b[i] || (std::isnan(a[i]) && std::isnan(b[i])))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void disabledPassesEverything() {
+    auto filter = make(SampleFilter::Mode::NONE, 1.0);
+    CHECK(!filter.enabled());
+    CHECK(same(values(feed(filter, {1, 1, 1, 2})), {1, 1, 1, 2}));
+}
+
+void deadbandAbsolute() {
+    auto filter = make(SampleFilter::Mode::DEADBAND, 0.5);
+    CHECK(filter.enabled());
+    SampleFilter::Stats stats;
+    // Порог считается от последнего отправленного, а не от предыдущего
+    const auto out = feed(filter, {10.0, 10.4, 10.8, 11.0, 11.2, 10.2}, &stats);
+    CHECK(same(values(out), {10.0, 10.8, 10.2}));
+    CHECK(stats.forwarded == 3 && stats.suppressed == 3);
+}
+
+void deadbandPercent() {
+    // 10% от 100 больше абсолютного порога
+    auto filter = make(SampleFilter::Mode::DEADBAND, 1.0, 10.0);
+    CHECK(same(values(feed(filter, {100, 109, 111, 120, 123})), {100, 111, 123}));
+}
+
+void deadbandZeroThresholdForwardsChanges() {
+    auto filter = make(SampleFilter::Mode::DEADBAND, 0.0);
+    CHECK(same(values(feed(filter, {1, 1, 2, 2, 1})), {1, 2, 1}));
+}
+
+void deadbandHeartbeat() {
+    auto filter = make(SampleFilter::Mode::DEADBAND, 10.0, 0.0, std::chrono::milliseconds(250));
+    // Шаг 100 мс: после 300 мс тишины измерение уходит без проверки порога
+    const auto out = feed(filter, {1, 1, 1, 1, 1, 1, 1});
+    CHECK(out.size() == 3);
+    CHECK(millis(out[1]) == 300 && millis(out[2]) == 600);
+}
+
+void swingingDoorLineKeepsEndpoints() {
+    auto filter = make(SampleFilter::Mode::SWINGING_DOOR, 0.1);
+    SampleFilter::Stats stats;
+    // Прямая: после первой точки все придерживается, отправленного одно
+    const auto out = feed(filter, {0, 1, 2, 3, 4, 5}, &stats);
+    CHECK(same(values(out), {0}));
+    CHECK(stats.suppressed == 4);
+
+    // Придержанный конец линии выходит по flushHeld, если он старше before
+    std::vector<SensorData> held;
+    CHECK(filter.flushHeld(sample(500, 0).timestamp, held).forwarded == 0);
+    CHECK(filter.flushHeld(sample(501, 0).timestamp, held).forwarded == 1);
+    CHECK(same(values(held), {5}) && millis(held[0]) == 500);
+    // Повторно та же точка не выходит
+    CHECK(filter.flushHeld(sample(10000, 0).timestamp, held).forwarded == 0);
+}
+
+void swingingDoorForwardsCorner() {
+    auto filter = make(SampleFilter::Mode::SWINGING_DOOR, 0.1);
+    // Излом на 300 мс: вершина уходит, когда следующее измерение закрывает дверь
+    const auto out = feed(filter, {0, 1, 2, 3, 2, 1, 0});
+    CHECK(same(values(out), {0, 3}));
+    CHECK(millis(out[1]) == 300);
+}
+
+// Отброшенное измерение отходит от ломаной по отправленным точкам не больше порога
+void swingingDoorStaysWithinThreshold() {
+    constexpr double kThreshold = 0.5;
+    auto filter = make(SampleFilter::Mode::SWINGING_DOOR, kThreshold);
+    std::mt19937 random(42);
+    std::normal_distribution<double> step(0.0, 0.3);
+    std::vector<double> walk{0.0};
+    for (int i = 1; i < 2000; ++i) {
+        walk.push_back(walk.back() + step(random));
+    }
+    auto out = feed(filter, walk);
+    filter.flushHeld(std::chrono::system_clock::time_point::max(), out);
+    CHECK(out.size() < walk.size() / 2);
+    CHECK(millis(out.front()) == 0 && millis(out.back()) == 100 * (static_cast<int64_t>(walk.size()) - 1));
+
+    size_t segment = 0;
+    for (size_t i = 0; i < walk.size(); ++i) {
+        const int64_t ms = static_cast<int64_t>(i) * 100;
+        while (segment + 1 < out.size() && millis(out[segment + 1]) < ms) {
+            ++segment;
+        }
+        const SensorData& from = out[segment];
+        const SensorData& to = out[std::min(segment + 1, out.size() - 1)];
+        const double span = static_cast<double>(millis(to) - millis(from));
+        const double line = span > 0.0
+            ? from.value + (to.value - from.value) * static_cast<double>(ms - millis(from)) / span
+            : from.value;
+        CHECK(std::fabs(walk[i] - line) <= kThreshold + 1e-9);
+    }
+}
+
+void swingingDoorHeartbeat() {
+    auto filter = make(SampleFilter::Mode::SWINGING_DOOR, 10.0, 0.0, std::chrono::milliseconds(250));
+    const auto out = feed(filter, {1, 1, 1, 1, 1, 1, 1});
+    CHECK(out.size() == 3);
+    CHECK(millis(out[1]) == 300 && millis(out[2]) == 600);
+}
+
+void removeReleasesHeldPoint() {
+    auto filter = make(SampleFilter::Mode::SWINGING_DOOR, 0.1);
+    feed(filter, {0, 1, 2});
+    std::vector<SensorData> out;
+    CHECK(filter.remove(1, out).forwarded == 1);
+    CHECK(same(values(out), {2}));
+    CHECK(filter.remove(1, out).forwarded == 0);
+    // Вернувшийся датчик начинает с чистого состояния
+    CHECK(same(values(feed(filter, {7})), {7}));
+}
+
+// Переход в NaN/бесконечность и обратно отправляется, повторы - нет
+void nonFiniteHandledAlikeInBothModes() {
+    const double inf = std::numeric_limits<double>::infinity();
+    const std::vector<double> input{1, kNaN, kNaN, kNaN, 1, inf, inf, -inf, 2};
+    const std::vector<double> expected{1, kNaN, 1, inf, -inf, 2};
+    for (auto mode : {SampleFilter::Mode::DEADBAND, SampleFilter::Mode::SWINGING_DOOR}) {
+        auto filter = make(mode, 0.5);
+        auto out = feed(filter, input);
+        filter.flushHeld(std::chrono::system_clock::time_point::max(), out);
+        CHECK(same(values(out), expected));
+    }
+}
+
+void nonFiniteClosesOpenDoor() {
+    auto filter = make(SampleFilter::Mode::SWINGING_DOOR, 0.1);
+    // Придержанная 2 уходит перед NaN, иначе конец линии потерялся бы
+    CHECK(same(values(feed(filter, {0, 1, 2, kNaN})), {0, 2, kNaN}));
+}
+
+void sensorsFilteredIndependently() {
+    auto filter = make(SampleFilter::Mode::DEADBAND, 0.5);
+    std::vector<SensorData> out;
+    const SensorData batch[] = {
+        sample(0, 1.0, 1), sample(0, 5.0, 2),
+        sample(100, 1.1, 1), sample(100, 6.0, 2),
+    };
+    const auto stats = filter.filter(batch, 4, out);
+    CHECK(stats.forwarded == 3 && stats.suppressed == 1);
+    CHECK(out.size() == 3 && out[2].sensor_id == 2 && out[2].value == 6.0);
+}
+
+void rejectsNegativeThresholds() {
+    bool threw = false;
+    try {
+        make(SampleFilter::Mode::DEADBAND, -1.0);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+void run(const char* name, const std::function<void()>& test) {
+    const int before = failures;
+    test();
+    std::cout << (failures == before ? "ok   " : "FAIL ") << name << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    run("disabled passes everything", disabledPassesEverything);
+    run("deadband absolute", deadbandAbsolute);
+    run("deadband percent", deadbandPercent);
+    run("deadband zero threshold forwards changes", deadbandZeroThresholdForwardsChanges);
+    run("deadband heartbeat", deadbandHeartbeat);
+    run("swinging door line keeps endpoints", swingingDoorLineKeepsEndpoints);
+    run("swinging door forwards corner", swingingDoorForwardsCorner);
+    run("swinging door stays within threshold", swingingDoorStaysWithinThreshold);
+    run("swinging door heartbeat", swingingDoorHeartbeat);
+    run("remove releases held point", removeReleasesHeldPoint);
+    run("non-finite handled alike in both modes", nonFiniteHandledAlikeInBothModes);
+    run("non-finite closes open door", nonFiniteClosesOpenDoor);
+    run("sensors filtered independently", sensorsFilteredIndependently);
+    run("rejects negative thresholds", rejectsNegativeThresholds);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,262 @@
+// Тесты SensorBatchCodec: кодирование и декодирование обратно дают те же
+// измерения (значения - побитно, включая NaN), серии упорядочены по id,
+// а поврежденный пакет отвергается исключением, а не чтением за границей.
+// Декодер на Python сверяется с этим кодеком в api_service/tests.
+//
+//   g++ -std=c++17 -Iinclude tests/SensorBatchCodecTest.cpp src/SensorBatchCodec.cpp -o batch_codec_test
+//   ./batch_codec_test
+#include "SensorBatchCodec.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #condition << std::endl; \
+            ++failures;                                                           \
+        }                                                                         \
+    } while (0)
+
+std::chrono::system_clock::time_point at(int64_t ms) {
+    return std::chrono::system_clock::time_point(std::chrono::milliseconds(ms));
+}
+
+uint64_t bits(double value) {
+    uint64_t result;
+    std::memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+double fromBits(uint64_t value) {
+    double result;
+    std::memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+const uint8_t* bytes(const std::string& encoded) {
+    return reinterpret_cast<const uint8_t*>(encoded.data());
+}
+
+// Ожидаемый порядок после декодирования: серии по возрастанию id,
+// внутри серии - исходный порядок
+std::vector<SensorData> grouped(std::vector<SensorData> batch) {
+    std::stable_sort(batch.begin(), batch.end(), [](const SensorData& a, const SensorData& b) {
+        return a.sensor_id < b.sensor_id;
+    });
+    return batch;
+}
+
+bool sameRecords(const std::vector<SensorData>& a, const std::vector<SensorData>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].sensor_id != b[i].sensor_id || a[i].timestamp != b[i].timestamp
+            || bits(a[i].value) != bits(b[i].value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<SensorData> roundTrip(const std::vector<SensorData>& batch, size_t* size = nullptr) {
+    SensorBatchCodec codec;
+    std::string encoded;
+    codec.encode(batch, encoded);
+    if (size != nullptr) {
+        *size = encoded.size();
+    }
+    CHECK(SensorBatchCodec::isBatch(bytes(encoded), encoded.size()));
+    std::vector<SensorData> decoded;
+    SensorBatchCodec::decode(bytes(encoded), encoded.size(), decoded);
+    return decoded;
+}
+
+void emptyBatch() {
+    CHECK(roundTrip({}).empty());
+}
+
+void groupsSeriesById() {
+    const std::vector<SensorData> batch{
+        {7, 0, 1.5, at(1000)}, {-3, 0, 2.5, at(1001)}, {7, 0, 3.5, at(999)},
+        {0, 0, 4.5, at(1002)}, {-3, 0, 5.5, at(1003)},
+    };
+    const auto decoded = roundTrip(batch);
+    CHECK(sameRecords(decoded, grouped(batch)));
+    // trace в формат не входит
+    CHECK(std::all_of(decoded.begin(), decoded.end(), [](const SensorData& d) { return d.trace == 0; }));
+}
+
+void specialValuesAreBitExact() {
+    using limits = std::numeric_limits<double>;
+    const double values[] = {
+        0.0, -0.0, limits::quiet_NaN(), -limits::quiet_NaN(), fromBits(0x7ff0000000000123ull),
+        limits::infinity(), -limits::infinity(), limits::denorm_min(), limits::max(),
+        limits::lowest(), 1.0, 1.0, 1.0 + limits::epsilon(), 20.5, -20.5,
+    };
+    std::vector<SensorData> batch;
+    int64_t ms = 1700000000000;
+    for (double value : values) {
+        batch.push_back({1, 0, value, at(ms)});
+        ms += 1000;
+    }
+    CHECK(sameRecords(roundTrip(batch), batch));
+}
+
+// Время внутри серии может идти назад и быть до эпохи; пределы - 1900 и
+// 2100 годы, system_clock в наносекундах шире не представим
+void timestampsAnyDirection() {
+    const std::vector<SensorData> batch{
+        {1, 0, 1, at(0)}, {1, 0, 2, at(-5)}, {1, 0, 3, at(-2208988800000)},
+        {1, 0, 4, at(4102444799999)}, {2, 0, 5, at(-1)}, {2, 0, 6, at(-1)},
+    };
+    CHECK(sameRecords(roundTrip(batch), grouped(batch)));
+}
+
+void extremeSensorIds() {
+    const std::vector<SensorData> batch{
+        {std::numeric_limits<int>::max(), 0, 1, at(1)},
+        {std::numeric_limits<int>::min(), 0, 2, at(2)},
+        {0, 0, 3, at(3)},
+    };
+    CHECK(sameRecords(roundTrip(batch), grouped(batch)));
+}
+
+void randomBatchesRoundTrip() {
+    std::mt19937_64 random(99);
+    SensorBatchCodec codec;  // внутренние буферы переиспользуются между пакетами
+    std::string encoded;
+    for (int round = 0; round < 500; ++round) {
+        std::vector<SensorData> batch(random() % 300);
+        const int sensors = 1 + static_cast<int>(random() % 20);
+        int64_t ms = static_cast<int64_t>(random() % 2000000000000ull);
+        for (auto& data : batch) {
+            data.sensor_id = static_cast<int>(random() % sensors) - 5;
+            data.trace = 0;
+            ms += static_cast<int64_t>(random() % 2000) - 100;
+            data.timestamp = at(ms);
+            switch (random() % 3) {
+                case 0: data.value = fromBits(random()); break;
+                case 1: data.value = static_cast<double>(random() % 1000) / 10.0; break;
+                default: data.value = 21.5; break;
+            }
+        }
+        codec.encode(batch, encoded);
+        std::vector<SensorData> decoded;
+        SensorBatchCodec::decode(bytes(encoded), encoded.size(), decoded);
+        CHECK(sameRecords(decoded, grouped(batch)));
+    }
+}
+
+// Медленно меняющийся ряд сжимается сильно: это и есть смысл формата
+void slowSignalIsCompact() {
+    std::vector<SensorData> batch;
+    for (int sensor = 0; sensor < 10; ++sensor) {
+        for (int i = 0; i < 100; ++i) {
+            batch.push_back({sensor, 0, 20.0 + (i / 10) * 0.5, at(1700000000000 + i * 1000)});
+        }
+    }
+    size_t size = 0;
+    CHECK(sameRecords(roundTrip(batch, &size), grouped(batch)));
+    CHECK(size < batch.size() * 4);
+}
+
+void decodeAppendsToOutput() {
+    SensorBatchCodec codec;
+    std::string encoded;
+    codec.encode({{1, 0, 2.0, at(5)}}, encoded);
+    std::vector<SensorData> out{{9, 0, 9.0, at(9)}};
+    SensorBatchCodec::decode(bytes(encoded), encoded.size(), out);
+    CHECK(out.size() == 2 && out[0].sensor_id == 9 && out[1].sensor_id == 1);
+}
+
+bool rejects(const std::string& encoded) {
+    std::vector<SensorData> out;
+    try {
+        SensorBatchCodec::decode(bytes(encoded), encoded.size(), out);
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+void rejectsMalformedInput() {
+    SensorBatchCodec codec;
+    std::string encoded;
+    codec.encode({{1, 0, 1.0, at(1)}, {1, 0, 2.0, at(2)}, {2, 0, 3.0, at(3)}}, encoded);
+
+    CHECK(rejects(""));
+    CHECK(rejects("WPSB"));
+    CHECK(rejects("{\"sensor_id\":1}"));
+    CHECK(!SensorBatchCodec::isBatch(reinterpret_cast<const uint8_t*>("WPS"), 3));
+
+    std::string wrong_version = encoded;
+    wrong_version[4] = 2;
+    CHECK(rejects(wrong_version));
+
+    // Любой обрезанный пакет отвергается
+    for (size_t size = 0; size < encoded.size(); ++size) {
+        CHECK(rejects(encoded.substr(0, size)));
+    }
+
+    // Число записей больше, чем байт в пакете
+    std::string huge_count = encoded.substr(0, 6) + std::string("\xff\xff\xff\xff\x0f", 5);
+    CHECK(rejects(huge_count));
+}
+
+// Случайная порча: либо исключение, либо какой-то результат, но не выход
+// за границы (ловится сборкой с -fsanitize=address)
+void survivesCorruption() {
+    std::mt19937_64 random(5);
+    SensorBatchCodec codec;
+    std::string encoded;
+    std::vector<SensorData> batch;
+    for (int i = 0; i < 50; ++i) {
+        batch.push_back({i % 4, 0, i * 0.25, at(1700000000000 + i)});
+    }
+    codec.encode(batch, encoded);
+    for (int round = 0; round < 20000; ++round) {
+        std::string corrupted = encoded;
+        const int flips = 1 + static_cast<int>(random() % 4);
+        for (int f = 0; f < flips; ++f) {
+            const size_t at_byte = 4 + random() % (corrupted.size() - 4);
+            corrupted[at_byte] = static_cast<char>(corrupted[at_byte] ^ (1 << (random() % 8)));
+        }
+        rejects(corrupted);
+    }
+}
+
+void run(const char* name, const std::function<void()>& test) {
+    const int before = failures;
+    test();
+    std::cout << (failures == before ? "ok   " : "FAIL ") << name << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    run("empty batch", emptyBatch);
+    run("groups series by id", groupsSeriesById);
+    run("special values are bit exact", specialValuesAreBitExact);
+    run("timestamps any direction", timestampsAnyDirection);
+    run("extreme sensor ids", extremeSensorIds);
+    run("random batches round trip", randomBatchesRoundTrip);
+    run("slow signal is compact", slowSignalIsCompact);
+    run("decode appends to output", decodeAppendsToOutput);
+    run("rejects malformed input", rejectsMalformedInput);
+    run("survives corruption", survivesCorruption);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,169 @@
+// Тесты SensorDataSerializer: вывод побайтно совпадает с
+// nlohmann::json::dump() для обычных записей и итогов окон, включая
+// крайние значения, и не выходит за kMaxRecordSize/kMaxRollupSize.
+//
+//   g++ -std=c++17 -Iinclude tests/SensorDataSerializerTest.cpp src/SensorDataSerializer.cpp -o serializer_test
+//   ./serializer_test
+#include "SensorDataSerializer.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #condition << std::endl; \
+            ++failures;                                                           \
+        }                                                                         \
+    } while (0)
+
+// Запас за пределом записи: сериализатор не должен писать дальше длины
+constexpr char kGuard = '\x5a';
+
+std::chrono::system_clock::time_point at(int64_t ms) {
+    return std::chrono::system_clock::time_point(std::chrono::milliseconds(ms));
+}
+
+// Эталон - прежний путь через nlohmann::json
+std::string reference(const SensorData& data) {
+    nlohmann::json json;
+    json["sensor_id"] = data.sensor_id;
+    json["timestamp"] = std::chrono::duration_cast<std::chrono::milliseconds>(
+        data.timestamp.time_since_epoch()).count();
+    json["value"] = data.value;
+    return json.dump();
+}
+
+std::string reference(const SensorRollup& rollup) {
+    auto millis = [](std::chrono::system_clock::time_point timestamp) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(timestamp.time_since_epoch()).count();
+    };
+    nlohmann::json json;
+    json["sensor_id"] = rollup.sensor_id;
+    json["timestamp"] = millis(rollup.window_end);
+    json["value"] = rollup.mean;
+    json["window_start"] = millis(rollup.window_start);
+    json["count"] = rollup.count;
+    json["min"] = rollup.min;
+    json["max"] = rollup.max;
+    json["mean"] = rollup.mean;
+    json["last"] = rollup.last;
+    json["stddev"] = rollup.stddev;
+    return json.dump();
+}
+
+std::string serialize(const SensorData& data) {
+    std::vector<char> out(SensorDataSerializer::kMaxRecordSize + 16, kGuard);
+    const size_t size = SensorDataSerializer::serializeInto(data, out.data());
+    CHECK(size <= SensorDataSerializer::kMaxRecordSize);
+    CHECK(out[size] == kGuard);
+    return std::string(out.data(), size);
+}
+
+std::string serialize(const SensorRollup& rollup) {
+    std::vector<char> out(SensorDataSerializer::kMaxRollupSize + 16, kGuard);
+    const size_t size = SensorDataSerializer::serializeRollupInto(rollup, out.data());
+    CHECK(size <= SensorDataSerializer::kMaxRollupSize);
+    CHECK(out[size] == kGuard);
+    return std::string(out.data(), size);
+}
+
+// Значения, на которых форматирование чисел чаще всего расходится
+std::vector<double> edgeValues() {
+    using limits = std::numeric_limits<double>;
+    return {
+        0.0, -0.0, 1.0, -1.0, 0.1, 20.5, 1e21, 1e22, 1e-7, 123456789012345678.0,
+        5e-324, -5e-324, limits::min(), limits::max(), -limits::max(), limits::epsilon(),
+        1.0 / 3.0, 2.0 / 3.0, 9007199254740993.0, 0.30000000000000004,
+        limits::quiet_NaN(), limits::infinity(), -limits::infinity(),
+    };
+}
+
+void documentedExample() {
+    const SensorData data{1, 0, 20.5, at(1700000000000)};
+    CHECK(serialize(data) == R"({"sensor_id":1,"timestamp":1700000000000,"value":20.5})");
+}
+
+void edgeValuesMatchDump() {
+    const int ids[] = {0, 1, -1, std::numeric_limits<int>::max(), std::numeric_limits<int>::min()};
+    const int64_t stamps[] = {0, -1, 1700000000123, -2208988800000, 4102444799999};
+    for (double value : edgeValues()) {
+        for (int id : ids) {
+            for (int64_t ms : stamps) {
+                const SensorData data{id, 0, value, at(ms)};
+                const std::string actual = serialize(data);
+                const std::string expected = reference(data);
+                if (actual != expected) {
+                    std::cerr << "  " << actual << " != " << expected << std::endl;
+                }
+                CHECK(actual == expected);
+            }
+        }
+    }
+}
+
+// Случайные биты double покрывают все порядки и длины мантиссы
+void randomValuesMatchDump() {
+    std::mt19937_64 random(2024);
+    size_t mismatches = 0;
+    for (int i = 0; i < 200000; ++i) {
+        const uint64_t bits = random();
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        const SensorData data{
+            static_cast<int>(random()),
+            0,
+            i % 2 == 0 ? value : static_cast<double>(static_cast<int64_t>(random() % 2000000) - 1000000) / 1000.0,
+            at(static_cast<int64_t>(random() % 4000000000000ull))
+        };
+        if (serialize(data) != reference(data)) {
+            ++mismatches;
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+void rollupMatchesDump() {
+    std::vector<SensorRollup> rollups;
+    rollups.push_back({1, at(1700000000000), at(1700000001000), 10, 18.0, 22.5, 20.1, 21.0, 1.2});
+    for (double value : edgeValues()) {
+        rollups.push_back({
+            std::numeric_limits<int>::min(), at(-1000), at(0),
+            std::numeric_limits<uint64_t>::max(), value, value, value, value, value
+        });
+    }
+    for (const auto& rollup : rollups) {
+        CHECK(serialize(rollup) == reference(rollup));
+    }
+    CHECK(serialize(rollups[0]) ==
+          R"({"count":10,"last":21.0,"max":22.5,"mean":20.1,"min":18.0,"sensor_id":1,)"
+          R"("stddev":1.2,"timestamp":1700000001000,"value":20.1,"window_start":1700000000000})");
+}
+
+void run(const char* name, const std::function<void()>& test) {
+    const int before = failures;
+    test();
+    std::cout << (failures == before ? "ok   " : "FAIL ") << name << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    run("documented example", documentedExample);
+    run("edge values match dump", edgeValuesMatchDump);
+    run("random values match dump", randomValuesMatchDump);
+    run("rollup matches dump", rollupMatchesDump);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,210 @@
+// Тесты SysfsSensorDriver на обычных временных файлах: оба пути чтения,
+// io_uring и preadv, должны вести себя одинаково.
+//
+//   g++ -std=c++17 -Iinclude tests/SysfsSensorDriverTest.cpp src/SysfsSensorDriver.cpp -o sysfs_driver_test
+//   ./sysfs_driver_test
+//
+// Если ядро не дает создать кольцо, io_uring-вариант проверяет запасной путь.
+#include "SysfsSensorDriver.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #condition << std::endl; \
+            ++failures;                                                           \
+        }                                                                         \
+    } while (0)
+
+bool near(double a, double b) {
+    return std::fabs(a - b) < 1e-9;
+}
+
+class TempDir {
+public:
+    TempDir() {
+        char pattern[] = "/tmp/sysfs-driver-test-XXXXXX";
+        path_ = mkdtemp(pattern);
+    }
+
+    ~TempDir() {
+        std::system(("rm -rf '" + path_ + "'").c_str());
+    }
+
+    std::string file(const std::string& name) const { return path_ + "/" + name; }
+
+    // Перезаписывает файл целиком, как ядро обновляет значение в sysfs
+    void write(const std::string& name, const std::string& text) const {
+        std::ofstream(file(name), std::ios::trunc) << text;
+    }
+
+    void remove(const std::string& name) const {
+        unlink(file(name).c_str());
+    }
+
+private:
+    std::string path_;
+};
+
+struct Batch {
+    std::vector<double> values;
+    std::vector<uint8_t> ok;
+
+    void read(SysfsSensorDriver& driver, const std::vector<int>& ids) {
+        driver.readBatch(ids, values, ok);
+    }
+};
+
+SysfsSensorDriver::Config config(const TempDir& dir, bool use_io_uring) {
+    SysfsSensorDriver::Config config;
+    config.path_pattern = dir.file("temp{id}_input");
+    config.scale = 0.001;
+    config.use_io_uring = use_io_uring;
+    return config;
+}
+
+void readsPatternWithScale(bool use_io_uring) {
+    TempDir dir;
+    dir.write("temp1_input", "21500\n");
+    dir.write("temp2_input", "-3250\n");
+    SysfsSensorDriver driver(config(dir, use_io_uring));
+
+    Batch batch;
+    batch.read(driver, {1, 2});
+    CHECK(batch.values.size() == 2 && batch.ok.size() == 2);
+    CHECK(batch.ok[0] && near(batch.values[0], 21.5));
+    CHECK(batch.ok[1] && near(batch.values[1], -3.25));
+}
+
+void rereadsFromStartEachPoll(bool use_io_uring) {
+    TempDir dir;
+    dir.write("temp1_input", "1000\n");
+    SysfsSensorDriver driver(config(dir, use_io_uring));
+
+    Batch batch;
+    batch.read(driver, {1});
+    CHECK(batch.ok[0] && near(batch.values[0], 1.0));
+    // Дескриптор остается открытым, новое значение читается с нулевого смещения
+    dir.write("temp1_input", "2000\n");
+    batch.read(driver, {1});
+    CHECK(batch.ok[0] && near(batch.values[0], 2.0));
+}
+
+void missingFileRecoversWhenCreated(bool use_io_uring) {
+    TempDir dir;
+    dir.write("temp1_input", "1000\n");
+    SysfsSensorDriver driver(config(dir, use_io_uring));
+
+    Batch batch;
+    batch.read(driver, {1, 5});
+    CHECK(batch.ok[0] && !batch.ok[1]);
+    dir.write("temp5_input", "5000\n");
+    batch.read(driver, {1, 5});
+    CHECK(batch.ok[0] && batch.ok[1] && near(batch.values[1], 5.0));
+}
+
+void emptyReadReopensFile(bool use_io_uring) {
+    TempDir dir;
+    dir.write("temp1_input", "");
+    SysfsSensorDriver driver(config(dir, use_io_uring));
+
+    Batch batch;
+    batch.read(driver, {1});
+    CHECK(!batch.ok[0]);
+    // Старый файл удален, на его месте новый: нужен переоткрытый дескриптор
+    dir.remove("temp1_input");
+    dir.write("temp1_input", "7000\n");
+    batch.read(driver, {1});
+    CHECK(batch.ok[0] && near(batch.values[0], 7.0));
+}
+
+void rejectsGarbage(bool use_io_uring) {
+    TempDir dir;
+    dir.write("temp1_input", "n/a\n");
+    dir.write("temp2_input", "42\n");
+    SysfsSensorDriver driver(config(dir, use_io_uring));
+
+    Batch batch;
+    batch.read(driver, {1, 2});
+    CHECK(!batch.ok[0]);
+    CHECK(batch.ok[1] && near(batch.values[1], 0.042));
+}
+
+void explicitChannelOverridesPattern(bool use_io_uring) {
+    TempDir dir;
+    dir.write("in_voltage0_raw", "512\n");
+    dir.write("temp1_input", "1000\n");
+    SysfsSensorDriver::Config cfg = config(dir, use_io_uring);
+    cfg.path_pattern.clear();
+    SysfsSensorDriver driver(cfg);
+    driver.addChannel(9, dir.file("in_voltage0_raw"), 0.5, 1.0);
+
+    Batch batch;
+    batch.read(driver, {9, 1});
+    CHECK(batch.ok[0] && near(batch.values[0], 257.0));
+    // Без шаблона датчик без канала не читается
+    CHECK(!batch.ok[1]);
+}
+
+void batchLargerThanRing(bool use_io_uring) {
+    TempDir dir;
+    std::vector<int> ids;
+    for (int id = 0; id < 37; ++id) {
+        dir.write("temp" + std::to_string(id) + "_input", std::to_string(id * 1000));
+        ids.push_back(id);
+    }
+    SysfsSensorDriver::Config cfg = config(dir, use_io_uring);
+    cfg.ring_entries = 4;
+    SysfsSensorDriver driver(cfg);
+
+    Batch batch;
+    for (int round = 0; round < 3; ++round) {
+        batch.read(driver, ids);
+        for (int id = 0; id < 37; ++id) {
+            CHECK(batch.ok[id] && near(batch.values[id], id));
+        }
+    }
+}
+
+void run(const char* name, const std::function<void(bool)>& test) {
+    for (bool use_io_uring : {true, false}) {
+        const int before = failures;
+        test(use_io_uring);
+        std::cout << (failures == before ? "ok   " : "FAIL ") << name
+                  << (use_io_uring ? " [io_uring]" : " [preadv]") << std::endl;
+    }
+}
+
+}  // namespace
+
+int main() {
+    {
+        TempDir dir;
+        SysfsSensorDriver ring_driver(config(dir, true));
+        SysfsSensorDriver plain_driver(config(dir, false));
+        CHECK(!plain_driver.usingIoUring());
+        if (!ring_driver.usingIoUring()) {
+            std::cout << "io_uring unavailable, both runs use preadv" << std::endl;
+        }
+    }
+
+    run("reads pattern with scale", readsPatternWithScale);
+    run("rereads from start each poll", rereadsFromStartEachPoll);
+    run("missing file recovers when created", missingFileRecoversWhenCreated);
+    run("empty read reopens file", emptyReadReopensFile);
+    run("rejects garbage", rejectsGarbage);
+    run("explicit channel overrides pattern", explicitChannelOverridesPattern);
+    run("batch larger than ring", batchLargerThanRing);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,261 @@
+// Тесты WindowAggregator: окна tumbling и скользящие (слияние панелей
+// сверяется с прямым подсчетом), закрытие по часам, опоздавшие измерения
+// и забывание замолчавших датчиков.
+//
+//   g++ -std=c++17 -Iinclude tests/WindowAggregatorTest.cpp src/WindowAggregator.cpp -o window_aggregator_test
+//   ./window_aggregator_test
+#include "WindowAggregator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #condition << std::endl; \
+            ++failures;                                                           \
+        }                                                                         \
+    } while (0)
+
+bool near(double a, double b) {
+    return std::fabs(a - b) < 1e-9 * std::max(1.0, std::fabs(b));
+}
+
+std::chrono::system_clock::time_point at(int64_t ms) {
+    return std::chrono::system_clock::time_point(std::chrono::milliseconds(ms));
+}
+
+int64_t millis(std::chrono::system_clock::time_point timestamp) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(timestamp.time_since_epoch()).count();
+}
+
+SensorData sample(int64_t ms, double value, int sensor_id = 1) {
+    return {sensor_id, 0, value, at(ms)};
+}
+
+WindowAggregator make(WindowAggregator::Output output, int64_t window_ms, int64_t slide_ms = 0,
+                      int64_t lateness_ms = 5000) {
+    WindowAggregator::Config config;
+    config.default_policy.output = output;
+    config.default_policy.window = std::chrono::milliseconds(window_ms);
+    config.default_policy.slide = std::chrono::milliseconds(slide_ms);
+    config.lateness = std::chrono::milliseconds(lateness_ms);
+    return WindowAggregator(config);
+}
+
+void tumblingWindow() {
+    auto aggregator = make(WindowAggregator::Output::ROLLUP, 1000);
+    CHECK(aggregator.enabled());
+    std::vector<SensorRollup> rollups;
+    for (int i = 0; i < 10; ++i) {
+        CHECK(!aggregator.add(sample(i * 100, i + 1), rollups));
+    }
+    CHECK(rollups.empty());
+    // Первое измерение за границей закрывает окно
+    aggregator.add(sample(1000, 100), rollups);
+    CHECK(rollups.size() == 1);
+    const auto& rollup = rollups[0];
+    CHECK(rollup.sensor_id == 1);
+    CHECK(millis(rollup.window_start) == 0 && millis(rollup.window_end) == 1000);
+    CHECK(rollup.count == 10);
+    CHECK(rollup.min == 1 && rollup.max == 10);
+    CHECK(near(rollup.mean, 5.5));
+    CHECK(rollup.last == 10);
+    CHECK(near(rollup.stddev, std::sqrt(8.25)));
+    CHECK(aggregator.getStats().rollups == 1);
+}
+
+// Каждое скользящее окно сверяется с подсчетом по самим измерениям
+void slidingWindowsMatchDirectComputation() {
+    constexpr int64_t kWindow = 1000;
+    constexpr int64_t kSlide = 250;
+    auto aggregator = make(WindowAggregator::Output::ROLLUP, kWindow, kSlide);
+
+    std::mt19937 random(7);
+    std::uniform_real_distribution<double> value(-50.0, 50.0);
+    std::uniform_int_distribution<int64_t> step(1, 90);
+    std::vector<SensorData> samples;
+    std::vector<SensorRollup> rollups;
+    for (int64_t ms = 0; ms < 20000; ms += step(random)) {
+        samples.push_back(sample(ms, value(random)));
+        aggregator.add(samples.back(), rollups);
+    }
+    CHECK(rollups.size() > 70);
+
+    for (const auto& rollup : rollups) {
+        const int64_t begin = millis(rollup.window_start);
+        const int64_t end = millis(rollup.window_end);
+        CHECK(end - begin == kWindow && end % kSlide == 0);
+
+        uint64_t count = 0;
+        double sum = 0.0;
+        double min = 1e300;
+        double max = -1e300;
+        double last = 0.0;
+        for (const auto& data : samples) {
+            const int64_t ms = millis(data.timestamp);
+            if (ms >= begin && ms < end) {
+                ++count;
+                sum += data.value;
+                min = std::min(min, data.value);
+                max = std::max(max, data.value);
+                last = data.value;
+            }
+        }
+        const double mean = sum / static_cast<double>(count);
+        double squares = 0.0;
+        for (const auto& data : samples) {
+            const int64_t ms = millis(data.timestamp);
+            if (ms >= begin && ms < end) {
+                squares += (data.value - mean) * (data.value - mean);
+            }
+        }
+        CHECK(rollup.count == count);
+        CHECK(rollup.min == min && rollup.max == max && rollup.last == last);
+        CHECK(near(rollup.mean, mean));
+        CHECK(near(rollup.stddev, std::sqrt(squares / static_cast<double>(count))));
+    }
+    // Окна идут подряд с шагом slide
+    for (size_t i = 1; i < rollups.size(); ++i) {
+        CHECK(millis(rollups[i].window_end) - millis(rollups[i - 1].window_end) == kSlide);
+    }
+}
+
+void outputPolicies() {
+    std::vector<SensorRollup> rollups;
+    auto raw = make(WindowAggregator::Output::RAW, 1000);
+    CHECK(!raw.enabled());
+    CHECK(raw.add(sample(0, 1), rollups));
+    CHECK(raw.add(sample(5000, 1), rollups));
+    CHECK(rollups.empty());
+
+    auto both = make(WindowAggregator::Output::BOTH, 1000);
+    CHECK(both.add(sample(0, 1), rollups));
+    CHECK(both.add(sample(1000, 1), rollups));
+    CHECK(rollups.size() == 1);
+
+    WindowAggregator::Config config;
+    config.sensor_policies[2].output = WindowAggregator::Output::ROLLUP;
+    config.sensor_policies[2].window = std::chrono::milliseconds(1000);
+    WindowAggregator per_sensor(config);
+    CHECK(per_sensor.enabled());
+    CHECK(per_sensor.add(sample(0, 1, 1), rollups));
+    CHECK(!per_sensor.add(sample(0, 1, 2), rollups));
+}
+
+void lateSampleForwardedRaw() {
+    auto aggregator = make(WindowAggregator::Output::ROLLUP, 1000);
+    std::vector<SensorRollup> rollups;
+    aggregator.add(sample(100, 1), rollups);
+    aggregator.add(sample(1100, 2), rollups);
+    CHECK(rollups.size() == 1);
+    // Окно [0, 1000) уже отправлено: измерение уходит как есть
+    CHECK(aggregator.add(sample(900, 3), rollups));
+    CHECK(aggregator.getStats().late_samples == 1);
+    CHECK(rollups.size() == 1);
+}
+
+void flushClosesByClock() {
+    auto aggregator = make(WindowAggregator::Output::ROLLUP, 1000, 0, 500);
+    std::vector<SensorRollup> rollups;
+    aggregator.add(sample(100, 1), rollups);
+    aggregator.add(sample(200, 3), rollups);
+    // Граница 1000 еще не отстала от часов на lateness
+    aggregator.flush(at(1400), rollups);
+    CHECK(rollups.empty());
+    aggregator.flush(at(1600), rollups);
+    CHECK(rollups.size() == 1 && rollups[0].count == 2 && near(rollups[0].mean, 2.0));
+    // Повторный flush не дублирует окно
+    aggregator.flush(at(1700), rollups);
+    CHECK(rollups.size() == 1);
+}
+
+void pauseSkipsEmptyWindows() {
+    auto aggregator = make(WindowAggregator::Output::ROLLUP, 1000, 500);
+    std::vector<SensorRollup> rollups;
+    aggregator.add(sample(100, 1), rollups);
+    aggregator.add(sample(60000, 2), rollups);
+    // Измерение 100 попадает в два скользящих окна, пустые окна паузы не отправляются
+    CHECK(rollups.size() == 2);
+    for (const auto& rollup : rollups) {
+        CHECK(rollup.count == 1 && rollup.last == 1);
+    }
+}
+
+void lastFollowsTimestampNotArrival() {
+    auto aggregator = make(WindowAggregator::Output::ROLLUP, 1000);
+    std::vector<SensorRollup> rollups;
+    aggregator.add(sample(500, 5), rollups);
+    aggregator.add(sample(300, 3), rollups);
+    aggregator.add(sample(1000, 0), rollups);
+    CHECK(rollups.size() == 1 && rollups[0].last == 5);
+}
+
+void idleSensorIsForgotten() {
+    auto aggregator = make(WindowAggregator::Output::ROLLUP, 1000, 0, 500);
+    std::vector<SensorRollup> rollups;
+    aggregator.add(sample(100, 1), rollups);
+    aggregator.add(sample(1100, 2), rollups);
+    // Окно [1000, 2000) закрыто по часам, но датчик еще помнится:
+    // измерение в отправленное окно считается опоздавшим
+    aggregator.flush(at(2600), rollups);
+    CHECK(rollups.size() == 2);
+    CHECK(aggregator.add(sample(1200, 3), rollups));
+    CHECK(aggregator.getStats().late_samples == 1);
+
+    // Еще lateness тишины после последнего окна - состояние датчика удалено,
+    // вернувшийся датчик начинает окна заново
+    aggregator.flush(at(3100), rollups);
+    CHECK(rollups.size() == 2);
+    CHECK(!aggregator.add(sample(5000, 4), rollups));
+    aggregator.add(sample(6000, 5), rollups);
+    CHECK(rollups.size() == 3 && rollups[2].count == 1 && rollups[2].last == 4);
+    CHECK(aggregator.getStats().late_samples == 1);
+}
+
+void rejectsBadPolicy() {
+    auto throws = [](int64_t window_ms, int64_t slide_ms) {
+        try {
+            make(WindowAggregator::Output::ROLLUP, window_ms, slide_ms);
+        } catch (const std::invalid_argument&) {
+            return true;
+        }
+        return false;
+    };
+    CHECK(throws(0, 0));
+    CHECK(throws(1000, 300));
+    CHECK(throws(1000, 2000));
+    CHECK(throws(1000000, 1));
+    CHECK(!throws(1000, 250));
+}
+
+void run(const char* name, const std::function<void()>& test) {
+    const int before = failures;
+    test();
+    std::cout << (failures == before ? "ok   " : "FAIL ") << name << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    run("tumbling window", tumblingWindow);
+    run("sliding windows match direct computation", slidingWindowsMatchDirectComputation);
+    run("output policies", outputPolicies);
+    run("late sample forwarded raw", lateSampleForwardedRaw);
+    run("flush closes by clock", flushClosesByClock);
+    run("pause skips empty windows", pauseSkipsEmptyWindows);
+    run("last follows timestamp not arrival", lastFollowsTimestampNotArrival);
+    run("idle sensor is forgotten", idleSensorIsForgotten);
+    run("rejects bad policy", rejectsBadPolicy);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
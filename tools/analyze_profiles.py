@@ -2,12 +2,19 @@
 
 import os
 import sys
+import shutil
 import subprocess
 import argparse
+from collections import defaultdict
 from datetime import datetime
 
 def analyze_cpu_profile(profile_path):
     """Анализ CPU профиля"""
+    # Сервис сам пишет символизированные стеки рядом с профилем
+    if os.path.exists(f"{profile_path}.collapsed"):
+        analyze_collapsed(f"{profile_path}.collapsed", "samples")
+        return
+
     print(f"\nAnalyzing CPU profile: {profile_path}")
     
     # Топ горячих функций
@@ -26,6 +33,10 @@ def analyze_cpu_profile(profile_path):
 
 def analyze_heap_profile(profile_path):
     """Анализ профиля памяти"""
+    if os.path.exists(f"{profile_path}.collapsed"):
+        analyze_collapsed(f"{profile_path}.collapsed", "bytes")
+        return
+
     print(f"\nAnalyzing heap profile: {profile_path}")
     
     # Топ аллокаций
@@ -41,19 +52,69 @@ def analyze_heap_profile(profile_path):
         profile_path
     ])
 
+def read_collapsed(profile_path):
+    """Чтение collapsed stacks: "a;b;c N" на строку"""
+    stacks = []
+    with open(profile_path) as f:
+        for line in f:
+            stack, _, value = line.rstrip('\n').rpartition(' ')
+            if stack and value.isdigit():
+                stacks.append((stack.split(';'), int(value)))
+    return stacks
+
+def analyze_collapsed(profile_path, unit, top_n=20):
+    """Анализ collapsed stacks: собственный и полный вес кадров"""
+    print(f"\nAnalyzing collapsed stacks: {profile_path}")
+
+    self_time = defaultdict(int)
+    total_time = defaultdict(int)
+    for frames, value in read_collapsed(profile_path):
+        self_time[frames[-1]] += value
+        # Рекурсивный участок учитывается в полном времени один раз
+        for frame in set(frames):
+            total_time[frame] += value
+
+    print(f"{'self, ' + unit:>16} {'total, ' + unit:>16}  frame")
+    for frame, value in sorted(self_time.items(), key=lambda item: -item[1])[:top_n]:
+        print(f"{value:>16} {total_time[frame]:>16}  {frame}")
+
+    # SVG обычно уже нарисован сервисом; иначе - flamegraph.pl, если есть
+    svg_path = profile_path[:-len('.collapsed')] + '.svg'
+    if not os.path.exists(svg_path) and shutil.which("flamegraph.pl"):
+        with open(svg_path, "w") as svg:
+            subprocess.run([
+                "flamegraph.pl", f"--countname={unit}",
+                profile_path
+            ], stdout=svg)
+
+def is_raw_profile(file, prefix):
+    """Сырой профиль gperftools, а не производный .collapsed/.svg/.pdf рядом с ним"""
+    if not file.startswith(prefix):
+        return False
+    # Heap-профайлер пишет дампы <префикс>.NNNN.heap
+    if prefix in ('heap_profile_', 'growth_profile_'):
+        return file.endswith('.heap')
+    # CPU-профиль - файл без расширения: cpu_profile_<время>[_<причина>]
+    return '.' not in file
+
 def main():
     parser = argparse.ArgumentParser(description='Analyze performance profiles')
     parser.add_argument('profile_dir', help='Directory with profile files')
-    parser.add_argument('--type', choices=['cpu', 'heap', 'all'],
+    parser.add_argument('--type', choices=['cpu', 'heap', 'scope', 'all'],
                        default='all', help='Type of profiles to analyze')
     args = parser.parse_args()
 
     for file in os.listdir(args.profile_dir):
-        if args.type in ['cpu', 'all'] and file.startswith('cpu_profile_'):
+        if args.type in ['cpu', 'all'] and is_raw_profile(file, 'cpu_profile_'):
             analyze_cpu_profile(os.path.join(args.profile_dir, file))
         
-        if args.type in ['heap', 'all'] and file.startswith('heap_profile_'):
+        if args.type in ['heap', 'all'] and (is_raw_profile(file, 'heap_profile_')
+                                             or is_raw_profile(file, 'growth_profile_')):
             analyze_heap_profile(os.path.join(args.profile_dir, file))
 
+        if args.type in ['scope', 'all'] and file.startswith('scope_profile_') \
+                and file.endswith('.collapsed'):
+            analyze_collapsed(os.path.join(args.profile_dir, file), 'us')
+
 if __name__ == '__main__':
     main() 
\ No newline at end of file